@@ -0,0 +1,323 @@
+/*
+  Times parsing and freeing a specifications response with cJSON, first on
+  the system allocator and then on an arena, alongside the json-extract scan
+  the client uses for it, then printing a batch of readings into a growing
+  and into a preallocated buffer, and writing it with json-writer the way
+  pack_batch does. Last, the same readings are packed as the JSON and the
+  CBOR upload bodies, comparing their sizes and the time taken to encode
+  and decode them. Run with an optional iteration count.
+*/
+
+#include "arena.h"
+#include "batch.h"
+#include "json-extract.h"
+#include "json-writer.h"
+#include "misc-structs.h"
+#include "cJSON.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 200000
+/* readings in the printed batch, and how many times fewer it is printed */
+#define BATCH_READINGS 500
+#define BATCH_DIVISOR 100
+
+/* as sent by the server, with the container details it includes */
+static const char specifications[] =
+  "{\n"
+  "  \"specifications\": {\n"
+  "    \"nextUpdateIn\": \"300\",\n"
+  "    \"lastReadStatus\": \"OK\",\n"
+  "    \"uploadURL\": \"/containers/2/readings\",\n"
+  "    \"monitor\": {\n"
+  "      \"productID\": \"47794\",\n"
+  "      \"vendorID\": \"1027\",\n"
+  "      \"serialNumber\": \"FTG4XK2A\",\n"
+  "      \"model\": \"SEM710\"\n"
+  "    },\n"
+  "    \"container\": {\n"
+  "      \"id\": 2,\n"
+  "      \"name\": \"Freezer 2\",\n"
+  "      \"location\": \"Room 1104, Bay C\",\n"
+  "      \"expectedTemperature\": -80.0,\n"
+  "      \"temperatureRange\": 5.0,\n"
+  "      \"alarmContacts\": [\"lab@example.org\", \"oncall@example.org\"]\n"
+  "    }\n"
+  "  }\n"
+  "}\n";
+
+typedef struct {
+  int next_update;
+  char status[255];
+  char upload_path[255];
+  int product_id;
+  int vendor_id;
+} BENCH_SPECIFICATIONS;
+
+static const JSON_FIELD fields[] = {
+  { "specifications.nextUpdateIn", JSON_FIELD_INT,
+    offsetof(BENCH_SPECIFICATIONS, next_update), 0 },
+  { "specifications.lastReadStatus", JSON_FIELD_STRING,
+    offsetof(BENCH_SPECIFICATIONS, status), 255 },
+  { "specifications.uploadURL", JSON_FIELD_STRING,
+    offsetof(BENCH_SPECIFICATIONS, upload_path), 255 },
+  { "specifications.monitor.productID", JSON_FIELD_INT,
+    offsetof(BENCH_SPECIFICATIONS, product_id), 0 },
+  { "specifications.monitor.vendorID", JSON_FIELD_INT,
+    offsetof(BENCH_SPECIFICATIONS, vendor_id), 0 }
+};
+
+static double ns_since(struct timespec *start, long iterations)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec - start->tv_sec)*1e9 +
+	  (now.tv_nsec - start->tv_nsec)) / iterations;
+}
+
+static int read_fields(cJSON *root, BENCH_SPECIFICATIONS *specs)
+{
+  /* the lookups get_specifications used to make on the tree */
+  cJSON *s = cJSON_GetObjectItem(root, "specifications");
+  cJSON *monitor = cJSON_GetObjectItem(s, "monitor");
+
+  if (s == NULL || monitor == NULL) {
+    return 1;
+  }
+  specs->next_update =
+    atoi(cJSON_GetObjectItem(s, "nextUpdateIn")->valuestring);
+  strcpy(specs->status,
+	 cJSON_GetObjectItem(s, "lastReadStatus")->valuestring);
+  strcpy(specs->upload_path,
+	 cJSON_GetObjectItem(s, "uploadURL")->valuestring);
+  specs->product_id =
+    atoi(cJSON_GetObjectItem(monitor, "productID")->valuestring);
+  specs->vendor_id =
+    atoi(cJSON_GetObjectItem(monitor, "vendorID")->valuestring);
+  return 0;
+}
+
+static int write_batch(string *out)
+{
+  JSON_WRITER w;
+  int i;
+
+  json_begin(&w, out);
+  json_begin_object(&w);
+  json_key(&w, "readings");
+  json_begin_array(&w);
+  for (i = 0; i < BATCH_READINGS; i++) {
+    json_begin_object(&w);
+    json_key(&w, "timestamp");
+    json_integer(&w, 1700000000 + 30 * i);
+    json_key(&w, "temperature");
+    json_float(&w, -80.125f + 0.01f * i);
+    json_key(&w, "status");
+    json_string(&w, "OK");
+    json_end_object(&w);
+  }
+  json_end_array(&w);
+  json_end_object(&w);
+  return json_end(&w);
+}
+
+static void make_readings(TIMED_READING *readings)
+{
+  int i;
+
+  memset(readings, 0, sizeof(TIMED_READING) * BATCH_READINGS);
+  for (i = 0; i < BATCH_READINGS; i++) {
+    readings[i].timestamp = 1700000000 + 30 * i;
+    readings[i].temperature = -80.125f + 0.01f * i;
+    readings[i].status = READ_STATUS_OK;
+  }
+}
+
+static cJSON *make_batch(void)
+{
+  cJSON *batch = cJSON_CreateObject();
+  cJSON *readings = cJSON_CreateArray();
+  cJSON *reading;
+  int i;
+
+  for (i = 0; i < BATCH_READINGS; i++) {
+    reading = cJSON_CreateObject();
+    cJSON_AddNumberToObject(reading, "timestamp", 1700000000 + 30 * i);
+    cJSON_AddNumberToObject(reading, "temperature", -80.125 + 0.01 * i);
+    cJSON_AddStringToObject(reading, "status", "OK");
+    cJSON_AddItemToArray(readings, reading);
+  }
+  cJSON_AddItemToObject(batch, "readings", readings);
+  return batch;
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = DEFAULT_ITERATIONS;
+  long i;
+  struct timespec start;
+  BENCH_SPECIFICATIONS specs;
+  JSON_EXTRACTOR extractor;
+  ARENA arena;
+  cJSON *root;
+  char *text;
+  char *buffer;
+  int buffer_size;
+  string written;
+  TIMED_READING readings[BATCH_READINGS];
+  TIMED_READING decoded[BATCH_READINGS];
+  uint8_t *encoded;
+  size_t encoded_size;
+  size_t encoded_len;
+  int count;
+  long print_iterations;
+  uint32_t found;
+  int failures = 0;
+
+  if (argc > 1) {
+    iterations = atol(argv[1]);
+  }
+  if (iterations <= 0 ||
+      ARENA_init(&arena, 4096) ||
+      JSON_EXTRACTOR_init(&extractor, fields, 5)) {
+    return 1;
+  }
+
+  printf("%ld iterations of a %d byte specifications response\n",
+	 iterations, (int) strlen(specifications));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < iterations; i++) {
+    root = cJSON_Parse(specifications);
+    failures += (root == NULL || read_fields(root, &specs));
+    cJSON_Delete(root);
+  }
+  printf("cJSON, malloc:        %8.0f ns\n", ns_since(&start, iterations));
+
+  cjson_use_arena(&arena);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < iterations; i++) {
+    root = cJSON_Parse(specifications);
+    failures += (root == NULL || read_fields(root, &specs));
+    arena_reset(&arena);
+  }
+  printf("cJSON, arena:         %8.0f ns (%lu bytes a document)\n",
+	 ns_since(&start, iterations),
+	 (unsigned long) arena.high_water);
+  cjson_use_arena(NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < iterations; i++) {
+    failures += (json_extract(&extractor,
+			      specifications,
+			      sizeof(specifications) - 1,
+			      &specs,
+			      &found) != 0 || found != 0x1F);
+  }
+  printf("json_extract:         %8.0f ns\n", ns_since(&start, iterations));
+
+  root = make_batch();
+  text = cJSON_PrintUnformatted(root);
+  buffer_size = strlen(text) + 1;
+  buffer = (char *) malloc(buffer_size);
+  printf("printing a %d reading, %d byte batch\n",
+	 BATCH_READINGS, buffer_size - 1);
+  free(text);
+
+  print_iterations = (iterations + BATCH_DIVISOR - 1) / BATCH_DIVISOR;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < print_iterations; i++) {
+    text = cJSON_PrintUnformatted(root);
+    failures += (text == NULL);
+    free(text);
+  }
+  printf("cJSON_PrintUnformatted: %8.0f ns\n",
+	 ns_since(&start, print_iterations));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < print_iterations; i++) {
+    failures += !cJSON_PrintPreallocated(root, buffer, buffer_size, 0);
+  }
+  printf("cJSON_PrintPreallocated:%8.0f ns\n",
+	 ns_since(&start, print_iterations));
+  free(buffer);
+  cJSON_Delete(root);
+
+  init_string(&written);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < print_iterations; i++) {
+    failures += write_batch(&written);
+  }
+  printf("JSON_WRITER:            %8.0f ns\n",
+	 ns_since(&start, print_iterations));
+
+  make_readings(readings);
+  encoded_size = encoded_batch_bound(BATCH_READINGS);
+  encoded = (uint8_t *) malloc(encoded_size);
+  failures += (encoded == NULL ||
+	       pack_batch(readings, BATCH_READINGS, &written) ||
+	       encode_batch(readings,
+			    BATCH_READINGS,
+			    encoded,
+			    encoded_size,
+			    &encoded_len));
+  if (failures) {
+    return 1;
+  }
+  printf("packing %d readings: %d bytes of JSON, %d of CBOR\n",
+	 BATCH_READINGS, (int) written.len, (int) encoded_len);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < print_iterations; i++) {
+    failures += pack_batch(readings, BATCH_READINGS, &written);
+  }
+  printf("pack_batch:             %8.0f ns\n",
+	 ns_since(&start, print_iterations));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < print_iterations; i++) {
+    failures += encode_batch(readings,
+			     BATCH_READINGS,
+			     encoded,
+			     encoded_size,
+			     &encoded_len);
+  }
+  printf("encode_batch:           %8.0f ns\n",
+	 ns_since(&start, print_iterations));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < print_iterations; i++) {
+    failures += (decode_batch(encoded,
+			      encoded_len,
+			      decoded,
+			      BATCH_READINGS,
+			      &count) ||
+		 count != BATCH_READINGS);
+  }
+  printf("decode_batch:           %8.0f ns\n",
+	 ns_since(&start, print_iterations));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < print_iterations; i++) {
+    root = cJSON_Parse(written.ptr);
+    failures += (cJSON_GetArraySize(root) != BATCH_READINGS);
+    cJSON_Delete(root);
+  }
+  printf("cJSON_Parse of JSON:    %8.0f ns\n",
+	 ns_since(&start, print_iterations));
+
+  free(encoded);
+  deinit_string(&written);
+
+  ARENA_destroy(&arena);
+  if (failures) {
+    printf("%d failed parses\n", failures);
+    return 1;
+  }
+  return 0;
+}
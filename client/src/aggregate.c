@@ -0,0 +1,73 @@
+#include <math.h>
+#include <string.h>
+
+#include "aggregate.h"
+
+void aggregate_clear(AGGREGATE *aggregate)
+{
+  memset(aggregate, 0, sizeof(AGGREGATE));
+}
+
+void aggregate_add(AGGREGATE *aggregate, float value)
+{
+  double delta;
+
+  if (aggregate->count == 0 || value < aggregate->min) {
+    aggregate->min = value;
+  }
+  if (aggregate->count == 0 || value > aggregate->max) {
+    aggregate->max = value;
+  }
+
+  /* Welford's update keeps the variance accurate over long runs */
+  aggregate->count++;
+  delta = value - aggregate->mean;
+  aggregate->mean += delta / aggregate->count;
+  aggregate->m2 += delta * (value - aggregate->mean);
+
+  aggregate->last = value;
+  aggregate->window[(aggregate->count - 1) % AGGREGATE_MEDIAN_WINDOW] = value;
+}
+
+static float window_median(AGGREGATE *aggregate)
+{
+  /* the median of the readings in the window, found by insertion sort */
+  float sorted[AGGREGATE_MEDIAN_WINDOW];
+  float value;
+  int count;
+  int i;
+  int j;
+
+  count = (aggregate->count < AGGREGATE_MEDIAN_WINDOW) ?
+    (int) aggregate->count : AGGREGATE_MEDIAN_WINDOW;
+  for (i = 0; i < count; i++) {
+    value = aggregate->window[i];
+    for (j = i; j > 0 && sorted[j - 1] > value; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = value;
+  }
+
+  if (count % 2 == 1) {
+    return sorted[count / 2];
+  }
+  return (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+void aggregate_summary(AGGREGATE *aggregate, READING_SUMMARY *summary)
+{
+  memset(summary, 0, sizeof(READING_SUMMARY));
+  if (aggregate->count == 0) {
+    return;
+  }
+
+  summary->samples = aggregate->count;
+  summary->min = (float) aggregate->min;
+  summary->max = (float) aggregate->max;
+  summary->mean = (float) aggregate->mean;
+  /* the sample standard deviation, 0 for a lone reading */
+  if (aggregate->count > 1) {
+    summary->stddev = (float) sqrt(aggregate->m2 / (aggregate->count - 1));
+  }
+  summary->median = window_median(aggregate);
+}
@@ -0,0 +1,52 @@
+#ifndef __INC_AGGREGATE_H
+#define __INC_AGGREGATE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* how many of the latest readings the median filter covers */
+#define AGGREGATE_MEDIAN_WINDOW 5
+
+/* what is uploaded about the readings taken over one upload interval */
+typedef struct {
+  uint32_t samples; /* 0 for a single reading, which has none of the rest */
+  float min;
+  float max;
+  float mean;
+  float stddev;
+  float median; /* of the last AGGREGATE_MEDIAN_WINDOW readings */
+} READING_SUMMARY;
+
+/*
+  the statistics of the readings taken so far, kept in the same memory
+  however many there are: the mean and variance are updated with Welford's
+  method and the median filter only remembers the latest few readings
+*/
+typedef struct {
+  uint32_t count;
+  double min;
+  double max;
+  double mean;
+  double m2;   /* sum of squared differences from the mean */
+  float last;
+  float window[AGGREGATE_MEDIAN_WINDOW]; /* a ring of the latest readings */
+} AGGREGATE;
+
+void aggregate_clear(AGGREGATE *aggregate);
+
+void aggregate_add(AGGREGATE *aggregate, float value);
+
+/*
+  write the statistics of the readings added since the last clear into
+  summary; its samples is 0 if there were none
+*/
+void aggregate_summary(AGGREGATE *aggregate, READING_SUMMARY *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_AGGREGATE_H */
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "arena.h"
+#include "cJSON.h"
+
+struct ARENA_CHUNK {
+  ARENA_CHUNK *next;
+  size_t size; /* usable bytes */
+  size_t used;
+};
+
+/* usable bytes start after the header, at the first aligned offset */
+#define CHUNK_HEADER \
+  ((sizeof(ARENA_CHUNK) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+#define CHUNK_DATA(chunk) ((char *) (chunk) + CHUNK_HEADER)
+
+static ARENA_CHUNK *new_chunk(size_t size, ARENA_CHUNK *next)
+{
+  ARENA_CHUNK *chunk = (ARENA_CHUNK *) malloc(CHUNK_HEADER + size);
+
+  if (chunk != NULL) {
+    chunk->next = next;
+    chunk->size = size;
+    chunk->used = 0;
+  }
+  return chunk;
+}
+
+static void free_chunks(ARENA_CHUNK *chunk)
+{
+  ARENA_CHUNK *next;
+
+  while (chunk != NULL) {
+    next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+}
+
+int ARENA_init(ARENA *arena, size_t chunk_size)
+{
+  arena->chunk_size = chunk_size;
+  arena->high_water = 0;
+  arena->chunks = new_chunk(chunk_size, NULL);
+
+  return (arena->chunks == NULL);
+}
+
+void ARENA_destroy(ARENA *arena)
+{
+  free_chunks(arena->chunks);
+  arena->chunks = NULL;
+}
+
+void *arena_alloc(ARENA *arena, size_t size)
+{
+  ARENA_CHUNK *chunk = arena->chunks;
+  size_t grow;
+  void *ptr;
+
+  size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    /* the rest of the full chunk is left unused until the reset */
+    grow = (size > arena->chunk_size) ? size : arena->chunk_size;
+    chunk = new_chunk(grow, chunk);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    arena->chunks = chunk;
+  }
+
+  ptr = CHUNK_DATA(chunk) + chunk->used;
+  chunk->used += size;
+  return ptr;
+}
+
+void arena_reset(ARENA *arena)
+{
+  ARENA_CHUNK *chunk;
+  size_t total = 0;
+
+  for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+    total += chunk->used;
+  }
+  if (total > arena->high_water) {
+    arena->high_water = total;
+  }
+
+  if (arena->chunks != NULL && arena->chunks->next == NULL) {
+    arena->chunks->used = 0;
+    return;
+  }
+
+  /* it outgrew its chunk, so start over with one that holds it all */
+  if (arena->high_water > arena->chunk_size) {
+    arena->chunk_size = arena->high_water;
+  }
+  free_chunks(arena->chunks);
+  arena->chunks = new_chunk(arena->chunk_size, NULL);
+}
+
+int arena_owns(const ARENA *arena, const void *ptr)
+{
+  const ARENA_CHUNK *chunk;
+  uintptr_t p = (uintptr_t) ptr;
+  uintptr_t data;
+
+  for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+    data = (uintptr_t) CHUNK_DATA(chunk);
+    if (p >= data && p < data + chunk->size) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* the arena cJSON allocates from in each thread, if any */
+static __thread ARENA *cjson_arena;
+static pthread_once_t cjson_hooks_once = PTHREAD_ONCE_INIT;
+
+static void *cjson_arena_malloc(size_t size)
+{
+  ARENA *arena = cjson_arena;
+
+  return (arena != NULL) ? arena_alloc(arena, size) : malloc(size);
+}
+
+static void cjson_arena_free(void *ptr)
+{
+  ARENA *arena = cjson_arena;
+
+  if (arena == NULL || !arena_owns(arena, ptr)) {
+    free(ptr);
+  }
+}
+
+static void install_cjson_hooks(void)
+{
+  cJSON_Hooks hooks;
+
+  hooks.malloc_fn = cjson_arena_malloc;
+  hooks.free_fn = cjson_arena_free;
+  cJSON_InitHooks(&hooks);
+}
+
+void cjson_use_arena(ARENA *arena)
+{
+  pthread_once(&cjson_hooks_once, install_cjson_hooks);
+  cjson_arena = arena;
+}
@@ -0,0 +1,55 @@
+#ifndef __INC_ARENA_H
+#define __INC_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* every allocation is aligned to this many bytes */
+#define ARENA_ALIGN 16
+
+typedef struct ARENA_CHUNK ARENA_CHUNK;
+
+/*
+  a bump allocator: allocations are carved from a chunk one after another and
+  are never freed on their own; arena_reset frees them all at once. When a
+  chunk runs out another is added, and the next reset replaces the chunks with
+  a single one big enough for all of them, so that a workload repeated
+  between resets soon stops calling malloc at all
+*/
+typedef struct {
+  ARENA_CHUNK *chunks; /* the chunk being filled first */
+  size_t chunk_size;
+  size_t high_water;   /* most bytes handed out between two resets */
+} ARENA;
+
+/* set up the arena with a first chunk of chunk_size bytes; returns 0 */
+int ARENA_init(ARENA *arena, size_t chunk_size);
+
+void ARENA_destroy(ARENA *arena);
+
+/* size bytes from the arena, or NULL if a chunk could not be allocated */
+void *arena_alloc(ARENA *arena, size_t size);
+
+/* release everything allocated from the arena */
+void arena_reset(ARENA *arena);
+
+/* whether ptr was allocated from the arena */
+int arena_owns(const ARENA *arena, const void *ptr);
+
+/*
+  have cJSON allocate from arena in the calling thread until it is called
+  again with NULL; documents built meanwhile are freed by resetting the arena,
+  and cJSON_Delete on them does nothing. Memory cJSON allocated before is
+  still returned to the system allocator. Anything to be kept, such as
+  printed text, must be copied out before the reset
+*/
+void cjson_use_arena(ARENA *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_ARENA_H */
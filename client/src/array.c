@@ -1,9 +1,56 @@
 #include "array.h"
 #include <stdint.h>
-#include <stdlib.h>
+#include <string.h>
 
-#define L_ENDIAN (get_endianness() == 0)
-#define B_ENDIAN (get_endianness() == 1)
+/*
+  The device's values are little endian and may sit at any offset in a frame,
+  so they are copied out with memcpy (safe for unaligned addresses, and
+  compiled to a plain load) and only byte swapped on big endian machines.
+*/
+#if defined(__GNUC__)
+#define swap_16(x) __builtin_bswap16(x)
+#define swap_32(x) __builtin_bswap32(x)
+#else
+#define swap_16(x) ((uint16_t) (((x) >> 8) | ((x) << 8)))
+#define swap_32(x) ((((x) & 0xFF000000u) >> 24) | (((x) & 0x00FF0000u) >> 8) \
+		    | (((x) & 0x0000FF00u) << 8) | (((x) & 0x000000FFu) << 24))
+#endif
+
+static inline uint32_t load_32(const uint8_t *bytes)
+{
+  uint32_t u;
+
+  memcpy(&u, bytes, sizeof(u));
+#if ARRAY_BIG_ENDIAN
+  u = swap_32(u);
+#endif
+  return u;
+}
+
+static inline void store_32(uint8_t *bytes, uint32_t u)
+{
+#if ARRAY_BIG_ENDIAN
+  u = swap_32(u);
+#endif
+  memcpy(bytes, &u, sizeof(u));
+}
+
+static inline float load_float(const uint8_t *bytes)
+{
+  uint32_t u = load_32(bytes);
+  float f;
+
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static inline void store_float(uint8_t *bytes, float f)
+{
+  uint32_t u;
+
+  memcpy(&u, &f, sizeof(u));
+  store_32(bytes, u);
+}
 
 int get_endianness()
 {
@@ -11,68 +58,39 @@ int get_endianness()
     Return 0 if this machine uses little endian byte storage or 1 if it uses
     big endian byte storage
   */
-  int a = 0x12345678;
-  unsigned char *c = (unsigned char*)(&a);
-  if (*c == 0x78) {
-    return 0;
-  }
-  else {
-    return 1;
-  }
+  return ARRAY_BIG_ENDIAN;
 }
 
 float float_from_byte_array(uint8_t *byte_array, int start_index)
 {
   /* Gets and returns the float stored in the given byte array. */
-  int i;
-  float f1;
-  int size;
-  uint8_t *bytes;
-
-  size = (int) sizeof(float);
-  bytes = (uint8_t *) malloc(size);
-
-  if (B_ENDIAN) {
-    /* If this machine is big endian, reverse the order of the bytes */
-    for (i = 0; i < size; i++) {
-      bytes[(size-1) - i] = byte_array[start_index + i];
-    }
-    f1 = *((float *)(&bytes[0]));
-  }
-  else {
-    f1 = *((float *)(&byte_array[start_index]));
-  }
-
-  free(bytes);
-  return f1;
+  return load_float(byte_array + start_index);
 }
 
 uint16_t short_from_byte_array(uint8_t *byte_array, int start_index)
 {
   /* Gets and returns the short stored in the given byte array */
-  int i;
-  short s1;
-  int size;
-  uint8_t *bytes;
-
-  size = (int) sizeof(short);
-  bytes = (uint8_t *) malloc(size);
-
-  if (B_ENDIAN) {
-    /* If this machine is big endian, reverse the order of the bytes */
-    for (i = 0; i < size; i++) {
-      bytes[(size-1) - i] = byte_array[start_index + i];
-    }
-    s1 = *((short *)(&bytes[0]));
-  }
-  else {
-    s1 = *((short *)(&byte_array[start_index]));
-  }
+  uint16_t s1;
 
-  free(bytes);
+  memcpy(&s1, byte_array + start_index, sizeof(s1));
+#if ARRAY_BIG_ENDIAN
+  s1 = swap_16(s1);
+#endif
   return s1;
 }
 
+int floats_from_byte_array(uint8_t *byte_array, int start_index,
+			   float *floats, int count)
+{
+  int i;
+  uint8_t *bytes = byte_array + start_index;
+
+  for (i = 0; i < count; i++) {
+    floats[i] = load_float(bytes + 4 * i);
+  }
+  return start_index + 4 * count;
+}
+
 int string_from_byte_array(uint8_t *byte_array, char *string,
 			   int start_index, int end_index)
 {
@@ -99,20 +117,30 @@ int float_into_byte_array(uint8_t *byte_array, int index, float flt)
      insert flt into byte_array at index, returning the index of the next open
      space in the array
   */
-  int retval;
+  store_float(byte_array + index, flt);
+  return index + 4;
+}
+
+int short_into_byte_array(uint8_t *byte_array, int index, uint16_t shrt)
+{
+  /*
+     insert shrt into byte_array at index, returning the index of the next open
+     space in the array
+  */
+#if ARRAY_BIG_ENDIAN
+  shrt = swap_16(shrt);
+#endif
+  memcpy(byte_array + index, &shrt, sizeof(shrt));
+  return index + 2;
+}
+
+int floats_into_byte_array(uint8_t *byte_array, int index,
+			   const float *floats, int count)
+{
   int i;
 
-  retval = index + 4;
-  if (B_ENDIAN) {
-    /* put the bytes in backwards if this machine is big endian */
-    for (i = 3; i >= 0; i--) {
-      byte_array[index + 3 - i] = *(((char *) &flt) + i);
-    }
-  }
-  else {
-    for (i = 0; i < 4; i++) {
-      byte_array[index + i] = *(((char *) &flt) + i);
-    }
+  for (i = 0; i < count; i++) {
+    store_float(byte_array + index + 4 * i, floats[i]);
   }
-  return retval;
+  return index + 4 * count;
 }
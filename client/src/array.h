@@ -3,6 +3,17 @@
 
 #include <stdint.h>
 
+/*
+  byte order of this machine, resolved when compiling; the SEM710 sends and
+  expects its values little endian
+*/
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) \
+  && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ARRAY_BIG_ENDIAN 1
+#else
+#define ARRAY_BIG_ENDIAN 0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -11,6 +22,21 @@ int get_endianness();
 float float_from_byte_array(uint8_t *byte_array, int start_index);
 uint16_t short_from_byte_array(uint8_t *byte_array, int start_index);
 int float_into_byte_array(uint8_t *byte_array, int index, float flt);
+int short_into_byte_array(uint8_t *byte_array, int index, uint16_t shrt);
+
+/*
+  decode count consecutive floats starting at start_index into floats;
+  returns the index just past the last one
+*/
+int floats_from_byte_array(uint8_t *byte_array, int start_index,
+			   float *floats, int count);
+
+/*
+  encode count floats into byte_array starting at index; returns the index of
+  the next open space in the array
+*/
+int floats_into_byte_array(uint8_t *byte_array, int index,
+			   const float *floats, int count);
 
 #ifdef __cplusplus
 }
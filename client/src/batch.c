@@ -0,0 +1,347 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "cbor.h"
+#include "json-writer.h"
+
+/*
+  the most bytes a reading takes in CBOR: its array head, the tagged 8 byte
+  timestamp, the temperature and status, and a summary's count and floats
+*/
+#define CBOR_READING_BOUND (1 + 1 + 9 + 5 + 9 + 5 + 5*5)
+
+int READING_BATCH_init(READING_BATCH *batch, int size, int latency)
+{
+  /* allocate room for size readings; returns 1 if the allocation failed */
+  batch->readings = (TIMED_READING *) malloc(sizeof(TIMED_READING)*size);
+  batch->size = size;
+  batch->latency = latency;
+  batch->count = 0;
+  batch->alarm = 0;
+
+  return (batch->readings == NULL);
+}
+
+void READING_BATCH_destroy(READING_BATCH *batch)
+{
+  free(batch->readings);
+  batch->readings = NULL;
+  batch->size = 0;
+  batch->count = 0;
+}
+
+int batch_add(READING_BATCH *batch, TIMED_READING *reading)
+{
+  /*
+    add the reading to the batch, returning 1 if the batch was already full
+    (in which case the reading is not added)
+  */
+  if (batch->count >= batch->size) {
+    return 1;
+  }
+  batch->readings[batch->count++] = *reading;
+
+  /* alarm states are reported right away instead of waiting for the batch */
+  if (reading->status != READ_STATUS_OK) {
+    batch->alarm = 1;
+  }
+  return 0;
+}
+
+int batch_due(READING_BATCH *batch, time_t now)
+{
+  /* returns whether the batch should be uploaded now */
+  if (batch->count == 0) {
+    return 0;
+  }
+  return (batch->alarm ||
+	  batch->count >= batch->size ||
+	  difftime(now, batch->readings[0].timestamp) >= batch->latency);
+}
+
+void batch_clear(READING_BATCH *batch)
+{
+  batch->count = 0;
+  batch->alarm = 0;
+}
+
+void batch_remove(READING_BATCH *batch, int count)
+{
+  /*
+    drop the oldest count readings, as once they were uploaded, keeping any
+    added since
+  */
+  int i;
+
+  if (count >= batch->count) {
+    batch_clear(batch);
+    return;
+  }
+  memmove(batch->readings,
+	  batch->readings + count,
+	  sizeof(TIMED_READING) * (batch->count - count));
+  batch->count -= count;
+
+  batch->alarm = 0;
+  for (i = 0; i < batch->count; i++) {
+    if (batch->readings[i].status != READ_STATUS_OK) {
+      batch->alarm = 1;
+    }
+  }
+}
+
+static void write_summary(JSON_WRITER *w, READING_SUMMARY *summary)
+{
+  /* add the statistics of an oversampled reading to the object being written */
+  if (summary->samples == 0) {
+    return;
+  }
+  json_key(w, "samples");
+  json_integer(w, summary->samples);
+  json_key(w, "min");
+  json_float(w, summary->min);
+  json_key(w, "max");
+  json_float(w, summary->max);
+  json_key(w, "mean");
+  json_float(w, summary->mean);
+  json_key(w, "stddev");
+  json_float(w, summary->stddev);
+  json_key(w, "median");
+  json_float(w, summary->median);
+}
+
+int pack_reading(TIMED_READING *reading, string *buffer)
+{
+  /*
+    write the reading as a JSON upload body into the buffer, replacing its
+    contents, as pack_readings does along with any statistics of an
+    oversampled reading; returns 1 if the buffer could not hold it
+  */
+  JSON_WRITER w;
+
+  json_begin(&w, buffer);
+  json_begin_object(&w);
+  json_key(&w, "temperature");
+  json_float(&w, reading->temperature);
+  write_summary(&w, &reading->summary);
+  json_end_object(&w);
+
+  return json_end(&w);
+}
+
+static void write_reading(JSON_WRITER *w, TIMED_READING *reading)
+{
+  /* write the reading as an element of a batch */
+  json_begin_object(w);
+  json_key(w, "temperature");
+  json_float(w, reading->temperature);
+  json_key(w, "timestamp");
+  json_integer(w, reading->timestamp);
+  json_key(w, "status");
+  json_string(w, get_read_status_string(reading->status));
+  write_summary(w, &reading->summary);
+  json_end_object(w);
+}
+
+int pack_batch(TIMED_READING *readings, int count, string *buffer)
+{
+  /*
+    write the given readings as a JSON array upload body into the buffer,
+    replacing its contents; returns 1 if the buffer could not hold them
+  */
+  JSON_WRITER w;
+  int i;
+
+  json_begin(&w, buffer);
+  json_begin_array(&w);
+  for (i = 0; i < count; i++) {
+    write_reading(&w, &readings[i]);
+  }
+  json_end_array(&w);
+
+  return json_end(&w);
+}
+
+size_t encoded_batch_bound(int count)
+{
+  return 9 + (size_t) count * CBOR_READING_BOUND;
+}
+
+int encode_batch(TIMED_READING *readings,
+		 int count,
+		 uint8_t *buffer,
+		 size_t size,
+		 size_t *len)
+{
+  /*
+    write the given readings as a CBOR upload body into the size bytes at
+    buffer, setting len to how many were written; returns 1 if they did not
+    fit. The body is an array of readings, each an array of its timestamp
+    (tagged as seconds since the epoch, always in 8 bytes), its temperature
+    as a single precision float and its READ_STATUS code, followed for an
+    oversampled reading by the samples, min, max, mean, stddev and median of
+    its summary
+  */
+  CBOR_WRITER w;
+  READING_SUMMARY *summary;
+  int i;
+
+  cbor_begin(&w, buffer, size);
+  cbor_array(&w, count);
+  for (i = 0; i < count; i++) {
+    summary = &readings[i].summary;
+    cbor_array(&w, (summary->samples > 0) ? 9 : 3);
+    cbor_tag(&w, CBOR_TAG_EPOCH);
+    cbor_uint64(&w, (uint64_t) readings[i].timestamp);
+    cbor_float(&w, readings[i].temperature);
+    cbor_integer(&w, readings[i].status);
+    if (summary->samples > 0) {
+      cbor_integer(&w, summary->samples);
+      cbor_float(&w, summary->min);
+      cbor_float(&w, summary->max);
+      cbor_float(&w, summary->mean);
+      cbor_float(&w, summary->stddev);
+      cbor_float(&w, summary->median);
+    }
+  }
+
+  *len = w.len;
+  return cbor_end(&w);
+}
+
+static int decode_reading(CBOR_READER *r, TIMED_READING *reading)
+{
+  /* read a reading as encode_batch writes it; returns 0 on success */
+  READING_SUMMARY *summary = &reading->summary;
+  uint64_t items;
+  int64_t status;
+  int64_t samples = 0;
+
+  memset(reading, 0, sizeof(TIMED_READING));
+  items = cbor_read_array(r);
+  if (items != 3 && items != 9) {
+    return 1;
+  }
+  if (cbor_read_tag(r) != CBOR_TAG_EPOCH) {
+    return 1;
+  }
+  reading->timestamp = (time_t) cbor_read_integer(r);
+  reading->temperature = cbor_read_float(r);
+  status = cbor_read_integer(r);
+  if (items == 9) {
+    samples = cbor_read_integer(r);
+    summary->min = cbor_read_float(r);
+    summary->max = cbor_read_float(r);
+    summary->mean = cbor_read_float(r);
+    summary->stddev = cbor_read_float(r);
+    summary->median = cbor_read_float(r);
+  }
+
+  if (r->failed ||
+      status < READ_STATUS_OK || status > READ_STATUS_PROBE_MISSING ||
+      samples < 0 || samples > UINT32_MAX) {
+    return 1;
+  }
+  reading->status = (READ_STATUS) status;
+  summary->samples = (uint32_t) samples;
+  return 0;
+}
+
+int decode_batch(const uint8_t *data,
+		 size_t len,
+		 TIMED_READING *readings,
+		 int max,
+		 int *count)
+{
+  /*
+    read up to max readings from the len bytes of CBOR at data, as
+    encode_batch writes them, setting count to how many there were; returns
+    1 if the data is not such a body or holds more than max readings
+  */
+  CBOR_READER r;
+  uint64_t n;
+  uint64_t i;
+
+  *count = 0;
+  cbor_read_begin(&r, data, len);
+  n = cbor_read_array(&r);
+  if (r.failed || n > (uint64_t) max) {
+    return 1;
+  }
+  for (i = 0; i < n; i++) {
+    if (decode_reading(&r, &readings[i])) {
+      return 1;
+    }
+  }
+  if (cbor_read_end(&r)) {
+    return 1;
+  }
+
+  *count = (int) n;
+  return 0;
+}
+
+int pack_batch_cbor(TIMED_READING *readings, int count, string *buffer)
+{
+  /*
+    write the given readings as a CBOR upload body into the buffer,
+    replacing its contents; once the buffer is large enough nothing is
+    allocated. Returns 1 if the buffer could not hold them
+  */
+  size_t len;
+
+  reset_string(buffer);
+  if (reserve_string(buffer, encoded_batch_bound(count)) ||
+      encode_batch(readings,
+		   count,
+		   (uint8_t *) buffer->ptr,
+		   buffer->size - 1,
+		   &len)) {
+    return 1;
+  }
+  buffer->len = len;
+  buffer->ptr[len] = '\0';
+  return 0;
+}
+
+int repack_batch_as_json(const uint8_t *data,
+			 size_t len,
+			 int single,
+			 string *buffer)
+{
+  /*
+    write the readings in the CBOR upload body at data as a JSON upload body
+    into the buffer, replacing its contents, reading by reading: as
+    pack_reading does if single, or else as pack_batch does. Returns 1 if
+    the data is not such a body or the buffer could not hold them
+  */
+  JSON_WRITER w;
+  CBOR_READER r;
+  TIMED_READING reading;
+  uint64_t n;
+  uint64_t i;
+
+  cbor_read_begin(&r, data, len);
+  n = cbor_read_array(&r);
+  if (r.failed || (single && n != 1)) {
+    return 1;
+  }
+  if (single) {
+    return (decode_reading(&r, &reading) ||
+	    cbor_read_end(&r) ||
+	    pack_reading(&reading, buffer));
+  }
+
+  json_begin(&w, buffer);
+  json_begin_array(&w);
+  for (i = 0; i < n; i++) {
+    if (decode_reading(&r, &reading)) {
+      return 1;
+    }
+    write_reading(&w, &reading);
+  }
+  json_end_array(&w);
+
+  return json_end(&w) || cbor_read_end(&r);
+}
@@ -0,0 +1,82 @@
+#ifndef __INC_BATCH_H
+#define __INC_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "aggregate.h"
+#include "devtypes.h"
+#include "misc-structs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  a single reading along with when it was taken; when oversampling, the
+  temperature is the last of the readings summarized
+*/
+typedef struct {
+  time_t timestamp;
+  float temperature;
+  READ_STATUS status;
+  READING_SUMMARY summary;
+} TIMED_READING;
+
+/*
+  readings collected in memory so they can be uploaded together; the batch
+  is due once it holds size readings, once its oldest reading is latency
+  seconds old, or as soon as a reading in an alarm state is added
+*/
+typedef struct {
+  TIMED_READING *readings;
+  int size;
+  int latency;
+  int count;
+  int alarm;
+} READING_BATCH;
+
+int READING_BATCH_init(READING_BATCH *batch, int size, int latency);
+
+void READING_BATCH_destroy(READING_BATCH *batch);
+
+int batch_add(READING_BATCH *batch, TIMED_READING *reading);
+
+int batch_due(READING_BATCH *batch, time_t now);
+
+void batch_clear(READING_BATCH *batch);
+
+void batch_remove(READING_BATCH *batch, int count);
+
+int pack_reading(TIMED_READING *reading, string *buffer);
+
+int pack_batch(TIMED_READING *readings, int count, string *buffer);
+
+/* the most bytes encode_batch writes for count readings */
+size_t encoded_batch_bound(int count);
+
+int encode_batch(TIMED_READING *readings,
+		 int count,
+		 uint8_t *buffer,
+		 size_t size,
+		 size_t *len);
+
+int decode_batch(const uint8_t *data,
+		 size_t len,
+		 TIMED_READING *readings,
+		 int max,
+		 int *count);
+
+int pack_batch_cbor(TIMED_READING *readings, int count, string *buffer);
+
+int repack_batch_as_json(const uint8_t *data,
+			 size_t len,
+			 int single,
+			 string *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_BATCH_H */
@@ -116,27 +116,78 @@ static const char *parse_number(cJSON *item,const char *num)
 	return num;
 }
 
-/* Render the number nicely from the given item into a string. */
-static char *print_number(cJSON *item)
+/* Output buffer the printer writes the whole document into. */
+typedef struct {char *buffer; size_t length; size_t offset; int noalloc;} printbuffer;
+
+/* Make room for needed more bytes at the buffer's offset, doubling it as it grows; returns where to write. */
+static char *ensure(printbuffer *p,size_t needed)
+{
+	char *newbuffer;size_t newsize;
+	if (!p || !p->buffer) return 0;
+	needed+=p->offset;
+	if (needed<=p->length) return p->buffer+p->offset;
+	if (p->noalloc) return 0;
+
+	newsize=p->length?p->length:64;
+	while (newsize<needed) newsize*=2;
+	newbuffer=(char*)cJSON_malloc(newsize);
+	if (!newbuffer) {cJSON_free(p->buffer);p->length=0;p->buffer=0;return 0;}
+	memcpy(newbuffer,p->buffer,p->offset);
+	cJSON_free(p->buffer);
+	p->length=newsize;
+	p->buffer=newbuffer;
+	return newbuffer+p->offset;
+}
+
+/* Append the len bytes of str. */
+static int print_raw(printbuffer *p,const char *str,size_t len)
+{
+	char *out=ensure(p,len+1);
+	if (!out) return 0;
+	memcpy(out,str,len);out[len]=0;
+	p->offset+=len;
+	return 1;
+}
+
+/* Write the digits of v backwards ending at end; returns where they start. */
+static char *print_digits(char *end,unsigned long long v)
+{
+	do *--end=(char)('0'+v%10),v/=10; while (v);
+	return end;
+}
+
+/* Render the number nicely from the given item into the buffer. */
+static int print_number(cJSON *item,printbuffer *p)
 {
-	char *str;
-	double d=item->valuedouble;
-	if (fabs(((double)item->valueint)-d)<=DBL_EPSILON && d<=INT_MAX && d>=INT_MIN)
+	char tmp[64];char *end=tmp+sizeof(tmp),*ptr;
+	double d=item->valuedouble,a=fabs(d);
+	unsigned long long whole,frac;int i,digits;
+
+	if (d!=d || a>DBL_MAX) return print_raw(p,"null",4);	/* NaN and infinity are not JSON. */
+
+	if (a<9007199254740992.0 && floor(a)==a)		/* Integers exactly held by a double. */
 	{
-		str=(char*)cJSON_malloc(21);	/* 2^64+1 can be represented in 21 chars. */
-		if (str) sprintf(str,"%d",item->valueint);
+		ptr=print_digits(end,(unsigned long long)a);
+		if (d<0) *--ptr='-';
+		return print_raw(p,ptr,end-ptr);
 	}
-	else
+	if (a>=1.0e-6 && a<=1.0e9)				/* Fixed point, to six decimal places as with %f but without trailing zeros. */
 	{
-		str=(char*)cJSON_malloc(64);	/* This is a nice tradeoff. */
-		if (str)
-		{
-			if (fabs(floor(d)-d)<=DBL_EPSILON && fabs(d)<1.0e60)sprintf(str,"%.0f",d);
-			else if (fabs(d)<1.0e-6 || fabs(d)>1.0e9)			sprintf(str,"%e",d);
-			else												sprintf(str,"%f",d);
-		}
+		whole=(unsigned long long)(a*1000000.0+0.5);
+		frac=whole%1000000;whole/=1000000;
+		ptr=end;digits=6;
+		while (digits && frac%10==0) frac/=10,digits--;
+		for (i=0;i<digits;i++) *--ptr=(char)('0'+frac%10),frac/=10;
+		if (digits) *--ptr='.';
+		ptr=print_digits(ptr,whole);
+		if (d<0) *--ptr='-';
+		return print_raw(p,ptr,end-ptr);
 	}
-	return str;
+
+	/* Very large or small: rare enough to leave to the C library. */
+	if (a<1.0e60 && floor(a)==a) i=snprintf(tmp,sizeof(tmp),"%.0f",d);
+	else i=snprintf(tmp,sizeof(tmp),"%e",d);
+	return (i>0 && i<(int)sizeof(tmp))?print_raw(p,tmp,i):0;
 }
 
 /* Parse the input text into an unescaped cstring, and populate item. */
@@ -200,20 +251,22 @@ static const char *parse_string(cJSON *item,const char *str)
 	return ptr;
 }
 
-/* Render the cstring provided to an escaped version that can be printed. */
-static char *print_string_ptr(const char *str)
+/* Render the cstring provided to an escaped version into the buffer. */
+static int print_string_ptr(const char *str,printbuffer *p)
 {
-	const char *ptr;char *ptr2,*out;int len=0;unsigned char token;
-	
-	if (!str) return cJSON_strdup("");
+	static const char hex[]="0123456789abcdef";
+	const char *ptr;char *ptr2,*out;size_t len=0;unsigned char token;
+
+	if (!str) return print_raw(p,"\"\"",2);
 	ptr=str;while ((token=*ptr) && ++len) {if (strchr("\"\\\b\f\n\r\t",token)) len++; else if (token<32) len+=5;ptr++;}
-	
-	out=(char*)cJSON_malloc(len+3);
+
+	out=ensure(p,len+3);
 	if (!out) return 0;
 
 	ptr2=out;ptr=str;
 	*ptr2++='\"';
-	while (*ptr)
+	if (len==(size_t)(ptr-str)) {memcpy(ptr2,str,len);ptr2+=len;}	/* Nothing to escape. */
+	else while (*ptr)
 	{
 		if ((unsigned char)*ptr>31 && *ptr!='\"' && *ptr!='\\') *ptr2++=*ptr++;
 		else
@@ -228,23 +281,24 @@ static char *print_string_ptr(const char *str)
 				case '\n':	*ptr2++='n';	break;
 				case '\r':	*ptr2++='r';	break;
 				case '\t':	*ptr2++='t';	break;
-				default: sprintf(ptr2,"u%04x",token);ptr2+=5;	break;	/* escape and print */
+				default: *ptr2++='u';*ptr2++='0';*ptr2++='0';*ptr2++=hex[token>>4];*ptr2++=hex[token&15];	break;	/* escape and print */
 			}
 		}
 	}
-	*ptr2++='\"';*ptr2++=0;
-	return out;
+	*ptr2++='\"';*ptr2=0;
+	p->offset+=ptr2-out;
+	return 1;
 }
 /* Invote print_string_ptr (which is useful) on an item. */
-static char *print_string(cJSON *item)	{return print_string_ptr(item->valuestring);}
+static int print_string(cJSON *item,printbuffer *p)	{return print_string_ptr(item->valuestring,p);}
 
 /* Predeclare these prototypes. */
 static const char *parse_value(cJSON *item,const char *value);
-static char *print_value(cJSON *item,int depth,int fmt);
+static int print_value(cJSON *item,int depth,int fmt,printbuffer *p);
 static const char *parse_array(cJSON *item,const char *value);
-static char *print_array(cJSON *item,int depth,int fmt);
+static int print_array(cJSON *item,int depth,int fmt,printbuffer *p);
 static const char *parse_object(cJSON *item,const char *value);
-static char *print_object(cJSON *item,int depth,int fmt);
+static int print_object(cJSON *item,int depth,int fmt,printbuffer *p);
 
 /* Utility to jump whitespace and cr/lf */
 static const char *skip(const char *in) {while (in && *in && (unsigned char)*in<=32) in++; return in;}
@@ -269,8 +323,28 @@ cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int r
 cJSON *cJSON_Parse(const char *value) {return cJSON_ParseWithOpts(value,0,0);}
 
 /* Render a cJSON item/entity/structure to text. */
-char *cJSON_Print(cJSON *item)				{return print_value(item,0,1);}
-char *cJSON_PrintUnformatted(cJSON *item)	{return print_value(item,0,0);}
+char *cJSON_Print(cJSON *item)				{return cJSON_PrintBuffered(item,256,1);}
+char *cJSON_PrintUnformatted(cJSON *item)	{return cJSON_PrintBuffered(item,256,0);}
+
+char *cJSON_PrintBuffered(cJSON *item,int prebuffer,int fmt)
+{
+	printbuffer p;
+	if (!item) return 0;
+	p.length=(prebuffer>0)?(size_t)prebuffer:64;
+	p.buffer=(char*)cJSON_malloc(p.length);
+	p.offset=0;p.noalloc=0;
+	if (!p.buffer) return 0;
+	if (!print_value(item,0,fmt,&p)) {cJSON_free(p.buffer);return 0;}
+	return p.buffer;
+}
+
+int cJSON_PrintPreallocated(cJSON *item,char *buffer,const int length,const int fmt)
+{
+	printbuffer p;
+	if (!item || !buffer || length<=0) return 0;
+	p.buffer=buffer;p.length=(size_t)length;p.offset=0;p.noalloc=1;
+	return print_value(item,0,fmt,&p);
+}
 
 /* Parser core - when encountering text, process appropriately. */
 static const char *parse_value(cJSON *item,const char *value)
@@ -288,21 +362,20 @@ static const char *parse_value(cJSON *item,const char *value)
 }
 
 /* Render a value to text. */
-static char *print_value(cJSON *item,int depth,int fmt)
+static int print_value(cJSON *item,int depth,int fmt,printbuffer *p)
 {
-	char *out=0;
 	if (!item) return 0;
 	switch ((item->type)&255)
 	{
-		case cJSON_NULL:	out=cJSON_strdup("null");	break;
-		case cJSON_False:	out=cJSON_strdup("false");break;
-		case cJSON_True:	out=cJSON_strdup("true"); break;
-		case cJSON_Number:	out=print_number(item);break;
-		case cJSON_String:	out=print_string(item);break;
-		case cJSON_Array:	out=print_array(item,depth,fmt);break;
-		case cJSON_Object:	out=print_object(item,depth,fmt);break;
+		case cJSON_NULL:	return print_raw(p,"null",4);
+		case cJSON_False:	return print_raw(p,"false",5);
+		case cJSON_True:	return print_raw(p,"true",4);
+		case cJSON_Number:	return print_number(item,p);
+		case cJSON_String:	return print_string(item,p);
+		case cJSON_Array:	return print_array(item,depth,fmt,p);
+		case cJSON_Object:	return print_object(item,depth,fmt,p);
 	}
-	return out;
+	return 0;
 }
 
 /* Build an array from input text. */
@@ -334,61 +407,18 @@ static const char *parse_array(cJSON *item,const char *value)
 }
 
 /* Render an array to text */
-static char *print_array(cJSON *item,int depth,int fmt)
+static int print_array(cJSON *item,int depth,int fmt,printbuffer *p)
 {
-	char **entries;
-	char *out=0,*ptr,*ret;int len=5;
 	cJSON *child=item->child;
-	int numentries=0,i=0,fail=0;
-	
-	/* How many entries in the array? */
-	while (child) numentries++,child=child->next;
-	/* Explicitly handle numentries==0 */
-	if (!numentries)
-	{
-		out=(char*)cJSON_malloc(3);
-		if (out) strcpy(out,"[]");
-		return out;
-	}
-	/* Allocate an array to hold the values for each */
-	entries=(char**)cJSON_malloc(numentries*sizeof(char*));
-	if (!entries) return 0;
-	memset(entries,0,numentries*sizeof(char*));
-	/* Retrieve all the results: */
-	child=item->child;
-	while (child && !fail)
-	{
-		ret=print_value(child,depth+1,fmt);
-		entries[i++]=ret;
-		if (ret) len+=strlen(ret)+2+(fmt?1:0); else fail=1;
-		child=child->next;
-	}
-	
-	/* If we didn't fail, try to malloc the output string */
-	if (!fail) out=(char*)cJSON_malloc(len);
-	/* If that fails, we fail. */
-	if (!out) fail=1;
 
-	/* Handle failure. */
-	if (fail)
-	{
-		for (i=0;i<numentries;i++) if (entries[i]) cJSON_free(entries[i]);
-		cJSON_free(entries);
-		return 0;
-	}
-	
-	/* Compose the output array. */
-	*out='[';
-	ptr=out+1;*ptr=0;
-	for (i=0;i<numentries;i++)
+	if (!print_raw(p,"[",1)) return 0;
+	while (child)
 	{
-		strcpy(ptr,entries[i]);ptr+=strlen(entries[i]);
-		if (i!=numentries-1) {*ptr++=',';if(fmt)*ptr++=' ';*ptr=0;}
-		cJSON_free(entries[i]);
+		if (!print_value(child,depth+1,fmt,p)) return 0;
+		child=child->next;
+		if (child && !print_raw(p,", ",fmt?2:1)) return 0;
 	}
-	cJSON_free(entries);
-	*ptr++=']';*ptr++=0;
-	return out;	
+	return print_raw(p,"]",1);
 }
 
 /* Build an object from the text. */
@@ -428,71 +458,48 @@ static const char *parse_object(cJSON *item,const char *value)
 }
 
 /* Render an object to text. */
-static char *print_object(cJSON *item,int depth,int fmt)
+static int print_object(cJSON *item,int depth,int fmt,printbuffer *p)
 {
-	char **entries=0,**names=0;
-	char *out=0,*ptr,*ret,*str;int len=7,i=0,j;
+	char *ptr;int i;
 	cJSON *child=item->child;
-	int numentries=0,fail=0;
-	/* Count the number of entries. */
-	while (child) numentries++,child=child->next;
+
 	/* Explicitly handle empty object case */
-	if (!numentries)
+	if (!child)
 	{
-		out=(char*)cJSON_malloc(fmt?depth+3:3);
-		if (!out)	return 0;
-		ptr=out;*ptr++='{';
+		ptr=ensure(p,fmt?depth+4:3);
+		if (!ptr) return 0;
+		*ptr++='{';
 		if (fmt) {*ptr++='\n';for (i=0;i<depth-1;i++) *ptr++='\t';}
-		*ptr++='}';*ptr++=0;
-		return out;
+		*ptr++='}';*ptr=0;
+		p->offset=ptr-p->buffer;
+		return 1;
 	}
-	/* Allocate space for the names and the objects */
-	entries=(char**)cJSON_malloc(numentries*sizeof(char*));
-	if (!entries) return 0;
-	names=(char**)cJSON_malloc(numentries*sizeof(char*));
-	if (!names) {cJSON_free(entries);return 0;}
-	memset(entries,0,sizeof(char*)*numentries);
-	memset(names,0,sizeof(char*)*numentries);
-
-	/* Collect all the results into our arrays: */
-	child=item->child;depth++;if (fmt) len+=depth;
+
+	if (!print_raw(p,"{\n",fmt?2:1)) return 0;
+	depth++;
 	while (child)
 	{
-		names[i]=str=print_string_ptr(child->string);
-		entries[i++]=ret=print_value(child,depth,fmt);
-		if (str && ret) len+=strlen(ret)+strlen(str)+2+(fmt?2+depth:0); else fail=1;
+		if (fmt)
+		{
+			if (!(ptr=ensure(p,depth+1))) return 0;
+			for (i=0;i<depth;i++) *ptr++='\t';
+			p->offset+=depth;
+		}
+		if (!print_string_ptr(child->string,p)) return 0;
+		if (!print_raw(p,":\t",fmt?2:1)) return 0;
+		if (!print_value(child,depth,fmt,p)) return 0;
 		child=child->next;
+		if (child && !print_raw(p,",",1)) return 0;
+		if (fmt && !print_raw(p,"\n",1)) return 0;
 	}
-	
-	/* Try to allocate the output string */
-	if (!fail) out=(char*)cJSON_malloc(len);
-	if (!out) fail=1;
 
-	/* Handle failure */
-	if (fail)
-	{
-		for (i=0;i<numentries;i++) {if (names[i]) cJSON_free(names[i]);if (entries[i]) cJSON_free(entries[i]);}
-		cJSON_free(names);cJSON_free(entries);
-		return 0;
-	}
-	
-	/* Compose the output: */
-	*out='{';ptr=out+1;if (fmt)*ptr++='\n';*ptr=0;
-	for (i=0;i<numentries;i++)
+	if (fmt)
 	{
-		if (fmt) for (j=0;j<depth;j++) *ptr++='\t';
-		strcpy(ptr,names[i]);ptr+=strlen(names[i]);
-		*ptr++=':';if (fmt) *ptr++='\t';
-		strcpy(ptr,entries[i]);ptr+=strlen(entries[i]);
-		if (i!=numentries-1) *ptr++=',';
-		if (fmt) *ptr++='\n';*ptr=0;
-		cJSON_free(names[i]);cJSON_free(entries[i]);
+		if (!(ptr=ensure(p,depth))) return 0;
+		for (i=0;i<depth-1;i++) *ptr++='\t';
+		p->offset+=depth-1;
 	}
-	
-	cJSON_free(names);cJSON_free(entries);
-	if (fmt) for (i=0;i<depth-1;i++) *ptr++='\t';
-	*ptr++='}';*ptr++=0;
-	return out;	
+	return print_raw(p,"}",1);
 }
 
 /* Get Array size/item / object item. */
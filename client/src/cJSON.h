@@ -70,6 +70,10 @@ extern cJSON *cJSON_Parse(const char *value);
 extern char  *cJSON_Print(cJSON *item);
 /* Render a cJSON entity to text for transfer/storage without any formatting. Free the char* when finished. */
 extern char  *cJSON_PrintUnformatted(cJSON *item);
+/* Render a cJSON entity to text into one buffer, starting at prebuffer bytes and doubling as needed; fmt=0 gives unformatted, =1 gives formatted. Free the char* when finished. */
+extern char  *cJSON_PrintBuffered(cJSON *item,int prebuffer,int fmt);
+/* Render a cJSON entity to text into the caller's buffer of length bytes without allocating; returns 1 on success and 0 if it does not fit. */
+extern int    cJSON_PrintPreallocated(cJSON *item,char *buffer,const int length,const int fmt);
 /* Delete a cJSON entity and all subentities. */
 extern void   cJSON_Delete(cJSON *c);
 
@@ -0,0 +1,332 @@
+#include <math.h>
+#include <string.h>
+
+#include "cbor.h"
+
+/* the additional information following a major type in an item's head */
+#define CBOR_FOLLOWS_1 24
+#define CBOR_FOLLOWS_2 25
+#define CBOR_FOLLOWS_4 26
+#define CBOR_FOLLOWS_8 27
+
+/* the simple values that are floats */
+#define CBOR_FLOAT16 25
+#define CBOR_FLOAT32 26
+#define CBOR_FLOAT64 27
+
+void cbor_begin(CBOR_WRITER *w, uint8_t *buffer, size_t size)
+{
+  w->buffer = buffer;
+  w->size = size;
+  w->len = 0;
+  w->failed = 0;
+}
+
+int cbor_end(CBOR_WRITER *w)
+{
+  return w->failed;
+}
+
+static uint8_t *reserve(CBOR_WRITER *w, size_t n)
+{
+  /* where the next n bytes go, or NULL if they do not fit */
+  uint8_t *p;
+
+  if (w->failed || w->size - w->len < n) {
+    w->failed = 1;
+    return NULL;
+  }
+  p = w->buffer + w->len;
+  w->len += n;
+  return p;
+}
+
+static void put_big_endian(uint8_t *p, uint64_t value, int n)
+{
+  int i;
+
+  for (i = n - 1; i >= 0; i--) {
+    p[i] = (uint8_t) value;
+    value >>= 8;
+  }
+}
+
+static void write_head(CBOR_WRITER *w, int type, uint64_t value, int fixed)
+{
+  /*
+    write the head of an item of the given major type, with its value in
+    the fewest bytes, or in 8 if fixed
+  */
+  uint8_t *p;
+  int n;
+  int info;
+
+  if (fixed || value > 0xFFFFFFFFu) {
+    n = 8;
+    info = CBOR_FOLLOWS_8;
+  } else if (value > 0xFFFF) {
+    n = 4;
+    info = CBOR_FOLLOWS_4;
+  } else if (value > 0xFF) {
+    n = 2;
+    info = CBOR_FOLLOWS_2;
+  } else if (value >= CBOR_FOLLOWS_1) {
+    n = 1;
+    info = CBOR_FOLLOWS_1;
+  } else {
+    n = 0;
+    info = (int) value;
+  }
+
+  p = reserve(w, 1 + n);
+  if (p != NULL) {
+    p[0] = (uint8_t) (type << 5 | info);
+    put_big_endian(p + 1, value, n);
+  }
+}
+
+void cbor_array(CBOR_WRITER *w, uint64_t count)
+{
+  write_head(w, CBOR_ARRAY, count, 0);
+}
+
+void cbor_map(CBOR_WRITER *w, uint64_t count)
+{
+  write_head(w, CBOR_MAP, count, 0);
+}
+
+void cbor_tag(CBOR_WRITER *w, uint64_t tag)
+{
+  write_head(w, CBOR_TAG, tag, 0);
+}
+
+void cbor_integer(CBOR_WRITER *w, int64_t value)
+{
+  /* a negative n is written as -1 - n */
+  if (value < 0) {
+    write_head(w, CBOR_NEGATIVE, (uint64_t) (-1 - value), 0);
+  } else {
+    write_head(w, CBOR_UNSIGNED, (uint64_t) value, 0);
+  }
+}
+
+void cbor_uint64(CBOR_WRITER *w, uint64_t value)
+{
+  write_head(w, CBOR_UNSIGNED, value, 1);
+}
+
+void cbor_float(CBOR_WRITER *w, float value)
+{
+  uint8_t *p = reserve(w, 5);
+  uint32_t bits;
+
+  if (p != NULL) {
+    memcpy(&bits, &value, sizeof(bits));
+    p[0] = (uint8_t) (CBOR_SIMPLE << 5 | CBOR_FLOAT32);
+    put_big_endian(p + 1, bits, 4);
+  }
+}
+
+void cbor_text(CBOR_WRITER *w, const char *s)
+{
+  size_t len = strlen(s);
+  uint8_t *p;
+
+  write_head(w, CBOR_TEXT, len, 0);
+  p = reserve(w, len);
+  if (p != NULL) {
+    memcpy(p, s, len);
+  }
+}
+
+void cbor_read_begin(CBOR_READER *r, const uint8_t *data, size_t len)
+{
+  r->data = data;
+  r->len = len;
+  r->pos = 0;
+  r->failed = 0;
+}
+
+int cbor_read_end(CBOR_READER *r)
+{
+  return r->failed || r->pos != r->len;
+}
+
+int cbor_peek_type(CBOR_READER *r)
+{
+  if (r->failed || r->pos >= r->len) {
+    return -1;
+  }
+  return r->data[r->pos] >> 5;
+}
+
+static const uint8_t *take(CBOR_READER *r, size_t n)
+{
+  /* the next n bytes, or NULL if the data ends first */
+  const uint8_t *p;
+
+  if (r->failed || r->len - r->pos < n) {
+    r->failed = 1;
+    return NULL;
+  }
+  p = r->data + r->pos;
+  r->pos += n;
+  return p;
+}
+
+static uint64_t get_big_endian(const uint8_t *p, int n)
+{
+  uint64_t value = 0;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    value = value << 8 | p[i];
+  }
+  return value;
+}
+
+static int read_head(CBOR_READER *r, int *type, uint64_t *value)
+{
+  /*
+    read the head of the next item into its major type and value, which for
+    a float is its bits; returns 0 on success. Indefinite lengths are not
+    supported
+  */
+  const uint8_t *p = take(r, 1);
+  int info;
+  int n;
+
+  if (p == NULL) {
+    return 1;
+  }
+  *type = p[0] >> 5;
+  info = p[0] & 0x1F;
+  if (info < CBOR_FOLLOWS_1) {
+    *value = (uint64_t) info;
+    return 0;
+  }
+  if (info > CBOR_FOLLOWS_8) {
+    r->failed = 1;
+    return 1;
+  }
+
+  n = 1 << (info - CBOR_FOLLOWS_1);
+  p = take(r, n);
+  if (p == NULL) {
+    return 1;
+  }
+  *value = get_big_endian(p, n);
+  return 0;
+}
+
+static uint64_t read_value(CBOR_READER *r, int expected)
+{
+  /* the value in the head of the next item, which must be of expected type */
+  uint64_t value;
+  int type;
+
+  if (read_head(r, &type, &value)) {
+    return 0;
+  }
+  if (type != expected) {
+    r->failed = 1;
+    return 0;
+  }
+  return value;
+}
+
+uint64_t cbor_read_array(CBOR_READER *r)
+{
+  return read_value(r, CBOR_ARRAY);
+}
+
+uint64_t cbor_read_map(CBOR_READER *r)
+{
+  return read_value(r, CBOR_MAP);
+}
+
+uint64_t cbor_read_tag(CBOR_READER *r)
+{
+  return read_value(r, CBOR_TAG);
+}
+
+int64_t cbor_read_integer(CBOR_READER *r)
+{
+  uint64_t value;
+  int type;
+
+  if (read_head(r, &type, &value)) {
+    return 0;
+  }
+  if ((type != CBOR_UNSIGNED && type != CBOR_NEGATIVE) ||
+      value > (uint64_t) INT64_MAX) {
+    r->failed = 1;
+    return 0;
+  }
+  return (type == CBOR_NEGATIVE) ? -1 - (int64_t) value : (int64_t) value;
+}
+
+static float half_to_float(uint16_t half)
+{
+  /* as given in RFC 8949, appendix D */
+  int exponent = (half >> 10) & 0x1F;
+  int mantissa = half & 0x3FF;
+  double value;
+
+  if (exponent == 0) {
+    value = ldexp(mantissa, -24);
+  } else if (exponent != 31) {
+    value = ldexp(mantissa + 1024, exponent - 25);
+  } else {
+    value = (mantissa == 0) ? INFINITY : NAN;
+  }
+  return (float) ((half & 0x8000) ? -value : value);
+}
+
+float cbor_read_float(CBOR_READER *r)
+{
+  size_t start = r->pos;
+  uint64_t bits;
+  uint32_t bits32;
+  float value32;
+  double value64;
+  int type;
+
+  if (read_head(r, &type, &bits)) {
+    return 0;
+  }
+  if (type != CBOR_SIMPLE) {
+    r->failed = 1;
+    return 0;
+  }
+
+  /* the size of a float is told by how many bytes followed the head */
+  switch (r->pos - start - 1) {
+  case 2:
+    return half_to_float((uint16_t) bits);
+  case 4:
+    bits32 = (uint32_t) bits;
+    memcpy(&value32, &bits32, sizeof(value32));
+    return value32;
+  case 8:
+    memcpy(&value64, &bits, sizeof(value64));
+    return (float) value64;
+  }
+  r->failed = 1;
+  return 0;
+}
+
+const char *cbor_read_text(CBOR_READER *r, size_t *len)
+{
+  uint64_t n = read_value(r, CBOR_TEXT);
+  const uint8_t *p;
+
+  *len = 0;
+  if (r->failed || n > r->len - r->pos) {
+    r->failed = 1;
+    return NULL;
+  }
+  p = take(r, (size_t) n);
+  *len = (size_t) n;
+  return (const char *) p;
+}
@@ -0,0 +1,100 @@
+#ifndef __INC_CBOR_H
+#define __INC_CBOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the CBOR major types (RFC 8949), in the top three bits of an item's head */
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_TAG 6
+#define CBOR_SIMPLE 7
+
+/* the tag of an integer number of seconds since the epoch */
+#define CBOR_TAG_EPOCH 1
+
+/*
+  writes CBOR items into a buffer the caller provides, without allocating.
+  As with JSON_WRITER the calls do not report failures; once an item does
+  not fit, the rest is ignored and cbor_end reports it
+*/
+typedef struct {
+  uint8_t *buffer;
+  size_t size;
+  size_t len;
+  int failed;
+} CBOR_WRITER;
+
+/* start writing into the size bytes at buffer */
+void cbor_begin(CBOR_WRITER *w, uint8_t *buffer, size_t size);
+
+/* returns 0 if everything fit, or 1 if anything did not */
+int cbor_end(CBOR_WRITER *w);
+
+/* the heads of arrays and maps of count items (pairs for a map) */
+void cbor_array(CBOR_WRITER *w, uint64_t count);
+void cbor_map(CBOR_WRITER *w, uint64_t count);
+
+void cbor_tag(CBOR_WRITER *w, uint64_t tag);
+
+/* in the fewest bytes that hold it */
+void cbor_integer(CBOR_WRITER *w, int64_t value);
+
+/* always in 8 bytes, so every record of a kind is the same size */
+void cbor_uint64(CBOR_WRITER *w, uint64_t value);
+
+/* a single precision float, always in 4 bytes */
+void cbor_float(CBOR_WRITER *w, float value);
+
+void cbor_text(CBOR_WRITER *w, const char *s);
+
+/*
+  reads CBOR items from a buffer in place; as with the writer, once an item
+  is not what was asked for or runs past the end, the rest of the reads fail
+  and leave 0 in what they return
+*/
+typedef struct {
+  const uint8_t *data;
+  size_t len;
+  size_t pos;
+  int failed;
+} CBOR_READER;
+
+void cbor_read_begin(CBOR_READER *r, const uint8_t *data, size_t len);
+
+/* returns 0 if every item was read and nothing is left over, or 1 */
+int cbor_read_end(CBOR_READER *r);
+
+/* the major type of the next item, or -1 at the end of the data */
+int cbor_peek_type(CBOR_READER *r);
+
+/* the count of the array or map that comes next */
+uint64_t cbor_read_array(CBOR_READER *r);
+uint64_t cbor_read_map(CBOR_READER *r);
+
+uint64_t cbor_read_tag(CBOR_READER *r);
+
+int64_t cbor_read_integer(CBOR_READER *r);
+
+/* a float of any precision, as a float */
+float cbor_read_float(CBOR_READER *r);
+
+/*
+  the text string that comes next, pointing into the data; len is set to
+  its length, and it is not null-terminated
+*/
+const char *cbor_read_text(CBOR_READER *r, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_CBOR_H */
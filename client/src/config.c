@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "config.h"
+
+static unsigned int hash_name(const char *name)
+{
+  /* FNV-1a */
+  uint32_t hash = 2166136261u;
+
+  while (*name != '\0') {
+    hash ^= (unsigned char) *name++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static int is_blank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int add_variable(CONFIG *config, const char *name, const char *value)
+{
+  unsigned int slot = hash_name(name) & (CONFIG_SLOTS - 1);
+
+  while (config->names[slot] != NULL) {
+    if (strcmp(config->names[slot], name) == 0) {
+      return 0;
+    }
+    slot = (slot + 1) & (CONFIG_SLOTS - 1);
+  }
+
+  /* keep a slot free so lookups of unset names always end */
+  if (config->count == CONFIG_SLOTS - 1) {
+    return 1;
+  }
+  config->names[slot] = name;
+  config->values[slot] = value;
+  config->count++;
+  return 0;
+}
+
+int config_parse(CONFIG *config, const char *text, size_t len)
+{
+  char *line;
+  char *next;
+  char *colon;
+  char *end;
+
+  memset(config->names, 0, sizeof(config->names));
+  memset(config->values, 0, sizeof(config->values));
+  config->count = 0;
+
+  if (len > CONFIG_SIZE) {
+    return 1;
+  }
+  memcpy(config->text, text, len);
+  config->text[len] = '\0';
+
+  for (line = config->text; line != NULL; line = next) {
+    next = strchr(line, '\n');
+    if (next != NULL) {
+      *next++ = '\0';
+    }
+
+    while (is_blank(*line)) {
+      line++;
+    }
+    colon = strchr(line, ':');
+    if (*line == '#' || colon == NULL || colon == line) {
+      continue;
+    }
+
+    /* the name is everything before the colon, the value everything after */
+    end = colon;
+    while (end > line && is_blank(end[-1])) {
+      end--;
+    }
+    *end = '\0';
+
+    colon++;
+    while (is_blank(*colon)) {
+      colon++;
+    }
+    end = colon + strlen(colon);
+    while (end > colon && is_blank(end[-1])) {
+      end--;
+    }
+    *end = '\0';
+
+    if (add_variable(config, line, colon)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int config_load(CONFIG *config, const char *path)
+{
+  /* read one byte more than fits, to tell a full file from a too large one */
+  FILE *f;
+  size_t len;
+  char buffer[CONFIG_SIZE + 1];
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    return 1;
+  }
+  len = fread(buffer, 1, sizeof(buffer), f);
+  if (ferror(f)) {
+    fclose(f);
+    return 1;
+  }
+  fclose(f);
+
+  return config_parse(config, buffer, len);
+}
+
+const char *config_get(const CONFIG *config, const char *name)
+{
+  unsigned int slot = hash_name(name) & (CONFIG_SLOTS - 1);
+
+  while (config->names[slot] != NULL) {
+    if (strcmp(config->names[slot], name) == 0) {
+      return config->values[slot];
+    }
+    slot = (slot + 1) & (CONFIG_SLOTS - 1);
+  }
+  return NULL;
+}
+
+int CONFIG_WATCH_open(CONFIG_WATCH *watch, const char *path)
+{
+  char directory[255];
+  const char *slash;
+
+  slash = strrchr(path, '/');
+  if (slash == NULL) {
+    strcpy(directory, ".");
+    slash = path - 1;
+  } else if (slash == path) {
+    strcpy(directory, "/");
+  } else if ((size_t) (slash - path) < sizeof(directory)) {
+    memcpy(directory, path, slash - path);
+    directory[slash - path] = '\0';
+  } else {
+    return 1;
+  }
+  if (strlen(slash + 1) >= sizeof(watch->name)) {
+    return 1;
+  }
+  strcpy(watch->name, slash + 1);
+
+  watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch->fd < 0) {
+    return 1;
+  }
+  watch->wd = inotify_add_watch(watch->fd,
+				directory,
+				IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (watch->wd < 0) {
+    close(watch->fd);
+    watch->fd = -1;
+    return 1;
+  }
+
+  return 0;
+}
+
+void CONFIG_WATCH_close(CONFIG_WATCH *watch)
+{
+  if (watch->fd >= 0) {
+    close(watch->fd);
+    watch->fd = -1;
+  }
+}
+
+int config_changed(CONFIG_WATCH *watch)
+{
+  char buffer[4096]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *event;
+  ssize_t len;
+  char *p;
+  int changed = 0;
+
+  if (watch->fd < 0) {
+    return 0;
+  }
+
+  /* a save may be several events; they are all taken as one change */
+  while ((len = read(watch->fd, buffer, sizeof(buffer))) > 0) {
+    for (p = buffer; p < buffer + len;
+	 p += sizeof(struct inotify_event) + event->len) {
+      event = (const struct inotify_event *) p;
+      if (event->len > 0 && strcmp(event->name, watch->name) == 0) {
+	changed = 1;
+      }
+    }
+  }
+
+  return changed;
+}
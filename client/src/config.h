@@ -0,0 +1,64 @@
+#ifndef __INC_CONFIG_H
+#define __INC_CONFIG_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* largest config file read, in bytes */
+#define CONFIG_SIZE 8192
+/* hash table slots; a power of two, well above the number of variables */
+#define CONFIG_SLOTS 128
+
+/*
+  the "name: value" lines of a config file, read in one pass and split in
+  place in text, with the names hashed into slots for constant time lookup.
+  A name given more than once keeps its first value.
+*/
+typedef struct {
+  char text[CONFIG_SIZE + 1];
+  const char *names[CONFIG_SLOTS];
+  const char *values[CONFIG_SLOTS];
+  int count;
+} CONFIG;
+
+/*
+  read the config file at path; returns 0 on success or 1 if it could not be
+  read or is larger than CONFIG_SIZE
+*/
+int config_load(CONFIG *config, const char *path);
+
+/* as config_load, from the len bytes of text */
+int config_parse(CONFIG *config, const char *text, size_t len);
+
+/* the value of the variable with the given name, or NULL if it is not set */
+const char *config_get(const CONFIG *config, const char *name);
+
+/*
+  an inotify watch on a config file. The file's directory is watched, so the
+  file being replaced (as editors do) is noticed as well as it being written
+*/
+typedef struct {
+  int fd;
+  int wd;
+  char name[255]; /* of the file within the directory */
+} CONFIG_WATCH;
+
+/* start watching the file at path; returns 0 on success */
+int CONFIG_WATCH_open(CONFIG_WATCH *watch, const char *path);
+
+void CONFIG_WATCH_close(CONFIG_WATCH *watch);
+
+/*
+  read the pending events without blocking; returns 1 if the file was written
+  or replaced since the last call, or 0 otherwise
+*/
+int config_changed(CONFIG_WATCH *watch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_CONFIG_H */
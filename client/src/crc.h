@@ -0,0 +1,27 @@
+#ifndef __INC_CRC_H
+#define __INC_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the SEM710 uses CRC-16/MODBUS: reflected polynomial 0xA001, seed 0xFFFF */
+#define CRC16_MODBUS_SEED 0xFFFF
+
+/*
+  continue the CRC-16/MODBUS crc over the given bytes, four at a time, and
+  return the updated crc
+*/
+uint16_t crc16_modbus_update(uint16_t crc, const uint8_t *bytes, size_t len);
+
+/* return the CRC-16/MODBUS of the given bytes */
+uint16_t crc16_modbus(const uint8_t *bytes, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_CRC_H */
@@ -0,0 +1,39 @@
+#include <math.h>
+#include <string.h>
+
+#include "deadband.h"
+
+void deadband_init(DEADBAND *deadband, float width, int max_silence)
+{
+  memset(deadband, 0, sizeof(DEADBAND));
+  deadband->width = width;
+  deadband->max_silence = max_silence;
+}
+
+DEADBAND_DECISION deadband_check(DEADBAND *deadband, TIMED_READING *reading)
+{
+  /*
+    whether the reading should be sent, given what was sent last; a change
+    of status is always sent, however small the change in temperature
+  */
+  if (deadband->width <= 0 ||
+      !deadband->sent ||
+      reading->status != deadband->status ||
+      fabsf(reading->temperature - deadband->temperature) > deadband->width) {
+    return DEADBAND_SEND;
+  }
+  if (difftime(reading->timestamp, deadband->sent_at) >=
+      deadband->max_silence) {
+    return DEADBAND_HEARTBEAT;
+  }
+  return DEADBAND_QUIET;
+}
+
+void deadband_sent(DEADBAND *deadband, TIMED_READING *reading)
+{
+  /* the readings to come are compared against this one */
+  deadband->sent = 1;
+  deadband->temperature = reading->temperature;
+  deadband->status = reading->status;
+  deadband->sent_at = reading->timestamp;
+}
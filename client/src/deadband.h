@@ -0,0 +1,45 @@
+#ifndef __INC_DEADBAND_H
+#define __INC_DEADBAND_H
+
+#include <time.h>
+
+#include "batch.h"
+#include "devtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* what becomes of a reading the server is due to be sent */
+typedef enum {
+  DEADBAND_SEND,      /* it tells the server something new */
+  DEADBAND_HEARTBEAT, /* nothing new, but the server last heard long ago */
+  DEADBAND_QUIET      /* nothing new, so it is not sent */
+} DEADBAND_DECISION;
+
+/*
+  remembers the last reading sent to the server, so that readings within
+  width degrees of it and of the same status are not sent again, save for a
+  heartbeat once max_silence seconds passed without sending anything
+*/
+typedef struct {
+  float width;     /* 0 sends every reading */
+  int max_silence;
+
+  int sent;        /* whether the rest holds a reading sent */
+  float temperature;
+  READ_STATUS status;
+  time_t sent_at;
+} DEADBAND;
+
+void deadband_init(DEADBAND *deadband, float width, int max_silence);
+
+DEADBAND_DECISION deadband_check(DEADBAND *deadband, TIMED_READING *reading);
+
+void deadband_sent(DEADBAND *deadband, TIMED_READING *reading);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_DEADBAND_H */
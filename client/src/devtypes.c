@@ -1,161 +1,386 @@
 #include "devtypes.h"
 #include "array.h"
+#include "crc.h"
 #include "cJSON.h"
+#include "json-writer.h"
 
 #include <stdio.h>
+#include <stddef.h>
+#include <string.h>
 #include <assert.h>
-#include <stdio.h>
+
+#define FIELD(type, index, record, member) \
+  { SEM_FIELD_##type, index, offsetof(record, member) }
+#define FIELDS(fields) fields, (int) (sizeof(fields) / sizeof(SEM_FIELD))
+
+/* READ_PROCESS reply: five floats from index 3 */
+static const SEM_FIELD process_fields[] = {
+  FIELD(FLOAT, 3, SEM710_READINGS, ADC_VALUE),
+  FIELD(FLOAT, 7, SEM710_READINGS, ELEC_VALUE),
+  FIELD(FLOAT, 11, SEM710_READINGS, PROCESS_VARIABLE),
+  FIELD(FLOAT, 15, SEM710_READINGS, MA_OUT),
+  FIELD(FLOAT, 19, SEM710_READINGS, CJ_TEMP)
+};
+
+/* READ_CONFIG reply: eight setting bytes, then eight floats */
+static const SEM_FIELD config_fields[] = {
+  FIELD(U8, 3, CONFIG_DATA, tc_code),
+  FIELD(U8, 4, CONFIG_DATA, up_scale),
+  FIELD(U8, 5, CONFIG_DATA, units),
+  FIELD(U8, 6, CONFIG_DATA, model_type),
+  FIELD(U8, 7, CONFIG_DATA, vout_range),
+  FIELD(U8, 8, CONFIG_DATA, action_A),
+  FIELD(U8, 9, CONFIG_DATA, action_B),
+  FIELD(U8, 10, CONFIG_DATA, spare),
+  FIELD(FLOAT, 11, CONFIG_DATA, low_range),
+  FIELD(FLOAT, 15, CONFIG_DATA, high_range),
+  FIELD(FLOAT, 19, CONFIG_DATA, low_trim),
+  FIELD(FLOAT, 23, CONFIG_DATA, high_trim),
+  FIELD(FLOAT, 27, CONFIG_DATA, setpoint_A),
+  FIELD(FLOAT, 31, CONFIG_DATA, hyst_A),
+  FIELD(FLOAT, 35, CONFIG_DATA, setpoint_B),
+  FIELD(FLOAT, 39, CONFIG_DATA, hyst_B)
+};
+
+/* READ_CAL reply: the calibration block, in the order it is stored */
+static const SEM_FIELD cal_fields[] = {
+  FIELD(U8, 3, UNIVERSAL_CALIBRATION, straight_from_programming),
+  FIELD(U8, 4, UNIVERSAL_CALIBRATION, dummy),
+  FIELD(FLOAT, 5, UNIVERSAL_CALIBRATION, lo_mv),
+  FIELD(FLOAT, 9, UNIVERSAL_CALIBRATION, hi_mv),
+  FIELD(FLOAT, 13, UNIVERSAL_CALIBRATION, lo_ma),
+  FIELD(FLOAT, 17, UNIVERSAL_CALIBRATION, hi_ma),
+  FIELD(FLOAT, 21, UNIVERSAL_CALIBRATION, lo_rtd),
+  FIELD(FLOAT, 25, UNIVERSAL_CALIBRATION, hi_rtd),
+  FIELD(FLOAT, 29, UNIVERSAL_CALIBRATION, lo_ma_in),
+  FIELD(FLOAT, 33, UNIVERSAL_CALIBRATION, hi_ma_in),
+  FIELD(FLOAT, 37, UNIVERSAL_CALIBRATION, hi_200mv_in),
+  FIELD(FLOAT, 41, UNIVERSAL_CALIBRATION, hi_1v_in),
+  FIELD(FLOAT, 45, UNIVERSAL_CALIBRATION, hi_10v_in),
+  FIELD(FLOAT, 49, UNIVERSAL_CALIBRATION, hi_cal_slide_wire),
+  FIELD(FLOAT, 53, UNIVERSAL_CALIBRATION, hi_voltage_output)
+};
+
+/*
+  Every command is sent with a single zero data byte unless given data. Only
+  the replies to READ_CONFIG and READ_PROCESS have known confirmation bytes;
+  the others are left at 0 in case someone down the line wants to use them.
+*/
+static const SEM_COMMAND_INFO command_info[] = {
+  { SEM_COMMANDS_cACK, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cNAK, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cREAD_CAL, 0, 1, FIELDS(cal_fields) },
+  { SEM_COMMANDS_cREAD_CONFIG, 33, 1, FIELDS(config_fields) },
+  { SEM_COMMANDS_cREAD_PROCESS, 34, 1, FIELDS(process_fields) },
+  { SEM_COMMANDS_cSELF_CAL_0mv, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSELF_CAL_50mv, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSELF_CAL_100R, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSELF_CAL_300R, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSELF_CAL_20mA, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSELF_CAL_0mA, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSELF_CAL_200mV, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSELF_CAL_1V, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSELF_CAL_10V, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSELF_CAL_slide_wire, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cPRESET_4ma_COUNT, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cPRESET_12ma_COUNT, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cPRESET_20ma_COUNT, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cPRESET_ENABLE, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSET_CAL, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cSET_CONFIG, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cREAD_RANGEA, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cREAD_RANGEB, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cREAD_RANGEC, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cREAD_RANGED, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cWRITE_RANGEA, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cWRITE_RANGEB, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cWRITE_RANGEC, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cWRITE_RANGED, 0, 1, NULL, 0 },
+  { SEM_COMMANDS_cidentify, 0, 1, NULL, 0 }
+};
+
+const SEM_COMMAND_INFO *get_command_info(SEM_COMMANDS c)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof(command_info) / sizeof(command_info[0]); i++) {
+    if (command_info[i].command == c) {
+      return &command_info[i];
+    }
+  }
+  return NULL;
+}
 
 uint8_t get_confirmation_byte(SEM_COMMANDS c) {
   /*
      Returns: the expected first byte after start byte in incoming message from
      device for the given command c.
-     Ugly, ugly function... I'll leave the unused commands at 0 in case someone
-     down the line wanted to use them, but with the SEM710 you'll likely only
-     use a few of these.
   */
-  switch(c) {
-  case SEM_COMMANDS_cACK:
-    return 0;
-  case SEM_COMMANDS_cNAK:
-    return 0;
-  case SEM_COMMANDS_cREAD_CAL:
-    return 0;
-  case SEM_COMMANDS_cREAD_CONFIG:
-    return 33;
-  case SEM_COMMANDS_cREAD_PROCESS:
-    return 34;
-  case SEM_COMMANDS_cSELF_CAL_0mv:
-    return 0;
-  case SEM_COMMANDS_cSELF_CAL_50mv:
-    return 0;
-  case SEM_COMMANDS_cSELF_CAL_100R:
-    return 0;
-  case SEM_COMMANDS_cSELF_CAL_300R:
-    return 0;
-  case SEM_COMMANDS_cSELF_CAL_20mA:
-    return 0;
-  case SEM_COMMANDS_cSELF_CAL_0mA:
-    return 0;
-  case SEM_COMMANDS_cSELF_CAL_200mV:
-    return 0;
-  case SEM_COMMANDS_cSELF_CAL_1V:
-    return 0;
-  case SEM_COMMANDS_cSELF_CAL_10V:
-    return 0;
-  case SEM_COMMANDS_cSELF_CAL_slide_wire:
-    return 0;
-  case SEM_COMMANDS_cPRESET_4ma_COUNT:
-    return 0;
-  case SEM_COMMANDS_cPRESET_12ma_COUNT:
-    return 0;
-  case SEM_COMMANDS_cPRESET_20ma_COUNT:
-    return 0;
-  case SEM_COMMANDS_cPRESET_ENABLE:
-    return 0;
-  case SEM_COMMANDS_cSET_CAL:
-    return 0;
-  case SEM_COMMANDS_cSET_CONFIG:
-    return 0;
-  case SEM_COMMANDS_cREAD_RANGEA:
-    return 0;
-  case SEM_COMMANDS_cREAD_RANGEB:
-    return 0;
-  case SEM_COMMANDS_cREAD_RANGEC:
-    return 0;
-  case SEM_COMMANDS_cREAD_RANGED:
-    return 0;
-  case SEM_COMMANDS_cWRITE_RANGEA:
-    return 0;
-  case SEM_COMMANDS_cWRITE_RANGEB:
-    return 0;
-  case SEM_COMMANDS_cWRITE_RANGEC:
-    return 0;
-  case SEM_COMMANDS_cWRITE_RANGED:
-    return 0;
-  case SEM_COMMANDS_cidentify:
-    return 0;
+  const SEM_COMMAND_INFO *info = get_command_info(c);
+
+  return info == NULL ? 0 : info->reply;
+}
+
+int encode_command(SEM_COMMANDS c, const uint8_t *data, int data_len,
+		   uint8_t *frame, int size)
+{
+  /*
+    the frame is start byte, command, index of the last data byte, the data,
+    the crc of everything from the command on (low byte first) and end byte
+  */
+  const SEM_COMMAND_INFO *info = get_command_info(c);
+  uint16_t crc;
+  int i;
+
+  if (data == NULL) {
+    data_len = info == NULL ? 1 : info->request_len;
+  }
+  if (data_len < 1 || data_len > 256 || data_len + 6 > size) {
+    return -1;
+  }
+
+  frame[0] = FRAME_START_BYTE;
+  frame[1] = (uint8_t) c;
+  frame[2] = (uint8_t) (data_len - 1);
+  if (data == NULL) {
+    memset(frame + 3, 0, data_len);
+  } else {
+    memcpy(frame + 3, data, data_len);
+  }
+  i = 3 + data_len;
+
+  crc = crc16_modbus(frame + 1, i - 1);
+  frame[i++] = crc & 0xFF;
+  frame[i++] = (crc >> 8) & 0xFF;
+  frame[i++] = FRAME_END_BYTE;
+
+  return i;
+}
+
+int decode_reply(SEM_COMMANDS c, const uint8_t *frame, int frame_len,
+		 void *out)
+{
+  const SEM_COMMAND_INFO *info = get_command_info(c);
+  const SEM_FIELD *field;
+  uint8_t *member;
+  int data_end;
+  int run;
+  int i;
+
+  /* everything but the crc and end byte may hold fields */
+  data_end = frame_len - 3;
+  if (info == NULL || frame_len < 6) {
+    return 1;
+  }
+  if (info->reply != 0 && frame[1] != info->reply) {
+    return 1;
+  }
+
+  for (i = 0; i < info->field_count; i++) {
+    field = &info->fields[i];
+    member = (uint8_t *) out + field->member_offset;
+
+    switch (field->type) {
+    case SEM_FIELD_U8:
+      if (field->frame_index + 1 > data_end) {
+	return 1;
+      }
+      *member = frame[field->frame_index];
+      break;
+    case SEM_FIELD_U16:
+      if (field->frame_index + 2 > data_end) {
+	return 1;
+      }
+      *(uint16_t *) member =
+	short_from_byte_array((uint8_t *) frame, field->frame_index);
+      break;
+    case SEM_FIELD_FLOAT:
+      /* floats laid out one after another in both go across in one pass */
+      run = 1;
+      while (i + run < info->field_count &&
+	     info->fields[i + run].type == SEM_FIELD_FLOAT &&
+	     info->fields[i + run].frame_index ==
+	     field->frame_index + 4 * run &&
+	     info->fields[i + run].member_offset ==
+	     field->member_offset + sizeof(float) * run) {
+	run++;
+      }
+      if (field->frame_index + 4 * run > data_end) {
+	return 1;
+      }
+      floats_from_byte_array((uint8_t *) frame,
+			     field->frame_index,
+			     (float *) member,
+			     run);
+      i += run - 1;
+      break;
+    }
   }
+
   return 0;
 }
+
+void frame_receiver_init(FRAME_RECEIVER *rx, uint8_t *frame, int size)
+{
+  rx->state = WAITING_FOR_START;
+  rx->frame = frame;
+  rx->size = size;
+  rx->len = 0;
+  rx->data_left = 0;
+}
+
+RX_FRAMING frame_receiver_feed(FRAME_RECEIVER *rx, uint8_t *bytes, int n)
+{
+  int i;
+  uint8_t byte;
+
+  for (i = 0; i < n; i++) {
+    if (rx->state == FRAME_COMPLETE || rx->state == RX_OVERFLOW) {
+      break;
+    }
+
+    byte = bytes[i];
+    if (rx->state == WAITING_FOR_START) {
+      /* skip anything before a start byte, such as the rest of a stale reply */
+      if (byte != FRAME_START_BYTE) {
+	continue;
+      }
+      rx->len = 0;
+    }
+
+    if (rx->len >= rx->size) {
+      rx->state = RX_OVERFLOW;
+      break;
+    }
+    rx->frame[rx->len++] = byte;
+
+    switch (rx->state) {
+    case WAITING_FOR_START:
+      rx->state = WAITING_FOR_COMMAND;
+      break;
+    case WAITING_FOR_COMMAND:
+      rx->state = WAITING_FOR_LEN;
+      break;
+    case WAITING_FOR_LEN:
+      /*
+	the length is the index of the last data byte, not their count, as
+	generate_message has framed requests to the device from the start
+	and encode_command does; a process reading's 20 data bytes come with
+	a length of 19
+      */
+      rx->data_left = byte + 1;
+      rx->state = WAITING_FOR_DATA;
+      break;
+    case WAITING_FOR_DATA:
+      if (--rx->data_left == 0) {
+	rx->state = WAITING_FOR_CRC_LO;
+      }
+      break;
+    case WAITING_FOR_CRC_LO:
+      rx->state = WAITING_FOR_CRC_HI;
+      break;
+    case WAITING_FOR_CRC_HI:
+      rx->state = WAITING_FOR_END;
+      break;
+    case WAITING_FOR_END:
+      /* a frame that doesn't end where its length says is out of step */
+      rx->state = (byte == FRAME_END_BYTE) ? FRAME_COMPLETE : WAITING_FOR_START;
+      break;
+    default:
+      break;
+    }
+  }
+
+  return rx->state;
+}
+
 /* (temp_exp - range) <= temp_reading <= (temp_exp + range) */
-char *get_device_read_status(float temp_reading, float temp_exp, 
-			     float temp_range) 
+READ_STATUS get_device_read_status_code(float temp_reading,
+					float temp_exp,
+					float temp_range)
 {
   if (temp_reading == -1000000.000000) {
-    return "ERROR: PROBE MISSING";
+    return READ_STATUS_PROBE_MISSING;
   }
   else if (!((temp_exp - temp_range) <= temp_reading && 
 	     temp_reading <= (temp_exp + temp_range))) {
-    return "WARNING: FREEZER TEMPERATURE OUT OF EXPECTED RANGE";
-  }
-  else if (0 /* additional status conditions go here */) {
-    return "";
+    return READ_STATUS_OUT_OF_RANGE;
   }
+  /* additional status conditions go here */
 
-  return "OK";
+  return READ_STATUS_OK;
 }
 
-void get_readings(SEM710_READINGS *readings, uint8_t *byte_array, int array_len)
+char *get_read_status_string(READ_STATUS status)
 {
-  assert (array_len > 23);
+  switch(status) {
+  case READ_STATUS_PROBE_MISSING:
+    return "ERROR: PROBE MISSING";
+  case READ_STATUS_OUT_OF_RANGE:
+    return "WARNING: FREEZER TEMPERATURE OUT OF EXPECTED RANGE";
+  case READ_STATUS_OK:
+    return "OK";
+  }
+  return "OK";
+}
 
-  /* float elec_value = float_from_byte_array(byte_array, 7); */
-  /* float ma_out = float_from_byte_array(byte_array, 15); */
-  /* float cj_temp = float_from_byte_array(byte_array, 19); */
+char *get_device_read_status(float temp_reading, float temp_exp, 
+			     float temp_range) 
+{
+  return get_read_status_string(get_device_read_status_code(temp_reading,
+							    temp_exp,
+							    temp_range));
+}
 
-  readings->ADC_VALUE = float_from_byte_array(byte_array, 3);
-  readings->PROCESS_VARIABLE = float_from_byte_array(byte_array, 11);
+int get_readings(SEM710_READINGS *readings, uint8_t *byte_array, int array_len)
+{
+  return decode_reply(SEM_COMMANDS_cREAD_PROCESS,
+		      byte_array,
+		      array_len,
+		      readings);
 }
 
 void display_readings(SEM710_READINGS *readings)
 {
   printf("ADC_VALUE=%f\n", readings->ADC_VALUE);
-  /* printf("ELEC_VALUE=%f\n", readings->ELEC_VALUE); */
-  /* printf("PROCESS_VARIABLE=%f\n", readings->PROCESS_VARIABLE); */
-  /* printf("MA_OUT=%f\n", readings->MA_OUT); */
-  /* printf("CJ_TEMP=%f\n", readings->CJ_TEMP); */
+  printf("ELEC_VALUE=%f\n", readings->ELEC_VALUE);
+  printf("PROCESS_VARIABLE=%f\n", readings->PROCESS_VARIABLE);
+  printf("MA_OUT=%f\n", readings->MA_OUT);
+  printf("CJ_TEMP=%f\n", readings->CJ_TEMP);
 }
 
-int pack_readings(SEM710_READINGS *readings, char *filename)
+int pack_readings(SEM710_READINGS *readings, string *buffer)
 {
-  char json_readings[500];
-  FILE *f;
-  
-  sprintf(json_readings, 
-	  "{ \"temperature\": %f }",
-	  readings->PROCESS_VARIABLE);
-
-  f = fopen(filename, "w");
-  if (f == NULL) {
-    return 1;
-  }
+  /*
+    write the readings as a JSON upload body into the given buffer, replacing
+    its contents; returns 1 if the buffer could not hold them
+  */
+  JSON_WRITER w;
 
-  fputs(json_readings, f);
+  json_begin(&w, buffer);
+  json_begin_object(&w);
+  json_key(&w, "temperature");
+  json_float(&w, readings->PROCESS_VARIABLE);
+  json_end_object(&w);
 
-  fclose(f);
-  return 0;
+  return json_end(&w);
 }
 
-int pack_error(char *error, char *filename)
+int pack_error(char *error, string *buffer)
 {
-  char json_readings[500];
-  FILE *f;
-  
-  sprintf(json_readings, 
-	  "{ \"error\": \"%s\" }",
-	  error);
-
-  f = fopen(filename, "w");
-
-  if (f == NULL) {
-    return 1;
-  }
+  /*
+    write the error as a JSON upload body into the given buffer, replacing
+    its contents; returns 1 if the buffer could not hold it
+  */
+  JSON_WRITER w;
 
-  fputs(json_readings, f);
+  json_begin(&w, buffer);
+  json_begin_object(&w);
+  json_key(&w, "error");
+  json_string(&w, error);
+  json_end_object(&w);
 
-  fclose(f);
-  return 0;
+  return json_end(&w);
 }
 
 void get_config(CONFIG_DATA *cal, uint8_t *byte_array, int array_len)
@@ -163,22 +388,15 @@ void get_config(CONFIG_DATA *cal, uint8_t *byte_array, int array_len)
   /* transfers the contents of the given byte array into the CONFIG_DATA */
   assert (array_len > 43);
 
-  cal->tc_code = byte_array[3];
-  cal->up_scale = byte_array[4];
-  cal->units = byte_array[5];
-  cal->model_type = byte_array[6];
-  cal->vout_range = byte_array[7];
-  cal->action_A = byte_array[8];
-  cal->action_B = byte_array[9];
-  cal->spare = byte_array[10];
-  cal->low_range = float_from_byte_array(byte_array, 11);
-  cal->high_range = float_from_byte_array(byte_array, 15);
-  cal->low_trim = float_from_byte_array(byte_array, 19);
-  cal->high_trim = float_from_byte_array(byte_array, 23);
-  cal->setpoint_A = float_from_byte_array(byte_array, 27);
-  cal->hyst_A = float_from_byte_array(byte_array, 31);
-  cal->setpoint_B = float_from_byte_array(byte_array, 35);
-  cal->hyst_B = float_from_byte_array(byte_array, 39);
+  decode_reply(SEM_COMMANDS_cREAD_CONFIG, byte_array, array_len, cal);
+}
+
+void get_calibration(UNIVERSAL_CALIBRATION *cal, uint8_t *byte_array,
+		     int array_len)
+{
+  assert (array_len > 59);
+
+  decode_reply(SEM_COMMANDS_cREAD_CAL, byte_array, array_len, cal);
 }
 
 void display_config(CONFIG_DATA *cal)
@@ -204,25 +422,34 @@ void display_config(CONFIG_DATA *cal)
 
 void CONFIG_BLOCK_init(CONFIG_BLOCK *config_block)
 {
-  config_block->fp = (float *) malloc((sizeof(float)*48));
-  config_block->config_input_float = (float *) malloc(sizeof(float)*4);
-  config_block->config_input_byte = (short *) malloc(sizeof(short)*4);
-  config_block->title = (char *) malloc(sizeof(char)*16);
-  config_block->units = (char *) malloc(sizeof(char)*4);
-  config_block->config_output_floats = (float *) malloc(sizeof(float)*8);
-  config_block->config_output_int = (short *) malloc(sizeof(short)*4);
-  config_block->tag_number = (char *) malloc(sizeof(char)*20);
+  /*
+    all of the block's arrays share one allocation, laid out widest type
+    first so that each array stays aligned
+  */
+  uint8_t *block;
+
+  block = (uint8_t *) malloc(sizeof(float) * (48 + 4 + 8)
+			     + sizeof(short) * (4 + 4)
+			     + sizeof(char) * (16 + 4 + 20));
+  if (block == NULL) {
+    memset(config_block, 0, sizeof(CONFIG_BLOCK));
+    return;
+  }
+
+  config_block->fp = (float *) block;
+  config_block->config_input_float = config_block->fp + 48;
+  config_block->config_output_floats = config_block->config_input_float + 4;
+  config_block->config_input_byte =
+    (short *) (config_block->config_output_floats + 8);
+  config_block->config_output_int = config_block->config_input_byte + 4;
+  config_block->title = (char *) (config_block->config_output_int + 4);
+  config_block->units = config_block->title + 16;
+  config_block->tag_number = config_block->units + 4;
 }
 
 void CONFIG_BLOCK_destroy(CONFIG_BLOCK *config_block)
 {
+  /* fp is the start of the single allocation made by CONFIG_BLOCK_init */
   free(config_block->fp);
-  free(config_block->config_input_float);
-  free(config_block->config_input_byte);
-  free(config_block->title);
-  free(config_block->units);
-  free(config_block->config_output_floats);
-  free(config_block->config_output_int);
-  free(config_block->tag_number);
+  memset(config_block, 0, sizeof(CONFIG_BLOCK));
 }
-
@@ -2,6 +2,7 @@
 #define __INC_DEVTYPES_H
 
 #include "cJSON.h"
+#include "misc-structs.h"
 #include <stdlib.h>
 #include <stdint.h>
 
@@ -53,9 +54,27 @@ typedef enum {
   WAITING_FOR_CRC_LO,
   WAITING_FOR_CRC_HI,
   WAITING_FOR_END,
-  RX_OVERFLOW
+  RX_OVERFLOW,
+  FRAME_COMPLETE
 } RX_FRAMING;
 
+/* frame delimiters shared by messages to and replies from the device */
+#define FRAME_START_BYTE 0x55
+#define FRAME_END_BYTE 0xAA
+
+/*
+  assembles a reply frame (start, command, length, data, crc, end) from the
+  bytes read off the device, however they are split between reads; the length
+  byte is the index of the last data byte, as in encode_command
+*/
+typedef struct {
+  RX_FRAMING state;
+  uint8_t *frame;
+  int size;       /* of the frame buffer */
+  int len;        /* bytes of the frame received so far */
+  int data_left;  /* data bytes still to come */
+} FRAME_RECEIVER;
+
 typedef enum {
 WAITING,
   GET_FUNCTION,
@@ -69,12 +88,18 @@ WAITING,
   MESSAGE_NOT_VALID
 } COMMS_RX_STATE;
 
+typedef enum {
+  READ_STATUS_OK,
+  READ_STATUS_OUT_OF_RANGE,
+  READ_STATUS_PROBE_MISSING
+} READ_STATUS;
+
 typedef struct {
   float ADC_VALUE;
-  /* float ELEC_VALUE; */
+  float ELEC_VALUE;
   float PROCESS_VARIABLE; /*<-- ie temperature!! */
-  /* float MA_OUT; */
-  /* float CJ_TEMP; */
+  float MA_OUT;
+  float CJ_TEMP;
 } SEM710_READINGS;
 
 
@@ -135,24 +160,95 @@ typedef struct {
    char *tag_number;
 } CONFIG_BLOCK;
 
+typedef enum {
+  SEM_FIELD_U8,
+  SEM_FIELD_U16,
+  SEM_FIELD_FLOAT
+} SEM_FIELD_TYPE;
+
+/* one value in a reply frame and the struct member it is decoded into */
+typedef struct {
+  SEM_FIELD_TYPE type;
+  uint8_t frame_index;
+  uint16_t member_offset;
+} SEM_FIELD;
+
+/*
+  describes a command: the byte the device's reply starts with (0 when it is
+  not known, in which case the reply is not checked), the number of data
+  bytes sent with it, and the layout of the reply's data, if any
+*/
+typedef struct {
+  SEM_COMMANDS command;
+  uint8_t reply;
+  uint8_t request_len;
+  const SEM_FIELD *fields;
+  int field_count;
+} SEM_COMMAND_INFO;
+
+/* the descriptor for command c, or NULL if c is not a SEM710 command */
+const SEM_COMMAND_INFO *get_command_info(SEM_COMMANDS c);
+
 uint8_t get_confirmation_byte(SEM_COMMANDS c);
+
+/*
+  build the frame for command c with the given data bytes directly in frame,
+  which holds size bytes; returns the length of the frame or -1 if it does not
+  fit. If data is NULL, the command's request_len zero bytes are sent.
+*/
+int encode_command(SEM_COMMANDS c, const uint8_t *data, int data_len,
+		   uint8_t *frame, int size);
+
+/*
+  decode every field of the reply to command c in frame into out, which must
+  be the struct the command's fields describe; returns 0, or 1 if the frame
+  is too short or is not a reply to c
+*/
+int decode_reply(SEM_COMMANDS c, const uint8_t *frame, int frame_len,
+		 void *out);
+
+/*
+  start the receiver waiting for the start of a frame, to be assembled in the
+  size bytes at frame
+*/
+void frame_receiver_init(FRAME_RECEIVER *rx, uint8_t *frame, int size);
+
+/*
+  feed the given bytes to the receiver, returning FRAME_COMPLETE once a whole
+  frame has been assembled (any bytes after it are ignored), RX_OVERFLOW if
+  the frame does not fit in the buffer, or the state it is waiting in
+*/
+RX_FRAMING frame_receiver_feed(FRAME_RECEIVER *rx, uint8_t *bytes, int n);
  
+READ_STATUS get_device_read_status_code(float temp_reading,
+					float temp_exp,
+					float temp_range);
+
+char *get_read_status_string(READ_STATUS status);
+
 char *get_device_read_status(float temp_reading, 
 			     float temp_exp, 
 			     float temp_range);
 
-void get_readings(SEM710_READINGS *readings, 
-		  uint8_t *byte_array, 
-		  int array_len);
+/*
+  decode the process reading reply in byte_array into readings; returns 0, or
+  1 if it is too short or is not a process reading reply
+*/
+int get_readings(SEM710_READINGS *readings,
+		 uint8_t *byte_array,
+		 int array_len);
 
 void display_readings(SEM710_READINGS *readings);
 
-int pack_readings(SEM710_READINGS *readings, char *filename);
+int pack_readings(SEM710_READINGS *readings, string *buffer);
 
-int pack_error(char *error, char *filename);
+int pack_error(char *error, string *buffer);
 
 void get_config(CONFIG_DATA *cal, uint8_t *input_array, int array_len);
 
+void get_calibration(UNIVERSAL_CALIBRATION *cal, uint8_t *byte_array,
+		     int array_len);
+
 void display_config(CONFIG_DATA *cal);
 
 void CONFIG_BLOCK_init(CONFIG_BLOCK *config_block);
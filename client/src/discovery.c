@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "discovery.h"
+
+int DISCOVERY_open(DISCOVERY *discovery)
+{
+  struct sockaddr_in address;
+  struct ip_mreq membership;
+  unsigned char loop = 0;
+  int reuse = 1;
+
+  discovery->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (discovery->fd < 0) {
+    return 1;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(DISCOVERY_PORT);
+
+  membership.imr_multiaddr.s_addr = inet_addr(DISCOVERY_GROUP);
+  membership.imr_interface.s_addr = htonl(INADDR_ANY);
+
+  /* don't hear our own requests, and never block on the socket */
+  if (setsockopt(discovery->fd,
+		 SOL_SOCKET,
+		 SO_REUSEADDR,
+		 &reuse,
+		 sizeof(reuse)) ||
+      bind(discovery->fd, (struct sockaddr *) &address, sizeof(address)) ||
+      setsockopt(discovery->fd,
+		 IPPROTO_IP,
+		 IP_ADD_MEMBERSHIP,
+		 &membership,
+		 sizeof(membership)) ||
+      setsockopt(discovery->fd,
+		 IPPROTO_IP,
+		 IP_MULTICAST_LOOP,
+		 &loop,
+		 sizeof(loop)) ||
+      fcntl(discovery->fd, F_SETFL, O_NONBLOCK)) {
+    DISCOVERY_close(discovery);
+    return 1;
+  }
+
+  return 0;
+}
+
+void DISCOVERY_close(DISCOVERY *discovery)
+{
+  if (discovery->fd >= 0) {
+    close(discovery->fd);
+    discovery->fd = -1;
+  }
+}
+
+int discovery_request(DISCOVERY *discovery)
+{
+  struct sockaddr_in group;
+  ssize_t sent;
+
+  memset(&group, 0, sizeof(group));
+  group.sin_family = AF_INET;
+  group.sin_addr.s_addr = inet_addr(DISCOVERY_GROUP);
+  group.sin_port = htons(DISCOVERY_PORT);
+
+  sent = sendto(discovery->fd,
+		DISCOVERY_REQUEST,
+		strlen(DISCOVERY_REQUEST),
+		0,
+		(struct sockaddr *) &group,
+		sizeof(group));
+
+  return (sent < 0);
+}
+
+int discovery_poll(DISCOVERY *discovery,
+		   int timeout,
+		   char *url,
+		   size_t url_size)
+{
+  struct pollfd pfd;
+  struct sockaddr_in sender;
+  socklen_t sender_len;
+  char datagram[256];
+  ssize_t len;
+  int found;
+  int ready;
+
+  pfd.fd = discovery->fd;
+  pfd.events = POLLIN;
+  ready = poll(&pfd, 1, timeout);
+  if (ready < 0) {
+    return (errno == EINTR) ? 0 : -1;
+  }
+
+  /* take every datagram waiting, so only the latest announcement counts */
+  found = 0;
+  for (;;) {
+    sender_len = sizeof(sender);
+    len = recvfrom(discovery->fd,
+		   datagram,
+		   sizeof(datagram) - 1,
+		   0,
+		   (struct sockaddr *) &sender,
+		   &sender_len);
+    if (len < 0) {
+      break;
+    }
+    datagram[len] = '\0';
+
+    /* other clients' requests and anything else are not announcements */
+    if (strcmp(datagram, DISCOVERY_ANNOUNCEMENT) != 0) {
+      continue;
+    }
+
+    snprintf(url,
+	     url_size,
+	     "http://%s:%d",
+	     inet_ntoa(sender.sin_addr),
+	     DISCOVERY_SERVER_PORT);
+    found = 1;
+  }
+
+  if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    return -1;
+  }
+  return found;
+}
+
+int save_server_url(char *path, char *url)
+{
+  char tmp_path[270];
+  FILE *f;
+  int err;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  f = fopen(tmp_path, "w");
+  if (f == NULL) {
+    return 1;
+  }
+  err = (fprintf(f, "url: %s\n", url) < 0);
+  err |= (fclose(f) != 0);
+  if (err || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef __INC_DISCOVERY_H
+#define __INC_DISCOVERY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the server announces itself to this multicast group */
+#define DISCOVERY_GROUP "224.1.1.1"
+#define DISCOVERY_PORT 10010
+/* the port the server is reached on, at the address it announced from */
+#define DISCOVERY_SERVER_PORT 5005
+/* sent to the group to ask the server to announce itself */
+#define DISCOVERY_REQUEST "REQUEST_SERVER_IP"
+/* what the server sends to the group to announce itself */
+#define DISCOVERY_ANNOUNCEMENT "TEMPMON_SERVER_IP"
+
+/*
+  a non-blocking socket joined to the discovery group, so server
+  announcements can be picked up whenever they arrive
+*/
+typedef struct {
+  int fd;
+} DISCOVERY;
+
+/* join the discovery group; returns 0 on success */
+int DISCOVERY_open(DISCOVERY *discovery);
+
+void DISCOVERY_close(DISCOVERY *discovery);
+
+/*
+  ask the server to announce itself; the server may also announce itself
+  unprompted, so a failure here is not fatal. Returns 0 if the request was sent
+*/
+int discovery_request(DISCOVERY *discovery);
+
+/*
+  wait up to timeout milliseconds (0 only checks, without waiting) for server
+  announcements, and write the server URL of the latest one received into url;
+  returns 1 if there was an announcement, 0 if there was none or -1 if the
+  socket failed
+*/
+int discovery_poll(DISCOVERY *discovery,
+		   int timeout,
+		   char *url,
+		   size_t url_size);
+
+/*
+  atomically replace the server URL file at path with the given URL, in the
+  "url: <url>" form read by get_file_variable; returns 0 on success
+*/
+int save_server_url(char *path, char *url);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_DISCOVERY_H */
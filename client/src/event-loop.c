@@ -0,0 +1,218 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "event-loop.h"
+
+int EVENT_LOOP_init(EVENT_LOOP *loop)
+{
+  loop->dispatching = 0;
+  loop->retired = NULL;
+  loop->fd = epoll_create1(EPOLL_CLOEXEC);
+
+  return (loop->fd < 0);
+}
+
+static void free_retired(EVENT_LOOP *loop)
+{
+  EVENT_WATCH *watch;
+
+  while (loop->retired != NULL) {
+    watch = loop->retired;
+    loop->retired = watch->next_retired;
+    free(watch);
+  }
+}
+
+void EVENT_LOOP_destroy(EVENT_LOOP *loop)
+{
+  free_retired(loop);
+  if (loop->fd >= 0) {
+    close(loop->fd);
+    loop->fd = -1;
+  }
+}
+
+int event_watch(EVENT_LOOP *loop,
+		EVENT_WATCH *watch,
+		int fd,
+		uint32_t events,
+		EVENT_CALLBACK callback,
+		void *data)
+{
+  struct epoll_event event;
+
+  watch->fd = fd;
+  watch->callback = callback;
+  watch->data = data;
+  watch->next_retired = NULL;
+
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.ptr = watch;
+  if (epoll_ctl(loop->fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    watch->callback = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+int event_modify(EVENT_LOOP *loop, EVENT_WATCH *watch, uint32_t events)
+{
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.ptr = watch;
+  return (epoll_ctl(loop->fd, EPOLL_CTL_MOD, watch->fd, &event) != 0);
+}
+
+void event_unwatch(EVENT_LOOP *loop, EVENT_WATCH *watch)
+{
+  if (watch->callback == NULL) {
+    return;
+  }
+  /* the fd may already be closed, which removed it from the epoll set */
+  epoll_ctl(loop->fd, EPOLL_CTL_DEL, watch->fd, NULL);
+  watch->callback = NULL;
+}
+
+EVENT_WATCH *event_watch_new(EVENT_LOOP *loop,
+			     int fd,
+			     uint32_t events,
+			     EVENT_CALLBACK callback,
+			     void *data)
+{
+  EVENT_WATCH *watch = (EVENT_WATCH *) malloc(sizeof(EVENT_WATCH));
+
+  if (watch != NULL &&
+      event_watch(loop, watch, fd, events, callback, data)) {
+    free(watch);
+    watch = NULL;
+  }
+  return watch;
+}
+
+void event_watch_free(EVENT_LOOP *loop, EVENT_WATCH *watch)
+{
+  event_unwatch(loop, watch);
+
+  /* an event for it may still be waiting to be handled */
+  if (loop->dispatching) {
+    watch->next_retired = loop->retired;
+    loop->retired = watch;
+  } else {
+    free(watch);
+  }
+}
+
+int event_loop_run_once(EVENT_LOOP *loop, int timeout)
+{
+  struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+  EVENT_WATCH *watch;
+  int count;
+  int i;
+
+  count = epoll_wait(loop->fd, events, EVENT_LOOP_MAX_EVENTS, timeout);
+  if (count < 0) {
+    return (errno == EINTR) ? 0 : -1;
+  }
+
+  loop->dispatching = 1;
+  for (i = 0; i < count; i++) {
+    watch = (EVENT_WATCH *) events[i].data.ptr;
+    /* skip watches dropped by an earlier callback */
+    if (watch->callback != NULL) {
+      watch->callback(watch->data, watch->fd, events[i].events);
+    }
+  }
+  loop->dispatching = 0;
+  free_retired(loop);
+
+  return count;
+}
+
+static void timer_expired(void *data, int fd, uint32_t events)
+{
+  EVENT_TIMER *timer = (EVENT_TIMER *) data;
+  uint64_t expirations;
+
+  /* nothing to read if the timer was set again since it expired */
+  if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+    timer->callback(timer->data, fd, events);
+  }
+}
+
+int EVENT_TIMER_init(EVENT_TIMER *timer,
+		     EVENT_LOOP *loop,
+		     EVENT_CALLBACK callback,
+		     void *data)
+{
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  timer->loop = loop;
+  timer->callback = callback;
+  timer->data = data;
+  timer->watch.fd = -1;
+  timer->watch.callback = NULL;
+  if (fd < 0) {
+    return 1;
+  }
+  if (event_watch(loop, &timer->watch, fd, EPOLLIN, timer_expired, timer)) {
+    close(fd);
+    timer->watch.fd = -1;
+    return 1;
+  }
+  return 0;
+}
+
+void EVENT_TIMER_destroy(EVENT_TIMER *timer)
+{
+  if (timer->watch.fd < 0) {
+    return;
+  }
+  event_unwatch(timer->loop, &timer->watch);
+  close(timer->watch.fd);
+  timer->watch.fd = -1;
+}
+
+int timer_at(EVENT_TIMER *timer, const struct timespec *deadline)
+{
+  struct itimerspec spec;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value = *deadline;
+  /* a zero time would disarm the timer instead */
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+    spec.it_value.tv_nsec = 1;
+  }
+  return (timerfd_settime(timer->watch.fd,
+			  TFD_TIMER_ABSTIME,
+			  &spec,
+			  NULL) != 0);
+}
+
+int timer_after(EVENT_TIMER *timer, long ms)
+{
+  struct itimerspec spec;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = ms / 1000;
+  spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+  if (ms <= 0) {
+    spec.it_value.tv_sec = 0;
+    spec.it_value.tv_nsec = 1;
+  }
+  return (timerfd_settime(timer->watch.fd, 0, &spec, NULL) != 0);
+}
+
+void timer_cancel(EVENT_TIMER *timer)
+{
+  struct itimerspec spec;
+
+  /* setting the timer also drops an expiry that was not handled yet */
+  memset(&spec, 0, sizeof(spec));
+  timerfd_settime(timer->watch.fd, 0, &spec, NULL);
+}
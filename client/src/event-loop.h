@@ -0,0 +1,119 @@
+#ifndef __INC_EVENT_LOOP_H
+#define __INC_EVENT_LOOP_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* most events taken from the kernel in one wait */
+#define EVENT_LOOP_MAX_EVENTS 32
+
+/*
+  called with the watched file descriptor and the epoll events (EPOLLIN,
+  EPOLLOUT, ...) that occurred on it
+*/
+typedef void (*EVENT_CALLBACK)(void *data, int fd, uint32_t events);
+
+/* a file descriptor watched on a loop, in memory owned by the watcher */
+typedef struct EVENT_WATCH {
+  int fd;
+  EVENT_CALLBACK callback; /* NULL while not watched */
+  void *data;
+  struct EVENT_WATCH *next_retired;
+} EVENT_WATCH;
+
+/*
+  waits on any number of file descriptors and timers at once, calling back
+  whichever are ready, so that device transfers, HTTP transfers and timers
+  all progress in one thread without any of them blocking the others
+*/
+typedef struct {
+  int fd;               /* the epoll instance */
+  int dispatching;      /* whether callbacks are being made */
+  EVENT_WATCH *retired; /* allocated watches to free once they are made */
+} EVENT_LOOP;
+
+/* a timerfd on a loop, calling back once each time it expires */
+typedef struct {
+  EVENT_LOOP *loop;
+  EVENT_WATCH watch;
+  EVENT_CALLBACK callback;
+  void *data;
+} EVENT_TIMER;
+
+/* returns 0 on success */
+int EVENT_LOOP_init(EVENT_LOOP *loop);
+
+void EVENT_LOOP_destroy(EVENT_LOOP *loop);
+
+/*
+  call callback with data whenever fd has any of the given events; returns 0
+  on success
+*/
+int event_watch(EVENT_LOOP *loop,
+		EVENT_WATCH *watch,
+		int fd,
+		uint32_t events,
+		EVENT_CALLBACK callback,
+		void *data);
+
+/* change the events a watched file descriptor is watched for */
+int event_modify(EVENT_LOOP *loop, EVENT_WATCH *watch, uint32_t events);
+
+/*
+  stop watching; events already taken from the kernel for the watch are
+  dropped, so it may be called from any callback
+*/
+void event_unwatch(EVENT_LOOP *loop, EVENT_WATCH *watch);
+
+/*
+  as event_watch, with the watch allocated; returns NULL if it could not be
+  allocated or watched
+*/
+EVENT_WATCH *event_watch_new(EVENT_LOOP *loop,
+			     int fd,
+			     uint32_t events,
+			     EVENT_CALLBACK callback,
+			     void *data);
+
+/*
+  unwatch and free a watch from event_watch_new; while callbacks are being
+  made it is only freed once they are done
+*/
+void event_watch_free(EVENT_LOOP *loop, EVENT_WATCH *watch);
+
+/*
+  wait up to timeout milliseconds (-1 without limit) for events and make
+  their callbacks; returns how many events were handled, 0 if the wait timed
+  out or was interrupted by a signal, or -1 on failure
+*/
+int event_loop_run_once(EVENT_LOOP *loop, int timeout);
+
+/* returns 0 on success; the timer starts disarmed */
+int EVENT_TIMER_init(EVENT_TIMER *timer,
+		     EVENT_LOOP *loop,
+		     EVENT_CALLBACK callback,
+		     void *data);
+
+void EVENT_TIMER_destroy(EVENT_TIMER *timer);
+
+/*
+  expire at the given CLOCK_MONOTONIC time, right away if it has passed,
+  replacing any time set before
+*/
+int timer_at(EVENT_TIMER *timer, const struct timespec *deadline);
+
+/* expire after the given number of milliseconds, right away for 0 */
+int timer_after(EVENT_TIMER *timer, long ms);
+
+void timer_cancel(EVENT_TIMER *timer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_EVENT_LOOP_H */
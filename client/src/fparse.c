@@ -34,29 +34,43 @@ void strip(char *s) {
 
 int get_file_variable(char *fname, char *vname, char *buffer)
 {
+  /*
+    copy the value from the "vname: value" line of the file with path given by
+    fname into buffer; returns 1 if the file has no such line
+  */
   char line[256];
-  char *vptr;
-  
-  int searching;
-  /* open the file with path given by fname */
+  char *value;
+  size_t vname_len;
+  int found;
+
   FILE *f = fopen(fname, "r");
   if (f == NULL) {
     return 1;
   }
-  /* scan the file line-by-line for the line beginning with vname */
-  searching = 1;
-  while(fgets(line, sizeof(line), f) && searching) {
-    /* the line contains the desired variable name */
-    if( (vptr = strstr(line, vname)) ) {
-      /* put its value into buffer */
-      strncpy(buffer, vptr+strlen(vname)+2, strlen(vptr+strlen(vname)));
-      strip(buffer);
-      searching = 0;
-    } 
+
+  /* the name must match whole, so that one name within another is not taken */
+  vname_len = strlen(vname);
+  found = 0;
+  while (!found && fgets(line, sizeof(line), f)) {
+    value = line + strspn(line, " \t");
+    if (strncmp(value, vname, vname_len) != 0) {
+      continue;
+    }
+    value += vname_len;
+    value += strspn(value, " \t");
+    if (*value != ':') {
+      continue;
+    }
+    value++;
+    value += strspn(value, " \t");
+
+    strcpy(buffer, value);
+    strip(buffer);
+    found = 1;
   }
   fclose(f);
-  
-  return (vptr == NULL);
+
+  return !found;
 }
 
 
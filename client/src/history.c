@@ -0,0 +1,300 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "history.h"
+
+/* the header gets a page of its own, as in the journal */
+#define HISTORY_HEADER_SIZE 4096
+
+static size_t history_size(uint32_t blocks, uint32_t block_size)
+{
+  /* the size of the file holding the given number of blocks */
+  size_t capacity = (size_t) blocks * block_size;
+
+  return HISTORY_HEADER_SIZE +
+    capacity * (sizeof(int64_t) + sizeof(float) + sizeof(uint8_t)) +
+    (size_t) blocks * sizeof(int64_t);
+}
+
+static int header_valid(HISTORY_HEADER *header, size_t file_size)
+{
+  return (header->magic == HISTORY_MAGIC &&
+	  header->version == HISTORY_VERSION &&
+	  header->blocks >= 2 &&
+	  header->block_size > 0 &&
+	  file_size == history_size(header->blocks, header->block_size) &&
+	  header->first % header->block_size == 0 &&
+	  header->first <= header->next &&
+	  header->next - header->first <=
+	  (uint64_t) header->blocks * header->block_size);
+}
+
+static int map_history(HISTORY *history, int writable)
+{
+  /* map the history file open on fd, whose header is valid; returns 0 or 1 */
+  HISTORY_HEADER header;
+  uint8_t *columns;
+  void *map;
+
+  if (pread(history->fd, &header, sizeof(header), 0) != sizeof(header)) {
+    return 1;
+  }
+  history->map_size = history_size(header.blocks, header.block_size);
+  map = mmap(NULL,
+	     history->map_size,
+	     writable ? PROT_READ | PROT_WRITE : PROT_READ,
+	     MAP_SHARED,
+	     history->fd,
+	     0);
+  if (map == MAP_FAILED) {
+    return 1;
+  }
+
+  history->header = (HISTORY_HEADER *) map;
+  history->capacity = (uint64_t) header.blocks * header.block_size;
+  columns = (uint8_t *) map + HISTORY_HEADER_SIZE;
+  history->timestamps = (int64_t *) columns;
+  history->temperatures = (float *) (history->timestamps + history->capacity);
+  /* the statuses are last but for the index, which is kept aligned */
+  history->index = (int64_t *) (history->temperatures + history->capacity);
+  history->statuses = (uint8_t *) (history->index + header.blocks);
+  return 0;
+}
+
+int HISTORY_open(HISTORY *history,
+		 char *path,
+		 uint32_t capacity,
+		 int retention)
+{
+  /*
+    open the history at path, creating it with room for at least capacity
+    readings if it does not exist or is not a valid history; an existing
+    history keeps its own capacity so no readings are lost. Readings are
+    kept for retention seconds at most, or until there is no room for them
+    if that is 0. Returns 0 on success or 1.
+  */
+  struct stat file_info;
+  HISTORY_HEADER header;
+  uint32_t blocks;
+  size_t map_size;
+
+  memset(history, 0, sizeof(HISTORY));
+  history->fd = -1;
+  history->retention = retention;
+
+  history->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (history->fd < 0 || fstat(history->fd, &file_info) < 0) {
+    HISTORY_close(history);
+    return 1;
+  }
+
+  if ((size_t) file_info.st_size < sizeof(header) ||
+      pread(history->fd, &header, sizeof(header), 0) != sizeof(header) ||
+      !header_valid(&header, file_info.st_size)) {
+    /* a block more than asked for, as a block is dropped to make room */
+    blocks = (capacity + HISTORY_BLOCK_SIZE - 1) / HISTORY_BLOCK_SIZE + 1;
+    map_size = history_size(blocks, HISTORY_BLOCK_SIZE);
+
+    /* allocate the blocks up front so a full disk can't fault the mapping */
+    memset(&header, 0, sizeof(header));
+    header.magic = HISTORY_MAGIC;
+    header.version = HISTORY_VERSION;
+    header.blocks = blocks;
+    header.block_size = HISTORY_BLOCK_SIZE;
+    if (ftruncate(history->fd, 0) < 0 ||
+	posix_fallocate(history->fd, 0, map_size) != 0 ||
+	pwrite(history->fd, &header, sizeof(header), 0) != sizeof(header)) {
+      HISTORY_close(history);
+      return 1;
+    }
+  }
+
+  if (map_history(history, 1)) {
+    HISTORY_close(history);
+    return 1;
+  }
+  return 0;
+}
+
+int HISTORY_view(HISTORY *history, char *path)
+{
+  struct stat file_info;
+  HISTORY_HEADER header;
+
+  memset(history, 0, sizeof(HISTORY));
+  history->fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (history->fd < 0 ||
+      fstat(history->fd, &file_info) < 0 ||
+      pread(history->fd, &header, sizeof(header), 0) != sizeof(header) ||
+      !header_valid(&header, file_info.st_size) ||
+      map_history(history, 0)) {
+    HISTORY_close(history);
+    return 1;
+  }
+  return 0;
+}
+
+void HISTORY_close(HISTORY *history)
+{
+  if (history->header != NULL) {
+    munmap(history->header, history->map_size);
+    history->header = NULL;
+  }
+  if (history->fd >= 0) {
+    close(history->fd);
+    history->fd = -1;
+  }
+}
+
+static uint64_t slot(HISTORY *history, uint64_t number)
+{
+  return number % history->capacity;
+}
+
+static void drop_block(HISTORY *history)
+{
+  /*
+    drop the oldest block; it is given up before it is written over, so a
+    viewer reading it meanwhile can tell
+  */
+  __atomic_store_n(&history->header->first,
+		   history->header->first + history->header->block_size,
+		   __ATOMIC_RELEASE);
+}
+
+int history_append(HISTORY *history, TIMED_READING *reading)
+{
+  /*
+    add the reading to the history, dropping the oldest block if there is
+    no room for it and any blocks past the retention; returns 0, or 1 if it
+    was taken before the last reading added, which it is not kept with
+  */
+  HISTORY_HEADER *header = history->header;
+  uint64_t next = header->next;
+  uint64_t last;
+  uint64_t position;
+
+  if (next > header->first &&
+      reading->timestamp < history->timestamps[slot(history, next - 1)]) {
+    return 1;
+  }
+
+  if (next - header->first == history->capacity) {
+    drop_block(history);
+  }
+  /* a block is dropped only once the one after it has begun */
+  while (history->retention > 0 &&
+	 next - header->first > header->block_size) {
+    last = header->first + header->block_size - 1;
+    if (reading->timestamp - history->timestamps[slot(history, last)] <=
+	history->retention) {
+      break;
+    }
+    drop_block(history);
+  }
+
+  position = slot(history, next);
+  history->timestamps[position] = reading->timestamp;
+  history->temperatures[position] = reading->temperature;
+  history->statuses[position] = (uint8_t) reading->status;
+  if (next % header->block_size == 0) {
+    history->index[(next / header->block_size) % header->blocks] =
+      reading->timestamp;
+  }
+  __atomic_store_n(&header->next, next + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static uint64_t find(HISTORY *history,
+		     uint64_t first,
+		     uint64_t next,
+		     time_t time)
+{
+  /*
+    the number of the first reading between first and next taken at time or
+    later, or next if there is none: the first block starting at time or
+    later is found in the index, and the reading in the block before it
+  */
+  uint32_t block_size = history->header->block_size;
+  uint32_t blocks = history->header->blocks;
+  uint64_t low;
+  uint64_t high;
+  uint64_t middle;
+
+  if (first == next) {
+    return next;
+  }
+
+  low = first / block_size;
+  high = (next - 1) / block_size + 1;
+  while (low < high) {
+    middle = low + (high - low) / 2;
+    if (history->index[middle % blocks] < time) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == first / block_size) {
+    return first;
+  }
+
+  /* the readings of the block before, up to the next block or reading */
+  high = low * block_size;
+  if (high > next) {
+    high = next;
+  }
+  low = (low - 1) * block_size;
+  while (low < high) {
+    middle = low + (high - low) / 2;
+    if (history->timestamps[slot(history, middle)] < time) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+void history_range(HISTORY *history,
+		   time_t from,
+		   time_t to,
+		   uint64_t *begin,
+		   uint64_t *end)
+{
+  uint64_t next = __atomic_load_n(&history->header->next, __ATOMIC_ACQUIRE);
+  uint64_t first = __atomic_load_n(&history->header->first, __ATOMIC_ACQUIRE);
+
+  *begin = find(history, first, next, from);
+  *end = (to > from) ? find(history, *begin, next, to) : *begin;
+}
+
+int history_read(HISTORY *history, uint64_t number, TIMED_READING *reading)
+{
+  /*
+    copy the reading with the given number; returns 0, or 1 if it is not
+    kept (any more)
+  */
+  uint64_t position = slot(history, number);
+
+  if (number >= __atomic_load_n(&history->header->next, __ATOMIC_ACQUIRE)) {
+    return 1;
+  }
+  memset(reading, 0, sizeof(TIMED_READING));
+  reading->timestamp = (time_t) history->timestamps[position];
+  reading->temperature = history->temperatures[position];
+  reading->status = (READ_STATUS) history->statuses[position];
+
+  /* the copy only counts if the block was not dropped meanwhile */
+  return (number < __atomic_load_n(&history->header->first, __ATOMIC_ACQUIRE));
+}
+
+int history_sync(HISTORY *history)
+{
+  /* flush the history to disk; returns 0 or 1 on failure */
+  return (msync(history->header, history->map_size, MS_SYNC) != 0);
+}
@@ -0,0 +1,86 @@
+#ifndef __INC_HISTORY_H
+#define __INC_HISTORY_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "batch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HISTORY_MAGIC 0x48545454 /* "TTTH" */
+#define HISTORY_VERSION 1
+
+/* readings in a block of the history; the index has an entry per block */
+#define HISTORY_BLOCK_SIZE 1024
+
+/*
+  The history is a fixed-size file mapped into memory, keeping every reading
+  taken for as long as there is room, in time order: a header page, then the
+  readings as columns (their timestamps, temperatures and statuses each in
+  an array of its own, so looking through one column touches only its
+  pages), then a sparse index of the first timestamp in each block of
+  HISTORY_BLOCK_SIZE readings. The columns are used as a ring of blocks:
+  once they are full the oldest block is dropped whole to make room, as are
+  blocks older than the retention. A time is found with a binary search of
+  the index and then of a single block.
+
+  Readings are numbered from the first ever appended. A history can be
+  viewed by another process while it is appended to; readings it finds may
+  be dropped before it reads them, which history_read tells.
+*/
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t blocks;
+  uint32_t block_size;
+  uint64_t first; /* number of the oldest reading kept, starting a block */
+  uint64_t next;  /* number of the next reading appended */
+} HISTORY_HEADER;
+
+typedef struct {
+  int fd;
+  size_t map_size;
+  HISTORY_HEADER *header;
+  int64_t *timestamps;
+  float *temperatures;
+  uint8_t *statuses;
+  int64_t *index;     /* the first timestamp of each block */
+  uint64_t capacity;  /* readings, blocks * block_size */
+  int retention;      /* seconds readings are kept at least; 0 for no limit */
+} HISTORY;
+
+int HISTORY_open(HISTORY *history,
+		 char *path,
+		 uint32_t capacity,
+		 int retention);
+
+/* open the history at path to read only; returns 0 on success or 1 */
+int HISTORY_view(HISTORY *history, char *path);
+
+void HISTORY_close(HISTORY *history);
+
+int history_append(HISTORY *history, TIMED_READING *reading);
+
+/*
+  set begin and end to the numbers of the first reading taken at from or
+  later and of the first taken at to or later, so that the readings from
+  begin up to end are those taken in between
+*/
+void history_range(HISTORY *history,
+		   time_t from,
+		   time_t to,
+		   uint64_t *begin,
+		   uint64_t *end);
+
+int history_read(HISTORY *history, uint64_t number, TIMED_READING *reading);
+
+int history_sync(HISTORY *history);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_HISTORY_H */
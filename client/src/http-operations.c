@@ -1,12 +1,16 @@
 #include <curl/curl.h>
 #include <sys/stat.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
+#include <strings.h>
+#include <zlib.h>
 
 #include "misc-structs.h"
+#include "http-operations.h"
 
 char *strcat_percent_encoded(char *destination, char *source)
 {
@@ -101,15 +105,10 @@ char *add_postfield(char *destination, char *fieldname, char *fieldvalue)
 
 size_t write_callback(void *ptr, size_t size, size_t nmemb, string *s)
 {
-  size_t new_len = s->len + size*nmemb;
-  s->ptr = realloc(s->ptr, new_len+1);
-  if (s->ptr == NULL) {
+  if (append_string(s, (const char *) ptr, size*nmemb)) {
     fprintf(stderr, "realloc() failed\n");
     exit(EXIT_FAILURE);
   }
-  memcpy(s->ptr+s->len, ptr, size*nmemb);
-  s->ptr[new_len] = '\0';
-  s->len = new_len;
 
   return size*nmemb;
 }
@@ -122,7 +121,543 @@ size_t read_callback(void *ptr, size_t size, size_t nmemb, void *stream)
   return retcode;
 }
 
-int http_PUT(char *url,
+static void copy_header_value(char *destination,
+			      size_t destination_size,
+			      char *value,
+			      size_t len)
+{
+  /* copy a header value, less surrounding whitespace and the line ending */
+  while (len > 0 && (*value == ' ' || *value == '\t')) {
+    value++;
+    len--;
+  }
+  while (len > 0 && (value[len-1] == '\r' || value[len-1] == '\n' ||
+		     value[len-1] == ' ' || value[len-1] == '\t')) {
+    len--;
+  }
+  if (len >= destination_size) {
+    /* a truncated validator would never match, so don't keep one */
+    len = 0;
+  }
+  memcpy(destination, value, len);
+  destination[len] = '\0';
+}
+
+static size_t header_callback(char *buffer,
+			      size_t size,
+			      size_t nitems,
+			      HTTP_CLIENT *client)
+{
+  size_t len = size*nitems;
+
+  /* note when the server sets a cookie, so only then are cookies saved */
+  if (len > 11 && strncasecmp(buffer, "Set-Cookie:", 11) == 0) {
+    client->cookies_changed = 1;
+  }
+
+  if (client->received != NULL) {
+    if (len > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+      /* a new response (after a redirect) brings its own validators */
+      client->received->etag[0] = '\0';
+      client->received->last_modified[0] = '\0';
+    } else if (len > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+      copy_header_value(client->received->etag,
+			sizeof(client->received->etag),
+			buffer + 5,
+			len - 5);
+    } else if (len > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0) {
+      copy_header_value(client->received->last_modified,
+			sizeof(client->received->last_modified),
+			buffer + 14,
+			len - 14);
+    }
+  }
+  return len;
+}
+
+int HTTP_CLIENT_init(HTTP_CLIENT *client)
+{
+  /*
+    create the easy handle and share object that persist across requests so
+    connections are kept alive and TLS sessions resumed; returns 0 on success
+  */
+  client->cookie_path[0] = '\0';
+  client->cookies_changed = 0;
+  client->received = NULL;
+  client->validators = NULL;
+  client->multi = NULL;
+  client->done = NULL;
+  client->done_data = NULL;
+  client->pending = 0;
+  client->headers = NULL;
+  client->compression_level = 0;
+  client->compression_threshold = 0;
+  init_string(&client->compressed);
+
+  client->curl = curl_easy_init();
+  client->share = curl_share_init();
+  if (client->curl == NULL || client->share == NULL) {
+    HTTP_CLIENT_destroy(client);
+    return 1;
+  }
+
+  /* cache connections, TLS sessions and DNS lookups between requests */
+  curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+  curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
+
+  /* an empty file name starts the cookie engine without reading anything */
+  curl_easy_setopt(client->curl, CURLOPT_COOKIEFILE, "");
+  curl_easy_setopt(client->curl, CURLOPT_SHARE, client->share);
+
+  return 0;
+}
+
+void HTTP_CLIENT_destroy(HTTP_CLIENT *client)
+{
+  http_cancel(client);
+
+  if (client->curl != NULL) {
+    curl_easy_cleanup(client->curl);
+    client->curl = NULL;
+  }
+  if (client->share != NULL) {
+    curl_share_cleanup(client->share);
+    client->share = NULL;
+  }
+  deinit_string(&client->compressed);
+}
+
+void http_set_compression(HTTP_CLIENT *client, int level, size_t threshold)
+{
+  client->compression_level = level;
+  client->compression_threshold = threshold;
+}
+
+static int compresses(HTTP_CLIENT *client, size_t len)
+{
+  /* returns whether the client sends a body of len bytes compressed */
+  return (client != NULL &&
+	  client->compression_level > 0 &&
+	  len >= client->compression_threshold);
+}
+
+int http_compress(int level, const char *data, size_t len, string *out)
+{
+  z_stream stream;
+  int err;
+
+  reset_string(out);
+  if (len > UINT_MAX) {
+    return 1;
+  }
+
+  /* 16 more window bits asks for a gzip header and trailer */
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream,
+		   level,
+		   Z_DEFLATED,
+		   15 + 16,
+		   8,
+		   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return 1;
+  }
+
+  /* deflateBound leaves room for all of it, even if it does not shrink */
+  if (reserve_string(out, deflateBound(&stream, len))) {
+    deflateEnd(&stream);
+    return 1;
+  }
+  stream.next_in = (Bytef *) data;
+  stream.avail_in = (uInt) len;
+  stream.next_out = (Bytef *) out->ptr;
+  stream.avail_out = (uInt) (out->size - 1);
+  err = deflate(&stream, Z_FINISH);
+  if (err == Z_STREAM_END) {
+    out->len = stream.total_out;
+  }
+  out->ptr[out->len] = '\0';
+  deflateEnd(&stream);
+
+  return (out->len == 0);
+}
+
+int http_load_cookies(HTTP_CLIENT *client, char *path)
+{
+  char line[1024];
+  int loaded;
+  FILE *f;
+
+  strncpy(client->cookie_path, path, sizeof(client->cookie_path) - 1);
+  client->cookie_path[sizeof(client->cookie_path) - 1] = '\0';
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    return 1;
+  }
+
+  /* each line is a cookie in the Netscape format written by curl */
+  loaded = 0;
+  while (fgets(line, sizeof(line), f)) {
+    /* the fields are tab separated, so only the line ending is stripped */
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] != '\0') {
+      curl_easy_setopt(client->curl, CURLOPT_COOKIELIST, line);
+      loaded = 1;
+    }
+  }
+  fclose(f);
+
+  return !loaded;
+}
+
+int http_save_cookies(HTTP_CLIENT *client)
+{
+  char tmp_path[270];
+  struct curl_slist *cookies = NULL;
+  struct curl_slist *cookie;
+  int err;
+  int fd;
+  FILE *f;
+
+  client->cookies_changed = 0;
+  if (client->cookie_path[0] == '\0') {
+    return 0;
+  }
+
+  if (curl_easy_getinfo(client->curl, CURLINFO_COOKIELIST, &cookies) !=
+      CURLE_OK) {
+    return 1;
+  }
+
+  /* write a new file and rename it over the old so it is never half-written */
+  sprintf(tmp_path, "%s.tmp", client->cookie_path);
+  fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0 || (f = fdopen(fd, "w")) == NULL) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    curl_slist_free_all(cookies);
+    return 1;
+  }
+
+  for (cookie = cookies; cookie != NULL; cookie = cookie->next) {
+    fprintf(f, "%s\n", cookie->data);
+  }
+  curl_slist_free_all(cookies);
+
+  err = (fflush(f) != 0 || fsync(fileno(f)) != 0);
+  err |= (fclose(f) != 0);
+  if (err || rename(tmp_path, client->cookie_path) != 0) {
+    unlink(tmp_path);
+    return 1;
+  }
+
+  return 0;
+}
+
+static CURL *start_request(HTTP_CLIENT *client,
+			   char *url,
+			   char *cookie_file_path_up,
+			   char *cookie_file_path_down,
+			   string *s)
+{
+  /*
+    return an easy handle set up with the options common to every request:
+    the client's handle, reset but with its connection cache intact, or a
+    one-off handle if no client is given
+  */
+  CURL *curl;
+
+  if (client != NULL) {
+    curl = client->curl;
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_SHARE, client->share);
+
+    /* keep using the cookies held in memory */
+    curl_easy_setopt(curl, CURLOPT_COOKIEFILE, "");
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, client);
+  } else {
+    curl = curl_easy_init();
+    if (curl == NULL) {
+      return NULL;
+    }
+  }
+
+  /* specify target URL */
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+
+  /* keep idle connections alive between readings */
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+  /* provide cookie (up) with request, if given */
+  if (cookie_file_path_up != NULL) {
+    curl_easy_setopt(curl, CURLOPT_COOKIEFILE, cookie_file_path_up);
+  }
+
+  /* write all cookies to the cookie path (down), if given */
+  if (cookie_file_path_down != NULL) {
+    curl_easy_setopt(curl, CURLOPT_COOKIEJAR, cookie_file_path_down);
+  }
+
+  /* set timeout at 60 seconds, giving up on connecting after 10 */
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+
+  /* While certificates are self-signed, ignore peer verification */
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+
+  /* set a callback function to return the data */
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+
+  /* passing the pointer to the response as the callback parameter */
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, s);
+
+  return curl;
+}
+
+static int end_request(HTTP_CLIENT *client, CURL *curl, CURLcode curl_code)
+{
+  /*
+    clean up after the request on the given handle finished with curl_code,
+    and return its http code, or 0 if the request failed
+  */
+  long ret = 0;
+
+  /* code is 0 if the operation went through, if so return the http code */
+  if (curl_code == CURLE_OK) {
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+  }
+
+  /* one-off handles are not kept */
+  if (client == NULL) {
+    curl_easy_cleanup(curl);
+    return (int) ret;
+  }
+
+  if (client->cookies_changed) {
+    http_save_cookies(client);
+  }
+  /* a 304 keeps the validators of the copy held, which is still current */
+  if (client->validators != NULL && ret == 200) {
+    *client->validators = client->response_validators;
+  }
+  client->validators = NULL;
+  client->received = NULL;
+  curl_slist_free_all(client->headers);
+  client->headers = NULL;
+
+  return (int) ret;
+}
+
+static int finish_request(HTTP_CLIENT *client,
+			  CURL *curl,
+			  struct curl_slist *headers)
+{
+  /*
+    perform the request set up on the given handle and return its http code,
+    or 0 if the request failed; or if the client was given a multi, start the
+    request there and return HTTP_PENDING. The headers are freed once the
+    request is over
+  */
+  HTTP_MULTI *multi;
+  int ret;
+
+  if (client == NULL) {
+    ret = end_request(client, curl, curl_easy_perform(curl));
+    curl_slist_free_all(headers);
+    return ret;
+  }
+  client->headers = headers;
+
+  multi = client->multi;
+  client->multi = NULL;
+  if (multi == NULL) {
+    return end_request(client, curl, curl_easy_perform(curl));
+  }
+
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, client);
+  if (curl_multi_add_handle(multi->multi, curl) != CURLM_OK) {
+    end_request(client, curl, CURLE_FAILED_INIT);
+    return 0;
+  }
+  client->multi = multi;
+  client->pending = 1;
+
+  return HTTP_PENDING;
+}
+
+static void check_multi(HTTP_MULTI *multi)
+{
+  /* end the requests that completed and let their callers know */
+  CURLMsg *message;
+  HTTP_CLIENT *client;
+  HTTP_DONE done;
+  CURL *curl;
+  int queued;
+  int ret;
+
+  while ((message = curl_multi_info_read(multi->multi, &queued)) != NULL) {
+    if (message->msg != CURLMSG_DONE) {
+      continue;
+    }
+    curl = message->easy_handle;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **) &client);
+    ret = end_request(client, curl, message->data.result);
+    curl_multi_remove_handle(multi->multi, curl);
+
+    /* the client is free for another request by the time done is called */
+    client->pending = 0;
+    client->multi = NULL;
+    done = client->done;
+    client->done = NULL;
+    if (done != NULL) {
+      done(client->done_data, ret);
+    }
+  }
+}
+
+static void socket_ready(void *data, int fd, uint32_t events)
+{
+  HTTP_MULTI *multi = (HTTP_MULTI *) data;
+  int flags = 0;
+  int running;
+
+  if (events & EPOLLIN) {
+    flags |= CURL_CSELECT_IN;
+  }
+  if (events & EPOLLOUT) {
+    flags |= CURL_CSELECT_OUT;
+  }
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    flags |= CURL_CSELECT_ERR;
+  }
+  curl_multi_socket_action(multi->multi, fd, flags, &running);
+  check_multi(multi);
+}
+
+static void timeout_expired(void *data, int fd, uint32_t events)
+{
+  HTTP_MULTI *multi = (HTTP_MULTI *) data;
+  int running;
+
+  (void) fd;
+  (void) events;
+  curl_multi_socket_action(multi->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+  check_multi(multi);
+}
+
+static int watch_socket(CURL *curl,
+			curl_socket_t socket,
+			int what,
+			void *data,
+			void *socket_data)
+{
+  /* curl saying which of its sockets to watch, and for what */
+  HTTP_MULTI *multi = (HTTP_MULTI *) data;
+  EVENT_WATCH *watch = (EVENT_WATCH *) socket_data;
+  uint32_t events = 0;
+
+  (void) curl;
+  if (what == CURL_POLL_REMOVE) {
+    if (watch != NULL) {
+      event_watch_free(multi->loop, watch);
+      curl_multi_assign(multi->multi, socket, NULL);
+    }
+    return 0;
+  }
+
+  if (what == CURL_POLL_IN || what == CURL_POLL_INOUT) {
+    events |= EPOLLIN;
+  }
+  if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT) {
+    events |= EPOLLOUT;
+  }
+
+  if (watch != NULL) {
+    return event_modify(multi->loop, watch, events) ? -1 : 0;
+  }
+  watch = event_watch_new(multi->loop, socket, events, socket_ready, multi);
+  if (watch == NULL) {
+    return -1;
+  }
+  curl_multi_assign(multi->multi, socket, watch);
+  return 0;
+}
+
+static int set_timeout(CURLM *curlm, long timeout_ms, void *data)
+{
+  /* curl asking to be called back after timeout_ms, or not at all for -1 */
+  HTTP_MULTI *multi = (HTTP_MULTI *) data;
+
+  (void) curlm;
+  if (timeout_ms < 0) {
+    timer_cancel(&multi->timer);
+    return 0;
+  }
+  return timer_after(&multi->timer, timeout_ms) ? -1 : 0;
+}
+
+int HTTP_MULTI_init(HTTP_MULTI *multi, EVENT_LOOP *loop)
+{
+  multi->loop = loop;
+  multi->multi = curl_multi_init();
+  if (multi->multi == NULL) {
+    return 1;
+  }
+  if (EVENT_TIMER_init(&multi->timer, loop, timeout_expired, multi)) {
+    curl_multi_cleanup(multi->multi);
+    multi->multi = NULL;
+    return 1;
+  }
+
+  curl_multi_setopt(multi->multi, CURLMOPT_SOCKETFUNCTION, watch_socket);
+  curl_multi_setopt(multi->multi, CURLMOPT_SOCKETDATA, multi);
+  curl_multi_setopt(multi->multi, CURLMOPT_TIMERFUNCTION, set_timeout);
+  curl_multi_setopt(multi->multi, CURLMOPT_TIMERDATA, multi);
+
+  return 0;
+}
+
+void HTTP_MULTI_destroy(HTTP_MULTI *multi)
+{
+  /* the clients' requests must have been abandoned already */
+  if (multi->multi != NULL) {
+    curl_multi_cleanup(multi->multi);
+    multi->multi = NULL;
+  }
+  EVENT_TIMER_destroy(&multi->timer);
+}
+
+void http_run_on(HTTP_CLIENT *client,
+		 HTTP_MULTI *multi,
+		 HTTP_DONE done,
+		 void *data)
+{
+  client->multi = multi;
+  client->done = done;
+  client->done_data = data;
+}
+
+void http_cancel(HTTP_CLIENT *client)
+{
+  if (client->pending) {
+    curl_multi_remove_handle(client->multi->multi, client->curl);
+    client->pending = 0;
+  }
+  client->multi = NULL;
+  client->done = NULL;
+  client->validators = NULL;
+  client->received = NULL;
+  curl_slist_free_all(client->headers);
+  client->headers = NULL;
+}
+
+int http_PUT(HTTP_CLIENT *client,
+	     char *url,
 	     char *cookie_file_path_up,
 	     char *cookie_file_path_down,
 	     char *header,
@@ -136,7 +671,6 @@ int http_PUT(char *url,
   struct stat file_info;
   
   CURL *curl;
-  CURLcode curl_code;
   struct curl_slist *slist = NULL;
   
   /* get request file size */
@@ -154,76 +688,51 @@ int http_PUT(char *url,
     return 0;
   }
 
-  curl = curl_easy_init();
-  if (curl) {
-    /* Set header to given header */
-    slist = curl_slist_append(slist, header);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
-    
-    /* enable uploading */
-    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
-
-    /* Set operation to PUT */
-    curl_easy_setopt(curl, CURLOPT_PUT, 1L);
-    
-    /* specify target URL */
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    
-    /* provide cookie (up) with request, if given */
-    if (cookie_file_path_up != NULL) {
-      curl_easy_setopt(curl, CURLOPT_COOKIEFILE, cookie_file_path_up);
-    }
-    
-    /* write all cookies to the cookie path (down), if given */
-    if (cookie_file_path_down != NULL) {
-      curl_easy_setopt(curl, CURLOPT_COOKIEJAR, cookie_file_path_down);
-    }
-    
-    /* set timeout at 60 seconds */
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60);
-
-    /* While certificates are self-signed, ignore peer verification */
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-        
-    /* setting a callback function to return the data */
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    
-    /* passing the pointer to the response as the callback parameter */
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, s);
-
-    /* now specify to upload file */
-    curl_easy_setopt(curl, CURLOPT_READDATA, (void *) request_file);
-    
-    /* provide the size of the upload */
-    curl_easy_setopt(curl, 
-		     CURLOPT_INFILESIZE_LARGE,
-		     (curl_off_t) file_info.st_size);
-
-    /* perform the PUT request */
-    curl_code = curl_easy_perform(curl);
+  curl = start_request(client,
+		       url,
+		       cookie_file_path_up,
+		       cookie_file_path_down,
+		       s);
+  if (curl == NULL) {
+    fclose(request_file);
+    return 0;
   }
 
-  /* code is 0 if the operation went through, if so return the http code */
-  if (curl_code == 0) {
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-  } else {
-    ret = 0;
+  /* Set header to given header */
+  slist = curl_slist_append(slist, header);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
+
+  /* enable uploading, which makes this a PUT operation */
+  curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+
+  /* now specify to upload file */
+  curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_callback);
+  curl_easy_setopt(curl, CURLOPT_READDATA, (void *) request_file);
+
+  /* provide the size of the upload */
+  curl_easy_setopt(curl,
+		   CURLOPT_INFILESIZE_LARGE,
+		   (curl_off_t) file_info.st_size);
+
+  /* perform the PUT request, blocking since the file is closed after it */
+  if (client != NULL) {
+    client->multi = NULL;
   }
+  ret = finish_request(client, curl, slist);
 
-  curl_slist_free_all(slist);
   fclose(request_file); 
-  curl_easy_cleanup(curl);   
   
   return ret;
 }
 
-int http_PUT_JSON(char *url,
+int http_PUT_JSON(HTTP_CLIENT *client,
+		  char *url,
 		  char *cookie_file_path_up,
 		  char *cookie_file_path_down,
 		  char *request_file_path,
 		  string *s) {
-  int ret =  http_PUT(url, 
+  int ret =  http_PUT(client,
+		      url,
 		      cookie_file_path_up, 
 		      cookie_file_path_down, 
 		      "Content-Type: application/json", 
@@ -233,126 +742,206 @@ int http_PUT_JSON(char *url,
   
 }
 
-int http_POST(char *url,
+static int send_buffer(HTTP_CLIENT *client,
+		       char *method,
+		       char *url,
+		       char *cookie_file_path_up,
+		       char *cookie_file_path_down,
+		       char *header,
+		       string *body,
+		       string *s)
+{
+  /*
+    send the contents of body with the given method (PUT or POST) straight
+    from memory, or compressed if the client compresses a body its size,
+    returning the http code or 0 if the request failed
+  */
+  CURL *curl;
+  struct curl_slist *slist = NULL;
+
+  curl = start_request(client,
+		       url,
+		       cookie_file_path_up,
+		       cookie_file_path_down,
+		       s);
+  if (curl == NULL) {
+    return 0;
+  }
+
+  /* Set header to given header, and skip waiting for 100-continue */
+  if (header != NULL) {
+    slist = curl_slist_append(slist, header);
+  }
+  slist = curl_slist_append(slist, "Expect:");
+
+  /* a body that fails to compress is sent as it is */
+  if (compresses(client, body->len) &&
+      !http_compress(client->compression_level,
+		     body->ptr,
+		     body->len,
+		     &client->compressed)) {
+    slist = curl_slist_append(slist, "Content-Encoding: gzip");
+    body = &client->compressed;
+  }
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
+
+  /* the body is sent from memory, without copying it again */
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) body->len);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->ptr);
+  curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+
+  return finish_request(client, curl, slist);
+}
+
+int http_PUT_buffer(HTTP_CLIENT *client,
+		    char *url,
+		    char *cookie_file_path_up,
+		    char *cookie_file_path_down,
+		    char *header,
+		    string *body,
+		    string *s)
+{
+  return send_buffer(client,
+		     "PUT",
+		     url,
+		     cookie_file_path_up,
+		     cookie_file_path_down,
+		     header,
+		     body,
+		     s);
+}
+
+int http_PUT_JSON_buffer(HTTP_CLIENT *client,
+			 char *url,
+			 char *cookie_file_path_up,
+			 char *cookie_file_path_down,
+			 string *body,
+			 string *s)
+{
+  return http_PUT_buffer(client,
+			 url,
+			 cookie_file_path_up,
+			 cookie_file_path_down,
+			 "Content-Type: application/json",
+			 body,
+			 s);
+}
+
+int http_POST_buffer(HTTP_CLIENT *client,
+		     char *url,
+		     char *cookie_file_path_up,
+		     char *cookie_file_path_down,
+		     char *header,
+		     string *body,
+		     string *s)
+{
+  return send_buffer(client,
+		     "POST",
+		     url,
+		     cookie_file_path_up,
+		     cookie_file_path_down,
+		     header,
+		     body,
+		     s);
+}
+
+int http_POST(HTTP_CLIENT *client,
+	      char *url,
               char *cookie_file_path_up,
 	      char *cookie_file_path_down,
 	      char *header,
 	      char *postfields,
 	      string *s)
 {
-  int ret;
-
   CURL *curl;
-  CURLcode curl_code;
   struct curl_slist *slist = NULL;
   
-  curl = curl_easy_init();
-  
-  if(curl) {
-    /* specify target URL */
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-
-    /* Set header to given header  */
-    if (header != NULL) {
-      curl_slist_append(slist, header);
-      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
-    }
-    /* provide cookie (up) with request, if given */
-    if (cookie_file_path_up != NULL) {
-      curl_easy_setopt(curl, CURLOPT_COOKIEFILE, cookie_file_path_up);
-    }
-    
-    /* write all cookies to the cookie path (down), if given */
-    if (cookie_file_path_down != NULL) {
-      curl_easy_setopt(curl, CURLOPT_COOKIEJAR, cookie_file_path_down);
-    }
-
-    /* set the postfields for the request  */
-    if (postfields != NULL) {
-      /* added a null option here because libcurl IS A DUMMIE */
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postfields);
-    }
-
-    /* While certificates are self-signed, ignore peer verification */
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-
-    /* set a callback function to return the data */
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-
-    /* passing the pointer to the response as the callback parameter */
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, s);
+  curl = start_request(client,
+		       url,
+		       cookie_file_path_up,
+		       cookie_file_path_down,
+		       s);
+  if (curl == NULL) {
+    return 0;
+  }
 
-    /* perform the POST request */
-    curl_code = curl_easy_perform(curl);
+  /* Set header to given header  */
+  if (header != NULL) {
+    slist = curl_slist_append(slist, header);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
   }
-  
-  /* code is 0 if the operation succeeded, in which case return the http code */
-  if (curl_code == 0) {
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-  } else {
-    ret = 0;
+
+  /* set the postfields for the request  */
+  if (postfields != NULL) {
+    /* copied, since a request on a multi outlives the caller's buffer */
+    curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, postfields);
   }
-  
-  curl_slist_free_all(slist);
-  curl_easy_cleanup(curl);
-  
-  return ret;
+
+  /* perform the POST request */
+  return finish_request(client, curl, slist);
 }
 
-int http_GET(char *url,
+int http_GET(HTTP_CLIENT *client,
+	     char *url,
 	     char *cookie_file_path_up,
 	     char *cookie_file_path_down,
 	     string *s)
 {
-  int ret;
+  CURL *curl;
   
+  curl = start_request(client,
+		       url,
+		       cookie_file_path_up,
+		       cookie_file_path_down,
+		       s);
+  if (curl == NULL) {
+    return 0;
+  }
+
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+
+  /* perform the GET request */
+  return finish_request(client, curl, NULL);
+}
+
+int http_GET_conditional(HTTP_CLIENT *client,
+			 char *url,
+			 HTTP_VALIDATORS *validators,
+			 string *s)
+{
+  char header[300];
+
   CURL *curl;
-  CURLcode curl_code;
   struct curl_slist *slist = NULL;
-  
-  curl = curl_easy_init();
-  if (curl) {
-    /* set the URL to what was given by the function callee */
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-
-    /* provide cookie (up) with request, if given */
-    if (cookie_file_path_up != NULL) {
-      curl_easy_setopt(curl, CURLOPT_COOKIEFILE, cookie_file_path_up);
-    }
-    
-    /* write all cookies to the cookie path (down), if given */
-    if (cookie_file_path_down != NULL) {
-      curl_easy_setopt(curl, CURLOPT_COOKIEJAR, cookie_file_path_down);
-    }
 
-    /* While certificates are self-signed, ignore peer verification */
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);    
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+  curl = start_request(client, url, NULL, NULL, s);
+  if (curl == NULL) {
+    return 0;
+  }
+
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 
-    /* set a callback function to return the data */
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    
-    /* passing the pointer to the response as the callback parameter */
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, s);
-    
-    /* perform the GET request */
-    curl_code = curl_easy_perform(curl);    
+  /* ask for the resource only if it differs from the copy held */
+  if (validators->etag[0] != '\0') {
+    snprintf(header, sizeof(header), "If-None-Match: %s", validators->etag);
+    slist = curl_slist_append(slist, header);
   }
-  
-  /* code is 0 if the operation succeeded, in which case return the http code */
-  if (curl_code == 0) {
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-  } else {
-    ret = 0;
+  if (validators->last_modified[0] != '\0') {
+    snprintf(header,
+	     sizeof(header),
+	     "If-Modified-Since: %s",
+	     validators->last_modified);
+    slist = curl_slist_append(slist, header);
   }
-  
-  curl_slist_free_all(slist);
-  curl_easy_cleanup(curl);
-  
-  return ret;
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
+
+  /* the validators are replaced once a 200 response is complete */
+  client->response_validators.etag[0] = '\0';
+  client->response_validators.last_modified[0] = '\0';
+  client->received = &client->response_validators;
+  client->validators = validators;
+
+  return finish_request(client, curl, slist);
 }
 
 
@@ -5,11 +5,131 @@
 #include <sys/stat.h>
 
 #include "misc-structs.h"
+#include "event-loop.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+  the validators a server gave for a resource, sent back with a conditional
+  GET so an unchanged resource is answered with 304 and no body; empty
+  strings if the server gave none
+*/
+typedef struct {
+  char etag[255];
+  char last_modified[255];
+} HTTP_VALIDATORS;
+
+/*
+  returned in place of the http code by a request started on an event loop,
+  which passes its http code to a callback once it completes
+*/
+#define HTTP_PENDING -1
+
+/* called with the http code of a request, or 0 if it failed */
+typedef void (*HTTP_DONE)(void *data, int http_response_code);
+
+/*
+  replace the contents of out with the len bytes at data compressed with
+  gzip at the given level; returns 0 on success
+*/
+int http_compress(int level, const char *data, size_t len, string *out);
+
+/*
+  curl's multi interface driven by an event loop: the sockets of running
+  requests are watched on the loop and curl's timeouts are kept with a timer,
+  so requests progress while the loop goes on with other work
+*/
+typedef struct {
+  CURLM *multi;
+  EVENT_LOOP *loop;
+  EVENT_TIMER timer;
+} HTTP_MULTI;
+
+/*
+  a persistent HTTP client; the easy handle and the share object are kept
+  between requests so connections are reused and TLS sessions resumed
+  instead of being set up again for every request. Session cookies are held
+  in memory, and written to cookie_path (if set) only when the server
+  changes them.
+*/
+typedef struct {
+  CURL *curl;
+  CURLSH *share;
+
+  char cookie_path[255];
+  int cookies_changed;
+
+  HTTP_VALIDATORS *received; /* validators of the current response, if kept */
+  HTTP_VALIDATORS *validators; /* replaced by received on a 200 */
+  HTTP_VALIDATORS response_validators;
+
+  /* where the next request runs, and what is called when it completes */
+  HTTP_MULTI *multi;
+  HTTP_DONE done;
+  void *done_data;
+
+  int pending; /* whether a request is running on a multi */
+  struct curl_slist *headers; /* of the running request */
+
+  /*
+    bodies sent from memory of at least compression_threshold bytes are
+    sent compressed with gzip at compression_level, or never if that is 0
+  */
+  int compression_level;
+  size_t compression_threshold;
+  string compressed; /* the compressed body of the running request */
+} HTTP_CLIENT;
+
+int HTTP_CLIENT_init(HTTP_CLIENT *client);
+
+/* a request still running on a multi is abandoned */
+void HTTP_CLIENT_destroy(HTTP_CLIENT *client);
+
+/*
+  have the client compress the bodies it sends of at least threshold bytes
+  at the given zlib level (1 to 9), or not at all if the level is 0
+*/
+void http_set_compression(HTTP_CLIENT *client, int level, size_t threshold);
+
+/* drive requests from the given loop; returns 0 on success */
+int HTTP_MULTI_init(HTTP_MULTI *multi, EVENT_LOOP *loop);
+
+void HTTP_MULTI_destroy(HTTP_MULTI *multi);
+
+/*
+  have the next request made with the client run on multi instead of
+  blocking: the request function returns HTTP_PENDING once the request is
+  started, and done is called with data and the http code when it completes,
+  or returns 0 (without calling done) if the request could not be started.
+  A client runs one request at a time. http_PUT, which streams a file,
+  always blocks
+*/
+void http_run_on(HTTP_CLIENT *client,
+		 HTTP_MULTI *multi,
+		 HTTP_DONE done,
+		 void *data);
+
+/*
+  abandon the request running on a multi, if any, without calling done; the
+  client is then free for another request
+*/
+void http_cancel(HTTP_CLIENT *client);
+
+/*
+  load the session cookies saved at the given path into the client and keep
+  saving them there whenever they change; returns 0 if any cookies were
+  loaded, or 1 if there were none
+*/
+int http_load_cookies(HTTP_CLIENT *client, char *path);
+
+/*
+  atomically replace the client's cookie file with its current cookies;
+  returns 0 on success
+*/
+int http_save_cookies(HTTP_CLIENT *client);
+
 char *strcat_percent_encoded(char *destination, char *source);
 
 char *start_postfield(char *destination, char *fieldname, char *fieldvalue);
@@ -29,35 +149,84 @@ size_t read_callback(void *ptr,
 /*
   perform a http PUT operation, place the response in the provided buffer and
   return the return code of the operation (i.e. 200, 404, 303 etc) or 0 if
-  request failed
+  request failed. The file is sent as it is, never compressed
 
   arguments:
+    client           - persistent client to use, or NULL for a one-off request
     url              - destination URL for the PUT operation
     cookie_file_path - path of the cookie file for the request (if any)
     header           - header of the request
     request_file     - file to PUT
     buffer           - buffer to place response
 */
-int http_PUT(char *url,
+int http_PUT(HTTP_CLIENT *client,
+	     char *url,
 	     char *cookie_file_path_up,
 	     char *cookie_file_down,
 	     char *header,
-	     char *body,
+	     char *request_file,
 	     struct string *s);
 
-int http_PUT_JSON(char *url, char *cookie_file_path_up, char *cookie_file_path_down, char *request_file_path, struct string *s);
+int http_PUT_JSON(HTTP_CLIENT *client,
+		  char *url,
+		  char *cookie_file_path_up,
+		  char *cookie_file_path_down,
+		  char *request_file_path,
+		  struct string *s);
+/*
+  perform a http PUT operation with a body held in memory, place the response
+  in the provided buffer and return the return code of the operation (i.e.
+  200, 404, 303 etc) or 0 if request failed; nothing touches the filesystem
+  unless cookie files are given
+
+  arguments:
+    client           - persistent client to use, or NULL for a one-off request
+    url              - destination URL for the PUT operation
+    cookie_file_path - path of the cookie file for the request (if any)
+    header           - header of the request (if any)
+    body             - body of the request
+    buffer           - buffer to place response
+*/
+int http_PUT_buffer(HTTP_CLIENT *client,
+		    char *url,
+		    char *cookie_file_path_up,
+		    char *cookie_file_path_down,
+		    char *header,
+		    struct string *body,
+		    struct string *s);
+
+int http_PUT_JSON_buffer(HTTP_CLIENT *client,
+			 char *url,
+			 char *cookie_file_path_up,
+			 char *cookie_file_path_down,
+			 struct string *body,
+			 struct string *s);
+
+/*
+  as http_PUT_buffer, but perform a http POST operation
+*/
+int http_POST_buffer(HTTP_CLIENT *client,
+		     char *url,
+		     char *cookie_file_path_up,
+		     char *cookie_file_path_down,
+		     char *header,
+		     struct string *body,
+		     struct string *s);
+
 /*
   perform a http POST operation, place the reposnse in the provided buffer
   and return the return code of the operation (i.e. 200, 404, 303 etc)
 
   arguments:
+    client      - persistent client to use, or NULL for a one-off request
     url         - destination URL for the POST operation
     cookie_file_path - path of the cookie file for the request (if any)
     header      - header of the request
     postfields  - body of the request
     buffer      - buffer to place response
 */
-int http_POST(char *url,
+int http_POST(HTTP_CLIENT *client,
+	      char *url,
               char *cookie_file_path_up,
 	      char *cookie_file_down,
 	      char *header,
@@ -69,15 +238,34 @@ int http_POST(char *url,
   return the return code of the operation (i.e. 200, 404, 303 etc)
 
   arguments:
+    client           - persistent client to use, or NULL for a one-off request
     url              - destination URL for the GET operation
     cookie_file_path - path of the cookie file for the request (if any)
     buffer           - buffer to place the response
 */
-int http_GET(char *url,
+int http_GET(HTTP_CLIENT *client,
+	     char *url,
 	     char *cookie_file_path_up,
 	     char *cookie_file_down,
 	     struct string *s);
 
+/*
+  perform a http GET operation that is answered with 304 (and nothing placed
+  in the buffer) if the resource still matches the given validators; on a 200
+  response the validators are replaced with those of the new response. Returns
+  the http code, or 0 if the request failed
+
+  arguments:
+    client           - persistent client to use
+    url              - destination URL for the GET operation
+    validators       - validators of the copy held by the caller
+    buffer           - buffer to place the response
+*/
+int http_GET_conditional(HTTP_CLIENT *client,
+			 char *url,
+			 HTTP_VALIDATORS *validators,
+			 struct string *s);
+
 /*
   perform a http DELETE operation, place the response in the provided buffer 
   and return the return code of the operation (i.e. 200, 404, 303, etc)
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+/* the header gets a page of its own so syncing it never touches records */
+#define JOURNAL_HEADER_SIZE 4096
+
+static uint32_t record_checksum(JOURNAL_RECORD *record)
+{
+  /* FNV-1a over every field of the record preceding the checksum */
+  const uint8_t *bytes = (const uint8_t *) record;
+  uint32_t hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < offsetof(JOURNAL_RECORD, checksum); i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static JOURNAL_RECORD *record_slot(JOURNAL *journal, uint64_t sequence)
+{
+  return &journal->records[sequence % journal->header->capacity];
+}
+
+static int record_valid(JOURNAL *journal, uint64_t sequence)
+{
+  /* whether the slot for sequence holds that record, completely written */
+  JOURNAL_RECORD *record = record_slot(journal, sequence);
+
+  return (record->sequence == sequence &&
+	  record->checksum == record_checksum(record));
+}
+
+static int header_valid(JOURNAL_HEADER *header, size_t file_size)
+{
+  return (header->magic == JOURNAL_MAGIC &&
+	  header->version == JOURNAL_VERSION &&
+	  header->record_size == sizeof(JOURNAL_RECORD) &&
+	  header->capacity > 0 &&
+	  file_size == JOURNAL_HEADER_SIZE +
+	  (size_t) header->capacity * sizeof(JOURNAL_RECORD) &&
+	  header->tail <= header->head);
+}
+
+int JOURNAL_open(JOURNAL *journal,
+		 char *path,
+		 uint32_t capacity,
+		 int sync_every)
+{
+  /*
+    open the journal at path, creating it with room for capacity records if
+    it does not exist or is not a valid journal; an existing journal keeps its
+    own capacity so no readings are lost. Returns 0 on success or 1.
+  */
+  struct stat file_info;
+  JOURNAL_HEADER header;
+  size_t map_size;
+  void *map;
+  int fresh;
+
+  memset(journal, 0, sizeof(JOURNAL));
+  journal->fd = -1;
+
+  journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (journal->fd < 0 || fstat(journal->fd, &file_info) < 0) {
+    JOURNAL_close(journal);
+    return 1;
+  }
+
+  fresh = 1;
+  if ((size_t) file_info.st_size >= JOURNAL_HEADER_SIZE &&
+      pread(journal->fd, &header, sizeof(header), 0) == sizeof(header) &&
+      header_valid(&header, file_info.st_size)) {
+    capacity = header.capacity;
+    fresh = 0;
+  }
+
+  map_size = JOURNAL_HEADER_SIZE + (size_t) capacity * sizeof(JOURNAL_RECORD);
+  if (fresh) {
+    /* allocate the blocks up front so a full disk can't fault the mapping */
+    if (ftruncate(journal->fd, 0) < 0 ||
+	posix_fallocate(journal->fd, 0, map_size) != 0) {
+      JOURNAL_close(journal);
+      return 1;
+    }
+  }
+
+  map = mmap(NULL,
+	     map_size,
+	     PROT_READ | PROT_WRITE,
+	     MAP_SHARED,
+	     journal->fd,
+	     0);
+  if (map == MAP_FAILED) {
+    JOURNAL_close(journal);
+    return 1;
+  }
+  journal->map_size = map_size;
+  journal->header = (JOURNAL_HEADER *) map;
+  journal->records = (JOURNAL_RECORD *) ((uint8_t *) map + JOURNAL_HEADER_SIZE);
+  journal->sync_every = sync_every;
+
+  if (fresh) {
+    journal->header->magic = JOURNAL_MAGIC;
+    journal->header->version = JOURNAL_VERSION;
+    journal->header->capacity = capacity;
+    journal->header->record_size = sizeof(JOURNAL_RECORD);
+    journal->header->head = 0;
+    journal->header->tail = 0;
+    journal->header->overwritten = 0;
+    journal_sync(journal);
+  } else {
+    /* recover records appended after the header was last written out */
+    while (record_valid(journal, journal->header->head)) {
+      journal->header->head++;
+    }
+    if (journal->header->head - journal->header->tail > capacity) {
+      journal->header->tail = journal->header->head - capacity;
+    }
+  }
+
+  return 0;
+}
+
+void JOURNAL_close(JOURNAL *journal)
+{
+  if (journal->header != NULL) {
+    journal_sync(journal);
+    munmap(journal->header, journal->map_size);
+    journal->header = NULL;
+    journal->records = NULL;
+  }
+  if (journal->fd >= 0) {
+    close(journal->fd);
+    journal->fd = -1;
+  }
+}
+
+int journal_append(JOURNAL *journal, TIMED_READING *reading)
+{
+  /*
+    record the reading at the head of the journal, overwriting the oldest
+    record if the journal is full; returns 0 or 1 if a sync failed. Unless a
+    sync is due this is only a copy into the mapping.
+  */
+  JOURNAL_HEADER *header = journal->header;
+  JOURNAL_RECORD *record;
+  uint64_t sequence = header->head;
+
+  if (sequence - header->tail >= header->capacity) {
+    header->tail = sequence - header->capacity + 1;
+    header->overwritten++;
+  }
+
+  record = record_slot(journal, sequence);
+  record->sequence = sequence;
+  record->timestamp = reading->timestamp;
+  record->temperature = reading->temperature;
+  record->status = reading->status;
+  record->samples = reading->summary.samples;
+  record->min = reading->summary.min;
+  record->max = reading->summary.max;
+  record->mean = reading->summary.mean;
+  record->stddev = reading->summary.stddev;
+  record->median = reading->summary.median;
+  record->checksum = record_checksum(record);
+
+  /* only publish the record once it is complete */
+  __sync_synchronize();
+  header->head = sequence + 1;
+
+  if (journal->sync_every > 0 && ++journal->unsynced >= journal->sync_every) {
+    return journal_sync(journal);
+  }
+  return 0;
+}
+
+int journal_peek(JOURNAL *journal,
+		 TIMED_READING *readings,
+		 int max_readings,
+		 uint64_t *next)
+{
+  /*
+    copy up to max_readings of the oldest records not yet uploaded into
+    readings without removing them, returning how many were copied. The
+    sequence number following the records covered, including damaged ones
+    that were skipped, is placed in next for passing to journal_ack.
+  */
+  JOURNAL_HEADER *header = journal->header;
+  JOURNAL_RECORD *record;
+  uint64_t sequence;
+  int count = 0;
+
+  for (sequence = header->tail;
+       sequence < header->head && count < max_readings;
+       sequence++) {
+    if (!record_valid(journal, sequence)) {
+      continue;
+    }
+    record = record_slot(journal, sequence);
+    readings[count].timestamp = (time_t) record->timestamp;
+    readings[count].temperature = record->temperature;
+    readings[count].status = (READ_STATUS) record->status;
+    readings[count].summary.samples = record->samples;
+    readings[count].summary.min = record->min;
+    readings[count].summary.max = record->max;
+    readings[count].summary.mean = record->mean;
+    readings[count].summary.stddev = record->stddev;
+    readings[count].summary.median = record->median;
+    count++;
+  }
+
+  *next = sequence;
+  return count;
+}
+
+int journal_ack(JOURNAL *journal, uint64_t next)
+{
+  /*
+    mark the records before sequence number next as uploaded; returns 0 or 1
+    if the header could not be synced. Records appended since they were
+    peeked stay, even if the oldest were overwritten meanwhile
+  */
+  JOURNAL_HEADER *header = journal->header;
+
+  if (next > header->head) {
+    next = header->head;
+  }
+  if (next > header->tail) {
+    header->tail = next;
+  }
+
+  if (journal->sync_every > 0) {
+    return journal_sync(journal);
+  }
+  return 0;
+}
+
+uint64_t journal_pending(JOURNAL *journal)
+{
+  /* returns the number of records not yet uploaded */
+  return journal->header->head - journal->header->tail;
+}
+
+int journal_sync(JOURNAL *journal)
+{
+  /* flush the journal to disk; returns 0 or 1 on failure */
+  journal->unsynced = 0;
+  return (msync(journal->header, journal->map_size, MS_SYNC) != 0);
+}
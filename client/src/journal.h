@@ -0,0 +1,82 @@
+#ifndef __INC_JOURNAL_H
+#define __INC_JOURNAL_H
+
+#include <stdint.h>
+
+#include "batch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JOURNAL_MAGIC 0x4A4D5454 /* "TTMJ" */
+#define JOURNAL_VERSION 2
+
+/*
+  The journal is a fixed-size file mapped into memory: a header page followed
+  by capacity record slots used as a ring. Every record carries its sequence
+  number and a checksum, so records that were only partly written when the
+  program or the machine stopped are recognized and skipped, and records
+  written after the last header update are recovered when it is reopened.
+  Once the ring is full the oldest records are overwritten.
+*/
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;    /* number of record slots */
+  uint32_t record_size;
+  uint64_t head;        /* sequence number of the next record written */
+  uint64_t tail;        /* sequence number of the oldest record not uploaded */
+  uint64_t overwritten; /* records lost to wrap-around before upload */
+} JOURNAL_HEADER;
+
+typedef struct {
+  uint64_t sequence;
+  int64_t timestamp;
+  float temperature;
+  uint32_t status;
+  uint32_t samples;     /* the summary of an oversampled reading, if not 0 */
+  float min;
+  float max;
+  float mean;
+  float stddev;
+  float median;
+  uint32_t checksum;    /* over all of the fields above */
+} JOURNAL_RECORD;
+
+typedef struct {
+  int fd;
+  size_t map_size;
+  JOURNAL_HEADER *header;
+  JOURNAL_RECORD *records;
+
+  /* msync the journal every sync_every records; 0 leaves it to the kernel */
+  int sync_every;
+  int unsynced;
+} JOURNAL;
+
+int JOURNAL_open(JOURNAL *journal,
+		 char *path,
+		 uint32_t capacity,
+		 int sync_every);
+
+void JOURNAL_close(JOURNAL *journal);
+
+int journal_append(JOURNAL *journal, TIMED_READING *reading);
+
+int journal_peek(JOURNAL *journal,
+		 TIMED_READING *readings,
+		 int max_readings,
+		 uint64_t *next);
+
+int journal_ack(JOURNAL *journal, uint64_t next);
+
+uint64_t journal_pending(JOURNAL *journal);
+
+int journal_sync(JOURNAL *journal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_JOURNAL_H */
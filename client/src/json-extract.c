@@ -0,0 +1,503 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#include "json-extract.h"
+
+/* the position in the document being scanned and what was found so far */
+typedef struct {
+  const JSON_EXTRACTOR *extractor;
+  const char *p;
+  const char *end;
+  char *out;
+  uint32_t found;
+} JSON_SCANNER;
+
+int JSON_EXTRACTOR_init(JSON_EXTRACTOR *extractor,
+			const JSON_FIELD *fields,
+			int field_count)
+{
+  const char *key;
+  const char *dot;
+  int depth;
+  int i;
+
+  if (field_count < 0 || field_count > JSON_EXTRACT_MAX_FIELDS) {
+    return 1;
+  }
+  extractor->fields = fields;
+  extractor->field_count = field_count;
+
+  for (i = 0; i < field_count; i++) {
+    depth = 0;
+    for (key = fields[i].path; ; key = dot + 1) {
+      dot = strchr(key, '.');
+      if (dot == NULL) {
+	dot = key + strlen(key);
+      }
+      if (dot == key || depth == JSON_EXTRACT_MAX_DEPTH) {
+	return 1;
+      }
+      extractor->keys[i][depth] = key;
+      extractor->key_lengths[i][depth] = dot - key;
+      depth++;
+      if (*dot == '\0') {
+	break;
+      }
+    }
+    extractor->depth[i] = depth;
+  }
+
+  return 0;
+}
+
+static void skip_space(JSON_SCANNER *s)
+{
+  while (s->p < s->end &&
+	 (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r')) {
+    s->p++;
+  }
+}
+
+static int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static int scan_string(JSON_SCANNER *s,
+		       const char **start,
+		       size_t *len,
+		       int *escaped)
+{
+  /*
+    step over the string at the scanner, giving the span between its quotes;
+    returns 1 if it is malformed
+  */
+  int i;
+
+  s->p++;
+  *start = s->p;
+  *escaped = 0;
+  while (s->p < s->end && *s->p != '"') {
+    if ((unsigned char) *s->p < 0x20) {
+      return 1;
+    }
+    if (*s->p == '\\') {
+      *escaped = 1;
+      if (++s->p == s->end) {
+	return 1;
+      }
+      if (*s->p == 'u') {
+	for (i = 0; i < 4; i++) {
+	  if (++s->p == s->end || hex_digit(*s->p) < 0) {
+	    return 1;
+	  }
+	}
+      } else if (strchr("\"\\/bfnrt", *s->p) == NULL) {
+	return 1;
+      }
+    }
+    s->p++;
+  }
+  if (s->p == s->end) {
+    return 1;
+  }
+  *len = s->p - *start;
+  s->p++;
+  return 0;
+}
+
+static int scan_number(JSON_SCANNER *s, const char **start, size_t *len)
+{
+  /* step over the number at the scanner; returns 1 if it is malformed */
+  const char *p = s->p;
+  const char *digits;
+
+  *start = p;
+  if (p < s->end && *p == '-') {
+    p++;
+  }
+  digits = p;
+  while (p < s->end && *p >= '0' && *p <= '9') {
+    p++;
+  }
+  if (p == digits || (*digits == '0' && p - digits > 1)) {
+    return 1;
+  }
+  if (p < s->end && *p == '.') {
+    digits = ++p;
+    while (p < s->end && *p >= '0' && *p <= '9') {
+      p++;
+    }
+    if (p == digits) {
+      return 1;
+    }
+  }
+  if (p < s->end && (*p == 'e' || *p == 'E')) {
+    p++;
+    if (p < s->end && (*p == '+' || *p == '-')) {
+      p++;
+    }
+    digits = p;
+    while (p < s->end && *p >= '0' && *p <= '9') {
+      p++;
+    }
+    if (p == digits) {
+      return 1;
+    }
+  }
+
+  *len = p - *start;
+  s->p = p;
+  return 0;
+}
+
+static int put_utf8(char *dest, size_t size, size_t *n, unsigned long c)
+{
+  unsigned char bytes[4];
+  int count;
+  int i;
+
+  if (c < 0x80) {
+    bytes[0] = c;
+    count = 1;
+  } else if (c < 0x800) {
+    bytes[0] = 0xC0 | (c >> 6);
+    bytes[1] = 0x80 | (c & 0x3F);
+    count = 2;
+  } else if (c < 0x10000) {
+    bytes[0] = 0xE0 | (c >> 12);
+    bytes[1] = 0x80 | ((c >> 6) & 0x3F);
+    bytes[2] = 0x80 | (c & 0x3F);
+    count = 3;
+  } else {
+    bytes[0] = 0xF0 | (c >> 18);
+    bytes[1] = 0x80 | ((c >> 12) & 0x3F);
+    bytes[2] = 0x80 | ((c >> 6) & 0x3F);
+    bytes[3] = 0x80 | (c & 0x3F);
+    count = 4;
+  }
+
+  if (*n + count >= size) {
+    return 1;
+  }
+  for (i = 0; i < count; i++) {
+    dest[(*n)++] = bytes[i];
+  }
+  return 0;
+}
+
+static unsigned long read_hex4(const char *p)
+{
+  return (hex_digit(p[0]) << 12) | (hex_digit(p[1]) << 8) |
+    (hex_digit(p[2]) << 4) | hex_digit(p[3]);
+}
+
+static int unescape(const char *src, size_t len, char *dest, size_t size)
+{
+  /*
+    copy the string body src, already checked by scan_string, into dest with
+    its escapes decoded; returns 1 if it does not fit in size bytes
+  */
+  const char *end = src + len;
+  unsigned long c;
+  unsigned long low;
+  size_t n = 0;
+
+  while (src < end) {
+    if (*src != '\\') {
+      if (n + 1 >= size) {
+	return 1;
+      }
+      dest[n++] = *src++;
+      continue;
+    }
+
+    src++;
+    switch (*src++) {
+    case 'b': c = '\b'; break;
+    case 'f': c = '\f'; break;
+    case 'n': c = '\n'; break;
+    case 'r': c = '\r'; break;
+    case 't': c = '\t'; break;
+    case 'u':
+      c = read_hex4(src);
+      src += 4;
+      /* a character outside the BMP comes as a surrogate pair */
+      if (c >= 0xD800 && c < 0xDC00 && end - src >= 6 &&
+	  src[0] == '\\' && src[1] == 'u') {
+	low = read_hex4(src + 2);
+	if (low >= 0xDC00 && low < 0xE000) {
+	  c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+	  src += 6;
+	}
+      }
+      break;
+    default: c = src[-1]; break;
+    }
+    if (put_utf8(dest, size, &n, c)) {
+      return 1;
+    }
+  }
+
+  if (size == 0) {
+    return 1;
+  }
+  dest[n] = '\0';
+  return 0;
+}
+
+static int parse_int(const char *text, size_t len, int *value)
+{
+  /* the whole of text as an int, truncating a fraction; returns 1 if not */
+  char buffer[32];
+  char *end;
+  double number;
+
+  if (len == 0 || len >= sizeof(buffer)) {
+    return 1;
+  }
+  memcpy(buffer, text, len);
+  buffer[len] = '\0';
+
+  number = strtod(buffer, &end);
+  if (*end != '\0' || !isfinite(number) ||
+      number < INT_MIN || number > INT_MAX) {
+    return 1;
+  }
+  *value = (int) number;
+  return 0;
+}
+
+static void store(JSON_SCANNER *s,
+		  uint32_t fields,
+		  const char *text,
+		  size_t len,
+		  int escaped)
+{
+  /* write the scalar text into every field in fields that ends here */
+  const JSON_FIELD *field;
+  char *member;
+  int i;
+
+  for (i = 0; fields != 0; i++, fields >>= 1) {
+    if (!(fields & 1)) {
+      continue;
+    }
+    field = &s->extractor->fields[i];
+    member = s->out + field->offset;
+
+    if (field->type == JSON_FIELD_STRING) {
+      if (unescape(text, len, member, field->size)) {
+	continue;
+      }
+    } else if (escaped || parse_int(text, len, (int *) member)) {
+      continue;
+    }
+    s->found |= (uint32_t) 1 << i;
+  }
+}
+
+static int scan_value(JSON_SCANNER *s,
+		      int depth,
+		      uint32_t candidates,
+		      int nesting);
+
+static int scan_object(JSON_SCANNER *s,
+		       int depth,
+		       uint32_t candidates,
+		       int nesting)
+{
+  const JSON_EXTRACTOR *x = s->extractor;
+  const char *key;
+  size_t key_len;
+  int escaped;
+  uint32_t next;
+  int i;
+
+  s->p++;
+  skip_space(s);
+  if (s->p < s->end && *s->p == '}') {
+    s->p++;
+    return 0;
+  }
+
+  for (;;) {
+    skip_space(s);
+    if (s->p == s->end || *s->p != '"' ||
+	scan_string(s, &key, &key_len, &escaped)) {
+      return 1;
+    }
+    skip_space(s);
+    if (s->p == s->end || *s->p++ != ':') {
+      return 1;
+    }
+
+    /* narrow the candidates to the fields whose path goes on with this key */
+    next = 0;
+    if (depth < JSON_EXTRACT_MAX_DEPTH && !escaped) {
+      for (i = 0; i < x->field_count; i++) {
+	if ((candidates & ((uint32_t) 1 << i)) &&
+	    x->depth[i] > depth &&
+	    x->key_lengths[i][depth] == key_len &&
+	    memcmp(x->keys[i][depth], key, key_len) == 0) {
+	  next |= (uint32_t) 1 << i;
+	}
+      }
+    }
+
+    if (scan_value(s, depth + 1, next, nesting)) {
+      return 1;
+    }
+
+    skip_space(s);
+    if (s->p == s->end) {
+      return 1;
+    }
+    if (*s->p == '}') {
+      s->p++;
+      return 0;
+    }
+    if (*s->p++ != ',') {
+      return 1;
+    }
+  }
+}
+
+static int scan_array(JSON_SCANNER *s, int nesting)
+{
+  /* paths only go through objects, so nothing in an array is a candidate */
+  s->p++;
+  skip_space(s);
+  if (s->p < s->end && *s->p == ']') {
+    s->p++;
+    return 0;
+  }
+
+  for (;;) {
+    if (scan_value(s, JSON_EXTRACT_MAX_DEPTH, 0, nesting)) {
+      return 1;
+    }
+    skip_space(s);
+    if (s->p == s->end) {
+      return 1;
+    }
+    if (*s->p == ']') {
+      s->p++;
+      return 0;
+    }
+    if (*s->p++ != ',') {
+      return 1;
+    }
+  }
+}
+
+static int scan_literal(JSON_SCANNER *s, const char *literal)
+{
+  size_t len = strlen(literal);
+
+  if ((size_t) (s->end - s->p) < len || memcmp(s->p, literal, len) != 0) {
+    return 1;
+  }
+  s->p += len;
+  return 0;
+}
+
+static int scan_value(JSON_SCANNER *s,
+		      int depth,
+		      uint32_t candidates,
+		      int nesting)
+{
+  /*
+    step over the value at the scanner, storing it if it is a scalar that
+    ends the path of one of the candidates; returns 1 if it is malformed
+  */
+  const JSON_EXTRACTOR *x = s->extractor;
+  const char *text;
+  size_t len;
+  int escaped;
+  uint32_t ending;
+  int i;
+
+  skip_space(s);
+  if (s->p == s->end) {
+    return 1;
+  }
+
+  ending = 0;
+  for (i = 0; i < x->field_count; i++) {
+    if ((candidates & ((uint32_t) 1 << i)) && x->depth[i] == depth) {
+      ending |= (uint32_t) 1 << i;
+    }
+  }
+
+  switch (*s->p) {
+  case '{':
+    if (nesting == JSON_EXTRACT_MAX_NESTING) {
+      return 1;
+    }
+    return scan_object(s, depth, candidates, nesting + 1);
+  case '[':
+    if (nesting == JSON_EXTRACT_MAX_NESTING) {
+      return 1;
+    }
+    return scan_array(s, nesting + 1);
+  case '"':
+    if (scan_string(s, &text, &len, &escaped)) {
+      return 1;
+    }
+    store(s, ending, text, len, escaped);
+    return 0;
+  case 't':
+    return scan_literal(s, "true");
+  case 'f':
+    return scan_literal(s, "false");
+  case 'n':
+    return scan_literal(s, "null");
+  default:
+    if (scan_number(s, &text, &len)) {
+      return 1;
+    }
+    store(s, ending, text, len, 0);
+    return 0;
+  }
+}
+
+int json_extract(const JSON_EXTRACTOR *extractor,
+		 const char *json,
+		 size_t len,
+		 void *out,
+		 uint32_t *found)
+{
+  JSON_SCANNER s;
+  uint32_t all;
+  int err;
+
+  s.extractor = extractor;
+  s.p = json;
+  s.end = json + len;
+  s.out = (char *) out;
+  s.found = 0;
+
+  all = (extractor->field_count == 32) ?
+    0xFFFFFFFFu : ((uint32_t) 1 << extractor->field_count) - 1;
+  err = scan_value(&s, 0, all, 0);
+  if (!err) {
+    skip_space(&s);
+    err = (s.p != s.end);
+  }
+
+  *found = s.found;
+  return err;
+}
@@ -0,0 +1,67 @@
+#ifndef __INC_JSON_EXTRACT_H
+#define __INC_JSON_EXTRACT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* most fields one extractor fills, and most keys in a field's path */
+#define JSON_EXTRACT_MAX_FIELDS 32
+#define JSON_EXTRACT_MAX_DEPTH 8
+/* deepest nesting of objects and arrays accepted in a document */
+#define JSON_EXTRACT_MAX_NESTING 64
+
+typedef enum {
+  JSON_FIELD_INT,    /* an int member, sent as a number or a numeric string */
+  JSON_FIELD_STRING  /* a char array member, sent as a string or a number */
+} JSON_FIELD_TYPE;
+
+/* a value to pull out of a document and the struct member it is written to */
+typedef struct {
+  const char *path;  /* object keys separated by dots, e.g. "a.b.c" */
+  JSON_FIELD_TYPE type;
+  size_t offset;     /* of the member, from offsetof */
+  size_t size;       /* of a string member, including its terminator */
+} JSON_FIELD;
+
+/*
+  a set of fields compiled once, with each path split into its keys, so that
+  json_extract can fill a struct from a document in a single forward scan,
+  without building a tree or allocating
+*/
+typedef struct {
+  const JSON_FIELD *fields;
+  int field_count;
+  int depth[JSON_EXTRACT_MAX_FIELDS];
+  const char *keys[JSON_EXTRACT_MAX_FIELDS][JSON_EXTRACT_MAX_DEPTH];
+  size_t key_lengths[JSON_EXTRACT_MAX_FIELDS][JSON_EXTRACT_MAX_DEPTH];
+} JSON_EXTRACTOR;
+
+/*
+  compile the given fields, which must outlive the extractor; returns 0, or 1
+  if there are too many fields or a path is empty or too deep
+*/
+int JSON_EXTRACTOR_init(JSON_EXTRACTOR *extractor,
+			const JSON_FIELD *fields,
+			int field_count);
+
+/*
+  scan the len bytes of json, writing each field found into out and setting
+  its bit (1 << its index) in found. Keys are matched exactly; a field whose
+  value is of the wrong kind, or does not fit, is not found. Returns 0, or 1
+  if json is not a well formed document
+*/
+int json_extract(const JSON_EXTRACTOR *extractor,
+		 const char *json,
+		 size_t len,
+		 void *out,
+		 uint32_t *found);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_JSON_EXTRACT_H */
@@ -0,0 +1,384 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json-writer.h"
+
+static const double powers_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5,
+  1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+  1e18, 1e19, 1e20, 1e21, 1e22, 1e23,
+  1e24, 1e25, 1e26, 1e27, 1e28, 1e29,
+  1e30, 1e31, 1e32, 1e33, 1e34, 1e35,
+  1e36, 1e37, 1e38, 1e39, 1e40, 1e41,
+  1e42, 1e43, 1e44, 1e45, 1e46, 1e47,
+  1e48, 1e49, 1e50, 1e51, 1e52, 1e53,
+};
+
+/* v * 10^s and m / 10^s, for s between -53 and 53 */
+static double scale_up(double v, int s)
+{
+  return (s >= 0) ? v * powers_of_ten[s] : v / powers_of_ten[-s];
+}
+
+static double scale_down(double m, int s)
+{
+  return (s >= 0) ? m / powers_of_ten[s] : m * powers_of_ten[-s];
+}
+
+/* whether d is m / 10^s exactly; powers past 10^22 are not exact doubles */
+static int is_exact(double d, double m, int s)
+{
+  if (s > 22 || s < -22) {
+    return 0;
+  }
+  return (s >= 0) ? fma(d, powers_of_ten[s], -m) == 0.0
+    : fma(m, powers_of_ten[-s], -d) == 0.0;
+}
+
+/*
+  whether the decimal m * 10^-s, which d approximates, reads back as f; only
+  asked for the rare candidate too close to a midpoint to tell from d
+*/
+static int reads_back(double d, double m, int s, float f)
+{
+  char decimal[32];
+
+  if (is_exact(d, m, s)) {
+    /* d is the decimal itself, and ties go to the even mantissa */
+    return ((float) d == f);
+  }
+  snprintf(decimal, sizeof(decimal), "%.0fe%d", m, -s);
+  return (strtof(decimal, NULL) == f);
+}
+
+int format_float(char *buffer, float value)
+{
+  /*
+    a decimal reads back as the float if it lies between the midpoints to
+    the neighbouring floats, which are exact doubles, or on one of them when
+    the float's mantissa is even. Candidates with 1 to 9 significant digits
+    are tried in turn; 9 digits always fit. A candidate is rounded once or
+    twice on its way into a double, so it is accepted outright only when it
+    clears the midpoints by a margin well above the few parts in 2^53 it can
+    be off by; one closer than that is checked exactly
+  */
+  char digits[16];
+  char *p = buffer;
+  float f = fabsf(value);
+  double v = f;
+  double low, high, margin, m = 0.0, d;
+  float neighbour;
+  uint32_t bits, neighbour_bits;
+  unsigned long integer;
+  int e, s = 0, n, point, i;
+  char c;
+
+  if (isnan(value) || isinf(value)) {
+    memcpy(buffer, "null", 5);
+    return 4;
+  }
+  if (f == 0.0f) {
+    memcpy(buffer, "0", 2);
+    return 1;
+  }
+
+  /* the neighbours are the floats whose bits are one less and one more */
+  memcpy(&bits, &f, sizeof(bits));
+  neighbour_bits = bits - 1;
+  memcpy(&neighbour, &neighbour_bits, sizeof(neighbour));
+  low = (v + neighbour) / 2;
+  neighbour_bits = bits + 1;
+  memcpy(&neighbour, &neighbour_bits, sizeof(neighbour));
+  high = isinf(neighbour) ? v + (v - low) : (v + neighbour) / 2;
+  margin = v * 0x1p-48;
+
+  /* the exponent of the leading digit, from the binary one */
+  e = (int) ((((int) (bits >> 23)) - 127) * 0.30103);
+  while (v < scale_down(1.0, -e)) {
+    e--;
+  }
+  while (v >= scale_down(1.0, -e - 1)) {
+    e++;
+  }
+
+  for (n = 1; n <= 9; n++) {
+    s = n - 1 - e;
+    m = nearbyint(scale_up(v, s));
+    d = scale_down(m, s);
+    if (d > low + margin && d < high - margin) {
+      break;
+    }
+    if (d >= low - margin && d <= high + margin && reads_back(d, m, s, f)) {
+      break;
+    }
+  }
+  if (n > 9) {
+    s = 8 - e;
+    m = nearbyint(scale_up(v, s));
+  }
+
+  /* value = digits * 10^-s, without trailing zeros */
+  integer = (unsigned long) m;
+  n = 0;
+  do {
+    digits[n++] = '0' + integer % 10;
+    integer /= 10;
+  } while (integer > 0);
+  for (i = 0; i < n / 2; i++) {
+    c = digits[i];
+    digits[i] = digits[n - 1 - i];
+    digits[n - 1 - i] = c;
+  }
+  while (n > 1 && digits[n - 1] == '0') {
+    n--;
+    s--;
+  }
+  point = n - s;
+
+  if (value < 0.0f) {
+    *p++ = '-';
+  }
+  if (point > 0 && point <= 9) {
+    /* 123, 1.25, 12500 */
+    for (i = 0; i < n || i < point; i++) {
+      if (i == point) {
+	*p++ = '.';
+      }
+      *p++ = (i < n) ? digits[i] : '0';
+    }
+  } else if (point <= 0 && point > -4) {
+    /* 0.000125 */
+    *p++ = '0';
+    *p++ = '.';
+    for (i = point; i < 0; i++) {
+      *p++ = '0';
+    }
+    memcpy(p, digits, n);
+    p += n;
+  } else {
+    /* 1.25e-7, 3.4028235e38 */
+    *p++ = digits[0];
+    if (n > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, n - 1);
+      p += n - 1;
+    }
+    p += sprintf(p, "e%d", point - 1);
+  }
+  *p = '\0';
+
+  return p - buffer;
+}
+
+/* room for n more bytes at the end of the output, or NULL once it failed */
+static char *room(JSON_WRITER *w, size_t n)
+{
+  if (w->failed) {
+    return NULL;
+  }
+  if (reserve_string(w->out, w->out->len + n)) {
+    w->failed = 1;
+    return NULL;
+  }
+  return w->out->ptr + w->out->len;
+}
+
+static void put(JSON_WRITER *w, const char *data, size_t n)
+{
+  char *p = room(w, n);
+
+  if (p != NULL) {
+    memcpy(p, data, n);
+    w->out->len += n;
+    w->out->ptr[w->out->len] = '\0';
+  }
+}
+
+static void separate(JSON_WRITER *w)
+{
+  /* a comma before every value but the first in its container */
+  if (w->after_key) {
+    w->after_key = 0;
+    return;
+  }
+  if (w->has_items & (1u << w->depth)) {
+    put(w, ",", 1);
+  }
+  w->has_items |= 1u << w->depth;
+}
+
+static void open_container(JSON_WRITER *w, char bracket)
+{
+  separate(w);
+  if (w->depth >= JSON_WRITER_MAX_DEPTH) {
+    w->failed = 1;
+    return;
+  }
+  put(w, &bracket, 1);
+  w->depth++;
+  w->has_items &= ~(1u << w->depth);
+}
+
+static void close_container(JSON_WRITER *w, char bracket)
+{
+  if (w->depth == 0) {
+    w->failed = 1;
+    return;
+  }
+  w->depth--;
+  put(w, &bracket, 1);
+}
+
+void json_begin(JSON_WRITER *w, string *out)
+{
+  w->out = out;
+  w->depth = 0;
+  w->has_items = 0;
+  w->after_key = 0;
+  w->failed = 0;
+  reset_string(out);
+}
+
+int json_end(JSON_WRITER *w)
+{
+  return (w->failed || w->depth != 0 || w->after_key);
+}
+
+void json_begin_object(JSON_WRITER *w)
+{
+  open_container(w, '{');
+}
+
+void json_end_object(JSON_WRITER *w)
+{
+  close_container(w, '}');
+}
+
+void json_begin_array(JSON_WRITER *w)
+{
+  open_container(w, '[');
+}
+
+void json_end_array(JSON_WRITER *w)
+{
+  close_container(w, ']');
+}
+
+/* length of the valid UTF-8 sequence starting at s, or 0 if there is none */
+static int utf8_sequence(const unsigned char *s)
+{
+  if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+    return ((s[1] & 0xc0) == 0x80) ? 2 : 0;
+  }
+  if (s[0] >= 0xe0 && s[0] <= 0xef) {
+    /* no overlong forms, and no UTF-16 surrogates */
+    if ((s[0] == 0xe0 && s[1] < 0xa0) || (s[0] == 0xed && s[1] > 0x9f)) {
+      return 0;
+    }
+    return ((s[1] & 0xc0) == 0x80 && (s[2] & 0xc0) == 0x80) ? 3 : 0;
+  }
+  if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+    /* no overlong forms, and nothing past U+10FFFF */
+    if ((s[0] == 0xf0 && s[1] < 0x90) || (s[0] == 0xf4 && s[1] > 0x8f)) {
+      return 0;
+    }
+    return ((s[1] & 0xc0) == 0x80 && (s[2] & 0xc0) == 0x80 &&
+	    (s[3] & 0xc0) == 0x80) ? 4 : 0;
+  }
+  return 0;
+}
+
+static void write_string(JSON_WRITER *w, const char *s)
+{
+  static const char hex[] = "0123456789abcdef";
+  const unsigned char *in = (const unsigned char *) s;
+  size_t len = strlen(s);
+  char *start;
+  char *p;
+  int n;
+
+  /* at worst every byte becomes a six byte \u escape */
+  start = p = room(w, len * 6 + 2);
+  if (p == NULL) {
+    return;
+  }
+
+  *p++ = '"';
+  while (*in != '\0') {
+    if (*in >= 0x20 && *in < 0x80 && *in != '"' && *in != '\\') {
+      *p++ = *in++;
+    } else if (*in >= 0x80) {
+      n = utf8_sequence(in);
+      if (n > 0) {
+	memcpy(p, in, n);
+	p += n;
+	in += n;
+      } else {
+	memcpy(p, "\xef\xbf\xbd", 3);
+	p += 3;
+	in++;
+      }
+    } else {
+      *p++ = '\\';
+      switch (*in) {
+      case '"': *p++ = '"'; break;
+      case '\\': *p++ = '\\'; break;
+      case '\b': *p++ = 'b'; break;
+      case '\f': *p++ = 'f'; break;
+      case '\n': *p++ = 'n'; break;
+      case '\r': *p++ = 'r'; break;
+      case '\t': *p++ = 't'; break;
+      default:
+	*p++ = 'u';
+	*p++ = '0';
+	*p++ = '0';
+	*p++ = hex[*in >> 4];
+	*p++ = hex[*in & 0xf];
+	break;
+      }
+      in++;
+    }
+  }
+  *p++ = '"';
+
+  w->out->len += p - start;
+  w->out->ptr[w->out->len] = '\0';
+}
+
+void json_key(JSON_WRITER *w, const char *key)
+{
+  separate(w);
+  write_string(w, key);
+  put(w, ":", 1);
+  w->after_key = 1;
+}
+
+void json_string(JSON_WRITER *w, const char *s)
+{
+  separate(w);
+  write_string(w, s);
+}
+
+void json_integer(JSON_WRITER *w, long long value)
+{
+  char digits[24];
+  int len;
+
+  separate(w);
+  len = snprintf(digits, sizeof(digits), "%lld", value);
+  put(w, digits, len);
+}
+
+void json_float(JSON_WRITER *w, float value)
+{
+  char digits[16];
+  int len;
+
+  separate(w);
+  len = format_float(digits, value);
+  put(w, digits, len);
+}
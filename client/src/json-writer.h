@@ -0,0 +1,68 @@
+#ifndef __INC_JSON_WRITER_H
+#define __INC_JSON_WRITER_H
+
+#include <stdint.h>
+
+#include "misc-structs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* deepest nesting of objects and arrays the writer keeps track of */
+#define JSON_WRITER_MAX_DEPTH 31
+
+/*
+  writes a JSON document into a string as it is described, value by value,
+  putting in the commas and escaping strings. The calls do not report
+  failures; once something fails (the string cannot grow, or the nesting is
+  too deep) the rest is ignored and json_end reports it
+*/
+typedef struct {
+  string *out;
+  int depth;
+  uint32_t has_items; /* bit n: the container at depth n has a value */
+  int after_key;      /* the next value belongs to the key just written */
+  int failed;
+} JSON_WRITER;
+
+/* start writing a document into out, replacing its contents */
+void json_begin(JSON_WRITER *w, string *out);
+
+/* returns 0 if the whole document was written, or 1 if anything failed */
+int json_end(JSON_WRITER *w);
+
+void json_begin_object(JSON_WRITER *w);
+void json_end_object(JSON_WRITER *w);
+void json_begin_array(JSON_WRITER *w);
+void json_end_array(JSON_WRITER *w);
+
+/* the key of the next value in an object */
+void json_key(JSON_WRITER *w, const char *key);
+
+/*
+  a string value; quotes, backslashes and control characters are escaped,
+  and bytes that are not valid UTF-8 are replaced with U+FFFD
+*/
+void json_string(JSON_WRITER *w, const char *s);
+
+void json_integer(JSON_WRITER *w, long long value);
+
+/*
+  the shortest decimal that reads back as the same float, or null for NaN
+  and infinities, which JSON cannot express
+*/
+void json_float(JSON_WRITER *w, float value);
+
+/*
+  write the shortest decimal that reads back as value into buffer, which
+  must hold at least 16 bytes, returning its length; NaN and infinities are
+  written as "null"
+*/
+int format_float(char *buffer, float value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_JSON_WRITER_H */
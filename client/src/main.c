@@ -3,451 +3,3326 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include <time.h>
 #include <math.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include <openssl/ssl.h>
+#include <libusb-1.0/libusb.h>
 
 #include "fparse.h"
 #include "devtypes.h"
 #include "usb-operations.h"
 #include "http-operations.h"
 #include "misc-structs.h"
-#include "cJSON.h"
+#include "batch.h"
+#include "journal.h"
+#include "history.h"
+#include "event-loop.h"
+#include "ring.h"
+#include "aggregate.h"
+#include "deadband.h"
+#include "discovery.h"
+#include "config.h"
+#include "json-extract.h"
 
 #define GLOBAL_FILE "globals.ini"
-#define READINGS_FILE "/tmp/lastread.json"
 #define AUTH_FILE "/tmp/auth.json"
 #define URL_FILE "/tmp/SERVER_URL"
 #define COOKIE_FILE "/tmp/SERVER_COOKIE"
+#define SPECIFICATIONS_FILE "/tmp/SERVER_SPECIFICATIONS"
+#define SPILL_FILE "/tmp/READINGS_SPILL"
 
 #define IO_ERROR 1
 #define USB_OPEN_ERROR 2
 #define USB_READ_ERROR 3
 #define SERVER_ERROR 4
 
-void init_string(struct string *s) {
-  s->len = 0;
-  s->ptr = malloc(s->len+1);
-  if (s->ptr == NULL) {
-    fprintf(stderr, "malloc() failed\n");
-    exit(EXIT_FAILURE);
+/* how open_monitor fails, alongside the failures of read_device */
+#define DEVICE_DETACH_FAILED -2000
+#define DEVICE_OPEN_FAILED -2001
+#define DEVICE_PREPARE_FAILED -2002
+
+/* daemon mode defaults, in seconds unless noted; overridable from globals.ini */
+#define DEFAULT_READ_INTERVAL 30
+#define DEFAULT_SPECIFICATIONS_REFRESH 300 /* also how long cached ones last */
+#define DEFAULT_BATCH_SIZE 1 /* readings; 1 uploads each reading on its own */
+#define DEFAULT_BATCH_LATENCY 300
+#define DEFAULT_JOURNAL_CAPACITY 100000 /* readings */
+#define DEFAULT_JOURNAL_SYNC_EVERY 0 /* readings; 0 leaves syncing to the OS */
+#define DEFAULT_HISTORY_CAPACITY 1209600 /* readings; two weeks of one a second */
+#define DEFAULT_HISTORY_RETENTION 0 /* 0 keeps readings while there is room */
+#define DEFAULT_DISCOVERY_TIMEOUT 60 /* to wait for the server to announce itself */
+#define DEFAULT_QUEUE_CAPACITY 1024 /* readings waiting to be recorded */
+#define DEFAULT_OVERSAMPLE_INTERVAL 0 /* milliseconds; 0 reads once per interval */
+#define DEFAULT_DEADBAND 0 /* degrees; 0 uploads every reading the server expects */
+#define DEFAULT_MAX_SILENCE 3600
+#define DEFAULT_COMPRESSION_LEVEL 0 /* 1 to 9; 0 sends bodies uncompressed */
+#define DEFAULT_COMPRESSION_THRESHOLD 1024 /* bytes */
+
+/* most devices polled from one host */
+#define MAX_MONITORS 32
+
+/* most readings sent from the journal in one request */
+#define JOURNAL_UPLOAD_SIZE 256
+/* longest wait between upload attempts while the server is unreachable */
+#define MAX_UPLOAD_RETRY_DELAY 600
+
+typedef struct {
+  char container_num[63];
+
+  char server_login_email[255];
+  char server_login_password[255];
+
+  char server_path_authentication[255];
+  char server_path_containers[255];
+  char server_path_specifications[255];
+
+  char server_url_base[255];
+  char server_url_authentication[255];
+  char server_url_specifications[255];
+
+  int read_interval;
+  int specifications_refresh;
+
+  /*
+    in daemon mode, the milliseconds between readings when the device is
+    read continuously, each read_interval summarizing the readings taken
+    over it; 0 takes one reading every read_interval
+  */
+  int oversample_interval;
+
+  int batch_size;
+  int batch_latency;
+
+  char journal_path[255]; /* empty if readings are not journaled */
+  int journal_capacity;
+  int journal_sync_every;
+
+  /* every reading taken is kept locally in the history unless this is empty */
+  char history_path[255];
+  int history_capacity;
+  int history_retention;
+
+  /*
+    the devices to poll, as "serial=container" pairs, when one host monitors
+    several containers; empty when only the first device found is used
+  */
+  char devices[255];
+
+  int discovery_timeout;
+
+  /*
+    how many readings can wait between the sampler thread and the uploader in
+    daemon mode, and what becomes of more
+  */
+  int queue_capacity;
+  RING_OVERFLOW queue_overflow;
+
+  /* readings outside of expected +/- range are alarms */
+  float expected_temperature;
+  float temperature_range;
+
+  /*
+    in daemon mode, readings within deadband degrees of the last one
+    uploaded and of the same status are not uploaded, except for one every
+    max_silence seconds to show the monitor is still running
+  */
+  float deadband;
+  int max_silence;
+
+  /* upload bodies of at least compression_threshold bytes are gzipped */
+  int compression_level;
+  int compression_threshold;
+
+  /*
+    whether readings are uploaded in CBOR rather than JSON, until the server
+    answers that it does not support it
+  */
+  int upload_cbor;
+} TEMPMON_GLOBALS;
+
+typedef struct {
+  char server_path_reading_upload[255];
+  char server_url_reading_upload[255];
+  int device_product_id;
+  int device_vendor_id;
+
+  time_t fetched_at; /* when the above were received from the server */
+  HTTP_VALIDATORS validators; /* to ask the server whether they changed */
+} TEMPMON_SPECIFICATIONS;
+
+/*
+  everything the server sends for the specifications; nextUpdateIn and
+  lastReadStatus change with every upload, so they are kept apart from specs
+  and never cached
+*/
+typedef struct {
+  TEMPMON_SPECIFICATIONS specs;
+  int time_until_update;
+  char last_read_status[255];
+} TEMPMON_SPECIFICATIONS_REPLY;
+
+/* the specifications as cached in SPECIFICATIONS_FILE between runs */
+typedef struct {
+  char server_url_specifications[255]; /* where they were fetched from */
+  TEMPMON_SPECIFICATIONS specs;
+} TEMPMON_SPECIFICATIONS_CACHE;
+
+/* a reading handed over by the sampler thread in daemon mode */
+typedef struct {
+  time_t taken_at;
+  int result; /* positive once a reading was taken, or how the device failed */
+  SEM710_READINGS readings;
+  READING_SUMMARY summary; /* when oversampling; readings holds the last */
+} SAMPLE;
+
+/* what a monitor is asking of the server in daemon mode, one at a time */
+typedef enum {
+  JOB_NONE,
+  JOB_LOGIN,
+  JOB_SPECIFICATIONS,
+  JOB_ERROR, /* reporting an error */
+  JOB_UPLOAD
+} SERVER_JOB;
+
+/*
+  everything kept alive between readings in daemon mode; one per device when
+  several devices are polled
+*/
+typedef struct {
+  /*
+    main's libusb context, shared by every monitor's ftHandle so a single
+    set of file descriptors carries all the device transfers
+  */
+  libusb_context *usb_context;
+  struct ftdi_context *ftHandle;
+  char device_serial[DEVICE_SERIAL_SIZE]; /* empty for the first device */
+  int device_vendor_id; /* from the specifications received on connecting */
+  int device_product_id;
+  int device_open;
+
+  HTTP_CLIENT http;
+  char specifications_path[255]; /* where the specifications are cached */
+
+  /* reused for every request so the hot path does not allocate */
+  string upload_body;
+  string response;
+  int upload_cbor;   /* whether upload_body holds readings in CBOR */
+  int upload_single; /* whether they are a lone reading */
+  int cbor_refused;  /* whether the server does not accept CBOR */
+
+  int logged_in; /* whether the client holds a session, possibly a saved one */
+
+  READING_BATCH batch;
+  DEADBAND deadband; /* what was last uploaded, to skip readings like it */
+
+  int journaling;
+  JOURNAL journal;
+
+  int keeping_history;
+  HISTORY history;
+  TIMED_READING journal_upload[JOURNAL_UPLOAD_SIZE];
+  int upload_failures;
+  time_t upload_retry_at;
+
+  TEMPMON_GLOBALS globals;
+  TEMPMON_SPECIFICATIONS specs;
+  int time_until_update; /* nextUpdateIn, as last received from the server */
+  time_t update_due_at;  /* when the server next expects a reading */
+  char last_read_status[255]; /* lastReadStatus, as last received */
+
+  /*
+    daemon mode, where the device is read from the sampler thread, which
+    passes each reading through samples to the loop keeping the server up to
+    date
+  */
+  int looping;
+  RING samples;
+  uint64_t samples_overflowed; /* dropped or spilled, as last reported */
+
+  /* used only by the sampler thread while the loop runs */
+  int sample_interval; /* read_interval, updated atomically */
+  EVENT_TIMER sample_timer;
+  struct timespec next_sample; /* CLOCK_MONOTONIC time of the next reading */
+  DEVICE_READ device_read;
+  int device_opening; /* whether the opener thread has the device */
+  int open_wanted;    /* guarded by the sampler's open_lock */
+  int open_result;    /* what open_monitor returned, once open_done is set */
+  int open_done;      /* set atomically by the opener thread */
+  uint8_t reading_buffer[280];
+  time_t read_at; /* when the reading being taken was asked for */
+  AGGREGATE aggregate; /* the readings taken since the last summary */
+  SEM710_READINGS last_readings;
+  int last_failure; /* how the device last failed since the last summary */
+  struct timespec next_summary; /* CLOCK_MONOTONIC time it is due */
+
+  SERVER_JOB job;    /* the request in flight */
+  SERVER_JOB resend; /* the upload body to send again once logged in */
+  int job_retried;   /* whether the job was already tried again */
+  char error_pending[255]; /* the latest error not yet reported, if any */
+  int reading_pending; /* whether latest_reading is owed to the server */
+  TIMED_READING latest_reading;
+  int draining; /* whether the batch or the journal is owed to the server */
+  uint64_t journal_next; /* journal sequence following the upload in flight */
+  int batch_uploading;  /* batch readings covered by the upload in flight */
+  uint64_t batch_dropped; /* readings the batch had no room for */
+} TEMPMON;
+
+/*
+  what keeps the server up to date for every monitor in daemon mode: one
+  event loop waits on the server connections, the readings handed over by
+  the sampler and the timers all at once, so a server that is slow to answer
+  never holds up the others
+*/
+typedef struct {
+  EVENT_LOOP events;
+  HTTP_MULTI http;
+  EVENT_WATCH samples_watch;
+  EVENT_WATCH discovery_watch;
+  EVENT_WATCH config_watch;
+  EVENT_TIMER discovery_deadline;
+  int awaiting_server; /* whether the server was asked to announce itself */
+  int opened;          /* how much of the above open_loop set up */
+
+  TEMPMON *monitors;
+  int count;           /* monitors set up on the loop */
+  int status;          /* the exit status ending the loop, 0 while it runs */
+} MONITOR_LOOP;
+
+/*
+  what reads every monitor's device in daemon mode, on a thread of its own
+  that waits only on the devices and the sample timers, so nothing the server
+  does can delay or skip a reading
+*/
+typedef struct {
+  EVENT_LOOP events;
+  USB_EVENTS usb;
+  EVENT_WATCH stop_watch;
+  int stop_fd;  /* eventfd written to stop the thread */
+  int wake_fd;  /* eventfd written for the loop once readings are queued */
+  int opened;   /* how much of the above open_sampler set up */
+  pthread_t thread;
+  int running;  /* whether the thread was started */
+  int stopping;
+  int status;   /* IO_ERROR once the thread has failed, read atomically */
+
+  /*
+    devices are (re)opened on a thread of their own, since opening one waits
+    on the device and would hold up the readings of the others
+  */
+  pthread_t opener;
+  int opener_running;
+  int opener_stopping; /* guarded by open_lock */
+  pthread_mutex_t open_lock;
+  pthread_cond_t open_wanted;
+  int opened_fd; /* eventfd written for the sampler once a device is opened */
+  EVENT_WATCH opened_watch;
+
+  TEMPMON *monitors;
+  int count;
+} SAMPLER;
+
+/* what is taken from the server's specifications response */
+static const JSON_FIELD specifications_fields[] = {
+  { "specifications.nextUpdateIn", JSON_FIELD_INT,
+    offsetof(TEMPMON_SPECIFICATIONS_REPLY, time_until_update), 0 },
+  { "specifications.lastReadStatus", JSON_FIELD_STRING,
+    offsetof(TEMPMON_SPECIFICATIONS_REPLY, last_read_status),
+    sizeof(((TEMPMON_SPECIFICATIONS_REPLY *) 0)->last_read_status) },
+  { "specifications.uploadURL", JSON_FIELD_STRING,
+    offsetof(TEMPMON_SPECIFICATIONS_REPLY, specs.server_path_reading_upload),
+    sizeof(((TEMPMON_SPECIFICATIONS *) 0)->server_path_reading_upload) },
+  { "specifications.monitor.productID", JSON_FIELD_INT,
+    offsetof(TEMPMON_SPECIFICATIONS_REPLY, specs.device_product_id), 0 },
+  { "specifications.monitor.vendorID", JSON_FIELD_INT,
+    offsetof(TEMPMON_SPECIFICATIONS_REPLY, specs.device_vendor_id), 0 }
+};
+#define SPECIFICATIONS_FIELD_COUNT \
+  ((int) (sizeof(specifications_fields) / sizeof(JSON_FIELD)))
+
+/* specifications_fields, compiled once at startup */
+static JSON_EXTRACTOR specifications_extractor;
+
+static volatile sig_atomic_t daemon_running = 1;
+
+/* listens for the server announcing itself, if the group could be joined */
+static DISCOVERY discovery = { -1 };
+
+/* notices the globals file changing in daemon mode, if it could be watched */
+static CONFIG_WATCH config_watch = { -1, -1, "" };
+
+static MONITOR_LOOP loop;
+
+static SAMPLER sampler;
+
+static void stop_daemon(int signum)
+{
+  (void) signum;
+  daemon_running = 0;
+}
+
+static int get_global(const CONFIG *config,
+		      char *vname,
+		      char *destination,
+		      size_t size)
+{
+  /*
+    copy the variable with the given name into destination, which holds size
+    bytes, returning 1 (and reporting it) if the variable could not be found
+  */
+  const char *value = config_get(config, vname);
+
+  if (value == NULL) {
+    printf("variable not found \"%s\"\n", vname);
+    return 1;
+  }
+  if (strlen(value) >= size) {
+    printf("variable too long \"%s\"\n", vname);
+    return 1;
+  }
+  strcpy(destination, value);
+  return 0;
+}
+
+static void get_optional_string_global(const CONFIG *config,
+				       char *vname,
+				       char *destination,
+				       size_t size)
+{
+  /* as get_global, but leaving destination empty if the variable is absent */
+  const char *value = config_get(config, vname);
+
+  if (value == NULL || strlen(value) >= size) {
+    destination[0] = '\0';
+    return;
+  }
+  strcpy(destination, value);
+}
+
+static int get_optional_global(const CONFIG *config,
+			       char *vname,
+			       int default_value)
+{
+  /*
+    return the integer variable with the given name, or default_value if it
+    is absent or not a positive number
+  */
+  const char *value = config_get(config, vname);
+  int number;
+
+  if (value == NULL) {
+    return default_value;
+  }
+  number = atoi(value);
+  return (number > 0) ? number : default_value;
+}
+
+static float get_optional_float_global(const CONFIG *config,
+				       char *vname,
+				       float default_value)
+{
+  /*
+    return the float variable with the given name, or default_value if it is
+    absent
+  */
+  const char *value = config_get(config, vname);
+
+  if (value == NULL) {
+    return default_value;
+  }
+  return (float) atof(value);
+}
+
+static int set_container(TEMPMON_GLOBALS *globals, char *container_num)
+{
+  /*
+    monitor the given container, whose specifications are at its own URL;
+    returns 1, changing nothing, if the container or the URL is too long
+  */
+  char url[sizeof(globals->server_url_specifications)];
+  int len;
+
+  if (strlen(container_num) >= sizeof(globals->container_num)) {
+    return 1;
+  }
+  len = snprintf(url,
+		 sizeof(url),
+		 "%s%s/%s%s",
+		 globals->server_url_base,
+		 globals->server_path_containers,
+		 container_num,
+		 globals->server_path_specifications);
+  if (len < 0 || (size_t) len >= sizeof(url)) {
+    return 1;
+  }
+
+  if (globals->container_num != container_num) {
+    strcpy(globals->container_num, container_num);
+  }
+  strcpy(globals->server_url_specifications, url);
+  return 0;
+}
+
+static int set_server_url(TEMPMON_GLOBALS *globals, char *url)
+{
+  /*
+    use the server at the given base URL; returns 1, changing nothing, if it
+    or a URL made from it is too long
+  */
+  char authentication[sizeof(globals->server_url_authentication)];
+  char previous[sizeof(globals->server_url_base)];
+  int len;
+
+  if (strlen(url) >= sizeof(globals->server_url_base)) {
+    return 1;
+  }
+  len = snprintf(authentication,
+		 sizeof(authentication),
+		 "%s%s",
+		 url,
+		 globals->server_path_authentication);
+  if (len < 0 || (size_t) len >= sizeof(authentication)) {
+    return 1;
+  }
+
+  strcpy(previous, globals->server_url_base);
+  if (globals->server_url_base != url) {
+    strcpy(globals->server_url_base, url);
+  }
+  if (set_container(globals, globals->container_num)) {
+    strcpy(globals->server_url_base, previous);
+    return 1;
+  }
+  strcpy(globals->server_url_authentication, authentication);
+  return 0;
+}
+
+static int get_globals(TEMPMON_GLOBALS *globals)
+{
+  /*
+    read the program globals from the server URL file and the globals file,
+    each read once; returns 0 on success or the exit status describing the
+    failure. The server URL is left empty if it has not been discovered yet
+  */
+  char url[255];
+  char overflow[15];
+  char format[15];
+  CONFIG *config;
+  int err;
+
+  if (get_file_variable(URL_FILE, "url", url)) {
+    url[0] = '\0';
+  }
+
+  config = (CONFIG *) malloc(sizeof(CONFIG));
+  if (config == NULL) {
+    return IO_ERROR;
+  }
+  if (config_load(config, GLOBAL_FILE)) {
+    printf("failed to read \"%s\"\n", GLOBAL_FILE);
+    free(config);
+    return IO_ERROR;
+  }
+
+  get_optional_string_global(config,
+			     "devices",
+			     globals->devices,
+			     sizeof(globals->devices));
+
+  /* with several devices, each one's container is given with it */
+  err = 0;
+  if ((globals->devices[0] == '\0' &&
+       get_global(config,
+		  "container_num",
+		  globals->container_num,
+		  sizeof(globals->container_num))) ||
+      get_global(config,
+		 "authentication_path",
+		 globals->server_path_authentication,
+		 sizeof(globals->server_path_authentication)) ||
+      get_global(config,
+		 "container_path",
+		 globals->server_path_containers,
+		 sizeof(globals->server_path_containers)) ||
+      get_global(config,
+		 "specifications_path",
+		 globals->server_path_specifications,
+		 sizeof(globals->server_path_specifications)) ||
+      get_global(config,
+		 "user",
+		 globals->server_login_email,
+		 sizeof(globals->server_login_email)) ||
+      get_global(config,
+		 "password",
+		 globals->server_login_password,
+		 sizeof(globals->server_login_password))) {
+    err = IO_ERROR;
+  }
+
+  globals->read_interval = get_optional_global(config,
+					       "read_interval",
+					       DEFAULT_READ_INTERVAL);
+  globals->oversample_interval =
+    get_optional_global(config,
+			"oversample_interval",
+			DEFAULT_OVERSAMPLE_INTERVAL);
+  globals->specifications_refresh =
+    get_optional_global(config,
+			"specifications_refresh",
+			DEFAULT_SPECIFICATIONS_REFRESH);
+  globals->batch_size = get_optional_global(config,
+					    "batch_size",
+					    DEFAULT_BATCH_SIZE);
+  globals->batch_latency = get_optional_global(config,
+					       "batch_latency",
+					       DEFAULT_BATCH_LATENCY);
+  get_optional_string_global(config,
+			     "journal_path",
+			     globals->journal_path,
+			     sizeof(globals->journal_path));
+  globals->journal_capacity = get_optional_global(config,
+						  "journal_capacity",
+						  DEFAULT_JOURNAL_CAPACITY);
+  globals->journal_sync_every =
+    get_optional_global(config,
+			"journal_sync_every",
+			DEFAULT_JOURNAL_SYNC_EVERY);
+  get_optional_string_global(config,
+			     "history_path",
+			     globals->history_path,
+			     sizeof(globals->history_path));
+  globals->history_capacity = get_optional_global(config,
+						  "history_capacity",
+						  DEFAULT_HISTORY_CAPACITY);
+  globals->history_retention = get_optional_global(config,
+						   "history_retention",
+						   DEFAULT_HISTORY_RETENTION);
+  globals->expected_temperature =
+    get_optional_float_global(config, "expected_temperature", 0);
+  globals->temperature_range =
+    get_optional_float_global(config, "temperature_range", INFINITY);
+  globals->deadband =
+    get_optional_float_global(config, "deadband", DEFAULT_DEADBAND);
+  globals->max_silence = get_optional_global(config,
+					     "max_silence",
+					     DEFAULT_MAX_SILENCE);
+  globals->compression_level =
+    get_optional_global(config,
+			"compression_level",
+			DEFAULT_COMPRESSION_LEVEL);
+  globals->compression_threshold =
+    get_optional_global(config,
+			"compression_threshold",
+			DEFAULT_COMPRESSION_THRESHOLD);
+  globals->discovery_timeout =
+    get_optional_global(config,
+			"discovery_timeout",
+			DEFAULT_DISCOVERY_TIMEOUT);
+  globals->queue_capacity = get_optional_global(config,
+						"queue_capacity",
+						DEFAULT_QUEUE_CAPACITY);
+  get_optional_string_global(config,
+			     "queue_overflow",
+			     overflow,
+			     sizeof(overflow));
+  get_optional_string_global(config,
+			     "upload_format",
+			     format,
+			     sizeof(format));
+  free(config);
+
+  /* readings are dropped unless asked to spill them */
+  globals->queue_overflow = RING_DROP_OLDEST;
+  if (strcmp(overflow, "spill") == 0) {
+    globals->queue_overflow = RING_SPILL;
+  } else if (overflow[0] != '\0' && strcmp(overflow, "drop_oldest") != 0) {
+    puts("queue_overflow must be \"drop_oldest\" or \"spill\"");
+    err = IO_ERROR;
+  }
+
+  /* readings go up as JSON unless asked to send CBOR */
+  globals->upload_cbor = (strcmp(format, "cbor") == 0);
+  if (format[0] != '\0' && !globals->upload_cbor &&
+      strcmp(format, "json") != 0) {
+    puts("upload_format must be \"json\" or \"cbor\"");
+    err = IO_ERROR;
+  }
+
+  if (!err && set_server_url(globals, url)) {
+    puts("the server URLs made from the globals are too long");
+    err = IO_ERROR;
+  }
+  return err;
+}
+
+static void login_postfields(TEMPMON_GLOBALS *globals, char *postfield_buffer)
+{
+  /* construct login postfield */
+  start_postfield(postfield_buffer, "email", globals->server_login_email);
+  add_postfield(postfield_buffer, "password", globals->server_login_password);
+}
+
+static int login_accepted(int http_response_code)
+{
+  /* whether the server answered a login with a session */
+  return (http_response_code >= 200 && http_response_code < 300);
+}
+
+static int authenticate(TEMPMON *tm)
+{
+  /*
+    log in to the server, leaving the session cookie with the HTTP client
+    (which saves it to COOKIE_FILE); returns the http code, or 0 if the
+    server did not respond. Only a login the server accepted is logged_in
+  */
+  TEMPMON_GLOBALS *globals = &tm->globals;
+
+  char postfield_buffer[1023];
+  int http_response_code;
+
+  login_postfields(globals, postfield_buffer);
+
+  /* perform a POST operation to the server authentication page */
+  http_response_code = http_POST(&tm->http,
+				 globals->server_url_authentication,
+				 NULL,
+				 NULL,
+				 NULL,
+				 postfield_buffer,
+				 &tm->response);
+  reset_string(&tm->response);
+
+  tm->logged_in = login_accepted(http_response_code);
+  return http_response_code;
+}
+
+static int session_expired(TEMPMON *tm, int http_response_code)
+{
+  /*
+    if the server refused a request because the session is missing or has
+    expired, log in again; returns whether the request should be retried
+  */
+  if (http_response_code != 401 && http_response_code != 403) {
+    return 0;
+  }
+  printf("session expired, logging in again... ");
+  authenticate(tm);
+  return tm->logged_in;
+}
+
+static void load_specifications(TEMPMON *tm)
+{
+  /*
+    load the specifications cached by an earlier run, if they were fetched
+    from the same place; otherwise leave specs empty so they are fetched
+  */
+  TEMPMON_SPECIFICATIONS_CACHE cache;
+  FILE *f;
+  size_t read;
+
+  f = fopen(tm->specifications_path, "rb");
+  if (f == NULL) {
+    return;
+  }
+  read = fread(&cache, sizeof(cache), 1, f);
+  /* one cached in another layout, by an older build, is not used */
+  if (fgetc(f) != EOF) {
+    read = 0;
+  }
+  fclose(f);
+
+  if (read == 1 &&
+      strcmp(cache.server_url_specifications,
+	     tm->globals.server_url_specifications) == 0) {
+    tm->specs = cache.specs;
+  }
+}
+
+static void save_specifications(TEMPMON *tm)
+{
+  /*
+    atomically replace the cached specifications with specs; a failure only
+    costs a fetch on the next run, so it is not reported
+  */
+  TEMPMON_SPECIFICATIONS_CACHE cache;
+  char tmp_path[270];
+  FILE *f;
+  int err;
+
+  memset(&cache, 0, sizeof(cache));
+  strcpy(cache.server_url_specifications,
+	 tm->globals.server_url_specifications);
+  cache.specs = tm->specs;
+
+  sprintf(tmp_path, "%s.tmp", tm->specifications_path);
+  f = fopen(tmp_path, "wb");
+  if (f == NULL) {
+    return;
+  }
+  err = (fwrite(&cache, sizeof(cache), 1, f) != 1);
+  err |= (fclose(f) != 0);
+  if (err || rename(tmp_path, tm->specifications_path) != 0) {
+    unlink(tmp_path);
+  }
+}
+
+static void forget_specifications(TEMPMON *tm)
+{
+  /* drop the cached specifications so they are fetched again in full */
+  memset(&tm->specs.validators, 0, sizeof(tm->specs.validators));
+  tm->specs.fetched_at = 0;
+  unlink(tm->specifications_path);
+}
+
+static int pack_upload(TEMPMON *tm,
+			TIMED_READING *readings,
+			int count,
+			int single)
+{
+  /*
+    write the readings into the upload body, in CBOR if the globals ask for
+    it and the server has not refused it, or else as JSON: as pack_reading
+    does if single, or as pack_batch does; returns 1 if they could not be
+    packed
+  */
+  tm->upload_single = single;
+  tm->upload_cbor = (tm->globals.upload_cbor && !tm->cbor_refused);
+  if (tm->upload_cbor) {
+    return pack_batch_cbor(readings, count, &tm->upload_body);
+  }
+  if (single) {
+    return pack_reading(readings, &tm->upload_body);
+  }
+  return pack_batch(readings, count, &tm->upload_body);
+}
+
+static int cbor_refused(TEMPMON *tm, int http_response_code)
+{
+  /*
+    if the server answered a CBOR upload body with 415 (unsupported media
+    type), upload JSON from now on, turning the body into JSON so it can be
+    sent again; returns whether it should be. The response buffer is used
+    for the new body, so it must be done with
+  */
+  string body;
+
+  if (http_response_code != 415 || !tm->upload_cbor) {
+    return 0;
+  }
+  puts("the server does not accept CBOR, uploading JSON instead");
+  tm->cbor_refused = 1;
+  tm->upload_cbor = 0;
+
+  if (repack_batch_as_json((const uint8_t *) tm->upload_body.ptr,
+			   tm->upload_body.len,
+			   tm->upload_single,
+			   &tm->response)) {
+    reset_string(&tm->response);
+    return 0;
+  }
+  body = tm->upload_body;
+  tm->upload_body = tm->response;
+  tm->response = body;
+  reset_string(&tm->response);
+  return 1;
+}
+
+static char *upload_content_type(TEMPMON *tm)
+{
+  return tm->upload_cbor ? "Content-Type: application/cbor" :
+    "Content-Type: application/json";
+}
+
+static void update_sent(TEMPMON *tm)
+{
+  /*
+    the server accepted a reading, so it expects the next one after the
+    nextUpdateIn it last gave
+  */
+  tm->update_due_at = time(NULL) + tm->time_until_update;
+}
+
+static int put_upload_body(TEMPMON *tm)
+{
+  /*
+    PUT the upload body to the server, logging in again if the session has
+    expired or sending it as JSON if CBOR was refused; returns the http code,
+    or 0 if the server did not respond
+  */
+  int http_response_code;
+  int retried = 0;
+
+  do {
+    http_response_code =
+      http_PUT_buffer(&tm->http,
+		      tm->specs.server_url_reading_upload,
+		      NULL,
+		      NULL,
+		      upload_content_type(tm),
+		      &tm->upload_body,
+		      &tm->response);
+    reset_string(&tm->response);
+  } while (!retried++ && (session_expired(tm, http_response_code) ||
+			  cbor_refused(tm, http_response_code)));
+
+  /* the upload location has moved, so the specifications are out of date */
+  if (http_response_code == 404) {
+    forget_specifications(tm);
+  }
+  if (http_response_code >= 200 && http_response_code < 300) {
+    update_sent(tm);
+  }
+
+  return http_response_code;
+}
+
+static int set_upload_url(TEMPMON_SPECIFICATIONS *specs, const char *base)
+{
+  /*
+    upload readings to the specifications' upload path on the server at the
+    given base URL; returns 1, changing nothing, if the URL is too long
+  */
+  char url[sizeof(specs->server_url_reading_upload)];
+  int len;
+
+  len = snprintf(url,
+		 sizeof(url),
+		 "%s%s",
+		 base,
+		 specs->server_path_reading_upload);
+  if (len < 0 || (size_t) len >= sizeof(url)) {
+    return 1;
+  }
+  strcpy(specs->server_url_reading_upload, url);
+  return 0;
+}
+
+static int specifications_received(TEMPMON *tm, int http_response_code)
+{
+  /*
+    take on the specifications in the response to a request for them, which
+    a 304 says are unchanged; returns 0 on success or SERVER_ERROR, leaving
+    the response buffer empty
+  */
+  TEMPMON_GLOBALS *globals = &tm->globals;
+  TEMPMON_SPECIFICATIONS *specs = &tm->specs;
+
+  TEMPMON_SPECIFICATIONS_REPLY fetched;
+  uint32_t found;
+  int err = 0;
+  int i;
+
+  if (http_response_code == 304) {
+    /* unchanged, so the specifications held are current as of now */
+    specs->fetched_at = time(NULL);
+    save_specifications(tm);
+    return 0;
+  }
+
+  /* extracted into a copy, so a bad response leaves specs as they were */
+  memset(&fetched, 0, sizeof(fetched));
+  fetched.specs = *specs;
+  err = json_extract(&specifications_extractor,
+		     tm->response.ptr,
+		     tm->response.len,
+		     &fetched,
+		     &found);
+  reset_string(&tm->response);
+  if (err) {
+    printf("invalid JSON struct returned\n");
+    return SERVER_ERROR;
+  }
+
+  for (i = 0; i < SPECIFICATIONS_FIELD_COUNT; i++) {
+    if (!(found & (1u << i))) {
+      printf("variable not found \"%s\"\n", specifications_fields[i].path);
+      err = 1;
+    }
+  }
+
+  if (!err && set_upload_url(&fetched.specs, globals->server_url_base)) {
+    printf("upload URL too long \"%s%s\"\n",
+	   globals->server_url_base,
+	   fetched.specs.server_path_reading_upload);
+    err = 1;
+  }
+
+  if (!err) {
+    *specs = fetched.specs;
+    specs->fetched_at = time(NULL);
+    save_specifications(tm);
+    tm->time_until_update = fetched.time_until_update;
+    tm->update_due_at = specs->fetched_at + fetched.time_until_update;
+    strcpy(tm->last_read_status, fetched.last_read_status);
+  } else {
+    forget_specifications(tm);
+  }
+
+  return err ? SERVER_ERROR : 0;
+}
+
+static int specifications_due(TEMPMON *tm)
+{
+  /* whether specifications_refresh has passed since they were fetched */
+  return (tm->specs.fetched_at == 0 ||
+	  difftime(time(NULL), tm->specs.fetched_at) >=
+	  tm->globals.specifications_refresh);
+}
+
+static int get_specifications(TEMPMON *tm)
+{
+  /*
+    bring specs up to date with the container specifications on the server;
+    returns 0 on success or SERVER_ERROR. Specifications fetched less than
+    specifications_refresh seconds ago are used as they are. Older ones are
+    revalidated, if the server gave validators for them, and only parsed
+    again if the server sends new ones.
+  */
+  int http_response_code;
+  int retried = 0;
+
+  if (!specifications_due(tm)) {
+    return 0;
+  }
+
+  do {
+    reset_string(&tm->response);
+    http_response_code =
+      http_GET_conditional(&tm->http,
+			   tm->globals.server_url_specifications,
+			   &tm->specs.validators,
+			   &tm->response);
+  } while (!retried++ && session_expired(tm, http_response_code));
+
+  return specifications_received(tm, http_response_code);
+}
+
+static void server_next(TEMPMON *tm);
+
+static int report_error(TEMPMON *tm, char *error_buffer)
+{
+  /*
+    upload the given error message to the server and print it; returns 0 or
+    IO_ERROR if the error could not be packed for upload. In daemon mode the
+    report waits until the server is free, replacing any still waiting
+  */
+  puts(error_buffer);
+  if (tm->looping) {
+    strcpy(tm->error_pending, error_buffer);
+    server_next(tm);
+    return 0;
+  }
+  tm->upload_cbor = 0;
+  if (pack_error(error_buffer, &tm->upload_body)) {
+    return IO_ERROR;
+  }
+
+  put_upload_body(tm);
+
+  return 0;
+}
+
+static char *describe_device(TEMPMON *tm, char *buffer)
+{
+  /* write how the device is identified in error messages into buffer */
+  if (tm->device_serial[0] != '\0') {
+    sprintf(buffer, "serial number %s", tm->device_serial);
+  } else {
+    sprintf(buffer,
+	    "vendor ID %d and product ID %d",
+	    tm->device_vendor_id,
+	    tm->device_product_id);
+  }
+  return buffer;
+}
+
+static char *describe_failure(TEMPMON *tm, int failure, char *buffer)
+{
+  /*
+    write the error message for the device failing as open_monitor or
+    read_device reported into buffer
+  */
+  char device[127];
+
+  describe_device(tm, device);
+  switch (failure) {
+  case DEVICE_DETACH_FAILED:
+    sprintf(buffer, "failed to detach device with %s.", device);
+    break;
+  case DEVICE_OPEN_FAILED:
+    sprintf(buffer, "failed to open device with %s.", device);
+    break;
+  case DEVICE_PREPARE_FAILED:
+    sprintf(buffer, "failed to prepare device with %s.", device);
+    break;
+  case READ_DEVICE_TIMEOUT:
+    sprintf(buffer,
+	    "device with %s did not reply within %d ms.",
+	    device,
+	    REPLY_TIMEOUT*REPLY_ATTEMPTS);
+    break;
+  case READ_DEVICE_BAD_REPLY:
+    sprintf(buffer, "device with %s sent a reply that could not be read.",
+	    device);
+    break;
+  default:
+    sprintf(buffer, "failed to read device with %s.", device);
+    break;
+  }
+  return buffer;
+}
+
+static int open_monitor(TEMPMON *tm)
+{
+  /*
+    detach the kernel driver from, open and prepare the temperature monitor
+    with the device IDs (and the serial number, if any); returns 0 on success
+    or DEVICE_DETACH_FAILED, DEVICE_OPEN_FAILED or DEVICE_PREPARE_FAILED,
+    which the caller reports. Only uses what the opener thread may
+  */
+  char *serial;
+  int err;
+
+  serial = (tm->device_serial[0] != '\0') ? tm->device_serial : NULL;
+
+  printf("Detaching device kernel... ");
+  if (serial != NULL) {
+    err = detach_device_kernel_serial(tm->usb_context,
+				      tm->device_vendor_id,
+				      tm->device_product_id,
+				      serial);
+  } else {
+    err = detach_device_kernel(tm->usb_context,
+			       tm->device_vendor_id,
+			       tm->device_product_id);
+  }
+  if (err) {
+    return DEVICE_DETACH_FAILED;
+  }
+  printf("done\n");
+
+  /* without a serial number this opens the first device found */
+  printf("Opening device... ");
+  if (ftdi_usb_open_desc(tm->ftHandle,
+			 tm->device_vendor_id,
+			 tm->device_product_id,
+			 NULL,
+			 serial)) {
+    return DEVICE_OPEN_FAILED;
+  }
+  printf("done\n");
+
+  printf("Preparing device... ");
+  if (prepare_device(tm->ftHandle)) {
+    ftdi_usb_close(tm->ftHandle);
+    return DEVICE_PREPARE_FAILED;
+  }
+  printf("done\n");
+
+  return 0;
+}
+
+static int take_reading(TEMPMON *tm, SEM710_READINGS *readings)
+{
+  /*
+    read the process values from the open monitor into readings, reporting
+    any failure to the server; returns 0 on success or an exit status
+  */
+  char error_buffer[255];
+  int read_bytes;
+  uint8_t reading_buffer[280];
+
+  printf("Reading device... ");
+  read_bytes = read_device(tm->ftHandle,
+			   SEM_COMMANDS_cREAD_PROCESS,
+			   reading_buffer);
+  if (read_bytes > 0 && get_readings(readings, reading_buffer, read_bytes)) {
+    read_bytes = READ_DEVICE_BAD_REPLY;
+  }
+  if (read_bytes <= 0) {
+    describe_failure(tm, read_bytes, error_buffer);
+    return report_error(tm, error_buffer) ? IO_ERROR : USB_READ_ERROR;
+  }
+  printf("done\n");
+
+  return 0;
+}
+
+static int update_expected(TEMPMON *tm)
+{
+  /*
+    returns whether the server expects an update: always, until it has said
+    otherwise in a specifications response received since starting
+  */
+  return difftime(time(NULL), tm->update_due_at) >= 0;
+}
+
+
+static int status_changed(TEMPMON *tm, READ_STATUS status)
+{
+  /*
+    returns whether the status differs from the one last uploaded, as the
+    server remembers it until something was uploaded since starting
+  */
+  if (tm->deadband.sent) {
+    return status != tm->deadband.status;
+  }
+  return strcmp(get_read_status_string(status),
+		tm->last_read_status) != 0;
+}
+
+static void keep_history(TEMPMON *tm, TIMED_READING *reading)
+{
+  /* add the reading to the history, if kept */
+  if (tm->keeping_history && history_append(&tm->history, reading)) {
+    puts("reading taken before the last one in the history, not kept in it");
+  }
+}
+
+static int upload_reading(TEMPMON *tm, TIMED_READING *reading)
+{
+  /*
+    upload the given reading if the server is expecting an update; returns
+    0 on success, IO_ERROR if the reading could not be packed or
+    SERVER_ERROR if the server did not respond
+  */
+  char error_buffer[255];
+  int http_response_code;
+
+  printf("Uploading reading to server... ");
+
+  if (update_expected(tm) || status_changed(tm, reading->status)) {
+    /*
+      if the time since the last read is greater than the required wait time,
+      or if the status has changed since the last read, update.
+    */
+    if (pack_upload(tm, reading, 1, 1)) {
+      sprintf(error_buffer,
+	      "Failed to pack reading for upload.");
+      report_error(tm, error_buffer);
+      return IO_ERROR;
+    }
+
+    http_response_code = put_upload_body(tm);
+
+    if (http_response_code == 0) {
+      printf("no response from server.\n");
+      return SERVER_ERROR;
+    }
+  }
+  printf("done\n");
+
+  return 0;
+}
+
+static int upload_batch(TEMPMON *tm)
+{
+  /*
+    upload every reading collected in the batch as a single request and
+    empty it; returns 0 on success, IO_ERROR if the batch could not be packed
+    or SERVER_ERROR if the server did not respond
+  */
+  int http_response_code;
+
+  printf("Uploading %d readings to server... ", tm->batch.count);
+  if (pack_upload(tm, tm->batch.readings, tm->batch.count, 0)) {
+    report_error(tm, "Failed to pack readings for upload.");
+    return IO_ERROR;
+  }
+
+  http_response_code = put_upload_body(tm);
+  batch_clear(&tm->batch);
+
+  if (http_response_code == 0) {
+    printf("no response from server.\n");
+    return SERVER_ERROR;
+  }
+  printf("done\n");
+
+  return 0;
+}
+
+static int connect_to_server(TEMPMON *tm)
+{
+  /*
+    authenticate with the server, unless a saved session is still held, and
+    fetch the container specifications; returns 0 on success or SERVER_ERROR
+  */
+  int saved_session = tm->logged_in;
+  int http_response_code;
+
+  if (!tm->logged_in) {
+    printf("Authenticating with server... ");
+    http_response_code = authenticate(tm);
+    if (http_response_code == 0) {
+      printf("no response from server.\n");
+      return SERVER_ERROR;
+    }
+    if (!tm->logged_in) {
+      printf("server refused the login with %d.\n", http_response_code);
+      return SERVER_ERROR;
+    }
+    printf("done\n");
+  }
+
+  printf("Getting specifications from server... ");
+  if (get_specifications(tm)) {
+    if (!saved_session) {
+      return SERVER_ERROR;
+    }
+    /* the saved session may not be accepted any more, so log in afresh */
+    tm->logged_in = 0;
+    return connect_to_server(tm);
+  }
+  printf("done\n");
+
+  /* the device is looked for with the IDs received first */
+  tm->device_vendor_id = tm->specs.device_vendor_id;
+  tm->device_product_id = tm->specs.device_product_id;
+
+  return 0;
+}
+
+static int run_once(TEMPMON *tm)
+{
+  /*
+    perform a single connect, read and upload cycle; returns the program exit
+    status
+  */
+  int err;
+  SEM710_READINGS readings;
+  TIMED_READING reading;
+  char error_buffer[255];
+
+  err = connect_to_server(tm);
+  if (err) {
+    return err;
+  }
+
+  /*
+    From this point all errors can be properly reported to the server, since we
+    know the upload location.
+   */
+  err = open_monitor(tm);
+  if (err) {
+    describe_failure(tm, err, error_buffer);
+    return report_error(tm, error_buffer) ? IO_ERROR : USB_OPEN_ERROR;
+  }
+
+  err = take_reading(tm, &readings);
+  ftdi_usb_close(tm->ftHandle);
+  if (err) {
+    return err;
+  }
+
+  memset(&reading, 0, sizeof(reading));
+  reading.timestamp = time(NULL);
+  reading.temperature = readings.PROCESS_VARIABLE;
+  reading.status = get_device_read_status_code(reading.temperature,
+					       tm->globals.expected_temperature,
+					       tm->globals.temperature_range);
+  keep_history(tm, &reading);
+
+  return upload_reading(tm, &reading);
+}
+
+static int change_server(TEMPMON *monitors, int count, char *url)
+{
+  /*
+    switch every monitor to the server at the given URL and remember it for
+    the next run; the specifications are fetched again from the new server on
+    the next cycle, which also logs in there. Returns 1, changing nothing, if
+    any monitor's URLs would be too long on that server
+  */
+  TEMPMON_SPECIFICATIONS specs;
+  TEMPMON_GLOBALS globals;
+  int i;
+
+  printf("Server announced at %s\n", url);
+  for (i = 0; i < count; i++) {
+    globals = monitors[i].globals;
+    specs = monitors[i].specs;
+    if (set_server_url(&globals, url) || set_upload_url(&specs, url)) {
+      puts("its URLs would be too long, so the server is not changed");
+      return 1;
+    }
+  }
+  if (save_server_url(URL_FILE, url)) {
+    printf("failed to record the server URL in \"%s\"\n", URL_FILE);
+  }
+
+  for (i = 0; i < count; i++) {
+    set_server_url(&monitors[i].globals, url);
+    set_upload_url(&monitors[i].specs, url);
+    monitors[i].specs.fetched_at = 0;
+  }
+  return 0;
+}
+
+static int listen_for_server(TEMPMON *monitors, int count, int timeout)
+{
+  /*
+    wait up to timeout milliseconds for the server to announce itself,
+    switching the monitors over if it has moved; returns whether it did,
+    ignoring a server the monitors' URLs would be too long for
+  */
+  char url[255];
+
+  if (discovery.fd < 0 ||
+      discovery_poll(&discovery, timeout, url, sizeof(url)) != 1) {
+    return 0;
+  }
+  if (strcmp(url, monitors[0].globals.server_url_base) != 0 &&
+      change_server(monitors, count, url)) {
+    return 0;
+  }
+  return 1;
+}
+
+static int rediscover_server(TEMPMON *monitors, int count)
+{
+  /*
+    ask the server to announce itself and wait up to discovery_timeout
+    seconds for it to, switching the monitors over if it has moved; returns 0
+    once it has announced itself, or SERVER_ERROR
+  */
+  struct timespec start;
+  struct timespec now;
+  long remaining;
+
+  if (discovery.fd < 0) {
+    return SERVER_ERROR;
+  }
+
+  puts("Waiting for the server to announce itself...");
+  discovery_request(&discovery);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (daemon_running) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    remaining = monitors[0].globals.discovery_timeout*1000L -
+      ((now.tv_sec - start.tv_sec)*1000L +
+       (now.tv_nsec - start.tv_nsec)/1000000);
+    if (remaining <= 0) {
+      break;
+    }
+    if (listen_for_server(monitors, count, (int) remaining)) {
+      return 0;
+    }
+  }
+
+  puts("the server did not announce itself.");
+  return SERVER_ERROR;
+}
+
+static void apply_globals(TEMPMON *tm, TEMPMON_GLOBALS *globals)
+{
+  /*
+    take on the reloaded globals that can change while running: the server
+    paths and login, the container (unless several devices are monitored)
+    and the timings. The specifications are fetched again if they are now at
+    another URL
+  */
+  TEMPMON_GLOBALS *current = &tm->globals;
+  TEMPMON_GLOBALS updated;
+  char server_url_specifications[255];
+
+  strcpy(server_url_specifications, current->server_url_specifications);
+
+  strcpy(current->server_login_email, globals->server_login_email);
+  strcpy(current->server_login_password, globals->server_login_password);
+
+  /* the paths are only taken on if the URLs made from them fit */
+  updated = *current;
+  strcpy(updated.server_path_authentication,
+	 globals->server_path_authentication);
+  strcpy(updated.server_path_containers, globals->server_path_containers);
+  strcpy(updated.server_path_specifications,
+	 globals->server_path_specifications);
+  if (updated.devices[0] == '\0') {
+    strcpy(updated.container_num, globals->container_num);
+  }
+  if (set_server_url(&updated, current->server_url_base)) {
+    printf("the server URLs for container %s would be too long, keeping "
+	   "its paths\n",
+	   current->container_num);
+  } else {
+    *current = updated;
+  }
+
+  current->read_interval = globals->read_interval;
+  __atomic_store_n(&tm->sample_interval,
+		   current->read_interval,
+		   __ATOMIC_RELAXED);
+  current->specifications_refresh = globals->specifications_refresh;
+  current->batch_latency = globals->batch_latency;
+  current->journal_sync_every = globals->journal_sync_every;
+  current->expected_temperature = globals->expected_temperature;
+  current->temperature_range = globals->temperature_range;
+  current->deadband = globals->deadband;
+  current->max_silence = globals->max_silence;
+  current->compression_level = globals->compression_level;
+  current->compression_threshold = globals->compression_threshold;
+  current->upload_cbor = globals->upload_cbor;
+  current->discovery_timeout = globals->discovery_timeout;
+
+  tm->batch.latency = current->batch_latency;
+  tm->deadband.width = current->deadband;
+  tm->deadband.max_silence = current->max_silence;
+  http_set_compression(&tm->http,
+		       current->compression_level,
+		       current->compression_threshold);
+  if (tm->journaling) {
+    tm->journal.sync_every = current->journal_sync_every;
+  }
+
+  if (strcmp(server_url_specifications,
+	     current->server_url_specifications) != 0) {
+    tm->specs.fetched_at = 0;
+    memset(&tm->specs.validators, 0, sizeof(tm->specs.validators));
+  }
+}
+
+static void reload_globals(TEMPMON *monitors, int count)
+{
+  /*
+    read the globals file again after it changed and apply it to every
+    monitor; the current globals are kept if it cannot be read
+  */
+  TEMPMON_GLOBALS globals;
+  TEMPMON_GLOBALS *current = &monitors[0].globals;
+  int i;
+
+  printf("Reloading globals from file... ");
+  memset(&globals, 0, sizeof(globals));
+  if (get_globals(&globals)) {
+    puts("keeping the current globals");
+    return;
+  }
+
+  for (i = 0; i < count; i++) {
+    apply_globals(&monitors[i], &globals);
+  }
+  printf("done\n");
+
+  if (strcmp(globals.devices, current->devices) != 0 ||
+      strcmp(globals.journal_path, current->journal_path) != 0 ||
+      globals.journal_capacity != current->journal_capacity ||
+      strcmp(globals.history_path, current->history_path) != 0 ||
+      globals.history_capacity != current->history_capacity ||
+      globals.history_retention != current->history_retention ||
+      globals.batch_size != current->batch_size ||
+      globals.queue_capacity != current->queue_capacity ||
+      globals.queue_overflow != current->queue_overflow ||
+      globals.oversample_interval != current->oversample_interval) {
+    puts("devices, batch_size, journal, history, queue and oversampling "
+	 "changes take effect on restart");
+  }
+}
+
+static void end_loop(int status)
+{
+  /* the first failure is the one the daemon exits with */
+  if (loop.status == 0) {
+    loop.status = status;
+  }
+}
+
+static void server_found(void)
+{
+  /* stop waiting for the server to announce itself */
+  if (loop.awaiting_server) {
+    timer_cancel(&loop.discovery_deadline);
+    loop.awaiting_server = 0;
+  }
+}
+
+static void await_server(void)
+{
+  /*
+    ask the server to announce itself, in case it has moved, ending the loop
+    with SERVER_ERROR unless it does within discovery_timeout seconds; the
+    monitors keep sampling meanwhile
+  */
+  if (loop.awaiting_server) {
+    return;
+  }
+  if (discovery.fd < 0) {
+    end_loop(SERVER_ERROR);
+    return;
+  }
+
+  puts("Waiting for the server to announce itself...");
+  discovery_request(&discovery);
+  timer_after(&loop.discovery_deadline,
+	      loop.monitors[0].globals.discovery_timeout*1000L);
+  loop.awaiting_server = 1;
+}
+
+static void retry_later(TEMPMON *tm)
+{
+  /*
+    leave the server be for a while, backing off for as long as it keeps
+    failing, with the readings kept in the journal or the batch meanwhile
+  */
+  int delay;
+
+  tm->upload_failures++;
+  delay = MAX_UPLOAD_RETRY_DELAY;
+  if (tm->upload_failures <= 16) {
+    delay = tm->globals.read_interval << (tm->upload_failures - 1);
+    if (delay > MAX_UPLOAD_RETRY_DELAY) {
+      delay = MAX_UPLOAD_RETRY_DELAY;
+    }
+  }
+  tm->upload_retry_at = time(NULL) + delay;
+  if (tm->journaling) {
+    printf("%llu readings kept in journal, retrying in %d seconds\n",
+	   (unsigned long long) journal_pending(&tm->journal),
+	   delay);
+  } else {
+    printf("%d readings kept in batch, retrying in %d seconds\n",
+	   tm->batch.count,
+	   delay);
+  }
+}
+
+static void server_unreachable(TEMPMON *tm,
+			       SERVER_JOB job,
+			       int http_response_code)
+{
+  /*
+    the server did not respond to the given job, or answered with a server
+    error. Journaled readings survive that, so the server is tried again
+    later; otherwise it may have moved, so it is asked where it is
+  */
+  if (http_response_code == 0) {
+    printf("no response from server.\n");
+  } else {
+    printf("server failed with %d.\n", http_response_code);
+  }
+  if (!tm->journaling) {
+    await_server();
+    return;
+  }
+
+  /* keep sampling with the specifications we have */
+  if (job == JOB_SPECIFICATIONS) {
+    tm->specs.fetched_at = time(NULL);
+  }
+  retry_later(tm);
+}
+
+static void journal_acked(TEMPMON *tm)
+{
+  /* the readings uploaded are done with, and the batch once all of them are */
+  journal_ack(&tm->journal, tm->journal_next);
+  if (journal_pending(&tm->journal) == 0) {
+    tm->draining = 0;
+    batch_clear(&tm->batch);
+  }
+}
+
+static void upload_accepted(TEMPMON *tm)
+{
+  /*
+    the server has the readings uploaded; those taken while they were sent
+    stay in the batch until it is due again
+  */
+  if (tm->journaling) {
+    journal_acked(tm);
+    return;
+  }
+  batch_remove(&tm->batch, tm->batch_uploading);
+  tm->batch_uploading = 0;
+  tm->draining = batch_due(&tm->batch, time(NULL));
+}
+
+static void server_replied(void *data, int http_response_code)
+{
+  /*
+    the job in flight is over, with the given http code or 0 if the server
+    did not respond; act on the response and go on to the next job
+  */
+  TEMPMON *tm = (TEMPMON *) data;
+  SERVER_JOB job = tm->job;
+
+  tm->job = JOB_NONE;
+  /*
+    a server error, as from a server or proxy restarting, is waited out like
+    no response when the readings are journaled, so they are not let go
+  */
+  if (http_response_code == 0 ||
+      (tm->journaling && http_response_code >= 500)) {
+    reset_string(&tm->response);
+    tm->job_retried = 0;
+    /* error reports are not worth waiting for the server over */
+    if (job != JOB_ERROR) {
+      server_unreachable(tm, job, http_response_code);
+    }
+    return;
+  }
+
+  server_found();
+  tm->upload_retry_at = 0;
+
+  if (job == JOB_LOGIN) {
+    tm->logged_in = login_accepted(http_response_code);
+    if (!tm->logged_in) {
+      /* asking again straight away would only be refused again */
+      printf("server refused the login with %d.\n", http_response_code);
+      retry_later(tm);
+    }
+  } else if ((http_response_code == 401 || http_response_code == 403) &&
+	     !tm->job_retried) {
+    /* the session is missing or has expired, so log in and try again */
+    printf("session expired, logging in again...\n");
+    tm->logged_in = 0;
+    tm->job_retried = 1;
+    if (job != JOB_SPECIFICATIONS) {
+      tm->resend = job;
+    }
+  } else if (job == JOB_UPLOAD && !tm->job_retried &&
+	     cbor_refused(tm, http_response_code)) {
+    /* the same readings go up again, as JSON */
+    tm->job_retried = 1;
+    tm->resend = job;
+  } else if (job == JOB_SPECIFICATIONS) {
+    if (specifications_received(tm, http_response_code) == 0) {
+      tm->job_retried = 0;
+    } else if (!tm->job_retried) {
+      /* the session may not be accepted any more, so log in afresh */
+      tm->logged_in = 0;
+      tm->job_retried = 1;
+    } else {
+      tm->job_retried = 0;
+      server_unreachable(tm, job, http_response_code);
+    }
+  } else {
+    tm->job_retried = 0;
+
+    /* the upload location has moved, so the specifications are out of date */
+    if (http_response_code == 404) {
+      forget_specifications(tm);
+    }
+    if (job == JOB_UPLOAD) {
+      if (http_response_code >= 200 && http_response_code < 300) {
+	/* only an upload accepted ends the backing off */
+	tm->upload_failures = 0;
+	update_sent(tm);
+	upload_accepted(tm);
+      } else if (tm->journaling || tm->batch.size > 1) {
+	/* refused, maybe until the specifications are fetched again */
+	printf("server refused the upload with %d.\n", http_response_code);
+	retry_later(tm);
+      }
+    }
+  }
+  reset_string(&tm->response);
+
+  server_next(tm);
+}
+
+static void send_upload_body(TEMPMON *tm, SERVER_JOB job)
+{
+  /* PUT the upload body to the server for the given job */
+  int http_response_code;
+
+  tm->job = job;
+  tm->resend = JOB_NONE;
+  http_run_on(&tm->http, &loop.http, server_replied, tm);
+  http_response_code =
+    http_PUT_buffer(&tm->http,
+		    tm->specs.server_url_reading_upload,
+		    NULL,
+		    NULL,
+		    upload_content_type(tm),
+		    &tm->upload_body,
+		    &tm->response);
+  if (http_response_code != HTTP_PENDING) {
+    server_replied(tm, http_response_code);
+  }
+}
+
+static int upload_owed(TEMPMON *tm)
+{
+  /* whether there are readings to upload */
+  if (tm->journaling) {
+    return tm->draining && journal_pending(&tm->journal) > 0;
+  }
+  return tm->reading_pending || tm->draining;
+}
+
+static void start_upload(TEMPMON *tm)
+{
+  /*
+    pack the readings owed into the upload body and send it: the latest
+    reading on its own, the batch, or up to JOURNAL_UPLOAD_SIZE of the
+    oldest journaled readings, which stay journaled until the server has
+    them
+  */
+  int count;
+  int err;
+
+  if (!tm->journaling && tm->batch.size <= 1) {
+    printf("Uploading reading to server\n");
+    err = pack_upload(tm, &tm->latest_reading, 1, 1);
+    tm->reading_pending = 0;
+  } else if (!tm->journaling) {
+    /* the batch is only emptied once the server has it */
+    printf("Uploading %d readings to server\n", tm->batch.count);
+    err = pack_upload(tm, tm->batch.readings, tm->batch.count, 0);
+    tm->batch_uploading = tm->batch.count;
+  } else {
+    count = journal_peek(&tm->journal,
+			 tm->journal_upload,
+			 JOURNAL_UPLOAD_SIZE,
+			 &tm->journal_next);
+    if (count == 0) {
+      /* only damaged records were left */
+      journal_acked(tm);
+      return;
+    }
+    printf("Uploading %d readings to server\n", count);
+    if (count == 1 && tm->batch.size <= 1) {
+      /* a lone reading goes up the same way as without the journal */
+      err = pack_upload(tm, tm->journal_upload, 1, 1);
+    } else {
+      err = pack_upload(tm, tm->journal_upload, count, 0);
+    }
+  }
+
+  if (err) {
+    puts("Failed to pack readings for upload.");
+    end_loop(IO_ERROR);
+    return;
+  }
+  send_upload_body(tm, JOB_UPLOAD);
+}
+
+static void start_login(TEMPMON *tm)
+{
+  char postfield_buffer[1023];
+  int http_response_code;
+
+  printf("Authenticating with server\n");
+  login_postfields(&tm->globals, postfield_buffer);
+
+  tm->job = JOB_LOGIN;
+  http_run_on(&tm->http, &loop.http, server_replied, tm);
+  http_response_code = http_POST(&tm->http,
+				 tm->globals.server_url_authentication,
+				 NULL,
+				 NULL,
+				 NULL,
+				 postfield_buffer,
+				 &tm->response);
+  if (http_response_code != HTTP_PENDING) {
+    server_replied(tm, http_response_code);
+  }
+}
+
+static void start_specifications(TEMPMON *tm)
+{
+  int http_response_code;
+
+  printf("Refreshing specifications from server\n");
+  reset_string(&tm->response);
+
+  tm->job = JOB_SPECIFICATIONS;
+  http_run_on(&tm->http, &loop.http, server_replied, tm);
+  http_response_code =
+    http_GET_conditional(&tm->http,
+			 tm->globals.server_url_specifications,
+			 &tm->specs.validators,
+			 &tm->response);
+  if (http_response_code != HTTP_PENDING) {
+    server_replied(tm, http_response_code);
+  }
+}
+
+static void server_next(TEMPMON *tm)
+{
+  /*
+    start the next request the server is owed, unless one is in flight:
+    logging in comes first, then the specifications once they are due, then
+    errors and last of all readings. While the server is unreachable nothing
+    is asked of it until it is due to be tried again
+  */
+  if (!tm->looping || tm->job != JOB_NONE || loop.status != 0 ||
+      time(NULL) < tm->upload_retry_at) {
+    return;
+  }
+
+  if (!tm->logged_in) {
+    start_login(tm);
+  } else if (tm->resend != JOB_NONE) {
+    send_upload_body(tm, tm->resend);
+  } else if (specifications_due(tm)) {
+    start_specifications(tm);
+  } else if (tm->error_pending[0] != '\0') {
+    tm->upload_cbor = 0;
+    if (pack_error(tm->error_pending, &tm->upload_body)) {
+      end_loop(IO_ERROR);
+      return;
+    }
+    tm->error_pending[0] = '\0';
+    send_upload_body(tm, JOB_ERROR);
+  } else if (upload_owed(tm)) {
+    start_upload(tm);
+  }
+}
+
+static READ_STATUS reading_status(TEMPMON *tm, TIMED_READING *reading)
+{
+  /*
+    the status of the reading; a summarized one is out of range if any of
+    the readings summarized were, so short excursions are not missed
+  */
+  TEMPMON_GLOBALS *globals = &tm->globals;
+  READ_STATUS status;
+  READ_STATUS extreme;
+
+  status = get_device_read_status_code(reading->temperature,
+				       globals->expected_temperature,
+				       globals->temperature_range);
+  if (status == READ_STATUS_OK && reading->summary.samples > 0) {
+    extreme = get_device_read_status_code(reading->summary.min,
+					  globals->expected_temperature,
+					  globals->temperature_range);
+    status = (extreme != READ_STATUS_OK) ? extreme :
+      get_device_read_status_code(reading->summary.max,
+				  globals->expected_temperature,
+				  globals->temperature_range);
+  }
+  return status;
+}
+
+static void record_reading(TEMPMON *tm, SAMPLE *sample)
+{
+  /*
+    keep the reading taken in the history and journal it if enabled, then
+    have it uploaded as soon as the server is free, or add it to the batch if
+    batching is enabled, having the batch uploaded once it is due; a reading
+    within the deadband of the last one uploaded is let go, unless it is due
+    as a heartbeat
+  */
+  TIMED_READING reading;
+  int expected;
+  uint64_t next;
+
+  reading.timestamp = sample->taken_at;
+  reading.temperature = sample->readings.PROCESS_VARIABLE;
+  reading.summary = sample->summary;
+  reading.status = reading_status(tm, &reading);
+  /* the history keeps even what the server is not told */
+  keep_history(tm, &reading);
+
+  switch (deadband_check(&tm->deadband, &reading)) {
+  case DEADBAND_QUIET:
+    /* the server already knows as much */
+    server_next(tm);
+    return;
+  case DEADBAND_HEARTBEAT:
+    /* the statistics add nothing to the last upload either */
+    memset(&reading.summary, 0, sizeof(reading.summary));
+    break;
+  case DEADBAND_SEND:
+    break;
+  }
+  expected = (update_expected(tm) ||
+	      status_changed(tm, reading.status));
+
+  if (tm->journaling && journal_append(&tm->journal, &reading)) {
+    puts("failed to sync the reading journal");
+  }
+
+  if (tm->batch.size <= 1) {
+    if (!tm->journaling) {
+      /* only the latest reading is sent, when the server expects one */
+      if (expected) {
+	tm->latest_reading = reading;
+	tm->reading_pending = 1;
+	deadband_sent(&tm->deadband, &reading);
+      }
+    } else if (!expected && journal_pending(&tm->journal) == 1) {
+      /* the server is not expecting this reading, and nothing is owed */
+      journal_peek(&tm->journal, tm->journal_upload, 1, &next);
+      journal_ack(&tm->journal, next);
+    } else {
+      tm->draining = 1;
+      deadband_sent(&tm->deadband, &reading);
+    }
+  } else {
+    /*
+      the batch fills up while an upload is in flight or retried; a reading
+      it has no room for is still uploaded from the journal, if any
+    */
+    if (batch_add(&tm->batch, &reading) == 0 || tm->journaling) {
+      deadband_sent(&tm->deadband, &reading);
+    } else {
+      tm->batch_dropped++;
+      printf("reading batch full, %llu readings dropped\n",
+	     (unsigned long long) tm->batch_dropped);
+    }
+    if (batch_due(&tm->batch, reading.timestamp)) {
+      tm->draining = 1;
+    }
+  }
+
+  server_next(tm);
+}
+
+static void report_queue(TEMPMON *tm, int always)
+{
+  /*
+    print how the readings queue has fared, always or only when readings
+    were dropped or spilled since it was last printed
+  */
+  RING_STATS stats;
+
+  ring_stats(&tm->samples, &stats);
+  if (!always && stats.dropped + stats.spilled == tm->samples_overflowed) {
+    return;
+  }
+  tm->samples_overflowed = stats.dropped + stats.spilled;
+  printf("Readings queue for container %s: %llu queued, %llu dropped, "
+	 "%llu spilled, %llu waiting, at most %llu at once\n",
+	 tm->globals.container_num,
+	 (unsigned long long) stats.pushed,
+	 (unsigned long long) stats.dropped,
+	 (unsigned long long) stats.spilled,
+	 (unsigned long long) stats.depth,
+	 (unsigned long long) stats.max_depth);
+}
+
+static void take_samples(void)
+{
+  /*
+    record the readings the sampler has queued for every monitor since last
+    time and report the devices that failed, in the order they were taken
+  */
+  char error_buffer[255];
+  SAMPLE sample;
+  TEMPMON *tm;
+  int i;
+
+  for (i = 0; i < loop.count; i++) {
+    tm = &loop.monitors[i];
+    while (ring_pop(&tm->samples, &sample)) {
+      if (sample.result > 0) {
+	record_reading(tm, &sample);
+      } else {
+	report_error(tm, describe_failure(tm, sample.result, error_buffer));
+      }
+    }
+    report_queue(tm, 0);
+
+    /* don't let a batch go stale while the device is not answering */
+    if (batch_due(&tm->batch, time(NULL))) {
+      tm->draining = 1;
+    }
+    server_next(tm);
+  }
+}
+
+static void samples_ready(void *data, int fd, uint32_t events)
+{
+  uint64_t count;
+
+  (void) data;
+  (void) events;
+
+  if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+    return;
+  }
+  if (__atomic_load_n(&sampler.status, __ATOMIC_ACQUIRE) != 0) {
+    puts("the sampler thread failed");
+    end_loop(IO_ERROR);
+    return;
+  }
+  take_samples();
+}
+
+static void notify(int fd)
+{
+  /* add to the count of the given eventfd, waking whatever waits on it */
+  uint64_t one = 1;
+
+  if (write(fd, &one, sizeof(one)) != sizeof(one)) {
+    /* the count is so high that it is already waking it */
+    return;
+  }
+}
+
+static void queue_sample(TEMPMON *tm,
+			 int result,
+			 SEM710_READINGS *readings,
+			 READING_SUMMARY *summary)
+{
+  /*
+    hand the reading taken, and its summary when oversampling, or how the
+    device failed, over to the loop. Runs on the sampler thread, which never
+    waits for the loop: once the queue is full, readings are dropped or
+    spilled as queue_overflow says
+  */
+  SAMPLE sample;
+
+  memset(&sample, 0, sizeof(sample));
+  sample.taken_at = tm->read_at;
+  sample.result = result;
+  if (readings != NULL) {
+    sample.readings = *readings;
+  }
+  if (summary != NULL) {
+    sample.summary = *summary;
+  }
+  ring_push(&tm->samples, &sample);
+  notify(sampler.wake_fd);
+}
+
+static void sample_failed(TEMPMON *tm, int failure)
+{
+  /*
+    queue how the device failed, or when oversampling keep it until the
+    summary is due, only queuing it then if no reading could be taken
+  */
+  if (tm->globals.oversample_interval > 0) {
+    tm->last_failure = failure;
+  } else {
+    queue_sample(tm, failure, NULL, NULL);
+  }
+}
+
+static void queue_summary(TEMPMON *tm)
+{
+  /*
+    queue the summary of the readings taken since the last one, along with
+    the last of them, or how the device last failed if none were taken
+  */
+  READING_SUMMARY summary;
+  char device[127];
+
+  tm->read_at = time(NULL);
+  aggregate_summary(&tm->aggregate, &summary);
+  if (summary.samples > 0) {
+    printf("Read device with %s %u times\n",
+	   describe_device(tm, device),
+	   summary.samples);
+    queue_sample(tm, (int) summary.samples, &tm->last_readings, &summary);
+  } else if (tm->last_failure != 0) {
+    queue_sample(tm, tm->last_failure, NULL, NULL);
+  }
+  aggregate_clear(&tm->aggregate);
+  tm->last_failure = 0;
+}
+
+static void reading_taken(void *data, int read_bytes)
+{
+  /*
+    the reading asked for by take_sample is over, with the length of the
+    reply or what read_device would have failed with; a failed device is
+    closed so it is reopened for the next reading
+  */
+  TEMPMON *tm = (TEMPMON *) data;
+  SEM710_READINGS readings;
+  char device[127];
+
+  if (read_bytes > 0 &&
+      get_readings(&readings, tm->reading_buffer, read_bytes)) {
+    read_bytes = READ_DEVICE_BAD_REPLY;
+  }
+  if (read_bytes <= 0) {
+    ftdi_usb_close(tm->ftHandle);
+    tm->device_open = 0;
+    sample_failed(tm, read_bytes);
+    return;
+  }
+  if (tm->globals.oversample_interval > 0) {
+    aggregate_add(&tm->aggregate, readings.PROCESS_VARIABLE);
+    tm->last_readings = readings;
+    return;
+  }
+  printf("Read device with %s\n", describe_device(tm, device));
+  queue_sample(tm, read_bytes, &readings, NULL);
+}
+
+static int time_reached(const struct timespec *time,
+			const struct timespec *now)
+{
+  return (time->tv_sec < now->tv_sec ||
+	  (time->tv_sec == now->tv_sec && time->tv_nsec <= now->tv_nsec));
+}
+
+static void read_monitor(TEMPMON *tm)
+{
+  /* start reading the open device, see reading_taken */
+  int err;
+
+  err = read_device_start(&tm->device_read,
+			  tm->ftHandle,
+			  SEM_COMMANDS_cREAD_PROCESS,
+			  tm->reading_buffer,
+			  reading_taken,
+			  tm);
+  if (err) {
+    reading_taken(tm, err);
+  }
+}
+
+static void request_open(TEMPMON *tm)
+{
+  /* hand the device over to the opener thread, see devices_opened */
+  tm->device_opening = 1;
+  pthread_mutex_lock(&sampler.open_lock);
+  tm->open_wanted = 1;
+  pthread_cond_signal(&sampler.open_wanted);
+  pthread_mutex_unlock(&sampler.open_lock);
+}
+
+static void devices_opened(void *data, int fd, uint32_t events)
+{
+  /*
+    take back the devices the opener thread is done with, starting the
+    reading each was opened for
+  */
+  uint64_t count;
+  TEMPMON *tm;
+  int i;
+
+  (void) data;
+  (void) events;
+
+  if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+    return;
+  }
+  for (i = 0; i < sampler.count; i++) {
+    tm = &sampler.monitors[i];
+    if (!__atomic_load_n(&tm->open_done, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    tm->open_done = 0;
+    tm->device_opening = 0;
+    if (tm->open_result) {
+      sample_failed(tm, tm->open_result);
+      continue;
+    }
+    tm->device_open = 1;
+    read_monitor(tm);
+  }
+}
+
+static void *run_opener(void *data)
+{
+  /* open the devices the sampler asks for until stopped */
+  TEMPMON *tm;
+  int i;
+
+  (void) data;
+
+  pthread_mutex_lock(&sampler.open_lock);
+  while (!sampler.opener_stopping) {
+    tm = NULL;
+    for (i = 0; i < sampler.count && tm == NULL; i++) {
+      if (sampler.monitors[i].open_wanted) {
+	tm = &sampler.monitors[i];
+      }
+    }
+    if (tm == NULL) {
+      pthread_cond_wait(&sampler.open_wanted, &sampler.open_lock);
+      continue;
+    }
+    tm->open_wanted = 0;
+    pthread_mutex_unlock(&sampler.open_lock);
+
+    tm->open_result = open_monitor(tm);
+    __atomic_store_n(&tm->open_done, 1, __ATOMIC_RELEASE);
+    notify(sampler.opened_fd);
+
+    pthread_mutex_lock(&sampler.open_lock);
+  }
+  pthread_mutex_unlock(&sampler.open_lock);
+  return NULL;
+}
+
+static void take_sample(void *data, int fd, uint32_t events)
+{
+  /*
+    start reading the device when a reading is due. Readings are due every
+    read_interval seconds from the first, or every oversample_interval
+    milliseconds when oversampling, in which case a summary of them is
+    queued every read_interval seconds instead. One that can not be taken on
+    time, because the last is still being read, is skipped rather than taken
+    late. A closed device is opened by the opener thread first
+  */
+  TEMPMON *tm = (TEMPMON *) data;
+  int oversampling = (tm->globals.oversample_interval > 0);
+  struct timespec now;
+  char device[127];
+  long period;
+
+  (void) fd;
+  (void) events;
+
+  period = oversampling ? tm->globals.oversample_interval :
+    __atomic_load_n(&tm->sample_interval, __ATOMIC_RELAXED)*1000L;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  do {
+    tm->next_sample.tv_sec += period / 1000;
+    tm->next_sample.tv_nsec += (period % 1000) * 1000000L;
+    if (tm->next_sample.tv_nsec >= 1000000000L) {
+      tm->next_sample.tv_sec++;
+      tm->next_sample.tv_nsec -= 1000000000L;
+    }
+  } while (time_reached(&tm->next_sample, &now));
+  timer_at(&tm->sample_timer, &tm->next_sample);
+
+  if (oversampling && time_reached(&tm->next_summary, &now)) {
+    queue_summary(tm);
+    do {
+      tm->next_summary.tv_sec += __atomic_load_n(&tm->sample_interval,
+						 __ATOMIC_RELAXED);
+    } while (time_reached(&tm->next_summary, &now));
+  }
+
+  if (tm->device_read.active) {
+    if (!oversampling) {
+      printf("device with %s is still being read, skipping a reading\n",
+	     describe_device(tm, device));
+    }
+    return;
+  }
+  if (tm->device_opening) {
+    if (!oversampling) {
+      printf("device with %s is still being opened, skipping a reading\n",
+	     describe_device(tm, device));
+    }
+    return;
+  }
+
+  tm->read_at = time(NULL);
+  if (!tm->device_open) {
+    /* when oversampling, a failed device is tried again once per summary */
+    if (oversampling && tm->last_failure != 0) {
+      return;
+    }
+    request_open(tm);
+    return;
+  }
+  read_monitor(tm);
+}
+
+static void sampler_stopped(void *data, int fd, uint32_t events)
+{
+  uint64_t count;
+
+  (void) data;
+  (void) events;
+
+  if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+    sampler.stopping = 1;
+  }
+}
+
+static void *run_sampler(void *data)
+{
+  /* read the devices until stopped, waking the loop if that fails */
+  (void) data;
+
+  while (!sampler.stopping) {
+    if (event_loop_run_once(&sampler.events, -1) < 0) {
+      puts("failed to wait for the devices");
+      __atomic_store_n(&sampler.status, IO_ERROR, __ATOMIC_RELEASE);
+      notify(sampler.wake_fd);
+      break;
+    }
+  }
+  return NULL;
+}
+
+static void close_sampler(void)
+{
+  /*
+    stop the sampler thread, if it was started, and undo as much of
+    open_sampler as was done, abandoning any reading in flight
+  */
+  TEMPMON *tm;
+
+  if (sampler.running) {
+    notify(sampler.stop_fd);
+    pthread_join(sampler.thread, NULL);
+    sampler.running = 0;
+  }
+  if (sampler.opener_running) {
+    pthread_mutex_lock(&sampler.open_lock);
+    sampler.opener_stopping = 1;
+    pthread_cond_broadcast(&sampler.open_wanted);
+    pthread_mutex_unlock(&sampler.open_lock);
+    pthread_join(sampler.opener, NULL);
+    sampler.opener_running = 0;
+  }
+
+  while (sampler.count > 0) {
+    tm = &sampler.monitors[--sampler.count];
+    /* so close_monitor closes a device opened too late to be read */
+    if (tm->open_done && tm->open_result == 0) {
+      tm->device_open = 1;
+    }
+    tm->open_done = 0;
+    tm->open_wanted = 0;
+    tm->device_opening = 0;
+    DEVICE_READ_destroy(&tm->device_read);
+    EVENT_TIMER_destroy(&tm->sample_timer);
+  }
+
+  switch (sampler.opened) {
+  case 5:
+    event_unwatch(&sampler.events, &sampler.opened_watch);
+    close(sampler.opened_fd);
+    pthread_cond_destroy(&sampler.open_wanted);
+    pthread_mutex_destroy(&sampler.open_lock);
+    /* fall through */
+  case 4:
+    close(sampler.wake_fd);
+    /* fall through */
+  case 3:
+    event_unwatch(&sampler.events, &sampler.stop_watch);
+    close(sampler.stop_fd);
+    /* fall through */
+  case 2:
+    USB_EVENTS_destroy(&sampler.usb);
+    /* fall through */
+  case 1:
+    EVENT_LOOP_destroy(&sampler.events);
+    /* fall through */
+  default:
+    break;
+  }
+  sampler.opened = 0;
+}
+
+static int open_sampler(TEMPMON *monitors, int count)
+{
+  /*
+    set up the sampler for every monitor, each taking its first reading
+    right away once the thread is started; returns 0 on success.
+    close_sampler cleans up even after a failure. The thread only handles
+    the events of the libusb context the monitors share, so a device opened
+    on any other would never have its reads complete
+  */
+  struct timespec now;
+  TEMPMON *tm;
+
+  sampler.monitors = monitors;
+  sampler.count = 0;
+  sampler.opened = 0;
+  sampler.running = 0;
+  sampler.stopping = 0;
+  sampler.status = 0;
+  sampler.opener_running = 0;
+  sampler.opener_stopping = 0;
+
+  if (EVENT_LOOP_init(&sampler.events)) {
+    return 1;
+  }
+  sampler.opened++;
+  if (USB_EVENTS_init(&sampler.usb,
+		      &sampler.events,
+		      monitors[0].usb_context)) {
+    return 1;
+  }
+  sampler.opened++;
+  sampler.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (sampler.stop_fd < 0) {
+    return 1;
+  }
+  if (event_watch(&sampler.events, &sampler.stop_watch,
+		  sampler.stop_fd, EPOLLIN, sampler_stopped, NULL)) {
+    close(sampler.stop_fd);
+    return 1;
+  }
+  sampler.opened++;
+  sampler.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (sampler.wake_fd < 0) {
+    return 1;
+  }
+  sampler.opened++;
+  sampler.opened_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (sampler.opened_fd < 0) {
+    return 1;
+  }
+  if (event_watch(&sampler.events, &sampler.opened_watch,
+		  sampler.opened_fd, EPOLLIN, devices_opened, NULL)) {
+    close(sampler.opened_fd);
+    return 1;
+  }
+  pthread_mutex_init(&sampler.open_lock, NULL);
+  pthread_cond_init(&sampler.open_wanted, NULL);
+  sampler.opened++;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  while (sampler.count < count) {
+    tm = &monitors[sampler.count];
+    if (tm->ftHandle->usb_ctx != sampler.usb.context) {
+      printf("device for container %s is not on the shared libusb context\n",
+	     tm->globals.container_num);
+      return 1;
+    }
+    if (EVENT_TIMER_init(&tm->sample_timer,
+			 &sampler.events,
+			 take_sample,
+			 tm)) {
+      return 1;
+    }
+    if (DEVICE_READ_init(&tm->device_read, &sampler.usb)) {
+      EVENT_TIMER_destroy(&tm->sample_timer);
+      return 1;
+    }
+    sampler.count++;
+
+    tm->device_opening = 0;
+    tm->open_wanted = 0;
+    tm->open_done = 0;
+    tm->sample_interval = tm->globals.read_interval;
+    aggregate_clear(&tm->aggregate);
+    tm->last_failure = 0;
+    tm->next_summary = now;
+    tm->next_summary.tv_sec += tm->sample_interval;
+    /* take_sample moves the time on by one period before waiting for it */
+    tm->next_sample = now;
+    timer_at(&tm->sample_timer, &now);
   }
-  s->ptr[0] = '\0';
+
+  return 0;
 }
 
-void deinit_string(struct string *s) {
-  free(s->ptr);
+static int start_sampler(void)
+{
+  /*
+    start the sampler thread and the opener thread, leaving the stop signals
+    to the main thread; returns 0 on success
+  */
+  sigset_t signals;
+  sigset_t previous;
+  int err;
+
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, &previous);
+  err = pthread_create(&sampler.opener, NULL, run_opener, NULL);
+  sampler.opener_running = (err == 0);
+  if (err == 0) {
+    err = pthread_create(&sampler.thread, NULL, run_sampler, NULL);
+    sampler.running = (err == 0);
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+  return err;
 }
 
-int main(void)
+static void discovery_deadline_passed(void *data, int fd, uint32_t events)
 {
-  char fbuffer[256];
+  (void) data;
+  (void) fd;
+  (void) events;
 
-  char *container_num = (char *) malloc(63);
-  char *last_read_status = (char *) malloc(255);
+  puts("the server did not announce itself.");
+  end_loop(SERVER_ERROR);
+}
 
-  char *server_login_email = (char *) malloc(255);
-  char *server_login_password = (char *) malloc(255);
-  
-  char *server_path_authentication = (char *) malloc(255);
-  char *server_path_containers = (char *) malloc(255);
-  char *server_path_specifications = (char *) malloc(255);
-  char *server_path_reading_upload = (char *) malloc(255);
+static int server_failing(void)
+{
+  /* whether the server is being waited for or failed the last upload */
+  int i;
 
-  char *certificate_authority_path = (char *) malloc(255);
+  if (loop.awaiting_server) {
+    return 1;
+  }
+  for (i = 0; i < loop.count; i++) {
+    if (loop.monitors[i].upload_failures > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
 
-  char *server_url_base = (char *) malloc(255);
-  char *server_url_authentication = (char *) malloc(255);
-  char *server_url_specifications = (char *) malloc(255);
-  char *server_url_reading_upload = (char *) malloc(255);
+static void server_announced(void *data, int fd, uint32_t events)
+{
+  /*
+    switch the monitors over once the server announces a new address, but
+    only while the current server is failing: anyone on the network can
+    send an announcement, and the login goes wherever it points
+  */
+  char url[255];
+  int i;
 
-  char *postfield_buffer = (char *) malloc(1023);
-  char *error_buffer = (char *) malloc(255);
+  (void) data;
+  (void) fd;
+  (void) events;
 
-  int http_response_code;
-  struct string http_response_buffer;
-  init_string(&http_response_buffer);
-  
-  struct string http_response_jsobj;
-  init_string(&http_response_jsobj);
+  if (discovery_poll(&discovery, 0, url, sizeof(url)) != 1) {
+    return;
+  }
+  if (!server_failing()) {
+    if (strcmp(url, loop.monitors[0].globals.server_url_base) != 0) {
+      printf("Ignoring server announced at %s while %s answers\n",
+	     url,
+	     loop.monitors[0].globals.server_url_base);
+    }
+    return;
+  }
 
-  cJSON *JSON_root;
-  cJSON *JSON_specifications;
-  cJSON *ob;
-  cJSON *monitor;
+  if (strcmp(url, loop.monitors[0].globals.server_url_base) != 0 &&
+      change_server(loop.monitors, loop.count, url)) {
+    return;
+  }
+  server_found();
+  for (i = 0; i < loop.count; i++) {
+    /* the server is there now, so no need to wait out the backoff */
+    loop.monitors[i].upload_retry_at = 0;
+    server_next(&loop.monitors[i]);
+  }
+}
 
-  int time_until_update;
-  int device_product_id;
-  int device_vendor_id;
+static void globals_changed(void *data, int fd, uint32_t events)
+{
+  /* reload the globals as soon as the globals file changes */
+  (void) data;
+  (void) fd;
+  (void) events;
 
-  int err = 0;
+  if (config_changed(&config_watch)) {
+    reload_globals(loop.monitors, loop.count);
+  }
+}
 
-  struct ftdi_context *ftHandle = NULL;
+static void close_loop(void)
+{
+  /*
+    stop the sampler and undo as much of open_loop as was done, abandoning
+    anything in flight
+  */
+  TEMPMON *tm;
 
-  int read_bytes;
-  uint8_t reading_buffer[280];
+  close_sampler();
 
-  SEM710_READINGS readings;
+  while (loop.count > 0) {
+    tm = &loop.monitors[--loop.count];
+    http_cancel(&tm->http);
+    tm->job = JOB_NONE;
+    tm->looping = 0;
+    report_queue(tm, 1);
+    RING_destroy(&tm->samples);
+  }
 
-  ftHandle = ftdi_new();
-  ftdi_init(ftHandle);
+  switch (loop.opened) {
+  case 3:
+    event_unwatch(&loop.events, &loop.samples_watch);
+    event_unwatch(&loop.events, &loop.config_watch);
+    event_unwatch(&loop.events, &loop.discovery_watch);
+    EVENT_TIMER_destroy(&loop.discovery_deadline);
+    /* fall through */
+  case 2:
+    HTTP_MULTI_destroy(&loop.http);
+    /* fall through */
+  case 1:
+    EVENT_LOOP_destroy(&loop.events);
+    /* fall through */
+  default:
+    break;
+  }
+  loop.opened = 0;
+}
 
-  curl_global_init(CURL_GLOBAL_ALL);
+static int open_loop(TEMPMON *monitors, int count)
+{
+  /*
+    set up the loop and the sampler for every monitor, along with the queue
+    of readings between them; returns 0 on success. close_loop cleans up
+    even after a failure
+  */
+  char spill_path[320];
+  TEMPMON *tm;
 
-  /*************************/
-  /* Get globals from file */
-  /*************************/
-  printf("Getting globals from file... ");
-  err = get_file_variable(URL_FILE, "url", fbuffer);
-  if (!err) {
-    strcpy(server_url_base, fbuffer);
-  } else {
-    puts("variable not found \"url\"");
-    exit(SERVER_ERROR);
+  loop.monitors = monitors;
+  loop.count = 0;
+  loop.status = 0;
+  loop.awaiting_server = 0;
+  loop.opened = 0;
+
+  if (EVENT_LOOP_init(&loop.events)) {
+    return 1;
   }
+  loop.opened++;
+  if (HTTP_MULTI_init(&loop.http, &loop.events)) {
+    return 1;
+  }
+  loop.opened++;
+  if (EVENT_TIMER_init(&loop.discovery_deadline,
+		       &loop.events,
+		       discovery_deadline_passed,
+		       NULL)) {
+    return 1;
+  }
+  loop.opened++;
 
-  err = get_file_variable(GLOBAL_FILE, "container_num", fbuffer);
-  if (!err) {
-    strcpy(container_num, fbuffer);
-  } else {
-    puts("variable not found \"container_num\"");
-    exit(IO_ERROR);
+  loop.samples_watch.callback = NULL;
+  loop.discovery_watch.callback = NULL;
+  loop.config_watch.callback = NULL;
+  if (discovery.fd >= 0) {
+    event_watch(&loop.events, &loop.discovery_watch,
+		discovery.fd, EPOLLIN, server_announced, NULL);
+  }
+  if (config_watch.fd >= 0) {
+    event_watch(&loop.events, &loop.config_watch,
+		config_watch.fd, EPOLLIN, globals_changed, NULL);
   }
 
-  err = get_file_variable(GLOBAL_FILE, "authentication_path", fbuffer);
-  if (!err) {
-    strcpy(server_path_authentication, fbuffer);
-  } else {
-    puts("variable not found \"authentication_path\"");
-    exit(IO_ERROR);
+  while (loop.count < count) {
+    tm = &monitors[loop.count];
+
+    /* each container spills to its own file when several are monitored */
+    strcpy(spill_path, SPILL_FILE);
+    if (tm->device_serial[0] != '\0') {
+      snprintf(spill_path,
+	       sizeof(spill_path),
+	       "%s.%s",
+	       SPILL_FILE,
+	       tm->globals.container_num);
+    }
+    if (RING_init(&tm->samples,
+		  sizeof(SAMPLE),
+		  tm->globals.queue_capacity,
+		  tm->globals.queue_overflow,
+		  spill_path)) {
+      printf("failed to set up the readings queue for container %s\n",
+	     tm->globals.container_num);
+      return 1;
+    }
+    loop.count++;
+
+    tm->looping = 1;
+    tm->samples_overflowed = 0;
+    tm->job = JOB_NONE;
+    tm->resend = JOB_NONE;
+    tm->job_retried = 0;
+    tm->error_pending[0] = '\0';
+    tm->reading_pending = 0;
+    /* send anything left over from a previous run */
+    tm->draining = tm->journaling && journal_pending(&tm->journal) > 0;
   }
 
-  err = get_file_variable(GLOBAL_FILE, "container_path", fbuffer);
-  if (!err) {
-    strcpy(server_path_containers, fbuffer);
-  } else {
-    puts("variable not found \"container_path\"");
-    exit(IO_ERROR);
+  if (open_sampler(monitors, count) ||
+      event_watch(&loop.events, &loop.samples_watch,
+		  sampler.wake_fd, EPOLLIN, samples_ready, NULL)) {
+    return 1;
   }
-  
-  err = get_file_variable(GLOBAL_FILE, "specifications_path", fbuffer);
-  if (!err) {
-    strcpy(server_path_specifications, fbuffer);
-  } else {
-    puts("variable not found \"specifications_path\"");
-    exit(IO_ERROR);
+
+  return 0;
+}
+
+static int run_loop(TEMPMON *monitors, int count)
+{
+  /*
+    read every monitor's device every read_interval seconds on the sampler
+    thread, and keep the server up to date from one event loop on this one,
+    until a stop signal is received or the server can not be found; returns
+    0 or the exit status that ended the loop
+  */
+  int err;
+
+  if (open_loop(monitors, count) || start_sampler()) {
+    puts("failed to start the event loop");
+    close_loop();
+    return IO_ERROR;
   }
-    
-  err = get_file_variable(GLOBAL_FILE, "user", fbuffer);
-  if (!err) {
-    strcpy(server_login_email, fbuffer);
-  } else {
-    puts("variable not found \"user\"");
-    exit(IO_ERROR);
+
+  while (daemon_running && loop.status == 0) {
+    if (event_loop_run_once(&loop.events, -1) < 0) {
+      puts("failed to wait for events");
+      end_loop(IO_ERROR);
+    }
   }
-  
-  err = get_file_variable(GLOBAL_FILE, "password", fbuffer);
-  if (!err) {
-    strcpy(server_login_password, fbuffer);
-  } else {
-    puts("variable not found \"password\"");
-    exit(IO_ERROR);
+
+  /* keep the readings taken before the sampler stopped */
+  close_sampler();
+  take_samples();
+
+  err = loop.status;
+  close_loop();
+  return err;
+}
+
+static void close_monitor(TEMPMON *tm)
+{
+  /* close the device, uploading the readings batched so far if stopped */
+  if (tm->device_open) {
+    ftdi_usb_close(tm->ftHandle);
+    tm->device_open = 0;
   }
-  
-  printf("done\n");
-  /******************************/
-  /* Authenticating with server */
-  /******************************/
-  printf("Authenticating with server... ");
-  sprintf(server_url_authentication,
-	  "%s%s",
-	  server_url_base,
-	  server_path_authentication);
 
-  /* construct login postfield */
-  start_postfield(postfield_buffer, "email", server_login_email);
-  add_postfield(postfield_buffer, "password", server_login_password);
-  
-  /* perform a POST operation to the server authentication page */
-  http_response_code = http_POST(server_url_authentication,
-				 NULL,
-				 COOKIE_FILE,
-				 NULL,
-				 postfield_buffer,
-				 &http_response_buffer);
+  /* don't lose the readings collected so far when stopped */
+  if (!daemon_running && !tm->journaling && tm->batch.count > 0) {
+    upload_batch(tm);
+  }
+}
 
-  if (http_response_code != 0) {
-    printf("done\n");
+static int run_daemon(TEMPMON *tm)
+{
+  /*
+    connect and open the device once, then read every read_interval seconds
+    and upload until a stop signal is received, keeping the device open and
+    the specifications cached between readings. A failed device is reopened
+    for the next reading; a server that stops responding ends the daemon with
+    SERVER_ERROR unless it announces itself within discovery_timeout seconds,
+    or, if readings are journaled, they are kept until the server responds
+    again.
+  */
+  int err;
+
+  signal(SIGINT, stop_daemon);
+  signal(SIGTERM, stop_daemon);
+
+  err = connect_to_server(tm);
+  if (err == SERVER_ERROR && rediscover_server(tm, 1) == 0) {
+    err = connect_to_server(tm);
   }
-  else {
-    printf("no response from server.\n");
-    exit(SERVER_ERROR);
+  if (err) {
+    return err;
   }
- 
-  /**********************************/
-  /* Get specifications from server */
-  /**********************************/
-  printf("Getting specifications from server... ");
 
-  sprintf(server_url_specifications, 
-	  "%s%s/%s%s", 
-	  server_url_base, 
-	  server_path_containers,
-	  container_num,
-	  server_path_specifications);
-
-  http_response_code = http_GET(server_url_specifications,
-				COOKIE_FILE,
-				NULL,
-				&http_response_jsobj);
-  
-  JSON_root = cJSON_Parse(http_response_jsobj.ptr);
-  if (JSON_root == NULL) {
-    printf("invalid JSON struct returned\n");
-    err = 1;
+  err = run_loop(tm, 1);
+
+  close_monitor(tm);
+  return daemon_running ? err : 0;
+}
+
+static int parse_devices(char *devices,
+			 char serials[][DEVICE_SERIAL_SIZE],
+			 char containers[][63])
+{
+  /*
+    split the "serial=container" pairs in devices, separated by spaces or
+    commas, into serials and containers; returns how many there are, or -1 if
+    a pair is malformed or there are more than MAX_MONITORS
+  */
+  char buffer[255];
+  char *pair;
+  char *container;
+  char *saveptr;
+  int count;
+
+  strcpy(buffer, devices);
+  count = 0;
+  for (pair = strtok_r(buffer, " ,", &saveptr);
+       pair != NULL;
+       pair = strtok_r(NULL, " ,", &saveptr)) {
+    container = strchr(pair, '=');
+    if (count == MAX_MONITORS || container == NULL || container == pair ||
+	container[1] == '\0' ||
+	container - pair >= DEVICE_SERIAL_SIZE ||
+	strlen(container + 1) >= 63) {
+      return -1;
+    }
+    *container++ = '\0';
+    strcpy(serials[count], pair);
+    strcpy(containers[count], container);
+    count++;
   }
-  else {
-    JSON_specifications = cJSON_GetObjectItem(JSON_root, "specifications");
 
-    if (JSON_specifications != NULL) {
-      ob = cJSON_GetObjectItem(JSON_specifications, "nextUpdateIn");
-      if (ob != NULL) {
-	time_until_update = atoi(ob->valuestring);
-      } else { 
-	puts("variable not found \"nextUpdateIn\"");
-	err = 1; 
-      }
-      
-      ob = cJSON_GetObjectItem(JSON_specifications, "lastReadStatus");
-      if (ob != NULL) {
-	strcpy(last_read_status, ob->valuestring);
-      } else {
-	puts("variable not found \"lastReadStatus\""); 
-	err = 1;
-      }
+  return count;
+}
 
-      ob = cJSON_GetObjectItem(JSON_specifications, "uploadURL");
-      if (ob != NULL) {	
-	strcpy(server_path_reading_upload, ob->valuestring);
-      } else { 
-	puts("variable not found \"uploadURL\"");
-	err = 1; 
-      }
-      
-      monitor = cJSON_GetObjectItem(JSON_specifications, "monitor");
-      if (monitor != NULL) {
-	ob = cJSON_GetObjectItem(monitor, "productID");
-	if (ob != NULL) {
-	  device_product_id = atoi(ob->valuestring);
-	} else { 
-	  puts("variable not found \"monitor\"");
-	  err = 1; 
-	}
-	
-	ob = cJSON_GetObjectItem(monitor, "vendorID");
-	if (ob != NULL) {
-	  device_vendor_id = atoi(ob->valuestring);
-	} else { 
-	  puts("variable not found \"vendorID\"");
-	  err = 1; 
-	}
-      }
-      else {
-	puts("JSON struct not given by server");
-	err = 1;
-      }
+static int start_monitor(TEMPMON *tm,
+			 char *cookie_path,
+			 char *specifications_path,
+			 char *journal_path,
+			 char *history_path)
+{
+  /*
+    set up everything kept for a device between readings: its libftdi
+    context, the HTTP client with the session saved at cookie_path, the
+    specifications cached at specifications_path and the batch, along with
+    the journal at journal_path and the history at history_path unless they
+    are empty; returns 0 on success or the exit status describing the
+    failure. stop_monitor cleans up even after a failure
+  */
+  init_string(&tm->upload_body);
+  init_string(&tm->response);
+
+  tm->ftHandle = ftdi_new();
+  if (tm->ftHandle == NULL) {
+    puts("failed to allocate the device context");
+    return IO_ERROR;
+  }
+  /*
+    the device is opened on the libusb context main owns, whose events the
+    loops handle, rather than on a private one of libftdi's
+  */
+  share_usb_context(tm->ftHandle, tm->usb_context);
+
+  if (HTTP_CLIENT_init(&tm->http)) {
+    puts("failed to initialize the HTTP client");
+    return SERVER_ERROR;
+  }
+  http_set_compression(&tm->http,
+		       tm->globals.compression_level,
+		       tm->globals.compression_threshold);
+  /* a session saved by an earlier run saves logging in again */
+  tm->logged_in = !http_load_cookies(&tm->http, cookie_path);
+  strcpy(tm->specifications_path, specifications_path);
+  load_specifications(tm);
+
+  if (READING_BATCH_init(&tm->batch,
+			 tm->globals.batch_size,
+			 tm->globals.batch_latency)) {
+    puts("failed to allocate the reading batch");
+    return IO_ERROR;
+  }
+  deadband_init(&tm->deadband,
+		tm->globals.deadband,
+		tm->globals.max_silence);
+
+  if (journal_path[0] != '\0') {
+    if (JOURNAL_open(&tm->journal,
+		     journal_path,
+		     tm->globals.journal_capacity,
+		     tm->globals.journal_sync_every)) {
+      printf("failed to open reading journal \"%s\"\n", journal_path);
+      return IO_ERROR;
     }
-    if (!err) {
-      strcpy(server_url_reading_upload, server_url_base);
-      strcat(server_url_reading_upload, server_path_reading_upload);      
+    tm->journaling = 1;
+  }
+
+  if (history_path[0] != '\0') {
+    if (HISTORY_open(&tm->history,
+		     history_path,
+		     tm->globals.history_capacity,
+		     tm->globals.history_retention)) {
+      printf("failed to open reading history \"%s\"\n", history_path);
+      return IO_ERROR;
     }
-    cJSON_Delete(JSON_root);
+    tm->keeping_history = 1;
   }
-  if (err) {
-    exit(SERVER_ERROR);
+
+  return 0;
+}
+
+static void stop_monitor(TEMPMON *tm)
+{
+  HTTP_CLIENT_destroy(&tm->http);
+
+  if (tm->journaling) {
+    JOURNAL_close(&tm->journal);
+    tm->journaling = 0;
+  }
+  if (tm->keeping_history) {
+    HISTORY_close(&tm->history);
+    tm->keeping_history = 0;
   }
+  READING_BATCH_destroy(&tm->batch);
+  deinit_string(&tm->upload_body);
+  deinit_string(&tm->response);
 
-  err = 0;
-  printf("done\n");
+  if (tm->ftHandle != NULL) {
+    /* the libusb context is main's to exit */
+    unshare_usb_context(tm->ftHandle);
+    ftdi_free(tm->ftHandle);
+    tm->ftHandle = NULL;
+  }
+}
 
+static void check_devices(TEMPMON *monitors, int count)
+{
   /*
-    From this point all errors can be properly reported to the server, since we
-    know the upload location.
-   */
-  /************************/
-  /* Detach device kernel */
-  /************************/
-  printf("Detaching device kernel... ");
-  err = detach_device_kernel(device_vendor_id, device_product_id);
-  if (err) {
-    sprintf(error_buffer, 
-	    "failed to detach device with vendor ID %d and product ID %d.",
-	    device_vendor_id,
-	    device_product_id);
-
-    err = pack_error(error_buffer, READINGS_FILE);
-    if (err) {
-      return err;
-    }
-    http_response_code = http_PUT_JSON(server_url_reading_upload,
-				       COOKIE_FILE,
-				       NULL, 
-				       READINGS_FILE,
-				       &http_response_buffer);
-    puts(error_buffer);
-    exit(USB_OPEN_ERROR);
+    list the attached devices, pointing out those that are not assigned a
+    container and the assigned ones that are missing
+  */
+  char found[MAX_MONITORS][DEVICE_SERIAL_SIZE];
+  int found_count;
+  int assigned;
+  int i;
+  int j;
+
+  found_count = find_device_serials(monitors[0].ftHandle,
+				    monitors[0].specs.device_vendor_id,
+				    monitors[0].specs.device_product_id,
+				    found,
+				    MAX_MONITORS);
+  if (found_count < 0) {
+    puts("failed to list attached devices");
+    return;
   }
-  printf("done\n");
 
-  /***************/
-  /* Open device */
-  /***************/
-  printf("Opening device... ");
-  err = ftdi_usb_open(ftHandle, device_vendor_id, device_product_id);
-  if (err) { 
-    sprintf(error_buffer,
-	    "failed to open device with vendor ID %d and product ID %D.",
-	    device_vendor_id,
-	    device_product_id);
-    
-    err = pack_error(error_buffer, READINGS_FILE);
-    if (err) {
-      exit(IO_ERROR);
-    }
-    http_response_code = http_PUT_JSON(server_url_reading_upload,
-				       COOKIE_FILE,
-				       NULL,
-				       READINGS_FILE,
-				       &http_response_buffer);
-    puts(error_buffer);
-    exit(USB_OPEN_ERROR);
+  for (i = 0; i < found_count; i++) {
+    assigned = 0;
+    for (j = 0; j < count; j++) {
+      assigned |= (strcmp(found[i], monitors[j].device_serial) == 0);
+    }
+    printf("Found device %s%s\n",
+	   found[i],
+	   assigned ? "" : ", which is not assigned a container");
   }
-  printf("done\n");
 
-  /******************/
-  /* Prepare device */
-  /******************/
-  printf("Preparing device... ");
-  err = prepare_device(ftHandle);
-  if (err) { 
-    sprintf(error_buffer,
-	    "failed to prepare device with vendor ID %d and product ID %D.",
-	    device_vendor_id,
-	    device_product_id);
-    
-    err = pack_error(error_buffer, READINGS_FILE);
-    if (err) {
-      exit(IO_ERROR);
-    }
-
-    http_response_code = http_PUT_JSON(server_url_reading_upload,
-				       COOKIE_FILE,
-				       NULL,
-				       READINGS_FILE,
-				       &http_response_buffer);
-    puts(error_buffer);
-    exit(USB_OPEN_ERROR);
+  for (j = 0; j < count; j++) {
+    assigned = 0;
+    for (i = 0; i < found_count; i++) {
+      assigned |= (strcmp(found[i], monitors[j].device_serial) == 0);
+    }
+    if (!assigned) {
+      printf("Device %s for container %s is not attached\n",
+	     monitors[j].device_serial,
+	     monitors[j].globals.container_num);
+    }
   }
-  printf("done\n");
+}
 
-  /*************************/
-  /* read data from SEM710 */
-  /*************************/
-  printf("Reading device... ");
-  read_bytes = read_device(ftHandle, 
-			   SEM_COMMANDS_cREAD_PROCESS, 
-			   reading_buffer);
-  ftdi_usb_close(ftHandle);
-  
-  if (read_bytes <= 0) {
-    sprintf(error_buffer,
-	    "failed to read device with vendor ID %d and product ID %d.",
-	    device_vendor_id,
-	    device_product_id);
-    
-    err = pack_error(error_buffer, READINGS_FILE);
-    if (err) {
-      exit(IO_ERROR);
-    }
-    http_response_code = http_PUT_JSON(server_url_reading_upload,
-				       COOKIE_FILE,
-				       NULL,
-				       READINGS_FILE,
-				       &http_response_buffer);
-    puts(error_buffer);
-    exit(USB_READ_ERROR);
-  }
-  
-  get_readings(&readings, reading_buffer, read_bytes);
-  printf("done\n");
+static int run_monitors(TEMPMON *tm)
+{
+  /*
+    as run_daemon, but for every device listed in devices, each identified by
+    its serial number and monitoring its own container with its own session,
+    cached specifications and journal. The devices are all read from the
+    same event loop, so a device that is slow to answer only holds up its own
+    readings
+  */
+  char serials[MAX_MONITORS][DEVICE_SERIAL_SIZE];
+  char containers[MAX_MONITORS][63];
+  char cookie_path[255];
+  char specifications_path[255];
+  char journal_path[320];
+  char history_path[320];
 
-  /*************************/
-  /* Upload data to server */
-  /*************************/
-  printf("Uploading reading to server... ");
-  if (time_until_update <= 0) {
-    /*
-      if the time since the last read is greater than the required wait time,
-      or if the status has changed since the last read, update.
-    */
-    err = pack_readings(&readings, READINGS_FILE);
+  TEMPMON *monitors;
+  TEMPMON *monitor;
+  int count;
+  int started;
+  int err;
 
-    if (err) {
-      sprintf(error_buffer,
-	      "Failed to write reading to file.");
-      
-      err = pack_error(error_buffer, READINGS_FILE);
-      if (err) {
-	exit(IO_ERROR);
-      }
-      http_response_code = http_PUT_JSON(server_url_reading_upload,
-					 COOKIE_FILE,
-					 NULL,
-					 READINGS_FILE,
-					 &http_response_buffer);
-      puts(error_buffer);
-      exit(IO_ERROR);
-    }
-    http_PUT_JSON(server_url_reading_upload, 
+  count = parse_devices(tm->globals.devices, serials, containers);
+  if (count <= 0) {
+    printf("devices must be up to %d \"serial=container\" pairs\n",
+	   MAX_MONITORS);
+    return IO_ERROR;
+  }
+
+  monitors = (TEMPMON *) calloc(count, sizeof(TEMPMON));
+  if (monitors == NULL) {
+    return IO_ERROR;
+  }
+
+  signal(SIGINT, stop_daemon);
+  signal(SIGTERM, stop_daemon);
+
+  err = 0;
+  for (started = 0; started < count && !err; started++) {
+    monitor = &monitors[started];
+    monitor->usb_context = tm->usb_context;
+    monitor->globals = tm->globals;
+    if (set_container(&monitor->globals, containers[started])) {
+      printf("the specifications URL of container %s is too long\n",
+	     containers[started]);
+      err = IO_ERROR;
+      break;
+    }
+    strcpy(monitor->device_serial, serials[started]);
+
+    /* each container keeps its own files */
+    snprintf(cookie_path,
+	     sizeof(cookie_path),
+	     "%s.%s",
 	     COOKIE_FILE,
-	     NULL,
-	     READINGS_FILE, 
-	     &http_response_buffer);
+	     containers[started]);
+    snprintf(specifications_path,
+	     sizeof(specifications_path),
+	     "%s.%s",
+	     SPECIFICATIONS_FILE,
+	     containers[started]);
+    journal_path[0] = '\0';
+    if (tm->globals.journal_path[0] != '\0') {
+      snprintf(journal_path,
+	       sizeof(journal_path),
+	       "%s.%s",
+	       tm->globals.journal_path,
+	       containers[started]);
+    }
+    history_path[0] = '\0';
+    if (tm->globals.history_path[0] != '\0') {
+      snprintf(history_path,
+	       sizeof(history_path),
+	       "%s.%s",
+	       tm->globals.history_path,
+	       containers[started]);
+    }
+
+    printf("Starting container %s with device %s\n",
+	   containers[started],
+	   serials[started]);
+    err = start_monitor(monitor,
+			cookie_path,
+			specifications_path,
+			journal_path,
+			history_path);
+    if (!err) {
+      err = connect_to_server(monitor);
+    }
+    if (err == SERVER_ERROR && rediscover_server(monitors, started + 1) == 0) {
+      err = connect_to_server(monitor);
+    }
   }
-  printf("done\n");
-  /****************/
-  /* close device */
-  /****************/
-  ftdi_deinit(ftHandle);
-  ftdi_free(ftHandle);
 
-  free(container_num);
-  free(last_read_status);
+  if (!err) {
+    check_devices(monitors, count);
+    err = run_loop(monitors, count);
+  }
+
+  while (started-- > 0) {
+    close_monitor(&monitors[started]);
+    stop_monitor(&monitors[started]);
+  }
+  free(monitors);
+
+  return daemon_running ? err : 0;
+}
+
+static int parse_time(char *text, time_t *time)
+{
+  /*
+    read a time given as seconds since the epoch or as a local "YYYY-MM-DD"
+    date, optionally followed by "HH:MM" or "HH:MM:SS"; returns 0 on success
+    or 1
+  */
+  struct tm local;
+  char *end;
+  int consumed;
 
-  free(server_login_email);
-  free(server_login_password);
+  *time = (time_t) strtoll(text, &end, 10);
+  if (end != text && *end == '\0') {
+    return 0;
+  }
 
-  free(server_path_authentication);
-  free(server_path_containers);
-  free(server_path_specifications);
+  memset(&local, 0, sizeof(local));
+  consumed = 0;
+  if (sscanf(text,
+	     "%d-%d-%d%n",
+	     &local.tm_year,
+	     &local.tm_mon,
+	     &local.tm_mday,
+	     &consumed) != 3) {
+    return 1;
+  }
+  text += consumed;
+  consumed = 0;
+  if (*text != '\0' &&
+      sscanf(text, " %d:%d%n", &local.tm_hour, &local.tm_min, &consumed) != 2) {
+    return 1;
+  }
+  text += consumed;
+  consumed = 0;
+  if (*text != '\0' && sscanf(text, ":%d%n", &local.tm_sec, &consumed) != 1) {
+    return 1;
+  }
+  if (text[consumed] != '\0') {
+    return 1;
+  }
 
-  free(server_path_reading_upload);
+  local.tm_year -= 1900;
+  local.tm_mon -= 1;
+  local.tm_isdst = -1;
+  *time = mktime(&local);
+  return (*time == (time_t) -1);
+}
 
-  free(certificate_authority_path);
+static int print_history(TEMPMON_GLOBALS *globals,
+			 char *container,
+			 time_t from,
+			 time_t to)
+{
+  /*
+    print the readings kept in the history of the container, or of the only
+    device if that is NULL, taken from from up to to, and what they add up
+    to; returns the program exit status
+  */
+  char history_path[320];
+  char time_buffer[32];
+  HISTORY history;
+  TIMED_READING reading;
+  AGGREGATE aggregate;
+  READING_SUMMARY summary;
+  uint64_t begin;
+  uint64_t end;
+  uint64_t number;
+  uint64_t out_of_range;
 
-  free(server_url_base);
-  free(server_url_authentication);
-  free(server_url_specifications);
-  free(server_url_reading_upload);
+  if (globals->history_path[0] == '\0') {
+    puts("no history_path is set, so no history is kept");
+    return IO_ERROR;
+  }
+  if (container != NULL) {
+    snprintf(history_path,
+	     sizeof(history_path),
+	     "%s.%s",
+	     globals->history_path,
+	     container);
+  } else {
+    snprintf(history_path, sizeof(history_path), "%s", globals->history_path);
+  }
+  if (HISTORY_view(&history, history_path)) {
+    printf("failed to open reading history \"%s\"\n", history_path);
+    return IO_ERROR;
+  }
 
-  free(postfield_buffer);
-  free(error_buffer);
+  aggregate_clear(&aggregate);
+  out_of_range = 0;
+  history_range(&history, from, to, &begin, &end);
+  for (number = begin; number < end; number++) {
+    /* the daemon may have dropped it meanwhile to make room */
+    if (history_read(&history, number, &reading)) {
+      continue;
+    }
+    strftime(time_buffer,
+	     sizeof(time_buffer),
+	     "%Y-%m-%d %H:%M:%S",
+	     localtime(&reading.timestamp));
+    printf("%s %8.2f %s\n",
+	   time_buffer,
+	   reading.temperature,
+	   get_read_status_string(reading.status));
+    aggregate_add(&aggregate, reading.temperature);
+    out_of_range += (reading.status != READ_STATUS_OK);
+  }
+  HISTORY_close(&history);
 
-  deinit_string(&http_response_buffer);
-  deinit_string(&http_response_jsobj);
-  
+  aggregate_summary(&aggregate, &summary);
+  if (summary.samples == 0) {
+    puts("no readings kept over that time");
+    return 0;
+  }
+  printf("%u readings: min %.2f, max %.2f, mean %.2f, %llu not OK\n",
+	 summary.samples,
+	 summary.min,
+	 summary.max,
+	 summary.mean,
+	 (unsigned long long) out_of_range);
   return 0;
 }
 
+static void usage(char *program)
+{
+  fprintf(stderr,
+	  "usage: %s [--daemon]\n"
+	  "       %s --history FROM [TO] [--container CONTAINER]\n"
+	  "where FROM and TO are seconds since the epoch or local times as "
+	  "\"YYYY-MM-DD [HH:MM[:SS]]\"\n",
+	  program,
+	  program);
+  exit(IO_ERROR);
+}
+
+int main(int argc, char **argv)
+{
+  int err;
+  int daemon_mode;
+  int history_mode;
+  char *container;
+  time_t from;
+  time_t to;
+  int i;
+
+  TEMPMON tm;
+
+  daemon_mode = 0;
+  history_mode = 0;
+  container = NULL;
+  /* up to now unless told otherwise, the current second included */
+  to = time(NULL) + 1;
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--daemon") == 0) {
+      daemon_mode = 1;
+    } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc &&
+	       parse_time(argv[++i], &from) == 0) {
+      history_mode = 1;
+      if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0 &&
+	  parse_time(argv[++i], &to)) {
+	usage(argv[0]);
+      }
+    } else if (strcmp(argv[i], "--container") == 0 && i + 1 < argc) {
+      container = argv[++i];
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if ((daemon_mode && history_mode) || (container != NULL && !history_mode)) {
+    usage(argv[0]);
+  }
+
+  memset(&tm, 0, sizeof(tm));
+  JSON_EXTRACTOR_init(&specifications_extractor,
+		      specifications_fields,
+		      SPECIFICATIONS_FIELD_COUNT);
+
+  /*************************/
+  /* Get globals from file */
+  /*************************/
+  printf("Getting globals from file... ");
+  err = get_globals(&tm.globals);
+  if (err) {
+    exit(err);
+  }
+  printf("done\n");
+
+  /* the history is read without the device or the server */
+  if (history_mode) {
+    exit(print_history(&tm.globals, container, from, to));
+  }
+
+  /* the last known server is tried first, and kept track of while running */
+  if (DISCOVERY_open(&discovery)) {
+    puts("failed to join the server discovery group");
+  }
+  if (tm.globals.server_url_base[0] == '\0' && rediscover_server(&tm, 1)) {
+    DISCOVERY_close(&discovery);
+    exit(SERVER_ERROR);
+  }
+
+  /* in daemon mode, changes to the globals file are applied as they are made */
+  if (daemon_mode && CONFIG_WATCH_open(&config_watch, GLOBAL_FILE)) {
+    puts("failed to watch the globals file; changes take effect on restart");
+  }
+
+  libusb_init(&tm.usb_context);
+  curl_global_init(CURL_GLOBAL_ALL);
+
+  if (daemon_mode && tm.globals.devices[0] != '\0') {
+    err = run_monitors(&tm);
+  } else {
+    /* the journal only pays off when readings outlive a single run */
+    err = start_monitor(&tm,
+			COOKIE_FILE,
+			SPECIFICATIONS_FILE,
+			daemon_mode ? tm.globals.journal_path : "",
+			tm.globals.history_path);
+    if (!err) {
+      err = daemon_mode ? run_daemon(&tm) : run_once(&tm);
+    }
+    stop_monitor(&tm);
+  }
+
+  /****************/
+  /* close device */
+  /****************/
+  curl_global_cleanup();
+  libusb_exit(tm.usb_context);
+  CONFIG_WATCH_close(&config_watch);
+  DISCOVERY_close(&discovery);
+
+  return err;
+}
+
 #endif
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc-structs.h"
+
+#define STRING_INITIAL_SIZE 64
+
+void init_string(string *s)
+{
+  s->len = 0;
+  s->size = STRING_INITIAL_SIZE;
+  s->ptr = (char *) malloc(s->size);
+  if (s->ptr == NULL) {
+    fprintf(stderr, "malloc() failed\n");
+    exit(EXIT_FAILURE);
+  }
+  s->ptr[0] = '\0';
+}
+
+void deinit_string(string *s)
+{
+  free(s->ptr);
+  s->ptr = NULL;
+  s->len = 0;
+  s->size = 0;
+}
+
+void reset_string(string *s)
+{
+  /* empty the string, keeping its allocation for reuse */
+  s->len = 0;
+  s->ptr[0] = '\0';
+}
+
+int reserve_string(string *s, size_t len)
+{
+  /*
+    make sure the string can hold len characters plus the null terminator,
+    growing it geometrically; returns 1 if the allocation failed
+  */
+  size_t size;
+  char *ptr;
+
+  if (len < s->size) {
+    return 0;
+  }
+
+  size = (s->size > 0) ? s->size : STRING_INITIAL_SIZE;
+  while (size <= len) {
+    size *= 2;
+  }
+
+  ptr = (char *) realloc(s->ptr, size);
+  if (ptr == NULL) {
+    return 1;
+  }
+  s->ptr = ptr;
+  s->size = size;
+
+  return 0;
+}
+
+int append_string(string *s, const char *data, size_t n)
+{
+  /* append n bytes of data to the string; returns 1 if it could not grow */
+  if (reserve_string(s, s->len + n)) {
+    return 1;
+  }
+  memcpy(s->ptr + s->len, data, n);
+  s->len += n;
+  s->ptr[s->len] = '\0';
+
+  return 0;
+}
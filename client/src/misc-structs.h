@@ -1,10 +1,37 @@
 #ifndef __MISC_STRUCTS_H
 #define __MISC_STRUCTS_H
 
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  a growable, null-terminated byte buffer; len is the length of the contents
+  and size the allocated capacity, so the buffer can be reset and refilled
+  without returning to the allocator
+*/
 struct string {
   char *ptr;
   size_t len;
+  size_t size;
 };
 
 typedef struct string string;
+
+void init_string(string *s);
+
+void deinit_string(string *s);
+
+void reset_string(string *s);
+
+int reserve_string(string *s, size_t len);
+
+int append_string(string *s, const char *data, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
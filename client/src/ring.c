@@ -0,0 +1,217 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ring.h"
+
+int RING_init(RING *ring,
+	      size_t item_size,
+	      uint64_t capacity,
+	      RING_OVERFLOW overflow,
+	      const char *spill_path)
+{
+  uint64_t i;
+
+  memset(ring, 0, sizeof(RING));
+  ring->overflow = overflow;
+  ring->item_size = item_size;
+  ring->spill_fd = -1;
+
+  /* a power of two, so positions wrap with a mask */
+  ring->capacity = 1;
+  while (ring->capacity < capacity) {
+    ring->capacity <<= 1;
+  }
+
+  /* items follow their sequence numbers 8 byte aligned */
+  ring->slot_size = sizeof(uint64_t) + (item_size + 7) / 8 * 8;
+  ring->slots = (uint8_t *) malloc(ring->capacity * ring->slot_size);
+  if (ring->slots == NULL) {
+    return 1;
+  }
+  /* no slot holds position 0 until it is pushed */
+  for (i = 0; i < ring->capacity; i++) {
+    *(uint64_t *) (ring->slots + i * ring->slot_size) = 0;
+  }
+
+  if (overflow == RING_SPILL) {
+    if (spill_path == NULL || spill_path[0] == '\0') {
+      RING_destroy(ring);
+      return 1;
+    }
+    ring->spill_fd = open(spill_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+			  0644);
+    if (ring->spill_fd < 0) {
+      RING_destroy(ring);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void RING_destroy(RING *ring)
+{
+  free(ring->slots);
+  ring->slots = NULL;
+  if (ring->spill_fd >= 0) {
+    close(ring->spill_fd);
+    ring->spill_fd = -1;
+  }
+}
+
+static uint64_t *slot_sequence(RING *ring, uint64_t position)
+{
+  return (uint64_t *) (ring->slots +
+		       (position & (ring->capacity - 1)) * ring->slot_size);
+}
+
+static int spill(RING *ring, const void *item)
+{
+  /* append the item to the spill file, starting it over once all was taken */
+  uint64_t spill_head = ring->spill_head;
+  uint64_t spill_tail = __atomic_load_n(&ring->spill_tail, __ATOMIC_ACQUIRE);
+  off_t offset;
+
+  if (spill_tail == spill_head && spill_head != ring->spill_base) {
+    /* the consumer is done reading it, so nothing reads it meanwhile */
+    if (ftruncate(ring->spill_fd, 0) == 0) {
+      __atomic_store_n(&ring->spill_base, spill_head, __ATOMIC_RELEASE);
+    }
+  }
+
+  offset = (off_t) ((spill_head - ring->spill_base) * ring->item_size);
+  if (pwrite(ring->spill_fd, item, ring->item_size, offset) !=
+      (ssize_t) ring->item_size) {
+    __atomic_store_n(&ring->spill_failed, ring->spill_failed + 1,
+		     __ATOMIC_RELAXED);
+    return 1;
+  }
+  __atomic_store_n(&ring->spill_head, spill_head + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int ring_push(RING *ring, const void *item)
+{
+  /*
+    each slot's sequence number is odd while its item is written and
+    2*(position + 1) once it holds the item at that position, so the
+    consumer can tell when the producer has lapped it and overwritten an item
+    it was about to take, as happens with RING_DROP_OLDEST
+  */
+  uint64_t head = ring->head;
+  uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  uint64_t *sequence;
+  uint64_t depth;
+
+  if (ring->overflow == RING_SPILL &&
+      (head - tail >= ring->capacity ||
+       __atomic_load_n(&ring->spill_tail, __ATOMIC_ACQUIRE) !=
+       ring->spill_head)) {
+    /* once spilling, keep spilling until the consumer catches up */
+    return spill(ring, item);
+  }
+
+  sequence = slot_sequence(ring, head);
+  __atomic_store_n(sequence, 2*head + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(sequence + 1, item, ring->item_size);
+  __atomic_store_n(sequence, 2*head + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+  depth = head + 1 - tail;
+  if (depth > ring->capacity) {
+    depth = ring->capacity;
+  }
+  if (depth > ring->max_depth) {
+    __atomic_store_n(&ring->max_depth, depth, __ATOMIC_RELAXED);
+  }
+  return 0;
+}
+
+int ring_pop(RING *ring, void *item)
+{
+  uint64_t tail = ring->tail;
+  uint64_t head;
+  uint64_t expected;
+  uint64_t spill_head;
+  uint64_t spill_base;
+  uint64_t *sequence;
+  off_t offset;
+
+  /*
+    read before the head, so that any item pushed into the ring ahead of
+    the spilled ones is seen
+  */
+  spill_head = __atomic_load_n(&ring->spill_head, __ATOMIC_ACQUIRE);
+
+  for (;;) {
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head - tail > ring->capacity) {
+      /* the oldest items were overwritten before they were taken */
+      __atomic_store_n(&ring->dropped,
+		       ring->dropped + (head - ring->capacity - tail),
+		       __ATOMIC_RELAXED);
+      tail = head - ring->capacity;
+    }
+    if (tail == head) {
+      break;
+    }
+
+    /* the copy only counts if the slot held the item throughout */
+    sequence = slot_sequence(ring, tail);
+    expected = 2*tail + 2;
+    if (__atomic_load_n(sequence, __ATOMIC_ACQUIRE) == expected) {
+      memcpy(item, sequence + 1, ring->item_size);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(sequence, __ATOMIC_RELAXED) == expected) {
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	return 1;
+      }
+    }
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+    tail++;
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+  /* items are only spilled once the ring is full, so they come after it */
+  while (ring->spill_tail < spill_head) {
+    spill_base = __atomic_load_n(&ring->spill_base, __ATOMIC_ACQUIRE);
+    offset = (off_t) ((ring->spill_tail - spill_base) * ring->item_size);
+    if (pread(ring->spill_fd, item, ring->item_size, offset) ==
+	(ssize_t) ring->item_size) {
+      __atomic_store_n(&ring->spill_tail, ring->spill_tail + 1,
+		       __ATOMIC_RELEASE);
+      return 1;
+    }
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->spill_tail, ring->spill_tail + 1,
+		     __ATOMIC_RELEASE);
+  }
+
+  return 0;
+}
+
+void ring_stats(RING *ring, RING_STATS *stats)
+{
+  /* the tails are read first, so they are never ahead of the heads */
+  uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  uint64_t spill_tail = __atomic_load_n(&ring->spill_tail, __ATOMIC_ACQUIRE);
+  uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  uint64_t spill_head = __atomic_load_n(&ring->spill_head, __ATOMIC_ACQUIRE);
+  uint64_t spill_failed = __atomic_load_n(&ring->spill_failed,
+					  __ATOMIC_RELAXED);
+  uint64_t depth = head - tail;
+
+  if (depth > ring->capacity) {
+    depth = ring->capacity;
+  }
+  stats->pushed = head + spill_head + spill_failed;
+  stats->dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED) +
+    spill_failed;
+  stats->spilled = spill_head;
+  stats->depth = depth + (spill_head - spill_tail);
+  stats->max_depth = __atomic_load_n(&ring->max_depth, __ATOMIC_RELAXED);
+}
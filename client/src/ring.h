@@ -0,0 +1,87 @@
+#ifndef __INC_RING_H
+#define __INC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* what a full ring does with the next item pushed */
+typedef enum {
+  RING_DROP_OLDEST, /* overwrite the oldest item not yet taken */
+  RING_SPILL        /* write it to the spill file, to be taken from there */
+} RING_OVERFLOW;
+
+typedef struct {
+  uint64_t pushed;
+  uint64_t dropped;   /* overwritten, or lost writing them to the spill file */
+  uint64_t spilled;   /* written to the spill file */
+  uint64_t depth;     /* waiting to be taken, in the ring or spilled */
+  uint64_t max_depth; /* the most that waited in the ring at once */
+} RING_STATS;
+
+/*
+  a bounded queue of fixed size items from one producer thread to one
+  consumer thread, without locks: pushing never waits for the consumer, and
+  what happens once the ring is full is up to the overflow policy. Items
+  spilled are taken after those in the ring, so they come out in the order
+  they were pushed. The counters are kept with atomic operations, so
+  ring_stats can be called from any thread
+*/
+typedef struct {
+  RING_OVERFLOW overflow;
+  size_t item_size;
+  uint64_t capacity; /* a power of two */
+  uint8_t *slots;    /* each a sequence number followed by an item */
+  size_t slot_size;
+  int spill_fd;      /* -1 unless spilling */
+
+  /* written by the producer only */
+  uint64_t head;       /* items pushed into the ring */
+  uint64_t spill_head; /* items written to the spill file */
+  uint64_t spill_base; /* the item at the start of the spill file */
+  uint64_t spill_failed;
+  uint64_t max_depth;
+
+  /* the consumer's counters are kept off the producer's cache line */
+  char pad[64];
+
+  /* written by the consumer only */
+  uint64_t tail;
+  uint64_t spill_tail;
+  uint64_t dropped;
+} RING;
+
+/*
+  make a ring of at least capacity items of item_size bytes; spill_path is
+  the file spilled to with RING_SPILL, which is emptied. Returns 0 on success
+*/
+int RING_init(RING *ring,
+	      size_t item_size,
+	      uint64_t capacity,
+	      RING_OVERFLOW overflow,
+	      const char *spill_path);
+
+void RING_destroy(RING *ring);
+
+/*
+  called by the producer; returns 0, or 1 if the item was lost because it
+  could not be spilled
+*/
+int ring_push(RING *ring, const void *item);
+
+/*
+  called by the consumer; copies the oldest item left into item, returning 1,
+  or returns 0 if there is none
+*/
+int ring_pop(RING *ring, void *item);
+
+void ring_stats(RING *ring, RING_STATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INC_RING_H */
@@ -1,47 +1,29 @@
 #include "devtypes.h"
 #include "array.h"
+#include "crc.h"
+#include "usb-operations.h"
 
 #include <ftdi.h>
 #include <libusb-1.0/libusb.h>
+#include <poll.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
 
 uint16_t make_crc(uint8_t *byte_array, int end_position)
 {
   /*
-    make a cyclic redundancy check for the given byte array; this is per the
-    rules found in the SEM710 specifications provided by Status Instruments;
-    This crc currently causes the device to respond to messages sent, however
-    the crc the device returns is incorrect by comparison to the one determined
-    here.
+    make a cyclic redundancy check for the given byte array, per the rules
+    found in the SEM710 specifications provided by Status Instruments; this is
+    CRC-16/MODBUS over the command, length and data, i.e. from index 1 up to
+    and including end_position (the start byte is not included)
   */
-  int i;
-  uint16_t crc;
-  char j;
-  char char_in;
-  int lsBit;
-
-  /*
-    The CRC is based on the following components of this message:
-
-    Start
-    Command
-    Length
-    Data
-  */
-
-  crc = 0xFFFF;
-  for (i = 1; i <= end_position; i++) {
-    char_in = byte_array[i];
-    crc = crc ^ char_in;
-    for (j = 1; j <= 8; j++) {
-      lsBit = crc & 1;
-      crc = crc >> 1;
-      if (lsBit == 1) {
-	crc = crc ^ 0xA001;
-      }
-    }
+  if (end_position < 1) {
+    return CRC16_MODBUS_SEED;
   }
-  return crc;
+  return crc16_modbus(byte_array + 1, end_position);
 }
 
 int crc_pass(uint8_t *rx_data, int rx_pointer)
@@ -64,22 +46,38 @@ int crc_pass(uint8_t *rx_data, int rx_pointer)
   return (calculated_crc == rx_crc);
 }
 
-int detach_device_kernel(int vendor_id, int product_id)
+static void crc_mismatch(uint8_t *frame, int len)
+{
+  /*
+    log a reply whose crc is not the one computed for it. The crc has not
+    been checked against frames captured from an SEM710, so such a reply is
+    still taken, and the whole frame is logged so it can be checked later
+  */
+  int i;
+
+  printf("reply crc mismatch, frame:");
+  for (i = 0; i < len; i++) {
+    printf(" %02X", frame[i]);
+  }
+  printf("\n");
+}
+
+int detach_device_kernel(libusb_context *context,
+			 int vendor_id,
+			 int product_id)
 {
   /*
     if the device kernel with the given vendor id and product id is currently
     active then detach it and return whether or not this action failed. This
-    must be done using libusb, since ftd2xx does not have this capability.
+    must be done using libusb, since ftd2xx does not have this capability. The
+    libusb context is owned by the caller so it can be kept between calls.
   */
 
   int detach_failed;
-  libusb_context *context;
   libusb_device_handle *handle;
 
-  context = NULL;
   handle = NULL;
 
-  libusb_init(&context);
   libusb_set_debug(context, 3);
 
   /* finds the first, as mentioned */
@@ -88,17 +86,146 @@ int detach_device_kernel(int vendor_id, int product_id)
     return -1;
   }
 
+  detach_failed = 0;
   if (libusb_kernel_driver_active(handle, 0)) {
     detach_failed = libusb_detach_kernel_driver(handle, 0);
-    if (detach_failed) {
-      return -1;
+  }
+  libusb_release_interface(handle, 0);
+  libusb_close(handle);
+
+  return detach_failed ? -1 : 0;
+}
+
+static libusb_device_handle *open_device_with_serial(libusb_context *context,
+						     int vendor_id,
+						     int product_id,
+						     char *serial)
+{
+  /*
+    open the device with the given vendor id, product id and serial number
+    using libusb, or return NULL if it is not attached
+  */
+  libusb_device **devices;
+  libusb_device_handle *handle;
+  struct libusb_device_descriptor descriptor;
+  unsigned char device_serial[DEVICE_SERIAL_SIZE];
+  ssize_t count;
+  ssize_t i;
+  int len;
+
+  count = libusb_get_device_list(context, &devices);
+  if (count < 0) {
+    return NULL;
+  }
+
+  handle = NULL;
+  for (i = 0; i < count && handle == NULL; i++) {
+    if (libusb_get_device_descriptor(devices[i], &descriptor) != 0 ||
+	descriptor.idVendor != vendor_id ||
+	descriptor.idProduct != product_id ||
+	libusb_open(devices[i], &handle) != 0) {
+      handle = NULL;
+      continue;
+    }
+
+    len = libusb_get_string_descriptor_ascii(handle,
+					     descriptor.iSerialNumber,
+					     device_serial,
+					     sizeof(device_serial));
+    if (len <= 0 || strcmp((char *) device_serial, serial) != 0) {
+      libusb_close(handle);
+      handle = NULL;
     }
   }
+  libusb_free_device_list(devices, 1);
+
+  return handle;
+}
+
+int detach_device_kernel_serial(libusb_context *context,
+				int vendor_id,
+				int product_id,
+				char *serial)
+{
+  /*
+    as detach_device_kernel, but for the device with the given serial number
+    rather than the first one found
+  */
+  int detach_failed;
+  libusb_device_handle *handle;
+
+  handle = open_device_with_serial(context, vendor_id, product_id, serial);
+  if (handle == NULL) {
+    return -1;
+  }
+
+  detach_failed = 0;
+  if (libusb_kernel_driver_active(handle, 0)) {
+    detach_failed = libusb_detach_kernel_driver(handle, 0);
+  }
   libusb_release_interface(handle, 0);
   libusb_close(handle);
-  libusb_exit(context);
 
-  return 0;
+  return detach_failed ? -1 : 0;
+}
+
+int find_device_serials(struct ftdi_context *ctx,
+			int vendor_id,
+			int product_id,
+			char serials[][DEVICE_SERIAL_SIZE],
+			int max_devices)
+{
+  /*
+    find every attached device with the given vendor and product id, and copy
+    the serial numbers of up to max_devices of them into serials (an empty
+    string if a device has none); returns how many were copied, or the
+    libftdi error if the devices could not be listed
+  */
+  struct ftdi_device_list *devices;
+  struct ftdi_device_list *device;
+  int count;
+
+  count = ftdi_usb_find_all(ctx, &devices, vendor_id, product_id);
+  if (count < 0) {
+    return count;
+  }
+
+  count = 0;
+  for (device = devices;
+       device != NULL && count < max_devices;
+       device = device->next) {
+    if (ftdi_usb_get_strings(ctx,
+			     device->dev,
+			     NULL, 0,
+			     NULL, 0,
+			     serials[count], DEVICE_SERIAL_SIZE) < 0) {
+      serials[count][0] = '\0';
+    }
+    count++;
+  }
+  ftdi_list_free(&devices);
+
+  return count;
+}
+
+void share_usb_context(struct ftdi_context *ctx, libusb_context *context)
+{
+  /*
+    have ctx use the caller's libusb context in place of the one ftdi_new
+    made for it, so the transfers of the device opened through ctx complete
+    when that context's events are handled, as those of every other device
+    are. The context stays the caller's: unshare_usb_context must be called
+    before ftdi_free, which would otherwise exit it
+  */
+  if (ctx->usb_ctx != NULL && ctx->usb_ctx != context) {
+    libusb_exit(ctx->usb_ctx);
+  }
+  ctx->usb_ctx = context;
+}
+
+void unshare_usb_context(struct ftdi_context *ctx)
+{
+  ctx->usb_ctx = NULL;
 }
 
 int open_device(struct ftdi_context *ctx, int vendor_id, int product_id)
@@ -150,60 +277,6 @@ int prepare_device(struct ftdi_context *ctx)
   return 0;
 }
 
-int generate_message(uint8_t COMMAND, uint8_t* byte_array,
-		     int byte_array_upper_index)
-{
-  /*
-    Generate a message to send to the device, based on the given command and
-    byte array; returns the size of the message
-  */
-  uint8_t output[259];
-  int i;
-  uint8_t x;
-  uint16_t crc;
-  uint8_t lbyte;
-  uint8_t rbyte;
-
-  /* start byte */
-  i = 0;
-  output[i] = 0x55;
-
-  /* command */
-  i++;
-  output[i] = COMMAND;
-
-  /* length */
-  i++;
-  output[i] = byte_array_upper_index;
-
-  /* data */
-  for (x = 0; x <= byte_array_upper_index; x++) {
-    i++;
-    output[i] = byte_array[x];
-  }
-
-  /* crc */
-  crc = make_crc(output, i);
-  lbyte = (crc >> 8) & 0xFF;
-  rbyte = (crc) & 0xFF;
-
-  /* put CRC on byte_array, little Endian */
-  i++;
-  output[i] = rbyte;
-  i++;
-  output[i] = lbyte;
-
-  /* add end byte */
-  i++;
-  output[i] = 0xAA;
-
-  for (x = 0; x <= i; x++) {
-    byte_array[x] = output[x];
-  }
-
-  return (i + 1); /* returns the size, NOT the highest index */
-}
-
 int generate_block_message(uint8_t device_address, int command,
 			   uint8_t byte_count, long block_address,
 			   uint8_t *byte_array, uint8_t read)
@@ -253,13 +326,28 @@ int generate_block_message(uint8_t device_address, int command,
   return i + 1;
 }
 
+static long ms_since(struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec)*1000 +
+    (now.tv_nsec - start->tv_nsec)/1000000;
+}
+
 int read_device(struct ftdi_context *ctx, int command, uint8_t *incoming_buff)
 {
   /*
      sends a read command to the device, and returns the length of the received
-     byte array
+     frame as soon as it is complete. The device is polled every
+     REPLY_POLL_INTERVAL microseconds; if no reply for the command arrives
+     within REPLY_TIMEOUT milliseconds, the command is sent again, up to
+     REPLY_ATTEMPTS times, after which the reason the last attempt failed is
+     returned: READ_DEVICE_TIMEOUT, or READ_DEVICE_REFUSED if the device
+     replied to something else. A reply failing its crc is logged, not refused
   */
   uint8_t outgoing_bytes[280];
+  uint8_t chunk[64];
 
   int len;
   int i;
@@ -267,40 +355,356 @@ int read_device(struct ftdi_context *ctx, int command, uint8_t *incoming_buff)
   int written;
   int received;
   int confirmation_byte;
+  int failure = READ_DEVICE_TIMEOUT;
 
-  for (i = 0; i < 280; i++) {
-    incoming_buff[i] = 0;
-  }
+  FRAME_RECEIVER rx;
+  RX_FRAMING state;
+  struct timespec sent;
+
+  memset(incoming_buff, 0, 280);
   confirmation_byte = get_confirmation_byte((SEM_COMMANDS)command);
 
-  outgoing_bytes[0] = 0;
-  len = generate_message(command, outgoing_bytes, 0);
+  len = encode_command((SEM_COMMANDS)command, NULL, 0,
+		       outgoing_bytes, sizeof(outgoing_bytes));
   if (len <= 0) {
     return -1;
   }
 
-  received = 0;
-  for (i = 0; (i < 4 && (incoming_buff[1] != confirmation_byte)); i++) {
-    /*  until positive response received, or 4 no-replies (2.8 seconds) */
+  for (i = 0; i < REPLY_ATTEMPTS; i++) {
     written = ftdi_write_data(ctx, outgoing_bytes, len);
     if (written < 0) {
       return written;
     }
+    clock_gettime(CLOCK_MONOTONIC, &sent);
+
+    frame_receiver_init(&rx, incoming_buff, 280);
+    do {
+      received = ftdi_read_data(ctx, chunk, sizeof(chunk));
+      if (received < 0) {
+	return received;
+      }
+      state = frame_receiver_feed(&rx, chunk, received);
+      if (received == 0) {
+	usleep(REPLY_POLL_INTERVAL);
+      }
+    } while (state != FRAME_COMPLETE &&
+	     state != RX_OVERFLOW &&
+	     ms_since(&sent) < REPLY_TIMEOUT);
+
+    if (state != FRAME_COMPLETE) {
+      failure = READ_DEVICE_TIMEOUT;
+    } else if (confirmation_byte != 0 &&
+	       incoming_buff[1] != confirmation_byte) {
+      failure = READ_DEVICE_REFUSED;
+    } else {
+      if (!crc_pass(incoming_buff, rx.len - 2)) {
+	crc_mismatch(incoming_buff, rx.len);
+      }
+      return rx.len;
+    }
+  }
+
+  return failure;
+}
+
+static void progress_reads(USB_EVENTS *events);
+
+static void handle_usb_events(USB_EVENTS *events)
+{
+  struct timeval zero = { 0, 0 };
+  struct timeval next;
+
+  /* complete whatever transfers are ready, without waiting for more */
+  libusb_handle_events_timeout_completed(events->context, &zero, NULL);
+  progress_reads(events);
+
+  if (!libusb_pollfds_handle_timeouts(events->context)) {
+    if (libusb_get_next_timeout(events->context, &next) == 1) {
+      timer_after(&events->timer, next.tv_sec*1000 + (next.tv_usec + 999)/1000);
+    } else {
+      timer_cancel(&events->timer);
+    }
+  }
+}
+
+static void usb_ready(void *data, int fd, uint32_t ready)
+{
+  (void) fd;
+  (void) ready;
+  handle_usb_events((USB_EVENTS *) data);
+}
+
+static void usb_fd_added(int fd, short poll_events, void *data)
+{
+  USB_EVENTS *events = (USB_EVENTS *) data;
+  uint32_t watch_events = 0;
+  int i;
+
+  if (poll_events & POLLIN) {
+    watch_events |= EPOLLIN;
+  }
+  if (poll_events & POLLOUT) {
+    watch_events |= EPOLLOUT;
+  }
+  for (i = 0; i < USB_EVENTS_MAX_FDS; i++) {
+    if (events->watches[i].callback == NULL) {
+      event_watch(events->loop, &events->watches[i],
+		  fd, watch_events, usb_ready, events);
+      return;
+    }
+  }
+  fprintf(stderr, "Too many libusb file descriptors to watch\n");
+}
+
+static void usb_fd_removed(int fd, void *data)
+{
+  USB_EVENTS *events = (USB_EVENTS *) data;
+  int i;
+
+  for (i = 0; i < USB_EVENTS_MAX_FDS; i++) {
+    if (events->watches[i].callback != NULL && events->watches[i].fd == fd) {
+      event_unwatch(events->loop, &events->watches[i]);
+      return;
+    }
+  }
+}
+
+int USB_EVENTS_init(USB_EVENTS *events,
+		    EVENT_LOOP *loop,
+		    libusb_context *context)
+{
+  const struct libusb_pollfd **fds;
+  int i;
+
+  events->context = context;
+  events->loop = loop;
+  events->reads = NULL;
+  for (i = 0; i < USB_EVENTS_MAX_FDS; i++) {
+    events->watches[i].fd = -1;
+    events->watches[i].callback = NULL;
+  }
+  if (EVENT_TIMER_init(&events->timer, loop, usb_ready, events)) {
+    return 1;
+  }
 
-    usleep(700000); /* give device some time to transmit process readings */
+  fds = libusb_get_pollfds(context);
+  if (fds == NULL) {
+    EVENT_TIMER_destroy(&events->timer);
+    return 1;
+  }
+  for (i = 0; fds[i] != NULL; i++) {
+    usb_fd_added(fds[i]->fd, fds[i]->events, events);
+  }
+  libusb_free_pollfds(fds);
+  libusb_set_pollfd_notifiers(context, usb_fd_added, usb_fd_removed, events);
 
-    received = ftdi_read_data(ctx, incoming_buff, 280);
-    if (received < 0) {
-      return received;
+  return 0;
+}
+
+void USB_EVENTS_destroy(USB_EVENTS *events)
+{
+  int i;
+
+  libusb_set_pollfd_notifiers(events->context, NULL, NULL, NULL);
+  for (i = 0; i < USB_EVENTS_MAX_FDS; i++) {
+    event_unwatch(events->loop, &events->watches[i]);
+  }
+  EVENT_TIMER_destroy(&events->timer);
+}
+
+static void stop_transfers(DEVICE_READ *read)
+{
+  /* how long to let libusb take back a transfer being cancelled */
+  struct timeval cancel_wait = { 0, 100000 };
+
+  if (read->write != NULL) {
+    if (read->write->completed) {
+      ftdi_transfer_data_done(read->write);
+    } else {
+      ftdi_transfer_data_cancel(read->write, &cancel_wait);
+    }
+    read->write = NULL;
+  }
+  if (read->read != NULL) {
+    if (read->read->completed) {
+      ftdi_transfer_data_done(read->read);
+    } else {
+      ftdi_transfer_data_cancel(read->read, &cancel_wait);
     }
+    read->read = NULL;
   }
+}
+
+static void stop_read(DEVICE_READ *read)
+{
+  DEVICE_READ **link;
+
+  stop_transfers(read);
+  timer_cancel(&read->timer);
+  for (link = &read->events->reads; *link != NULL; link = &(*link)->next) {
+    if (*link == read) {
+      *link = read->next;
+      break;
+    }
+  }
+  read->active = 0;
+}
 
-  if (incoming_buff[1] != confirmation_byte) {
+static void finish_read(DEVICE_READ *read, int result)
+{
+  /* done may start the next read with this one */
+  stop_read(read);
+  read->done(read->data, result);
+}
+
+static int send_command(DEVICE_READ *read)
+{
+  /* one attempt, as each time around read_device's loop */
+  memset(read->incoming_buff, 0, 280);
+  frame_receiver_init(&read->rx, read->incoming_buff, 280);
+  read->state = read->rx.state;
+  read->fed = 0;
+
+  read->write = ftdi_write_data_submit(read->ctx,
+				       read->outgoing_bytes,
+				       read->len);
+  if (read->write == NULL) {
+    return -1;
+  }
+  read->read = ftdi_read_data_submit(read->ctx,
+				     read->received,
+				     sizeof(read->received));
+  if (read->read == NULL) {
+    stop_transfers(read);
+    return -1;
+  }
+  if (timer_after(&read->timer, REPLY_TIMEOUT)) {
+    stop_transfers(read);
     return -1;
   }
+  return 0;
+}
+
+static void attempt_failed(DEVICE_READ *read, int failure)
+{
+  stop_transfers(read);
+  read->attempt++;
+  if (read->attempt >= REPLY_ATTEMPTS) {
+    finish_read(read, failure);
+  } else if (send_command(read)) {
+    finish_read(read, -1);
+  }
+}
+
+static void reply_timeout(void *data, int fd, uint32_t events)
+{
+  (void) fd;
+  (void) events;
+  attempt_failed((DEVICE_READ *) data, READ_DEVICE_TIMEOUT);
+}
+
+static void read_progress(DEVICE_READ *read)
+{
+  int written;
+  int received;
+
+  /* nothing more to come once the reply buffer was given up on */
+  if (!read->active || read->read == NULL) {
+    return;
+  }
+
+  if (read->write != NULL && read->write->completed) {
+    written = ftdi_transfer_data_done(read->write);
+    read->write = NULL;
+    if (written < 0) {
+      finish_read(read, written);
+      return;
+    }
+  }
 
-  if (!crc_pass(incoming_buff, received - 2)) {
-    /* do nothing for now  */
+  /* the read transfer fills its buffer as the device's packets come in */
+  received = read->read->offset;
+  if (received > read->fed) {
+    read->state = frame_receiver_feed(&read->rx,
+				      read->received + read->fed,
+				      received - read->fed);
+    read->fed = received;
+  }
+
+  if (read->state == FRAME_COMPLETE) {
+    if (read->confirmation_byte != 0 &&
+	read->incoming_buff[1] != read->confirmation_byte) {
+      attempt_failed(read, READ_DEVICE_REFUSED);
+    } else {
+      if (!crc_pass(read->incoming_buff, read->rx.len - 2)) {
+	crc_mismatch(read->incoming_buff, read->rx.len);
+      }
+      finish_read(read, read->rx.len);
+    }
+  } else if (read->state == RX_OVERFLOW || read->read->completed) {
+    /* no frame in a full buffer; it is left to time out, as read_device does */
+    stop_transfers(read);
+  }
+}
+
+static void progress_reads(USB_EVENTS *events)
+{
+  DEVICE_READ *read;
+  DEVICE_READ *next;
+
+  for (read = events->reads; read != NULL; read = next) {
+    next = read->next;
+    read_progress(read);
+  }
+}
+
+int DEVICE_READ_init(DEVICE_READ *read, USB_EVENTS *events)
+{
+  read->events = events;
+  read->active = 0;
+  read->write = NULL;
+  read->read = NULL;
+  read->next = NULL;
+  return EVENT_TIMER_init(&read->timer, events->loop, reply_timeout, read);
+}
+
+void DEVICE_READ_destroy(DEVICE_READ *read)
+{
+  read_device_cancel(read);
+  EVENT_TIMER_destroy(&read->timer);
+}
+
+int read_device_start(DEVICE_READ *read,
+		      struct ftdi_context *ctx,
+		      int command,
+		      uint8_t *incoming_buff,
+		      DEVICE_READ_DONE done,
+		      void *data)
+{
+  read_device_cancel(read);
+
+  read->ctx = ctx;
+  read->incoming_buff = incoming_buff;
+  read->done = done;
+  read->data = data;
+  read->attempt = 0;
+  read->confirmation_byte = get_confirmation_byte((SEM_COMMANDS)command);
+  read->len = encode_command((SEM_COMMANDS)command, NULL, 0,
+			     read->outgoing_bytes,
+			     sizeof(read->outgoing_bytes));
+  if (read->len <= 0 || send_command(read)) {
+    return -1;
+  }
+
+  read->active = 1;
+  read->next = read->events->reads;
+  read->events->reads = read;
+  return 0;
+}
+
+void read_device_cancel(DEVICE_READ *read)
+{
+  if (read->active) {
+    stop_read(read);
   }
-  return received;
 }
@@ -2,17 +2,120 @@
 #define __INC_USB_OPERATIONS_H
 
 #include <ftdi.h>
+#include <libusb-1.0/libusb.h>
 #include "devtypes.h"
+#include "event-loop.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int detach_device_kernel(int vendor_id, int product_id);
+/* how read_device waits for the device to reply to a command */
+#define REPLY_POLL_INTERVAL 2000 /* microseconds between polls of the device */
+#define REPLY_TIMEOUT 700 /* milliseconds before the command is sent again */
+#define REPLY_ATTEMPTS 4
+
+/* read_device failures, besides those returned by libftdi */
+#define READ_DEVICE_TIMEOUT -1000 /* no complete reply in any attempt */
+#define READ_DEVICE_REFUSED -1001 /* replies were not for the command sent */
+#define READ_DEVICE_BAD_REPLY -1002 /* the reply could not be decoded */
+
+/* room for a device serial number, which FTDI devices keep short */
+#define DEVICE_SERIAL_SIZE 64
+
+/* most file descriptors libusb is expected to want watched at once */
+#define USB_EVENTS_MAX_FDS 16
+
+typedef struct DEVICE_READ DEVICE_READ;
+
+/*
+  libusb's file descriptors, watched on an event loop so that transfers
+  submitted to devices complete as the loop runs, along with the device reads
+  waiting on them
+*/
+typedef struct {
+  libusb_context *context;
+  EVENT_LOOP *loop;
+  EVENT_WATCH watches[USB_EVENTS_MAX_FDS];
+  EVENT_TIMER timer;  /* for libusb timeouts it can not keep itself */
+  DEVICE_READ *reads; /* reads in progress */
+} USB_EVENTS;
+
+/* called with what read_device would have returned */
+typedef void (*DEVICE_READ_DONE)(void *data, int result);
+
+/*
+  a read_device done without blocking: the command is written and the reply
+  read by transfers left with libusb, and the attempt timed out by a timer
+*/
+struct DEVICE_READ {
+  USB_EVENTS *events;
+  EVENT_TIMER timer;
+  struct ftdi_context *ctx;
+  uint8_t *incoming_buff;
+  DEVICE_READ_DONE done;
+  void *data;
+  int active;
+
+  uint8_t outgoing_bytes[280];
+  int len;
+  int confirmation_byte;
+  int attempt;
+
+  struct ftdi_transfer_control *write;
+  struct ftdi_transfer_control *read;
+  uint8_t received[280]; /* the read transfer's buffer */
+  int fed;               /* bytes of it given to rx */
+  FRAME_RECEIVER rx;
+  RX_FRAMING state;
+
+  DEVICE_READ *next;
+};
+
+int detach_device_kernel(libusb_context *context,
+			 int vendor_id,
+			 int product_id);
+int detach_device_kernel_serial(libusb_context *context,
+				int vendor_id,
+				int product_id,
+				char *serial);
+int find_device_serials(struct ftdi_context *ctx,
+			int vendor_id,
+			int product_id,
+			char serials[][DEVICE_SERIAL_SIZE],
+			int max_devices);
+void share_usb_context(struct ftdi_context *ctx, libusb_context *context);
+void unshare_usb_context(struct ftdi_context *ctx);
 int open_device(struct ftdi_context *ctx, int vendor_id, int product_id);
 int prepare_device(struct ftdi_context *ctx);
 int read_device(struct ftdi_context *ctx, int command, uint8_t *incoming_buff);
 
+/* returns 0 on success */
+int USB_EVENTS_init(USB_EVENTS *events,
+		    EVENT_LOOP *loop,
+		    libusb_context *context);
+void USB_EVENTS_destroy(USB_EVENTS *events);
+
+/* returns 0 on success */
+int DEVICE_READ_init(DEVICE_READ *read, USB_EVENTS *events);
+void DEVICE_READ_destroy(DEVICE_READ *read);
+
+/*
+  start reading the device as read_device does, calling done with the result
+  once the loop has run far enough; returns 0 if the read was started, or
+  the failure otherwise, in which case done is not called. A read that is
+  still in progress is cancelled first
+*/
+int read_device_start(DEVICE_READ *read,
+		      struct ftdi_context *ctx,
+		      int command,
+		      uint8_t *incoming_buff,
+		      DEVICE_READ_DONE done,
+		      void *data);
+
+/* stop a read in progress without calling done */
+void read_device_cancel(DEVICE_READ *read);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,90 @@
+/*
+  The following are tests for the file aggregate.c
+*/
+
+#include "aggregate.h"
+
+#include <math.h>
+
+#include <gtest/gtest.h>
+
+TEST(aggregate, empty)
+{
+  AGGREGATE aggregate;
+  READING_SUMMARY summary;
+
+  aggregate_clear(&aggregate);
+  aggregate_summary(&aggregate, &summary);
+  ASSERT_EQ(0u, summary.samples);
+}
+
+TEST(aggregate, statistics)
+{
+  AGGREGATE aggregate;
+  READING_SUMMARY summary;
+  float values[] = { 2, 4, 4, 4, 5, 5, 7, 9 };
+  int i;
+
+  aggregate_clear(&aggregate);
+  aggregate_add(&aggregate, 3);
+  aggregate_summary(&aggregate, &summary);
+  ASSERT_EQ(1u, summary.samples);
+  ASSERT_FLOAT_EQ(3, summary.min);
+  ASSERT_FLOAT_EQ(3, summary.max);
+  ASSERT_FLOAT_EQ(3, summary.mean);
+  ASSERT_FLOAT_EQ(0, summary.stddev);
+  ASSERT_FLOAT_EQ(3, summary.median);
+
+  aggregate_clear(&aggregate);
+  for (i = 0; i < 8; i++) {
+    aggregate_add(&aggregate, values[i]);
+  }
+  aggregate_summary(&aggregate, &summary);
+  ASSERT_EQ(8u, summary.samples);
+  ASSERT_FLOAT_EQ(2, summary.min);
+  ASSERT_FLOAT_EQ(9, summary.max);
+  ASSERT_FLOAT_EQ(5, summary.mean);
+  /* the sample standard deviation */
+  ASSERT_FLOAT_EQ((float) sqrt(32.0 / 7), summary.stddev);
+  /* of the last five: 4, 5, 5, 7, 9 */
+  ASSERT_FLOAT_EQ(5, summary.median);
+}
+
+TEST(aggregate, median_filter)
+{
+  /* a short spike does not reach the median */
+  AGGREGATE aggregate;
+  READING_SUMMARY summary;
+
+  aggregate_clear(&aggregate);
+  aggregate_add(&aggregate, -80);
+  aggregate_add(&aggregate, -80);
+  aggregate_add(&aggregate, 25);
+  aggregate_add(&aggregate, -79);
+  aggregate_summary(&aggregate, &summary);
+  ASSERT_FLOAT_EQ(25, summary.max);
+  /* an even count takes the middle two */
+  ASSERT_FLOAT_EQ(-79.5, summary.median);
+
+  aggregate_add(&aggregate, 26);
+  aggregate_add(&aggregate, -78);
+  aggregate_summary(&aggregate, &summary);
+  ASSERT_FLOAT_EQ(-78, summary.median);
+}
+
+TEST(aggregate, long_run)
+{
+  /* the variance stays accurate around a large mean */
+  AGGREGATE aggregate;
+  READING_SUMMARY summary;
+  int i;
+
+  aggregate_clear(&aggregate);
+  for (i = 0; i < 1000000; i++) {
+    aggregate_add(&aggregate, (i % 2) ? -80.25f : -79.75f);
+  }
+  aggregate_summary(&aggregate, &summary);
+  ASSERT_EQ(1000000u, summary.samples);
+  ASSERT_NEAR(-80.0, summary.mean, 1e-4);
+  ASSERT_NEAR(0.25, summary.stddev, 1e-4);
+}
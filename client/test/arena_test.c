@@ -0,0 +1,98 @@
+/*
+  The following are tests for the file arena.c
+*/
+
+#include "arena.h"
+#include "cJSON.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <gtest/gtest.h>
+
+TEST(arena, aligned_and_owned)
+{
+  ARENA arena;
+  char *a;
+  char *b;
+  int outside;
+
+  ASSERT_EQ(ARENA_init(&arena, 256), 0);
+  a = (char *) arena_alloc(&arena, 3);
+  b = (char *) arena_alloc(&arena, 5);
+  ASSERT_EQ((uintptr_t) a % ARENA_ALIGN, 0u);
+  ASSERT_EQ((uintptr_t) b % ARENA_ALIGN, 0u);
+  ASSERT_EQ(b - a, ARENA_ALIGN);
+
+  ASSERT_TRUE(arena_owns(&arena, a));
+  ASSERT_TRUE(arena_owns(&arena, b + 4));
+  ASSERT_FALSE(arena_owns(&arena, &outside));
+  ARENA_destroy(&arena);
+}
+
+TEST(arena, reset_reuses_memory)
+{
+  ARENA arena;
+  void *first;
+
+  ASSERT_EQ(ARENA_init(&arena, 256), 0);
+  first = arena_alloc(&arena, 100);
+  arena_alloc(&arena, 100);
+  arena_reset(&arena);
+  ASSERT_EQ(arena_alloc(&arena, 100), first);
+  ARENA_destroy(&arena);
+}
+
+TEST(arena, grows_then_coalesces)
+{
+  ARENA arena;
+  void *big;
+  int i;
+
+  ASSERT_EQ(ARENA_init(&arena, 64), 0);
+  for (i = 0; i < 10; i++) {
+    ASSERT_TRUE(arena_alloc(&arena, 48) != NULL);
+  }
+  big = arena_alloc(&arena, 1000);
+  ASSERT_TRUE(big != NULL);
+  ASSERT_TRUE(arena_owns(&arena, big));
+
+  /* after a reset one chunk holds what took several */
+  arena_reset(&arena);
+  ASSERT_GE(arena.chunk_size, 10 * 48 + 1000u);
+  for (i = 0; i < 10; i++) {
+    arena_alloc(&arena, 48);
+  }
+  arena_alloc(&arena, 1000);
+  arena_reset(&arena);
+  ASSERT_EQ(arena.chunk_size, arena.high_water);
+  ARENA_destroy(&arena);
+}
+
+TEST(arena, cjson)
+{
+  ARENA arena;
+  cJSON *kept;
+  cJSON *root;
+
+  ASSERT_EQ(ARENA_init(&arena, 1024), 0);
+
+  /* made before the arena is used, so still freed normally */
+  kept = cJSON_Parse("{\"a\": \"b\"}");
+  ASSERT_TRUE(kept != NULL);
+
+  cjson_use_arena(&arena);
+  root = cJSON_Parse("{\"specifications\": {\"uploadURL\": \"/x\"}}");
+  ASSERT_TRUE(root != NULL);
+  ASSERT_TRUE(arena_owns(&arena, root));
+  ASSERT_STREQ(cJSON_GetObjectItem(cJSON_GetObjectItem(root,
+						       "specifications"),
+				   "uploadURL")->valuestring, "/x");
+  cJSON_Delete(root);
+  cJSON_Delete(kept);
+  arena_reset(&arena);
+  cjson_use_arena(NULL);
+
+  ARENA_destroy(&arena);
+}
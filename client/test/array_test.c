@@ -142,3 +142,32 @@ TEST(array, float_into_byte_array_2)
 
 
 
+
+TEST(array, short_into_byte_array_0)
+{
+  uint8_t shrt_bytes[3];
+
+  ASSERT_EQ(short_into_byte_array(shrt_bytes, 1, 0x7FFF), 3);
+  ASSERT_EQ(shrt_bytes[1], 0xFF);
+  ASSERT_EQ(shrt_bytes[2], 0x7F);
+  ASSERT_EQ(short_from_byte_array(shrt_bytes, 1), 0x7FFF);
+}
+
+TEST(array, floats_unaligned)
+{
+  float in[4] = { 1.0f, -2.5f, 1000.0f, 0.125f };
+  float out[4];
+  uint8_t bytes[1 + 16];
+  int i;
+
+  /* start at an odd offset, as the values do in a device frame */
+  ASSERT_EQ(floats_into_byte_array(bytes, 1, in, 4), 17);
+  ASSERT_EQ(bytes[3], 0x80);
+  ASSERT_EQ(bytes[4], 0x3F);
+
+  ASSERT_EQ(floats_from_byte_array(bytes, 1, out, 4), 17);
+  for (i = 0; i < 4; i++) {
+    ASSERT_FLOAT_EQ(out[i], in[i]);
+    ASSERT_FLOAT_EQ(float_from_byte_array(bytes, 1 + 4 * i), in[i]);
+  }
+}
@@ -0,0 +1,166 @@
+/*
+  The following are tests for the file batch.c
+*/
+
+#include "batch.h"
+#include "misc-structs.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#define READINGS 100
+
+static void make_readings(TIMED_READING *readings, int count)
+{
+  int i;
+
+  memset(readings, 0, sizeof(TIMED_READING) * count);
+  for (i = 0; i < count; i++) {
+    readings[i].timestamp = 1500000000 + 30*i;
+    readings[i].temperature = -80.125f + 0.01f * i;
+    readings[i].status = (i % 10 == 9) ? READ_STATUS_OUT_OF_RANGE :
+      READ_STATUS_OK;
+  }
+  /* an oversampled one */
+  readings[1].summary.samples = 30;
+  readings[1].summary.min = -80.5f;
+  readings[1].summary.max = -79.5f;
+  readings[1].summary.mean = -80.0f;
+  readings[1].summary.stddev = 0.25f;
+  readings[1].summary.median = -80.1f;
+}
+
+TEST(batch, add_remove)
+{
+  READING_BATCH batch;
+  TIMED_READING readings[12];
+  int i;
+
+  make_readings(readings, 12);
+  ASSERT_EQ(0, READING_BATCH_init(&batch, 10, 300));
+  for (i = 0; i < 10; i++) {
+    ASSERT_EQ(0, batch_add(&batch, &readings[i]));
+  }
+  /* a full batch takes no more */
+  ASSERT_EQ(1, batch_add(&batch, &readings[10]));
+  ASSERT_EQ(10, batch.count);
+  ASSERT_EQ(1, batch_due(&batch, readings[9].timestamp));
+
+  /* the readings added after those uploaded stay */
+  batch_remove(&batch, 4);
+  ASSERT_EQ(6, batch.count);
+  ASSERT_EQ(readings[4].timestamp, batch.readings[0].timestamp);
+  ASSERT_EQ(1, batch.alarm);
+  batch_remove(&batch, 5);
+  ASSERT_EQ(1, batch.count);
+  ASSERT_EQ(readings[9].timestamp, batch.readings[0].timestamp);
+
+  /* as does the alarm, only if one of them is in an alarm state */
+  ASSERT_EQ(0, batch_add(&batch, &readings[10]));
+  batch_remove(&batch, 1);
+  ASSERT_EQ(0, batch.alarm);
+  batch_remove(&batch, 5);
+  ASSERT_EQ(0, batch.count);
+
+  READING_BATCH_destroy(&batch);
+}
+
+TEST(batch, cbor_round_trip)
+{
+  TIMED_READING readings[READINGS];
+  TIMED_READING decoded[READINGS];
+  uint8_t buffer[READINGS * 64];
+  size_t len;
+  int count;
+
+  make_readings(readings, READINGS);
+  ASSERT_EQ(0, encode_batch(readings, READINGS, buffer, sizeof(buffer), &len));
+  ASSERT_LE(len, encoded_batch_bound(READINGS));
+
+  ASSERT_EQ(0, decode_batch(buffer, len, decoded, READINGS, &count));
+  ASSERT_EQ(READINGS, count);
+  ASSERT_EQ(0, memcmp(readings, decoded, sizeof(readings)));
+
+  /* too many readings for the room given */
+  ASSERT_EQ(1, decode_batch(buffer, len, decoded, READINGS - 1, &count));
+  ASSERT_EQ(0, count);
+
+  /* cut short */
+  ASSERT_EQ(1, decode_batch(buffer, len - 1, decoded, READINGS, &count));
+}
+
+TEST(batch, cbor_buffer_too_small)
+{
+  TIMED_READING readings[2];
+  uint8_t buffer[20];
+  size_t len;
+
+  make_readings(readings, 2);
+  ASSERT_EQ(1, encode_batch(readings, 2, buffer, sizeof(buffer), &len));
+  ASSERT_EQ(0, encode_batch(readings, 0, buffer, sizeof(buffer), &len));
+  ASSERT_EQ(1u, len);
+}
+
+TEST(batch, cbor_is_smaller)
+{
+  TIMED_READING readings[READINGS];
+  string json;
+  string cbor;
+
+  init_string(&json);
+  init_string(&cbor);
+  make_readings(readings, READINGS);
+  readings[1].summary.samples = 0;
+
+  ASSERT_EQ(0, pack_batch(readings, READINGS, &json));
+  ASSERT_EQ(0, pack_batch_cbor(readings, READINGS, &cbor));
+  /* 17 bytes a reading, against around 60 */
+  ASSERT_EQ(2u + 17u * READINGS, cbor.len);
+  ASSERT_GT(json.len, 3 * cbor.len);
+
+  deinit_string(&json);
+  deinit_string(&cbor);
+}
+
+TEST(batch, repack_as_json)
+{
+  TIMED_READING readings[READINGS];
+  string json;
+  string cbor;
+  string repacked;
+
+  init_string(&json);
+  init_string(&cbor);
+  init_string(&repacked);
+  make_readings(readings, READINGS);
+
+  ASSERT_EQ(0, pack_batch(readings, READINGS, &json));
+  ASSERT_EQ(0, pack_batch_cbor(readings, READINGS, &cbor));
+  ASSERT_EQ(0, repack_batch_as_json((uint8_t *) cbor.ptr,
+				    cbor.len,
+				    0,
+				    &repacked));
+  ASSERT_STREQ(json.ptr, repacked.ptr);
+
+  /* a lone reading is packed the way it is sent on its own */
+  ASSERT_EQ(0, pack_reading(&readings[1], &json));
+  ASSERT_EQ(0, pack_batch_cbor(&readings[1], 1, &cbor));
+  ASSERT_EQ(0, repack_batch_as_json((uint8_t *) cbor.ptr,
+				    cbor.len,
+				    1,
+				    &repacked));
+  ASSERT_STREQ(json.ptr, repacked.ptr);
+
+  /* only one reading can be packed that way */
+  ASSERT_EQ(0, pack_batch_cbor(readings, 2, &cbor));
+  ASSERT_EQ(1, repack_batch_as_json((uint8_t *) cbor.ptr,
+				    cbor.len,
+				    1,
+				    &repacked));
+
+  deinit_string(&json);
+  deinit_string(&cbor);
+  deinit_string(&repacked);
+}
@@ -0,0 +1,94 @@
+/*
+  The following are tests for the printer in the file cJSON.c
+*/
+
+#include "cJSON.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+static const char document[] =
+  "{\"a\":[1,2.5,-3.25,0.1,12345678901,{},[]],"
+  "\"b\":{\"c\":null,\"d\":true,\"e\":\"x\\n\\u0001\\\"y\"}}";
+
+TEST(cJSON, print_unformatted)
+{
+  cJSON *root = cJSON_Parse(document);
+  char *out = cJSON_PrintUnformatted(root);
+
+  ASSERT_STREQ(out, document);
+  free(out);
+  cJSON_Delete(root);
+}
+
+TEST(cJSON, print_formatted)
+{
+  cJSON *root = cJSON_Parse("{\"a\":[1,{}],\"b\":{\"c\":\"d\"}}");
+  char *out = cJSON_Print(root);
+
+  ASSERT_STREQ(out,
+	       "{\n"
+	       "\t\"a\":\t[1, {\n"
+	       "\t}],\n"
+	       "\t\"b\":\t{\n"
+	       "\t\t\"c\":\t\"d\"\n"
+	       "\t}\n"
+	       "}");
+  free(out);
+  cJSON_Delete(root);
+}
+
+TEST(cJSON, print_numbers)
+{
+  double numbers[] = { 0, -7, 21.5, -80.125, 0.000001, 1e-7, 4.0e20, 0.1234567 };
+  const char *expected[] = { "0", "-7", "21.5", "-80.125", "0.000001",
+			     "1.000000e-07", "400000000000000000000", "0.123457" };
+  cJSON *number;
+  char buffer[64];
+
+  for (int i = 0; i < 8; i++) {
+    number = cJSON_CreateNumber(numbers[i]);
+    ASSERT_EQ(cJSON_PrintPreallocated(number, buffer, sizeof(buffer), 0), 1);
+    ASSERT_STREQ(buffer, expected[i]);
+    cJSON_Delete(number);
+  }
+}
+
+TEST(cJSON, print_buffered_grows)
+{
+  cJSON *readings = cJSON_CreateArray();
+  cJSON *reading;
+  char *out;
+
+  for (int i = 0; i < 500; i++) {
+    reading = cJSON_CreateObject();
+    cJSON_AddNumberToObject(reading, "temperature", -80 + i * 0.25);
+    cJSON_AddStringToObject(reading, "status", "OK");
+    cJSON_AddItemToArray(readings, reading);
+  }
+
+  const char start[] =
+    "[{\"temperature\":-80,\"status\":\"OK\"},{\"temperature\":-79.75,";
+
+  out = cJSON_PrintBuffered(readings, 16, 0);
+  ASSERT_TRUE(out != NULL);
+  ASSERT_EQ(strncmp(out, start, sizeof(start) - 1), 0);
+  ASSERT_EQ(out[strlen(out) - 1], ']');
+  free(out);
+  cJSON_Delete(readings);
+}
+
+TEST(cJSON, print_preallocated)
+{
+  cJSON *root = cJSON_Parse(document);
+  char buffer[sizeof(document)];
+
+  /* exactly enough, then one byte short */
+  ASSERT_EQ(cJSON_PrintPreallocated(root, buffer, sizeof(buffer), 0), 1);
+  ASSERT_STREQ(buffer, document);
+  ASSERT_EQ(cJSON_PrintPreallocated(root, buffer, sizeof(buffer) - 1, 0), 0);
+  cJSON_Delete(root);
+}
@@ -0,0 +1,165 @@
+/*
+  The following are tests for the file cbor.c
+*/
+
+#include "cbor.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+/* the bytes written, as hex, to compare with the examples in RFC 8949 */
+static std::string hex(CBOR_WRITER *w)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string out;
+  size_t i;
+
+  for (i = 0; i < w->len; i++) {
+    out += digits[w->buffer[i] >> 4];
+    out += digits[w->buffer[i] & 0xF];
+  }
+  return out;
+}
+
+TEST(cbor, integers)
+{
+  uint8_t buffer[16];
+  CBOR_WRITER w;
+
+  cbor_begin(&w, buffer, sizeof(buffer));
+  cbor_integer(&w, 0);
+  cbor_integer(&w, 23);
+  cbor_integer(&w, 24);
+  cbor_integer(&w, -1);
+  cbor_integer(&w, -100);
+  ASSERT_EQ(0, cbor_end(&w));
+  ASSERT_EQ("00171818203863", hex(&w));
+
+  cbor_begin(&w, buffer, sizeof(buffer));
+  cbor_integer(&w, 1000);
+  cbor_integer(&w, 1000000);
+  ASSERT_EQ("1903e81a000f4240", hex(&w));
+
+  /* fixed width, whatever the value */
+  cbor_begin(&w, buffer, sizeof(buffer));
+  cbor_uint64(&w, 1);
+  ASSERT_EQ("1b0000000000000001", hex(&w));
+}
+
+TEST(cbor, items)
+{
+  uint8_t buffer[32];
+  CBOR_WRITER w;
+
+  cbor_begin(&w, buffer, sizeof(buffer));
+  cbor_array(&w, 2);
+  cbor_float(&w, 100000.0f);
+  cbor_text(&w, "IETF");
+  cbor_map(&w, 0);
+  cbor_tag(&w, CBOR_TAG_EPOCH);
+  cbor_integer(&w, 1363896240);
+  ASSERT_EQ(0, cbor_end(&w));
+  ASSERT_EQ("82fa47c35000" "6449455446" "a0" "c11a514b67b0", hex(&w));
+}
+
+TEST(cbor, buffer_too_small)
+{
+  uint8_t buffer[8];
+  CBOR_WRITER w;
+
+  cbor_begin(&w, buffer, sizeof(buffer));
+  cbor_uint64(&w, 1);
+  ASSERT_EQ(1, cbor_end(&w));
+  ASSERT_EQ(0u, w.len);
+
+  /* nothing more is written once an item did not fit */
+  cbor_integer(&w, 1);
+  ASSERT_EQ(0u, w.len);
+}
+
+TEST(cbor, read_back)
+{
+  uint8_t buffer[64];
+  CBOR_WRITER w;
+  CBOR_READER r;
+  const char *text;
+  size_t len;
+
+  cbor_begin(&w, buffer, sizeof(buffer));
+  cbor_array(&w, 4);
+  cbor_tag(&w, CBOR_TAG_EPOCH);
+  cbor_uint64(&w, 1500000000);
+  cbor_float(&w, -80.125f);
+  cbor_integer(&w, -70000);
+  cbor_text(&w, "OK");
+  ASSERT_EQ(0, cbor_end(&w));
+
+  cbor_read_begin(&r, buffer, w.len);
+  ASSERT_EQ(CBOR_ARRAY, cbor_peek_type(&r));
+  ASSERT_EQ(4u, cbor_read_array(&r));
+  ASSERT_EQ((uint64_t) CBOR_TAG_EPOCH, cbor_read_tag(&r));
+  ASSERT_EQ(1500000000, cbor_read_integer(&r));
+  ASSERT_EQ(-80.125f, cbor_read_float(&r));
+  ASSERT_EQ(-70000, cbor_read_integer(&r));
+  text = cbor_read_text(&r, &len);
+  ASSERT_EQ(std::string("OK"), std::string(text, len));
+  ASSERT_EQ(-1, cbor_peek_type(&r));
+  ASSERT_EQ(0, cbor_read_end(&r));
+}
+
+TEST(cbor, read_floats)
+{
+  /* half and double precision, as other encoders may send */
+  static const uint8_t half[] = { 0xf9, 0x3e, 0x00 };
+  static const uint8_t half_infinity[] = { 0xf9, 0x7c, 0x00 };
+  static const uint8_t double_value[] = {
+    0xfb, 0x3f, 0xf1, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9a
+  };
+  CBOR_READER r;
+
+  cbor_read_begin(&r, half, sizeof(half));
+  ASSERT_EQ(1.5f, cbor_read_float(&r));
+  ASSERT_EQ(0, cbor_read_end(&r));
+
+  cbor_read_begin(&r, half_infinity, sizeof(half_infinity));
+  ASSERT_TRUE(isinf(cbor_read_float(&r)));
+
+  cbor_read_begin(&r, double_value, sizeof(double_value));
+  ASSERT_EQ(1.1f, cbor_read_float(&r));
+  ASSERT_EQ(0, cbor_read_end(&r));
+}
+
+TEST(cbor, read_failures)
+{
+  static const uint8_t truncated[] = { 0x1a, 0x00, 0x0f };
+  static const uint8_t text[] = { 0x64, 0x49, 0x45, 0x54, 0x46 };
+  static const uint8_t short_text[] = { 0x64, 0x49, 0x45 };
+  static const uint8_t indefinite[] = { 0x9f, 0x01, 0xff };
+  CBOR_READER r;
+  size_t len;
+
+  cbor_read_begin(&r, truncated, sizeof(truncated));
+  ASSERT_EQ(0, cbor_read_integer(&r));
+  ASSERT_EQ(1, cbor_read_end(&r));
+
+  /* an item of another type than asked for */
+  cbor_read_begin(&r, text, sizeof(text));
+  ASSERT_EQ(0, cbor_read_integer(&r));
+  ASSERT_EQ(1, cbor_read_end(&r));
+
+  cbor_read_begin(&r, short_text, sizeof(short_text));
+  ASSERT_TRUE(cbor_read_text(&r, &len) == NULL);
+  ASSERT_EQ(0u, len);
+  ASSERT_EQ(1, cbor_read_end(&r));
+
+  cbor_read_begin(&r, indefinite, sizeof(indefinite));
+  cbor_read_array(&r);
+  ASSERT_EQ(1, cbor_read_end(&r));
+
+  /* data left over */
+  cbor_read_begin(&r, text, sizeof(text));
+  ASSERT_EQ(1, cbor_read_end(&r));
+}
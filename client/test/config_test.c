@@ -0,0 +1,107 @@
+/*
+  The following are tests for the file config.c
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+static const char globals[] =
+  "container_num: 2\n"
+  "container_path: /containers\n"
+  "\tuser :  admin@cbsrtempmon.ca  \r\n"
+  "# read_interval: 5\n"
+  "not a variable\n"
+  "read_interval: 30\n"
+  "read_interval: 60\n"
+  "journal_path:";
+
+TEST(config, lookup)
+{
+  CONFIG *config = (CONFIG *) malloc(sizeof(CONFIG));
+
+  ASSERT_EQ(config_parse(config, globals, strlen(globals)), 0);
+  ASSERT_EQ(config->count, 5);
+  ASSERT_STREQ(config_get(config, "container_num"), "2");
+  ASSERT_STREQ(config_get(config, "container_path"), "/containers");
+  ASSERT_STREQ(config_get(config, "user"), "admin@cbsrtempmon.ca");
+  ASSERT_STREQ(config_get(config, "journal_path"), "");
+
+  /* the first of several values is kept, and comments are skipped */
+  ASSERT_STREQ(config_get(config, "read_interval"), "30");
+  free(config);
+}
+
+TEST(config, whole_names_only)
+{
+  CONFIG *config = (CONFIG *) malloc(sizeof(CONFIG));
+
+  ASSERT_EQ(config_parse(config, globals, strlen(globals)), 0);
+  ASSERT_TRUE(config_get(config, "container") == NULL);
+  ASSERT_TRUE(config_get(config, "path") == NULL);
+  ASSERT_TRUE(config_get(config, "num") == NULL);
+  free(config);
+}
+
+TEST(config, too_many_variables)
+{
+  CONFIG *config = (CONFIG *) malloc(sizeof(CONFIG));
+  char text[CONFIG_SIZE];
+  int len = 0;
+
+  for (int i = 0; i < CONFIG_SLOTS; i++) {
+    len += sprintf(text + len, "v%d: %d\n", i, i);
+  }
+  ASSERT_EQ(config_parse(config, text, len), 1);
+  ASSERT_EQ(config_parse(config, text, CONFIG_SIZE + 1), 1);
+  free(config);
+}
+
+TEST(config, load_and_watch)
+{
+  char directory[] = "/tmp/config_testXXXXXX";
+  char path[64];
+  char replacement[64];
+  CONFIG *config = (CONFIG *) malloc(sizeof(CONFIG));
+  CONFIG_WATCH watch;
+  FILE *f;
+
+  ASSERT_TRUE(mkdtemp(directory) != NULL);
+  snprintf(path, sizeof(path), "%s/globals.ini", directory);
+  snprintf(replacement, sizeof(replacement), "%s/globals.new", directory);
+
+  f = fopen(path, "w");
+  fputs(globals, f);
+  fclose(f);
+
+  ASSERT_EQ(config_load(config, path), 0);
+  ASSERT_STREQ(config_get(config, "read_interval"), "30");
+
+  ASSERT_EQ(CONFIG_WATCH_open(&watch, path), 0);
+  ASSERT_EQ(config_changed(&watch), 0);
+
+  /* writing another file in the directory is not a change */
+  f = fopen(replacement, "w");
+  fputs("read_interval: 5\n", f);
+  fclose(f);
+  ASSERT_EQ(config_changed(&watch), 0);
+
+  /* replacing the file is */
+  ASSERT_EQ(rename(replacement, path), 0);
+  ASSERT_EQ(config_changed(&watch), 1);
+  ASSERT_EQ(config_changed(&watch), 0);
+
+  ASSERT_EQ(config_load(config, path), 0);
+  ASSERT_STREQ(config_get(config, "read_interval"), "5");
+
+  CONFIG_WATCH_close(&watch);
+  unlink(path);
+  rmdir(directory);
+  ASSERT_EQ(config_load(config, path), 1);
+  free(config);
+}
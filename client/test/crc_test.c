@@ -0,0 +1,84 @@
+/*
+  The following are tests for the file crc.c
+*/
+
+#include "crc.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+/* the bit at a time CRC-16/MODBUS the tables are checked against */
+static uint16_t bitwise_crc(const uint8_t *bytes, size_t len)
+{
+  uint16_t crc = CRC16_MODBUS_SEED;
+
+  for (size_t i = 0; i < len; i++) {
+    crc ^= bytes[i];
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+TEST(crc, crc16_modbus_check_value)
+{
+  const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+
+  ASSERT_EQ(crc16_modbus(check, sizeof(check)), 0x4B37);
+}
+
+TEST(crc, crc16_modbus_frame)
+{
+  /* read holding registers request, sent as 01 03 00 00 00 0A C5 CD */
+  const uint8_t frame[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+
+  ASSERT_EQ(crc16_modbus(frame, sizeof(frame)), 0xCDC5);
+}
+
+TEST(crc, crc16_modbus_sem710_process_request)
+{
+  /* command, length and data of the cREAD_PROCESS request */
+  const uint8_t request[] = { 0x02, 0x00, 0x00 };
+
+  ASSERT_EQ(crc16_modbus(request, sizeof(request)),
+	    bitwise_crc(request, sizeof(request)));
+}
+
+TEST(crc, crc16_modbus_high_bytes)
+{
+  /* bytes with the top bit set must not be sign extended */
+  const uint8_t bytes[] = { 0x80, 0xFF, 0xAA, 0x55, 0xC3 };
+
+  ASSERT_EQ(crc16_modbus(bytes, sizeof(bytes)),
+	    bitwise_crc(bytes, sizeof(bytes)));
+}
+
+TEST(crc, crc16_modbus_matches_bitwise)
+{
+  uint8_t bytes[300];
+
+  srand(710);
+  for (size_t i = 0; i < sizeof(bytes); i++) {
+    bytes[i] = rand() & 0xFF;
+  }
+
+  /* every length, so each tail after the four byte slices is covered */
+  for (size_t len = 0; len <= sizeof(bytes); len++) {
+    ASSERT_EQ(crc16_modbus(bytes, len), bitwise_crc(bytes, len));
+  }
+}
+
+TEST(crc, crc16_modbus_update_in_pieces)
+{
+  const uint8_t bytes[] = { 0x22, 0x13, 0x00, 0x10, 0x7F, 0x80, 0x81, 0x01 };
+  uint16_t crc;
+
+  crc = crc16_modbus_update(CRC16_MODBUS_SEED, bytes, 3);
+  crc = crc16_modbus_update(crc, bytes + 3, sizeof(bytes) - 3);
+
+  ASSERT_EQ(crc, crc16_modbus(bytes, sizeof(bytes)));
+}
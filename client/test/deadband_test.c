@@ -0,0 +1,84 @@
+/*
+  The following are tests for the file deadband.c
+*/
+
+#include "deadband.h"
+
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+static TIMED_READING reading_at(time_t timestamp,
+				float temperature,
+				READ_STATUS status)
+{
+  TIMED_READING reading;
+
+  memset(&reading, 0, sizeof(reading));
+  reading.timestamp = timestamp;
+  reading.temperature = temperature;
+  reading.status = status;
+  return reading;
+}
+
+TEST(deadband, disabled)
+{
+  DEADBAND deadband;
+  TIMED_READING reading = reading_at(1000, -80, READ_STATUS_OK);
+
+  deadband_init(&deadband, 0, 3600);
+  ASSERT_EQ(DEADBAND_SEND, deadband_check(&deadband, &reading));
+  deadband_sent(&deadband, &reading);
+  reading.timestamp++;
+  ASSERT_EQ(DEADBAND_SEND, deadband_check(&deadband, &reading));
+}
+
+TEST(deadband, within)
+{
+  DEADBAND deadband;
+  TIMED_READING reading = reading_at(1000, -80, READ_STATUS_OK);
+
+  deadband_init(&deadband, 0.5, 3600);
+  /* nothing was sent yet */
+  ASSERT_EQ(DEADBAND_SEND, deadband_check(&deadband, &reading));
+  deadband_sent(&deadband, &reading);
+
+  reading = reading_at(1030, -80.5, READ_STATUS_OK);
+  ASSERT_EQ(DEADBAND_QUIET, deadband_check(&deadband, &reading));
+  reading = reading_at(1060, -79.6, READ_STATUS_OK);
+  ASSERT_EQ(DEADBAND_QUIET, deadband_check(&deadband, &reading));
+
+  /* compared with the last sent, so a slow drift is sent eventually */
+  reading = reading_at(1090, -79.4, READ_STATUS_OK);
+  ASSERT_EQ(DEADBAND_SEND, deadband_check(&deadband, &reading));
+  deadband_sent(&deadband, &reading);
+  reading = reading_at(1120, -79.6, READ_STATUS_OK);
+  ASSERT_EQ(DEADBAND_QUIET, deadband_check(&deadband, &reading));
+}
+
+TEST(deadband, status_change)
+{
+  DEADBAND deadband;
+  TIMED_READING reading = reading_at(1000, -80, READ_STATUS_OK);
+
+  deadband_init(&deadband, 2, 3600);
+  deadband_sent(&deadband, &reading);
+  reading = reading_at(1030, -79, READ_STATUS_OUT_OF_RANGE);
+  ASSERT_EQ(DEADBAND_SEND, deadband_check(&deadband, &reading));
+}
+
+TEST(deadband, heartbeat)
+{
+  DEADBAND deadband;
+  TIMED_READING reading = reading_at(1000, -80, READ_STATUS_OK);
+
+  deadband_init(&deadband, 1, 300);
+  deadband_sent(&deadband, &reading);
+  reading.timestamp = 1299;
+  ASSERT_EQ(DEADBAND_QUIET, deadband_check(&deadband, &reading));
+  reading.timestamp = 1300;
+  ASSERT_EQ(DEADBAND_HEARTBEAT, deadband_check(&deadband, &reading));
+  deadband_sent(&deadband, &reading);
+  reading.timestamp = 1330;
+  ASSERT_EQ(DEADBAND_QUIET, deadband_check(&deadband, &reading));
+}
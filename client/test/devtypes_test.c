@@ -0,0 +1,300 @@
+/*
+  The following are tests for the file devtypes.c
+*/
+
+#include "devtypes.h"
+#include "array.h"
+#include "crc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <gtest/gtest.h>
+
+/* a process reading reply: start, command, length, 20 data bytes, crc, end */
+static int make_reply(uint8_t *reply)
+{
+  int i = 0;
+
+  reply[i++] = FRAME_START_BYTE;
+  reply[i++] = 34;
+  reply[i++] = 19;
+  for (int x = 0; x < 20; x++) {
+    reply[i++] = x;
+  }
+  reply[i++] = 0x12;
+  reply[i++] = 0x34;
+  reply[i++] = FRAME_END_BYTE;
+
+  return i;
+}
+
+TEST(devtypes, frame_receiver_whole_frame)
+{
+  uint8_t reply[64];
+  uint8_t frame[280];
+  FRAME_RECEIVER rx;
+  int len = make_reply(reply);
+
+  frame_receiver_init(&rx, frame, sizeof(frame));
+
+  ASSERT_EQ(frame_receiver_feed(&rx, reply, len), FRAME_COMPLETE);
+  ASSERT_EQ(rx.len, len);
+  ASSERT_EQ(memcmp(frame, reply, len), 0);
+}
+
+TEST(devtypes, frame_receiver_byte_at_a_time)
+{
+  uint8_t reply[64];
+  uint8_t frame[280];
+  FRAME_RECEIVER rx;
+  int len = make_reply(reply);
+
+  frame_receiver_init(&rx, frame, sizeof(frame));
+
+  for (int i = 0; i < len - 1; i++) {
+    ASSERT_NE(frame_receiver_feed(&rx, reply + i, 1), FRAME_COMPLETE);
+  }
+  ASSERT_EQ(frame_receiver_feed(&rx, reply + len - 1, 1), FRAME_COMPLETE);
+  ASSERT_EQ(rx.len, len);
+}
+
+TEST(devtypes, frame_receiver_skips_noise)
+{
+  uint8_t input[80];
+  uint8_t frame[280];
+  FRAME_RECEIVER rx;
+  int len;
+
+  /* the end of an earlier reply, then a frame that ends out of step */
+  input[0] = 0x01;
+  input[1] = FRAME_END_BYTE;
+  make_reply(input + 2);
+  input[2 + 25] = 0x00;
+  len = make_reply(input + 2 + 26);
+
+  frame_receiver_init(&rx, frame, sizeof(frame));
+
+  ASSERT_EQ(frame_receiver_feed(&rx, input, 2 + 26 + len), FRAME_COMPLETE);
+  ASSERT_EQ(rx.len, len);
+  ASSERT_EQ(memcmp(frame, input + 2 + 26, len), 0);
+}
+
+TEST(devtypes, frame_receiver_overflow)
+{
+  uint8_t reply[64];
+  uint8_t frame[16];
+  FRAME_RECEIVER rx;
+  int len = make_reply(reply);
+
+  frame_receiver_init(&rx, frame, sizeof(frame));
+
+  ASSERT_EQ(frame_receiver_feed(&rx, reply, len), RX_OVERFLOW);
+}
+
+TEST(devtypes, get_readings)
+{
+  uint8_t frame[26];
+  float values[5] = { 512.0f, 1.5f, 4.25f, 12.0f, 21.5f };
+  SEM710_READINGS readings;
+
+  memset(frame, 0, sizeof(frame));
+  floats_into_byte_array(frame, 3, values, 5);
+
+  frame[1] = 34;
+  ASSERT_EQ(get_readings(&readings, frame, sizeof(frame)), 0);
+  ASSERT_FLOAT_EQ(readings.ADC_VALUE, 512.0f);
+  ASSERT_FLOAT_EQ(readings.ELEC_VALUE, 1.5f);
+  ASSERT_FLOAT_EQ(readings.PROCESS_VARIABLE, 4.25f);
+  ASSERT_FLOAT_EQ(readings.MA_OUT, 12.0f);
+  ASSERT_FLOAT_EQ(readings.CJ_TEMP, 21.5f);
+}
+
+TEST(devtypes, get_readings_short_reply)
+{
+  uint8_t frame[26];
+  SEM710_READINGS readings;
+
+  memset(frame, 0, sizeof(frame));
+  frame[1] = 34;
+
+  /* the last float would run into the crc */
+  ASSERT_EQ(get_readings(&readings, frame, 24), 1);
+  ASSERT_EQ(get_readings(&readings, frame, 5), 1);
+
+  /* the reply to some other command */
+  frame[1] = 35;
+  ASSERT_EQ(get_readings(&readings, frame, sizeof(frame)), 1);
+}
+
+TEST(devtypes, get_config)
+{
+  uint8_t frame[46];
+  float values[8] = { -200.0f, 850.0f, 0.5f, -0.5f, 4.0f, 1.0f, 8.0f, 2.0f };
+  CONFIG_DATA cal;
+
+  memset(frame, 0, sizeof(frame));
+  frame[1] = 33;
+  for (int i = 3; i < 11; i++) {
+    frame[i] = i;
+  }
+  floats_into_byte_array(frame, 11, values, 8);
+
+  get_config(&cal, frame, sizeof(frame));
+  ASSERT_EQ(cal.tc_code, 3);
+  ASSERT_EQ(cal.spare, 10);
+  ASSERT_FLOAT_EQ(cal.low_range, -200.0f);
+  ASSERT_FLOAT_EQ(cal.high_range, 850.0f);
+  ASSERT_FLOAT_EQ(cal.setpoint_A, 4.0f);
+  ASSERT_FLOAT_EQ(cal.hyst_B, 2.0f);
+}
+
+TEST(devtypes, config_block)
+{
+  CONFIG_BLOCK block;
+
+  CONFIG_BLOCK_init(&block);
+  ASSERT_TRUE(block.fp != NULL);
+
+  /* every array is writable to its full size without touching the next */
+  memset(block.tag_number, 'x', 20);
+  memset(block.title, 't', 16);
+  block.fp[47] = 1.0f;
+  block.config_output_floats[7] = 2.0f;
+  block.config_output_int[3] = 3;
+  ASSERT_FLOAT_EQ(block.fp[47], 1.0f);
+  ASSERT_EQ(block.config_input_byte + 4, block.config_output_int);
+  ASSERT_EQ(block.units + 4, block.tag_number);
+  ASSERT_EQ(block.title[15], 't');
+
+  CONFIG_BLOCK_destroy(&block);
+  ASSERT_TRUE(block.fp == NULL);
+}
+
+TEST(devtypes, encode_command)
+{
+  uint8_t frame[16];
+  uint16_t crc;
+
+  /* a read is the command with a single zero data byte */
+  ASSERT_EQ(encode_command(SEM_COMMANDS_cREAD_PROCESS, NULL, 0,
+			   frame, sizeof(frame)), 7);
+  ASSERT_EQ(frame[0], FRAME_START_BYTE);
+  ASSERT_EQ(frame[1], SEM_COMMANDS_cREAD_PROCESS);
+  ASSERT_EQ(frame[2], 0);
+  ASSERT_EQ(frame[3], 0);
+  crc = crc16_modbus(frame + 1, 3);
+  ASSERT_EQ(frame[4], crc & 0xFF);
+  ASSERT_EQ(frame[5], crc >> 8);
+  ASSERT_EQ(frame[6], FRAME_END_BYTE);
+
+  ASSERT_EQ(encode_command(SEM_COMMANDS_cREAD_PROCESS, NULL, 0, frame, 6), -1);
+}
+
+TEST(devtypes, encode_command_data)
+{
+  uint8_t data[4] = { 1, 2, 3, 4 };
+  uint8_t frame[16];
+  FRAME_RECEIVER rx;
+  uint8_t received[16];
+
+  ASSERT_EQ(encode_command(SEM_COMMANDS_cWRITE_RANGEA, data, 4,
+			   frame, sizeof(frame)), 10);
+  ASSERT_EQ(frame[2], 3);
+  ASSERT_EQ(memcmp(frame + 3, data, 4), 0);
+
+  /* what is encoded is a frame the receiver accepts */
+  frame_receiver_init(&rx, received, sizeof(received));
+  ASSERT_EQ(frame_receiver_feed(&rx, frame, 10), FRAME_COMPLETE);
+  ASSERT_EQ(rx.len, 10);
+}
+
+TEST(devtypes, decode_reply_checks_frame)
+{
+  uint8_t frame[26];
+  SEM710_READINGS readings;
+
+  memset(frame, 0, sizeof(frame));
+  frame[1] = 33;
+  ASSERT_EQ(decode_reply(SEM_COMMANDS_cREAD_PROCESS, frame, sizeof(frame),
+			 &readings), 1);
+
+  frame[1] = 34;
+  ASSERT_EQ(decode_reply(SEM_COMMANDS_cREAD_PROCESS, frame, 20, &readings), 1);
+  ASSERT_EQ(decode_reply(SEM_COMMANDS_cREAD_PROCESS, frame, sizeof(frame),
+			 &readings), 0);
+}
+
+TEST(devtypes, decode_reply_floats)
+{
+  uint8_t frame[26];
+  SEM710_READINGS readings;
+  int i;
+
+  memset(frame, 0, sizeof(frame));
+  frame[1] = 34;
+  for (i = 0; i < 5; i++) {
+    float_into_byte_array(frame, 3 + 4 * i, -80.5f + i);
+  }
+  ASSERT_EQ(decode_reply(SEM_COMMANDS_cREAD_PROCESS, frame, sizeof(frame),
+			 &readings), 0);
+  ASSERT_FLOAT_EQ(readings.ADC_VALUE, -80.5f);
+  ASSERT_FLOAT_EQ(readings.ELEC_VALUE, -79.5f);
+  ASSERT_FLOAT_EQ(readings.PROCESS_VARIABLE, -78.5f);
+  ASSERT_FLOAT_EQ(readings.MA_OUT, -77.5f);
+  ASSERT_FLOAT_EQ(readings.CJ_TEMP, -76.5f);
+
+  /* the last float must fit before the crc */
+  ASSERT_EQ(decode_reply(SEM_COMMANDS_cREAD_PROCESS, frame, sizeof(frame) - 1,
+			 &readings), 1);
+}
+
+TEST(devtypes, get_calibration)
+{
+  uint8_t frame[60];
+  float values[13];
+  UNIVERSAL_CALIBRATION cal;
+
+  memset(frame, 0, sizeof(frame));
+  for (int i = 0; i < 13; i++) {
+    values[i] = i + 0.5f;
+  }
+  frame[3] = 1;
+  frame[4] = 2;
+  floats_into_byte_array(frame, 5, values, 13);
+
+  get_calibration(&cal, frame, sizeof(frame));
+  ASSERT_EQ(cal.straight_from_programming, 1);
+  ASSERT_EQ(cal.dummy, 2);
+  ASSERT_FLOAT_EQ(cal.lo_mv, 0.5f);
+  ASSERT_FLOAT_EQ(cal.hi_rtd, 5.5f);
+  ASSERT_FLOAT_EQ(cal.hi_voltage_output, 12.5f);
+}
+
+TEST(devtypes, pack_readings)
+{
+  SEM710_READINGS readings;
+  string buffer;
+
+  memset(&readings, 0, sizeof(readings));
+  readings.PROCESS_VARIABLE = -80.1f;
+  init_string(&buffer);
+
+  ASSERT_EQ(pack_readings(&readings, &buffer), 0);
+  ASSERT_STREQ(buffer.ptr, "{\"temperature\":-80.1}");
+
+  deinit_string(&buffer);
+}
+
+TEST(devtypes, pack_error)
+{
+  string buffer;
+
+  init_string(&buffer);
+
+  ASSERT_EQ(pack_error((char *) "Device \"A\" failed\n", &buffer), 0);
+  ASSERT_STREQ(buffer.ptr, "{\"error\":\"Device \\\"A\\\" failed\\n\"}");
+
+  deinit_string(&buffer);
+}
@@ -0,0 +1,214 @@
+/*
+  The following are tests for the file event-loop.c
+*/
+
+#include "event-loop.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+typedef struct {
+  EVENT_LOOP *loop;
+  EVENT_WATCH *other; /* unwatched by the callback, if given */
+  int calls;
+  int fd;
+  uint32_t events;
+} CALLS;
+
+static void count_call(void *data, int fd, uint32_t events)
+{
+  CALLS *calls = (CALLS *) data;
+
+  calls->calls++;
+  calls->fd = fd;
+  calls->events = events;
+  if (calls->other != NULL) {
+    event_unwatch(calls->loop, calls->other);
+  }
+}
+
+static void free_other(void *data, int fd, uint32_t events)
+{
+  CALLS *calls = (CALLS *) data;
+
+  (void) fd;
+  (void) events;
+  calls->calls++;
+  if (calls->other != NULL) {
+    event_watch_free(calls->loop, calls->other);
+    calls->other = NULL;
+  }
+}
+
+static long ms_between(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec)*1000 +
+    (end->tv_nsec - start->tv_nsec)/1000000;
+}
+
+TEST(event_loop, watch_pipe)
+{
+  EVENT_LOOP loop;
+  EVENT_WATCH watch;
+  CALLS calls = { NULL, NULL, 0, -1, 0 };
+  int fds[2];
+
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(0, EVENT_LOOP_init(&loop));
+  ASSERT_EQ(0, event_watch(&loop, &watch, fds[0], EPOLLIN, count_call, &calls));
+
+  /* nothing to read yet */
+  ASSERT_EQ(0, event_loop_run_once(&loop, 0));
+  ASSERT_EQ(0, calls.calls);
+
+  ASSERT_EQ(1, write(fds[1], "x", 1));
+  ASSERT_EQ(1, event_loop_run_once(&loop, 100));
+  ASSERT_EQ(1, calls.calls);
+  ASSERT_EQ(fds[0], calls.fd);
+  ASSERT_TRUE(calls.events & EPOLLIN);
+
+  /* the byte is still there until read */
+  ASSERT_EQ(1, event_loop_run_once(&loop, 0));
+  ASSERT_EQ(2, calls.calls);
+
+  event_unwatch(&loop, &watch);
+  ASSERT_EQ(0, event_loop_run_once(&loop, 0));
+  ASSERT_EQ(2, calls.calls);
+
+  /* unwatching twice is harmless */
+  event_unwatch(&loop, &watch);
+
+  EVENT_LOOP_destroy(&loop);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(event_loop, unwatch_during_dispatch)
+{
+  /* a watch dropped by an earlier callback is not called for its event */
+  EVENT_LOOP loop;
+  EVENT_WATCH first;
+  EVENT_WATCH second;
+  CALLS first_calls = { &loop, &second, 0, -1, 0 };
+  CALLS second_calls = { &loop, &first, 0, -1, 0 };
+  int a[2];
+  int b[2];
+
+  ASSERT_EQ(0, pipe(a));
+  ASSERT_EQ(0, pipe(b));
+  ASSERT_EQ(0, EVENT_LOOP_init(&loop));
+  ASSERT_EQ(0, event_watch(&loop, &first, a[0], EPOLLIN,
+			   count_call, &first_calls));
+  ASSERT_EQ(0, event_watch(&loop, &second, b[0], EPOLLIN,
+			   count_call, &second_calls));
+  ASSERT_EQ(1, write(a[1], "x", 1));
+  ASSERT_EQ(1, write(b[1], "x", 1));
+
+  ASSERT_EQ(2, event_loop_run_once(&loop, 100));
+  ASSERT_EQ(1, first_calls.calls + second_calls.calls);
+
+  EVENT_LOOP_destroy(&loop);
+  close(a[0]);
+  close(a[1]);
+  close(b[0]);
+  close(b[1]);
+}
+
+TEST(event_loop, free_during_dispatch)
+{
+  /* a watch freed by a callback stays valid until the events are handled */
+  EVENT_LOOP loop;
+  EVENT_WATCH *first;
+  EVENT_WATCH *second;
+  CALLS first_calls = { &loop, NULL, 0, -1, 0 };
+  CALLS second_calls = { &loop, NULL, 0, -1, 0 };
+  int a[2];
+  int b[2];
+
+  ASSERT_EQ(0, pipe(a));
+  ASSERT_EQ(0, pipe(b));
+  ASSERT_EQ(0, EVENT_LOOP_init(&loop));
+  first = event_watch_new(&loop, a[0], EPOLLIN, free_other, &first_calls);
+  second = event_watch_new(&loop, b[0], EPOLLIN, free_other, &second_calls);
+  ASSERT_TRUE(first != NULL);
+  ASSERT_TRUE(second != NULL);
+  first_calls.other = second;
+  second_calls.other = first;
+  ASSERT_EQ(1, write(a[1], "x", 1));
+  ASSERT_EQ(1, write(b[1], "x", 1));
+
+  ASSERT_EQ(2, event_loop_run_once(&loop, 100));
+  ASSERT_EQ(1, first_calls.calls + second_calls.calls);
+
+  /* the one left is freed outside of dispatching */
+  event_watch_free(&loop, (first_calls.calls == 1) ? first : second);
+
+  EVENT_LOOP_destroy(&loop);
+  close(a[0]);
+  close(a[1]);
+  close(b[0]);
+  close(b[1]);
+}
+
+TEST(event_loop, timers)
+{
+  EVENT_LOOP loop;
+  EVENT_TIMER early;
+  EVENT_TIMER late;
+  CALLS early_calls = { NULL, NULL, 0, -1, 0 };
+  CALLS late_calls = { NULL, NULL, 0, -1, 0 };
+  struct timespec start;
+  struct timespec now;
+  struct timespec deadline;
+
+  ASSERT_EQ(0, EVENT_LOOP_init(&loop));
+  ASSERT_EQ(0, EVENT_TIMER_init(&early, &loop, count_call, &early_calls));
+  ASSERT_EQ(0, EVENT_TIMER_init(&late, &loop, count_call, &late_calls));
+
+  /* timers start disarmed */
+  ASSERT_EQ(0, event_loop_run_once(&loop, 20));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  deadline = start;
+  deadline.tv_nsec += 60000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  ASSERT_EQ(0, timer_at(&late, &deadline));
+  ASSERT_EQ(0, timer_after(&early, 20));
+
+  ASSERT_EQ(1, event_loop_run_once(&loop, 1000));
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ASSERT_EQ(1, early_calls.calls);
+  ASSERT_EQ(0, late_calls.calls);
+  ASSERT_GE(ms_between(&start, &now), 19);
+
+  ASSERT_EQ(1, event_loop_run_once(&loop, 1000));
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ASSERT_EQ(1, late_calls.calls);
+  ASSERT_GE(ms_between(&start, &now), 59);
+
+  /* each expiry is called back once */
+  ASSERT_EQ(0, event_loop_run_once(&loop, 20));
+
+  /* a time already passed expires right away */
+  ASSERT_EQ(0, timer_at(&late, &start));
+  ASSERT_EQ(1, event_loop_run_once(&loop, 1000));
+  ASSERT_EQ(2, late_calls.calls);
+
+  /* a cancelled timer does not expire, even if it was due */
+  ASSERT_EQ(0, timer_after(&early, 0));
+  usleep(5000);
+  timer_cancel(&early);
+  ASSERT_EQ(0, event_loop_run_once(&loop, 20));
+  ASSERT_EQ(1, early_calls.calls);
+
+  EVENT_TIMER_destroy(&early);
+  EVENT_TIMER_destroy(&late);
+  EVENT_LOOP_destroy(&loop);
+}
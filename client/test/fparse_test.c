@@ -8,69 +8,57 @@
 
 #include <gtest/gtest.h>
 
-#define fpath "/home/cpeck1/workspace/tempmon3/tempmon/client/test/testfile.json"
+#define fpath "/tmp/tempmon_fparse_test.json"
+
+static void write_test_file(void)
+{
+  FILE *f = fopen(fpath, "w");
+
+  fputs("{\"test1\": \"1\", \"test2\": \"2\", \"test3\": \"3\"}", f);
+  fclose(f);
+}
 
 TEST(fparse, fparse_test_0) 
 {
-  cJSON *root;
+  char value[64];
+  char *buffer = value;
 
   char *fake_dir = "/path/to/fake/file.txt";
 
-  root = get_cjson_object_from_file(fake_dir, "fake object name");
-  EXPECT_EQ(NULL, root);
+  EXPECT_EQ(1, get_cjson_object_from_file(fake_dir,
+					  "fake object name",
+					  &buffer));
 }
 
 TEST(fparse, fparse_test_1) 
 {
-  cJSON *root;
-  cJSON *ob;
-
-  char *test1 = NULL;
-
-  root = get_cjson_object_from_file(fpath, "test");
-  if (root != NULL) {
-    ob = cJSON_GetObjectItem(root, "test1");
-    if (ob != NULL) {
-      test1 = ob->valuestring;
-    }
-  }
+  char value[64];
+  char *test1 = value;
 
+  write_test_file();
+  ASSERT_EQ(0, get_cjson_object_from_file(fpath, "test1", &test1));
   ASSERT_STREQ("1", test1);
-  cJSON_Delete(root);
+  unlink(fpath);
 }
 
 TEST(fparse, fparse_test_2) 
 {
-  cJSON *root;
-  cJSON *ob;
+  char value[64];
+  char *test2 = value;
 
-  char *test2 = NULL;
-
-  root = get_cjson_object_from_file(fpath, "test");
-  if (root != NULL) {
-    ob = cJSON_GetObjectItem(root, "test2");
-    if (ob != NULL) {
-      test2 = ob->valuestring;
-    }
-  }
+  write_test_file();
+  ASSERT_EQ(0, get_cjson_object_from_file(fpath, "test2", &test2));
   ASSERT_STREQ("2", test2);
-  cJSON_Delete(root);
+  unlink(fpath);
 }
 
 TEST(fparse, fparse_test_3) 
 {
-  cJSON *root;
-  cJSON *ob;
-
-  char *test3 = NULL;
+  char value[64];
+  char *test3 = value;
 
-  root = get_cjson_object_from_file(fpath, "test");
-  if (root != NULL) {
-    ob = cJSON_GetObjectItem(root, "test3");
-    if (ob != NULL) {
-      test3 = ob->valuestring;
-    }
-  }
+  write_test_file();
+  ASSERT_EQ(0, get_cjson_object_from_file(fpath, "test3", &test3));
   ASSERT_STREQ("3", test3);
-  cJSON_Delete(root);
+  unlink(fpath);
 }
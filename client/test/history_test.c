@@ -0,0 +1,192 @@
+/*
+  The following are tests for the file history.c
+*/
+
+#include "history.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#define hpath "/tmp/tempmon_history_test.history"
+
+static void add_readings(HISTORY *history, int first, int count, int step)
+{
+  TIMED_READING reading;
+  int i;
+
+  memset(&reading, 0, sizeof(reading));
+  for (i = first; i < first + count; i++) {
+    reading.timestamp = 1000 + (time_t) i * step;
+    reading.temperature = (float) -i;
+    reading.status = (i % 7 == 0) ? READ_STATUS_OUT_OF_RANGE : READ_STATUS_OK;
+    ASSERT_EQ(0, history_append(history, &reading));
+  }
+}
+
+TEST(history, append_read)
+{
+  HISTORY history;
+  TIMED_READING reading;
+  uint64_t begin;
+  uint64_t end;
+
+  unlink(hpath);
+  ASSERT_EQ(0, HISTORY_open(&history, hpath, 100, 0));
+  /* rounded up to whole blocks, plus the one dropped to make room */
+  ASSERT_EQ(2u * HISTORY_BLOCK_SIZE, history.capacity);
+
+  history_range(&history, 0, 5000, &begin, &end);
+  ASSERT_EQ(begin, end);
+  ASSERT_NE(0, history_read(&history, 0, &reading));
+
+  add_readings(&history, 0, 50, 1);
+  ASSERT_EQ(0, history_read(&history, 14, &reading));
+  ASSERT_EQ(1014, reading.timestamp);
+  ASSERT_FLOAT_EQ(-14.0, reading.temperature);
+  ASSERT_EQ(READ_STATUS_OUT_OF_RANGE, reading.status);
+  ASSERT_NE(0, history_read(&history, 50, &reading));
+
+  /* readings earlier than the last are not kept */
+  reading.timestamp = 1000;
+  ASSERT_NE(0, history_append(&history, &reading));
+  ASSERT_EQ(50u, history.header->next);
+
+  /* it persists */
+  HISTORY_close(&history);
+  ASSERT_EQ(0, HISTORY_open(&history, hpath, 5000, 0));
+  ASSERT_EQ(2u * HISTORY_BLOCK_SIZE, history.capacity);
+  ASSERT_EQ(0, history_read(&history, 49, &reading));
+  ASSERT_EQ(1049, reading.timestamp);
+  HISTORY_close(&history);
+  unlink(hpath);
+}
+
+TEST(history, range)
+{
+  HISTORY history;
+  uint64_t begin;
+  uint64_t end;
+
+  unlink(hpath);
+  ASSERT_EQ(0, HISTORY_open(&history, hpath, 4 * HISTORY_BLOCK_SIZE, 0));
+  /* a reading every 10 seconds over several blocks */
+  add_readings(&history, 0, 3 * HISTORY_BLOCK_SIZE + 100, 10);
+
+  history_range(&history, 1000, 1100, &begin, &end);
+  ASSERT_EQ(0u, begin);
+  ASSERT_EQ(10u, end);
+
+  /* between readings, and across a block boundary */
+  history_range(&history, 1000 + 10 * 1020 + 5, 1000 + 10 * 1030 + 5,
+		&begin, &end);
+  ASSERT_EQ(1021u, begin);
+  ASSERT_EQ(1031u, end);
+
+  /* exactly at the start of a block */
+  history_range(&history, 1000 + 10 * 2048, 1000 + 10 * 2049, &begin, &end);
+  ASSERT_EQ(2048u, begin);
+  ASSERT_EQ(2049u, end);
+
+  /* before and after all of it */
+  history_range(&history, 0, 500, &begin, &end);
+  ASSERT_EQ(0u, begin);
+  ASSERT_EQ(0u, end);
+  history_range(&history, 0, 1000000, &begin, &end);
+  ASSERT_EQ(0u, begin);
+  ASSERT_EQ(3u * HISTORY_BLOCK_SIZE + 100, end);
+  history_range(&history, 1000000, 2000000, &begin, &end);
+  ASSERT_EQ(3u * HISTORY_BLOCK_SIZE + 100, begin);
+  ASSERT_EQ(begin, end);
+
+  HISTORY_close(&history);
+  unlink(hpath);
+}
+
+TEST(history, full)
+{
+  HISTORY history;
+  TIMED_READING reading;
+  uint64_t begin;
+  uint64_t end;
+
+  unlink(hpath);
+  ASSERT_EQ(0, HISTORY_open(&history, hpath, HISTORY_BLOCK_SIZE, 0));
+  add_readings(&history, 0, 5 * HISTORY_BLOCK_SIZE + 10, 1);
+
+  /* the oldest blocks make room for the newest readings */
+  ASSERT_EQ(4u * HISTORY_BLOCK_SIZE, history.header->first);
+  ASSERT_NE(0, history_read(&history, 4 * HISTORY_BLOCK_SIZE - 1, &reading));
+  ASSERT_EQ(0, history_read(&history, 4 * HISTORY_BLOCK_SIZE, &reading));
+  ASSERT_EQ(1000 + 4 * HISTORY_BLOCK_SIZE, reading.timestamp);
+
+  history_range(&history, 0, 1000 + 4 * HISTORY_BLOCK_SIZE + 5, &begin, &end);
+  ASSERT_EQ(4u * HISTORY_BLOCK_SIZE, begin);
+  ASSERT_EQ(4u * HISTORY_BLOCK_SIZE + 5, end);
+
+  HISTORY_close(&history);
+  unlink(hpath);
+}
+
+TEST(history, retention)
+{
+  HISTORY history;
+  uint64_t begin;
+  uint64_t end;
+
+  unlink(hpath);
+  /* room for a lot more, but only an hour is kept */
+  ASSERT_EQ(0, HISTORY_open(&history, hpath, 10 * HISTORY_BLOCK_SIZE, 3600));
+  add_readings(&history, 0, 4 * HISTORY_BLOCK_SIZE, 2);
+
+  /* whole blocks go once all of their readings are older */
+  ASSERT_EQ(2u * HISTORY_BLOCK_SIZE, history.header->first);
+  history_range(&history, 0, 1000000, &begin, &end);
+  ASSERT_EQ(2u * HISTORY_BLOCK_SIZE, begin);
+  ASSERT_EQ(4u * HISTORY_BLOCK_SIZE, end);
+
+  HISTORY_close(&history);
+  unlink(hpath);
+}
+
+TEST(history, view)
+{
+  HISTORY history;
+  HISTORY view;
+  TIMED_READING reading;
+  uint64_t begin;
+  uint64_t end;
+  FILE *file;
+
+  unlink(hpath);
+  ASSERT_NE(0, HISTORY_view(&view, hpath));
+
+  ASSERT_EQ(0, HISTORY_open(&history, hpath, 10, 0));
+  add_readings(&history, 0, 20, 60);
+  ASSERT_EQ(0, HISTORY_view(&view, hpath));
+
+  /* the view sees what is appended after it is opened */
+  add_readings(&history, 20, 5, 60);
+  history_range(&view, 1000 + 60 * 18, 1000 + 60 * 30, &begin, &end);
+  ASSERT_EQ(18u, begin);
+  ASSERT_EQ(25u, end);
+  ASSERT_EQ(0, history_read(&view, 24, &reading));
+  ASSERT_FLOAT_EQ(-24.0, reading.temperature);
+
+  HISTORY_close(&view);
+  ASSERT_EQ(0, history_sync(&history));
+  HISTORY_close(&history);
+
+  /* what is not a history is started over */
+  file = fopen(hpath, "w");
+  fputs("not a history", file);
+  fclose(file);
+  ASSERT_NE(0, HISTORY_view(&view, hpath));
+  ASSERT_EQ(0, HISTORY_open(&history, hpath, 10, 0));
+  ASSERT_EQ(0u, history.header->next);
+  HISTORY_close(&history);
+  unlink(hpath);
+}
@@ -0,0 +1,76 @@
+/*
+  The following are tests for the file http-operations.c
+*/
+
+#include "http-operations.h"
+#include "misc-structs.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <gtest/gtest.h>
+
+/* a batch upload body, which repeats itself much as real ones do */
+static void make_body(string *body, int readings)
+{
+  char reading[127];
+  int i;
+
+  append_string(body, "[", 1);
+  for (i = 0; i < readings; i++) {
+    sprintf(reading,
+	    "%s{\"temperature\":%.1f,\"timestamp\":%d,\"status\":\"OK\"}",
+	    (i > 0) ? "," : "", -80 + (i % 7) / 10.0, 1500000000 + 30*i);
+    append_string(body, reading, strlen(reading));
+  }
+  append_string(body, "]", 1);
+}
+
+static void gunzip(const char *data, size_t len, string *out)
+{
+  z_stream stream;
+  char chunk[4096];
+  int err;
+
+  memset(&stream, 0, sizeof(stream));
+  ASSERT_EQ(Z_OK, inflateInit2(&stream, 15 + 16));
+  stream.next_in = (Bytef *) data;
+  stream.avail_in = (uInt) len;
+  do {
+    stream.next_out = (Bytef *) chunk;
+    stream.avail_out = sizeof(chunk);
+    err = inflate(&stream, Z_NO_FLUSH);
+    ASSERT_TRUE(err == Z_OK || err == Z_STREAM_END);
+    append_string(out, chunk, sizeof(chunk) - stream.avail_out);
+  } while (err != Z_STREAM_END);
+  inflateEnd(&stream);
+}
+
+TEST(http_operations, compress)
+{
+  string body;
+  string compressed;
+  string inflated;
+
+  init_string(&body);
+  init_string(&compressed);
+  init_string(&inflated);
+  make_body(&body, 256);
+
+  ASSERT_EQ(0, http_compress(6, body.ptr, body.len, &compressed));
+  ASSERT_LT(compressed.len * 4, body.len);
+  gunzip(compressed.ptr, compressed.len, &inflated);
+  ASSERT_EQ(body.len, inflated.len);
+  ASSERT_EQ(0, memcmp(body.ptr, inflated.ptr, body.len));
+
+  /* the buffer is reused, and even an empty body is a whole gzip stream */
+  reset_string(&inflated);
+  ASSERT_EQ(0, http_compress(1, "", 0, &compressed));
+  gunzip(compressed.ptr, compressed.len, &inflated);
+  ASSERT_EQ(0u, inflated.len);
+
+  deinit_string(&body);
+  deinit_string(&compressed);
+  deinit_string(&inflated);
+}
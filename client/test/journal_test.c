@@ -0,0 +1,205 @@
+/*
+  The following are tests for the file journal.c
+*/
+
+#include "journal.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#define jpath "/tmp/tempmon_journal_test.journal"
+
+static void add_readings(JOURNAL *journal, int first, int count)
+{
+  TIMED_READING reading;
+  int i;
+
+  memset(&reading, 0, sizeof(reading));
+  for (i = first; i < first + count; i++) {
+    reading.timestamp = 1000 + i;
+    reading.temperature = (float) -i;
+    reading.status = READ_STATUS_OK;
+    journal_append(journal, &reading);
+  }
+}
+
+TEST(journal, journal_append_peek_ack) 
+{
+  JOURNAL journal;
+  TIMED_READING readings[8];
+  uint64_t next;
+  int count;
+
+  unlink(jpath);
+  ASSERT_EQ(0, JOURNAL_open(&journal, jpath, 16, 0));
+
+  add_readings(&journal, 0, 5);
+  ASSERT_EQ(5u, journal_pending(&journal));
+
+  count = journal_peek(&journal, readings, 3, &next);
+  ASSERT_EQ(3, count);
+  ASSERT_EQ(3u, next);
+  ASSERT_EQ(1000, readings[0].timestamp);
+  ASSERT_FLOAT_EQ(-2.0, readings[2].temperature);
+
+  /* peeking does not remove anything until acknowledged */
+  ASSERT_EQ(5u, journal_pending(&journal));
+  journal_ack(&journal, next);
+  ASSERT_EQ(2u, journal_pending(&journal));
+
+  count = journal_peek(&journal, readings, 8, &next);
+  ASSERT_EQ(2, count);
+  ASSERT_EQ(1003, readings[0].timestamp);
+
+  JOURNAL_close(&journal);
+}
+
+TEST(journal, journal_wrap_around) 
+{
+  JOURNAL journal;
+  TIMED_READING readings[8];
+  uint64_t next;
+  int count;
+
+  unlink(jpath);
+  ASSERT_EQ(0, JOURNAL_open(&journal, jpath, 4, 0));
+
+  /* only the newest 4 of 6 readings fit */
+  add_readings(&journal, 0, 6);
+  ASSERT_EQ(4u, journal_pending(&journal));
+  ASSERT_EQ(2u, journal.header->overwritten);
+
+  count = journal_peek(&journal, readings, 8, &next);
+  ASSERT_EQ(4, count);
+  ASSERT_EQ(1002, readings[0].timestamp);
+  ASSERT_EQ(1005, readings[3].timestamp);
+
+  JOURNAL_close(&journal);
+}
+
+TEST(journal, journal_ack_after_wrap_around)
+{
+  JOURNAL journal;
+  TIMED_READING readings[8];
+  uint64_t next;
+  int count;
+
+  unlink(jpath);
+  ASSERT_EQ(0, JOURNAL_open(&journal, jpath, 4, 0));
+  add_readings(&journal, 0, 3);
+  ASSERT_EQ(3, journal_peek(&journal, readings, 8, &next));
+
+  /* while those are uploaded, the ring wraps and loses the oldest */
+  add_readings(&journal, 3, 3);
+  ASSERT_EQ(2u, journal.header->tail);
+
+  /* only what was uploaded is let go, not the readings taken since */
+  journal_ack(&journal, next);
+  ASSERT_EQ(3u, journal_pending(&journal));
+  count = journal_peek(&journal, readings, 8, &next);
+  ASSERT_EQ(3, count);
+  ASSERT_EQ(1003, readings[0].timestamp);
+
+  /* acknowledging what was overwritten meanwhile changes nothing */
+  journal_ack(&journal, 2);
+  ASSERT_EQ(3u, journal_pending(&journal));
+
+  JOURNAL_close(&journal);
+}
+
+TEST(journal, journal_reopen_recovers) 
+{
+  JOURNAL journal;
+  TIMED_READING readings[8];
+  uint64_t next;
+  int count;
+
+  unlink(jpath);
+  ASSERT_EQ(0, JOURNAL_open(&journal, jpath, 16, 0));
+  add_readings(&journal, 0, 3);
+  journal_peek(&journal, readings, 1, &next);
+  journal_ack(&journal, next);
+
+  /* as if the header update for the last record never reached the disk */
+  journal.header->head--;
+  JOURNAL_close(&journal);
+
+  /* the capacity of an existing journal is kept */
+  ASSERT_EQ(0, JOURNAL_open(&journal, jpath, 64, 0));
+  ASSERT_EQ(16u, journal.header->capacity);
+  ASSERT_EQ(2u, journal_pending(&journal));
+
+  count = journal_peek(&journal, readings, 8, &next);
+  ASSERT_EQ(2, count);
+  ASSERT_EQ(1001, readings[0].timestamp);
+  ASSERT_EQ(1002, readings[1].timestamp);
+
+  JOURNAL_close(&journal);
+}
+
+TEST(journal, journal_skips_damaged_records) 
+{
+  JOURNAL journal;
+  TIMED_READING readings[8];
+  uint64_t next;
+  int count;
+
+  unlink(jpath);
+  ASSERT_EQ(0, JOURNAL_open(&journal, jpath, 16, 0));
+  add_readings(&journal, 0, 3);
+
+  /* a torn write leaves the checksum wrong */
+  journal.records[1].temperature = 42;
+
+  count = journal_peek(&journal, readings, 8, &next);
+  ASSERT_EQ(2, count);
+  ASSERT_EQ(3u, next);
+  ASSERT_EQ(1000, readings[0].timestamp);
+  ASSERT_EQ(1002, readings[1].timestamp);
+
+  journal_ack(&journal, next);
+  ASSERT_EQ(0u, journal_pending(&journal));
+
+  JOURNAL_close(&journal);
+  unlink(jpath);
+}
+
+TEST(journal, journal_keeps_summaries)
+{
+  JOURNAL journal;
+  TIMED_READING reading;
+  TIMED_READING readings[2];
+  uint64_t next;
+
+  unlink(jpath);
+  ASSERT_EQ(0, JOURNAL_open(&journal, jpath, 16, 0));
+
+  memset(&reading, 0, sizeof(reading));
+  reading.timestamp = 1000;
+  reading.temperature = -79.5;
+  reading.summary.samples = 300;
+  reading.summary.min = -80.5;
+  reading.summary.max = -62.0;
+  reading.summary.mean = -79.0;
+  reading.summary.stddev = 1.5;
+  reading.summary.median = -79.25;
+  journal_append(&journal, &reading);
+  JOURNAL_close(&journal);
+
+  ASSERT_EQ(0, JOURNAL_open(&journal, jpath, 16, 0));
+  ASSERT_EQ(1, journal_peek(&journal, readings, 2, &next));
+  ASSERT_EQ(300u, readings[0].summary.samples);
+  ASSERT_FLOAT_EQ(-80.5, readings[0].summary.min);
+  ASSERT_FLOAT_EQ(-62.0, readings[0].summary.max);
+  ASSERT_FLOAT_EQ(-79.0, readings[0].summary.mean);
+  ASSERT_FLOAT_EQ(1.5, readings[0].summary.stddev);
+  ASSERT_FLOAT_EQ(-79.25, readings[0].summary.median);
+
+  JOURNAL_close(&journal);
+  unlink(jpath);
+}
@@ -0,0 +1,126 @@
+/*
+  The following are tests for the file json-extract.c
+*/
+
+#include "json-extract.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <gtest/gtest.h>
+
+typedef struct {
+  int next_update;
+  char status[16];
+  int product_id;
+  int vendor_id;
+} EXTRACT_TEST;
+
+static const JSON_FIELD fields[] = {
+  { "specifications.nextUpdateIn", JSON_FIELD_INT,
+    offsetof(EXTRACT_TEST, next_update), 0 },
+  { "specifications.lastReadStatus", JSON_FIELD_STRING,
+    offsetof(EXTRACT_TEST, status), sizeof(((EXTRACT_TEST *) 0)->status) },
+  { "specifications.monitor.productID", JSON_FIELD_INT,
+    offsetof(EXTRACT_TEST, product_id), 0 },
+  { "specifications.monitor.vendorID", JSON_FIELD_INT,
+    offsetof(EXTRACT_TEST, vendor_id), 0 }
+};
+
+static int extract(const char *json, EXTRACT_TEST *out, uint32_t *found)
+{
+  JSON_EXTRACTOR extractor;
+
+  memset(out, 0, sizeof(EXTRACT_TEST));
+  if (JSON_EXTRACTOR_init(&extractor, fields, 4)) {
+    return -1;
+  }
+  return json_extract(&extractor, json, strlen(json), out, found);
+}
+
+TEST(json_extract, strings)
+{
+  EXTRACT_TEST out;
+  uint32_t found;
+
+  ASSERT_EQ(extract("{ \"specifications\": { \"nextUpdateIn\": \"30\","
+		    " \"lastReadStatus\": \"OK\", \"uploadURL\": \"/r\","
+		    " \"monitor\": { \"productID\": \"47794\","
+		    " \"vendorID\": \"1027\" } } }", &out, &found), 0);
+  ASSERT_EQ(found, 0xFu);
+  ASSERT_EQ(out.next_update, 30);
+  ASSERT_STREQ(out.status, "OK");
+  ASSERT_EQ(out.product_id, 47794);
+  ASSERT_EQ(out.vendor_id, 1027);
+}
+
+TEST(json_extract, numbers)
+{
+  EXTRACT_TEST out;
+  uint32_t found;
+
+  ASSERT_EQ(extract("{\"specifications\":{\"monitor\":{\"vendorID\":1027,"
+		    "\"productID\":4.7794e4},\"nextUpdateIn\":-1,"
+		    "\"lastReadStatus\":200}}", &out, &found), 0);
+  ASSERT_EQ(found, 0xFu);
+  ASSERT_EQ(out.next_update, -1);
+  ASSERT_STREQ(out.status, "200");
+  ASSERT_EQ(out.product_id, 47794);
+  ASSERT_EQ(out.vendor_id, 1027);
+}
+
+TEST(json_extract, skips_other_values)
+{
+  EXTRACT_TEST out;
+  uint32_t found;
+
+  /* same keys elsewhere in the document, and values of the wrong kind */
+  ASSERT_EQ(extract("{ \"monitor\": { \"productID\": 1 },"
+		    " \"list\": [ { \"specifications\": { \"nextUpdateIn\": 5 } },"
+		    " true, false, null, \"\\u00e9\" ],"
+		    " \"specifications\": { \"nextUpdateIn\": { \"x\": 1 },"
+		    " \"lastReadStatus\": \"much too long to fit\","
+		    " \"monitor\": { \"productID\": \"12ab\","
+		    " \"vendorID\": 1027 } } }", &out, &found), 0);
+  ASSERT_EQ(found, 0x8u);
+  ASSERT_EQ(out.product_id, 0);
+  ASSERT_EQ(out.vendor_id, 1027);
+}
+
+TEST(json_extract, escapes)
+{
+  EXTRACT_TEST out;
+  uint32_t found;
+
+  ASSERT_EQ(extract("{\"specifications\":{\"lastReadStatus\":"
+		    "\"a\\\"b\\\\\\u00e9\\ud83d\\ude00\"}}", &out, &found), 0);
+  ASSERT_EQ(found, 0x2u);
+  ASSERT_STREQ(out.status, "a\"b\\\xc3\xa9\xf0\x9f\x98\x80");
+}
+
+TEST(json_extract, malformed)
+{
+  EXTRACT_TEST out;
+  uint32_t found;
+
+  ASSERT_EQ(extract("", &out, &found), 1);
+  ASSERT_EQ(extract("{", &out, &found), 1);
+  ASSERT_EQ(extract("{\"specifications\": }", &out, &found), 1);
+  ASSERT_EQ(extract("{\"a\": 01}", &out, &found), 1);
+  ASSERT_EQ(extract("{\"a\": \"\\x\"}", &out, &found), 1);
+  ASSERT_EQ(extract("{\"a\": 1} x", &out, &found), 1);
+  ASSERT_EQ(extract("[1, 2,]", &out, &found), 1);
+}
+
+TEST(json_extract, bad_paths)
+{
+  JSON_EXTRACTOR extractor;
+  JSON_FIELD field = { "a..b", JSON_FIELD_INT, 0, 0 };
+
+  ASSERT_EQ(JSON_EXTRACTOR_init(&extractor, &field, 1), 1);
+  field.path = "a.b.c.d.e.f.g.h.i";
+  ASSERT_EQ(JSON_EXTRACTOR_init(&extractor, &field, 1), 1);
+  field.path = "a.b.c.d.e.f.g.h";
+  ASSERT_EQ(JSON_EXTRACTOR_init(&extractor, &field, 1), 0);
+}
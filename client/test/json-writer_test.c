@@ -0,0 +1,180 @@
+/*
+  The following are tests for the functions in the file json-writer.c
+*/
+
+#include "json-writer.h"
+#include "misc-structs.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+static std::string format(float value)
+{
+  char buffer[16];
+  int len = format_float(buffer, value);
+
+  EXPECT_EQ((size_t) len, strlen(buffer));
+  return std::string(buffer, len);
+}
+
+/* digits of a formatted number, without its sign, point, exponent and padding */
+static int significant_digits(const char *number)
+{
+  std::string digits;
+
+  for (; *number != '\0' && *number != 'e'; number++) {
+    if (*number >= '0' && *number <= '9') {
+      digits += *number;
+    }
+  }
+  digits.erase(0, digits.find_first_not_of('0'));
+  digits.erase(digits.find_last_not_of('0') + 1);
+  return digits.size();
+}
+
+TEST(json_writer, format_float)
+{
+  ASSERT_EQ(format(0.0f), "0");
+  ASSERT_EQ(format(-0.0f), "0");
+  ASSERT_EQ(format(1.0f), "1");
+  ASSERT_EQ(format(21.5f), "21.5");
+  ASSERT_EQ(format(-80.125f), "-80.125");
+  ASSERT_EQ(format(0.1f), "0.1");
+  ASSERT_EQ(format(-196.0f), "-196");
+  ASSERT_EQ(format(100.0f), "100");
+  ASSERT_EQ(format(12500000.0f), "12500000");
+  ASSERT_EQ(format(0.000125f), "0.000125");
+  ASSERT_EQ(format(1.25e-7f), "1.25e-7");
+  ASSERT_EQ(format(1e10f), "1e10");
+  ASSERT_EQ(format(3.4028235e38f), "3.4028235e38");
+  ASSERT_EQ(format(1.4e-45f), "1e-45");
+  ASSERT_EQ(format(16777216.0f), "16777216");
+  ASSERT_EQ(format(NAN), "null");
+  ASSERT_EQ(format(-INFINITY), "null");
+}
+
+TEST(json_writer, format_float_round_trips)
+{
+  /* every output reads back as the same float, with no more digits than %g */
+  char buffer[16];
+  char shortest[32];
+  unsigned int bits = 12345;
+  float value;
+  int digits, shortest_digits;
+  int i;
+
+  for (i = 0; i < 200000; i++) {
+    bits = bits * 1103515245u + 12345u;
+    memcpy(&value, &bits, sizeof(value));
+    if (isnan(value) || isinf(value)) {
+      continue;
+    }
+
+    format_float(buffer, value);
+    ASSERT_EQ(strtof(buffer, NULL), value) << buffer;
+
+    for (shortest_digits = 1; shortest_digits < 9; shortest_digits++) {
+      snprintf(shortest, sizeof(shortest), "%.*g", shortest_digits, value);
+      if (strtof(shortest, NULL) == value) {
+	break;
+      }
+    }
+    digits = significant_digits(buffer);
+    ASSERT_LE(digits, shortest_digits) << buffer;
+  }
+}
+
+TEST(json_writer, document)
+{
+  string out;
+  JSON_WRITER w;
+
+  init_string(&out);
+  json_begin(&w, &out);
+  json_begin_object(&w);
+  json_key(&w, "a");
+  json_begin_array(&w);
+  json_integer(&w, 1);
+  json_float(&w, 2.5f);
+  json_begin_object(&w);
+  json_end_object(&w);
+  json_begin_array(&w);
+  json_end_array(&w);
+  json_string(&w, "x");
+  json_end_array(&w);
+  json_key(&w, "b");
+  json_integer(&w, -1234567890123LL);
+  json_end_object(&w);
+
+  ASSERT_EQ(json_end(&w), 0);
+  ASSERT_STREQ(out.ptr, "{\"a\":[1,2.5,{},[],\"x\"],\"b\":-1234567890123}");
+  ASSERT_EQ(out.len, strlen(out.ptr));
+
+  /* the buffer is replaced, not appended to */
+  json_begin(&w, &out);
+  json_begin_array(&w);
+  json_end_array(&w);
+  ASSERT_EQ(json_end(&w), 0);
+  ASSERT_STREQ(out.ptr, "[]");
+
+  deinit_string(&out);
+}
+
+TEST(json_writer, escaping)
+{
+  string out;
+  JSON_WRITER w;
+
+  init_string(&out);
+  json_begin(&w, &out);
+  json_begin_array(&w);
+  json_string(&w, "quote\" back\\ tab\t nl\n \x01 \x1f");
+  json_string(&w, "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x8c\xa1");
+  json_string(&w, "bad \xff \xc3 \xed\xa0\x80 \xc0\xaf end");
+  json_end_array(&w);
+
+  ASSERT_EQ(json_end(&w), 0);
+  ASSERT_STREQ(out.ptr,
+	       "[\"quote\\\" back\\\\ tab\\t nl\\n \\u0001 \\u001f\","
+	       "\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x8c\xa1\","
+	       "\"bad \xef\xbf\xbd \xef\xbf\xbd "
+	       "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd "
+	       "\xef\xbf\xbd\xef\xbf\xbd end\"]");
+
+  deinit_string(&out);
+}
+
+TEST(json_writer, unbalanced)
+{
+  string out;
+  JSON_WRITER w;
+  int i;
+
+  init_string(&out);
+
+  json_begin(&w, &out);
+  json_begin_object(&w);
+  ASSERT_EQ(json_end(&w), 1);
+
+  json_begin(&w, &out);
+  json_end_array(&w);
+  ASSERT_EQ(json_end(&w), 1);
+
+  json_begin(&w, &out);
+  json_begin_object(&w);
+  json_key(&w, "dangling");
+  json_end_object(&w);
+  ASSERT_EQ(json_end(&w), 1);
+
+  json_begin(&w, &out);
+  for (i = 0; i <= JSON_WRITER_MAX_DEPTH; i++) {
+    json_begin_array(&w);
+  }
+  ASSERT_EQ(json_end(&w), 1);
+
+  deinit_string(&out);
+}
@@ -0,0 +1,234 @@
+/*
+  The following are tests for the file ring.c
+*/
+
+#include "ring.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#define SPILL_PATH "/tmp/ring_test.spill"
+
+/* how many items the threaded tests pass through the ring */
+#define ITEMS 200000
+
+typedef struct {
+  uint64_t sequence;
+  float values[5];
+} ITEM;
+
+typedef struct {
+  RING *ring;
+  int done;
+} PRODUCER;
+
+static void *produce(void *data)
+{
+  PRODUCER *producer = (PRODUCER *) data;
+  ITEM item;
+  uint64_t i;
+  int j;
+
+  for (i = 0; i < ITEMS; i++) {
+    item.sequence = i;
+    for (j = 0; j < 5; j++) {
+      item.values[j] = (float) (i + j);
+    }
+    ring_push(producer->ring, &item);
+  }
+  __atomic_store_n(&producer->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/*
+  takes items while the producer runs, checking each is whole and later than
+  the last; returns how many were taken
+*/
+static uint64_t consume(RING *ring, PRODUCER *producer)
+{
+  ITEM item;
+  uint64_t taken = 0;
+  uint64_t next = 0;
+  int j;
+
+  for (;;) {
+    if (ring_pop(ring, &item)) {
+      EXPECT_GE(item.sequence, next);
+      for (j = 0; j < 5; j++) {
+	EXPECT_EQ((float) (item.sequence + j), item.values[j]);
+      }
+      next = item.sequence + 1;
+      taken++;
+    } else if (__atomic_load_n(&producer->done, __ATOMIC_ACQUIRE)) {
+      /* the producer is done; take whatever it left */
+      while (ring_pop(ring, &item)) {
+	EXPECT_GE(item.sequence, next);
+	next = item.sequence + 1;
+	taken++;
+      }
+      break;
+    }
+  }
+  return taken;
+}
+
+TEST(ring, in_order)
+{
+  RING ring;
+  RING_STATS stats;
+  int item;
+  int i;
+
+  /* capacity is rounded up to a power of two */
+  ASSERT_EQ(0, RING_init(&ring, sizeof(int), 6, RING_DROP_OLDEST, NULL));
+  ASSERT_EQ(8u, ring.capacity);
+  ASSERT_EQ(0, ring_pop(&ring, &item));
+
+  for (i = 0; i < 5; i++) {
+    ASSERT_EQ(0, ring_push(&ring, &i));
+  }
+  ring_stats(&ring, &stats);
+  ASSERT_EQ(5u, stats.pushed);
+  ASSERT_EQ(5u, stats.depth);
+  ASSERT_EQ(5u, stats.max_depth);
+  ASSERT_EQ(0u, stats.dropped);
+
+  for (i = 0; i < 5; i++) {
+    ASSERT_EQ(1, ring_pop(&ring, &item));
+    ASSERT_EQ(i, item);
+  }
+  ASSERT_EQ(0, ring_pop(&ring, &item));
+  ring_stats(&ring, &stats);
+  ASSERT_EQ(0u, stats.depth);
+  ASSERT_EQ(5u, stats.max_depth);
+
+  RING_destroy(&ring);
+}
+
+TEST(ring, drop_oldest)
+{
+  RING ring;
+  RING_STATS stats;
+  int item;
+  int i;
+
+  ASSERT_EQ(0, RING_init(&ring, sizeof(int), 4, RING_DROP_OLDEST, NULL));
+  for (i = 0; i < 7; i++) {
+    ASSERT_EQ(0, ring_push(&ring, &i));
+  }
+  ring_stats(&ring, &stats);
+  ASSERT_EQ(7u, stats.pushed);
+  ASSERT_EQ(4u, stats.depth);
+  ASSERT_EQ(4u, stats.max_depth);
+
+  /* the newest items are kept */
+  for (i = 3; i < 7; i++) {
+    ASSERT_EQ(1, ring_pop(&ring, &item));
+    ASSERT_EQ(i, item);
+  }
+  ASSERT_EQ(0, ring_pop(&ring, &item));
+  ring_stats(&ring, &stats);
+  ASSERT_EQ(3u, stats.dropped);
+  ASSERT_EQ(0u, stats.depth);
+
+  RING_destroy(&ring);
+}
+
+TEST(ring, spill)
+{
+  RING ring;
+  RING_STATS stats;
+  int item;
+  int i;
+
+  /* a spill file is needed */
+  ASSERT_NE(0, RING_init(&ring, sizeof(int), 4, RING_SPILL, NULL));
+
+  ASSERT_EQ(0, RING_init(&ring, sizeof(int), 4, RING_SPILL, SPILL_PATH));
+  for (i = 0; i < 10; i++) {
+    ASSERT_EQ(0, ring_push(&ring, &i));
+  }
+  ring_stats(&ring, &stats);
+  ASSERT_EQ(10u, stats.pushed);
+  ASSERT_EQ(6u, stats.spilled);
+  ASSERT_EQ(10u, stats.depth);
+
+  /* items pushed while the spill is not taken yet go after it */
+  for (i = 0; i < 5; i++) {
+    ASSERT_EQ(1, ring_pop(&ring, &item));
+    ASSERT_EQ(i, item);
+  }
+  i = 10;
+  ASSERT_EQ(0, ring_push(&ring, &i));
+  for (i = 5; i < 11; i++) {
+    ASSERT_EQ(1, ring_pop(&ring, &item));
+    ASSERT_EQ(i, item);
+  }
+  ASSERT_EQ(0, ring_pop(&ring, &item));
+
+  /* the ring is used again once the spill is taken, then the file reused */
+  for (i = 11; i < 20; i++) {
+    ASSERT_EQ(0, ring_push(&ring, &i));
+  }
+  for (i = 11; i < 20; i++) {
+    ASSERT_EQ(1, ring_pop(&ring, &item));
+    ASSERT_EQ(i, item);
+  }
+  ring_stats(&ring, &stats);
+  ASSERT_EQ(20u, stats.pushed);
+  ASSERT_EQ(0u, stats.dropped);
+  ASSERT_EQ(12u, stats.spilled);
+  ASSERT_EQ(0u, stats.depth);
+
+  RING_destroy(&ring);
+  unlink(SPILL_PATH);
+}
+
+TEST(ring, threads_drop_oldest)
+{
+  RING ring;
+  RING_STATS stats;
+  PRODUCER producer = { &ring, 0 };
+  pthread_t thread;
+  uint64_t taken;
+
+  ASSERT_EQ(0, RING_init(&ring, sizeof(ITEM), 16, RING_DROP_OLDEST, NULL));
+  ASSERT_EQ(0, pthread_create(&thread, NULL, produce, &producer));
+  taken = consume(&ring, &producer);
+  pthread_join(thread, NULL);
+
+  /* every item is either taken or counted as dropped */
+  ring_stats(&ring, &stats);
+  ASSERT_EQ((uint64_t) ITEMS, stats.pushed);
+  ASSERT_EQ((uint64_t) ITEMS, taken + stats.dropped);
+  ASSERT_EQ(0u, stats.depth);
+
+  RING_destroy(&ring);
+}
+
+TEST(ring, threads_spill)
+{
+  RING ring;
+  RING_STATS stats;
+  PRODUCER producer = { &ring, 0 };
+  pthread_t thread;
+  uint64_t taken;
+
+  ASSERT_EQ(0, RING_init(&ring, sizeof(ITEM), 16, RING_SPILL, SPILL_PATH));
+  ASSERT_EQ(0, pthread_create(&thread, NULL, produce, &producer));
+  taken = consume(&ring, &producer);
+  pthread_join(thread, NULL);
+
+  /* nothing is lost */
+  ring_stats(&ring, &stats);
+  ASSERT_EQ((uint64_t) ITEMS, taken);
+  ASSERT_EQ(0u, stats.dropped);
+  ASSERT_EQ(0u, stats.depth);
+
+  RING_destroy(&ring);
+  unlink(SPILL_PATH);
+}
@@ -6,6 +6,10 @@
 # 2 - USB opening-related error
 # 3 - USB reading-related error
 # 4 - server-related error
+#
+# The client is run with --daemon, so it stays running and takes a reading
+# every read_interval seconds (see client/globals.ini) until one of the errors
+# above occurs.
 
 # To make this a daemon process, move tempmonDaemon.sh to /etc/init.d, make sure
 # to chmod 755 both tempmonDaemon.sh and this file, change the directory in
@@ -21,7 +25,6 @@
 # : 
 d=/home/pi/tempmon
 c=$d/client/tempmon
-p=$d/UDPrecv.py
 f=$d/tempmonlogs.txt
 
 echo "Waiting for network to become available"
@@ -38,14 +41,13 @@ do
 done
 
 now=$(date)
-python $p
 cd $d/client
 make
 
 while [ true ];
 do
     echo "---Reading local device"
-    $c
+    $c --daemon
     a=$?
 
     # if the program executed successfully, wait 30 seconds
@@ -69,11 +71,9 @@ do
     elif [ "$a" -eq 3 ]; then
 	    sleep 60
 
-    # if the program terminated with a server-related error, re-run the server
-    # discovery service to re-discover the server
+    # if the program terminated with a server-related error, the client has
+    # already tried to re-discover the server itself, so wait before retrying
     elif [ "$a" -eq 4 ]; then
-	python $p 
-
 	sleep 10
     fi
 done